@@ -0,0 +1,139 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* rewrites a .grids file with the vertex values baked into the bricks
+   (instead of scalarIDs into a separate .scalars file), optionally
+   quantized to 16 or 8 bits per value relative to each brick's value
+   range */
+
+#include "umesh/UMesh.h"
+#include "grids.h"
+#include "scalars.h"
+#include "helpers.h"
+#include <sstream>
+#include <cmath>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  void usage(const std::string error="")
+  {
+    if (error != "")
+      std::cerr << "Error : " << error  << "\n\n";
+
+    std::cout << "Usage: ./amrBakeGrids <in.grids> -o <out.grids> --cells <in.cells> -s <in.scalars>" << std::endl;
+    std::cout << "         [--bits 32|16|8]" << std::endl;
+    std::cout << "--bits : 32 stores floats; 16 and 8 quantize each value relative to the" << std::endl;
+    std::cout << "         min/max of its brick (default 32)" << std::endl;
+    exit (error != "");
+  };
+
+  extern "C" int main(int ac, char **av)
+  {
+    std::string inFileName;
+    std::string outFileName;
+    std::string cellsFileName;
+    std::string scalarsFileName;
+    int bits = 32;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "-o")
+        outFileName = av[++i];
+      else if (arg == "--cells")
+        cellsFileName = av[++i];
+      else if (arg == "-s" || arg == "--scalars")
+        scalarsFileName = av[++i];
+      else if (arg == "--bits")
+        bits = std::stoi(av[++i]);
+      else if (arg[0] != '-')
+        inFileName = arg;
+      else
+        usage("unknown cmd-line arg '"+arg+"'");
+    }
+    if (inFileName == "") usage("no input file specified");
+    if (outFileName == "") usage("no output file specified");
+    if (cellsFileName == "") usage("no cells file specified");
+    if (scalarsFileName == "") usage("no scalars file specified");
+    const uint32_t valueFlag = gridsValueFlagForBits(bits);
+
+    MappedScalars scalars = mapScalars(scalarsFileName,cellsFileName);
+
+    uint32_t inFlags = 0;
+    std::vector<Gridlet> bricks = readGrids(inFileName,&inFlags);
+    if (inFlags & GRIDS_FLAGS_VALUES)
+      throw std::runtime_error("'"+inFileName+"' already has baked values");
+    const uint32_t flags = GRIDS_FLAG_OCCUPANCY | valueFlag | (inFlags & GRIDS_FLAG_NEIGHBORS);
+
+    // every brick gets baked (and serialized) on its own, in parallel;
+    // reading it back tells how much quantization changed the values
+    std::vector<std::string> baked(bricks.size());
+    std::vector<float> maxError(bricks.size()), maxRelError(bricks.size());
+    parallel_for(bricks.size(),[&](size_t brickID){
+        Gridlet &brick = bricks[brickID];
+        if (brick.cubeMask.empty())
+          brick.cubeMask = computeCubeMask(brick.numCubes,brick.scalarIDs.data());
+        const std::vector<uint32_t> used = computeVertexMask(brick.numCubes,brick.cubeMask.data());
+        std::vector<float> values(brick.numScalars());
+        range1f range;
+        for (size_t i=0;i<values.size();i++) {
+          const int scalarID = brick.scalarIDs[i];
+          values[i] = scalarID < 0 ? 0.f : scalars[scalarID];
+          if (isBitSet(used.data(),i)) range.extend(values[i]);
+        }
+        std::ostringstream out;
+        writeBakedGridlet(out,brick.lower,brick.level,brick.numCubes,
+                          values.data(),brick.cubeMask.data(),flags,brick.neighbors);
+        baked[brickID] = out.str();
+
+        std::istringstream in(baked[brickID]);
+        Gridlet check;
+        readGridlet(in,check,flags);
+        for (size_t i=0;i<values.size();i++)
+          if (isBitSet(used.data(),i))
+            maxError[brickID] = std::max(maxError[brickID],fabsf(check.values[i]-values[i]));
+        if (range.upper > range.lower)
+          maxRelError[brickID] = maxError[brickID] / (range.upper-range.lower);
+      });
+
+    std::ofstream out(outFileName,std::ios::binary);
+    if (!out.good())
+      throw std::runtime_error("could not create grids file '"+outFileName+"'");
+    writeGridsHeader(out,flags);
+    for (auto &brick : baked)
+      out.write(brick.data(),brick.size());
+    const size_t outSize = out.tellp();
+    out.close();
+
+    struct stat st;
+    stat(inFileName.c_str(),&st);
+    std::cout << "baked " << prettyNumber(bricks.size()) << " bricks with " << bits
+              << "-bit values: " << prettyNumber(size_t(st.st_size)) << "B of scalarIDs (plus "
+              << scalars.bytesPerScalar() << "B per referenced scalar) -> "
+              << prettyNumber(outSize) << "B" << std::endl;
+    float error = 0.f, relError = 0.f;
+    for (size_t brickID=0;brickID<bricks.size();brickID++) {
+      error    = std::max(error,maxError[brickID]);
+      relError = std::max(relError,maxRelError[brickID]);
+    }
+    std::cout << "max quantization error " << error << " ("
+              << relError << " of a brick's value range)" << std::endl;
+    return 0;
+  }
+
+} // ::gridlets
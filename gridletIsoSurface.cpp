@@ -0,0 +1,232 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* extracts an iso-surface from a full AMR data set in its
+   "gridlets + stitching elements" form: marching cubes runs directly
+   on the regular bricks of the .grids files, and umesh's general
+   marching-elements code on the stitching elements of the dual umesh;
+   both triangle soups then get welded into one mesh. */
+
+#include "umesh/UMesh.h"
+#include "umesh/extractIsoSurface.h"
+#include "scalars.h"
+#include "grids.h"
+#include "helpers.h"
+#include <fstream>
+#include <limits>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  /*! runs marching cubes over all (existing) cubes of the given
+    brick. The case index of an entire row of cubes gets computed
+    in one branch-free loop over contiguous per-vertex "is above"
+    flags (which the compiler vectorizes); only cubes that actually
+    cross the iso-value then go through the (scalar) triangle
+    tables */
+  void isoSurfaceBrick(std::vector<vec3f> &out,
+                       const Gridlet &brick,
+                       const MappedScalars &scalars,
+                       const float isoValue)
+  {
+    const vec3i numCubes = brick.numCubes;
+    const size_t numScalars = brick.numScalars();
+    const int nx = numCubes.x+1;
+    const int ny = numCubes.y+1;
+    const int cellWidth = 1<<brick.level;
+
+    std::vector<float>   value(numScalars);
+    std::vector<uint8_t> above(numScalars);
+    for (size_t i=0;i<numScalars;i++) {
+      if (!brick.values.empty())
+        value[i] = brick.values[i];
+      else {
+        const int scalarID = brick.scalarIDs[i];
+        value[i] = (scalarID < 0) ? 0.f : scalars[scalarID];
+      }
+      above[i] = value[i] > isoValue;
+    }
+    const std::vector<uint32_t> cubeMask
+      = brick.cubeMask.empty()
+      ? computeCubeMask(numCubes,brick.scalarIDs.data())
+      : brick.cubeMask;
+
+    auto vertexIdx = [&](int ix, int iy, int iz)
+    { return ix + nx*size_t(iy + ny*size_t(iz)); };
+
+    std::vector<uint8_t> caseIndex(numCubes.x);
+    for (int iz=0;iz<numCubes.z;iz++)
+      for (int iy=0;iy<numCubes.y;iy++) {
+        const uint8_t *a00 = &above[vertexIdx(0,iy  ,iz  )];
+        const uint8_t *a10 = &above[vertexIdx(0,iy+1,iz  )];
+        const uint8_t *a01 = &above[vertexIdx(0,iy  ,iz+1)];
+        const uint8_t *a11 = &above[vertexIdx(0,iy+1,iz+1)];
+        // bits in VTK hex vertex order
+        for (int ix=0;ix<numCubes.x;ix++)
+          caseIndex[ix]
+            = (a00[ix]     )
+            | (a00[ix+1]<<1)
+            | (a10[ix+1]<<2)
+            | (a10[ix  ]<<3)
+            | (a01[ix  ]<<4)
+            | (a01[ix+1]<<5)
+            | (a11[ix+1]<<6)
+            | (a11[ix  ]<<7);
+
+        const size_t rowCubeID = numCubes.x*size_t(iy + numCubes.y*size_t(iz));
+        for (int ix=0;ix<numCubes.x;ix++) {
+          if (caseIndex[ix] == 0 || caseIndex[ix] == 0xff) continue;
+          if (!isBitSet(cubeMask.data(),rowCubeID+ix)) continue;
+
+          vec4f corner[8];
+          for (int c=0;c<8;c++) {
+            // vtk order: 0,1,2,3 go around the bottom face, 4-7 the top
+            const int dx = ((c&3) == 1 || (c&3) == 2);
+            const int dy = ((c&3) >= 2);
+            const int dz = (c >> 2);
+            const vec3i cell = (brick.lower+vec3i(ix+dx,iy+dy,iz+dz))*cellWidth;
+            // same expression as the dual mesh's cell centers, so
+            // vertices on the border to stitching elements match
+            // bit for bit
+            const vec3f pos = vec3f(cell) + vec3f(0.5f*cellWidth);
+            corner[c] = vec4f(pos,value[vertexIdx(ix+dx,iy+dy,iz+dz)]);
+          }
+          isoSurfaceHex(out,corner,isoValue);
+        }
+      }
+  }
+
+  std::vector<vec3f> isoSurfaceGridlets(const std::vector<Gridlet> &bricks,
+                                        const MappedScalars &scalars,
+                                        const float isoValue)
+  {
+    const size_t blockSize = 64;
+    const size_t numBlocks = (bricks.size()+blockSize-1)/blockSize;
+    std::vector<std::vector<vec3f>> blockVertices(numBlocks);
+    parallel_for(numBlocks,[&](size_t blockID){
+        const size_t begin = blockID*blockSize;
+        const size_t end   = std::min(begin+blockSize,bricks.size());
+        for (size_t i=begin;i<end;i++)
+          isoSurfaceBrick(blockVertices[blockID],bricks[i],scalars,isoValue);
+      });
+    return concatBlocks(blockVertices);
+  }
+
+  void usage(const std::string error="")
+  {
+    if (error != "")
+      std::cerr << "Error : " << error  << "\n\n";
+
+    std::cout << "Usage: ./amrGridletIsoSurface --cells <in.cells> -s <in.scalars> -iso <value>" << std::endl;
+    std::cout << "         [--grids <in.grids>]* [--umesh <dual.umesh>]" << std::endl;
+    std::cout << "         (-o <out.umesh> | --obj <out.obj>)" << std::endl;
+    std::cout << "--cells : the .cells file the scalars belong to (only its size is used)" << std::endl;
+    std::cout << "--umesh : dual mesh with the stitching elements; its vertex values get" << std::endl;
+    std::cout << "          gathered from the given scalars through the vertex tags" << std::endl;
+    exit (error != "");
+  };
+
+  extern "C" int main(int ac, char **av)
+  {
+    float isoValue = std::numeric_limits<float>::infinity();
+    std::string cellsFileName;
+    std::string scalarsFileName;
+    std::string umeshFileName;
+    std::string outFileName;
+    std::string objFileName;
+    std::vector<std::string> gridsFileNames;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "-o")
+        outFileName = av[++i];
+      else if (arg == "--obj")
+        objFileName = av[++i];
+      else if (arg == "-iso" || arg == "--iso-value" || arg == "--iso")
+        isoValue = std::stof(av[++i]);
+      else if (arg == "--cells")
+        cellsFileName = av[++i];
+      else if (arg == "-s" || arg == "--scalars")
+        scalarsFileName = av[++i];
+      else if (arg == "--grids")
+        gridsFileNames.push_back(av[++i]);
+      else if (arg == "--umesh")
+        umeshFileName = av[++i];
+      else
+        usage("unknown cmd-line arg '"+arg+"'");
+    }
+    if (cellsFileName == "") usage("no cells file specified");
+    if (scalarsFileName == "") usage("no scalars file specified");
+    if (outFileName == "" && objFileName == "") usage("neither obj nor umesh output file specified");
+    if (isoValue == std::numeric_limits<float>::infinity())
+      usage("no iso-value specified");
+
+    MappedScalars scalars = mapScalars(scalarsFileName,cellsFileName);
+
+    std::vector<vec3f> triVertices;
+    for (auto fileName : gridsFileNames) {
+      std::cout << "reading bricks from " << fileName << std::endl;
+      std::vector<Gridlet> bricks = readGrids(fileName);
+      std::cout << "marching " << prettyNumber(bricks.size()) << " bricks" << std::endl;
+      std::vector<vec3f> brickVertices = isoSurfaceGridlets(bricks,scalars,isoValue);
+      triVertices.insert(triVertices.end(),brickVertices.begin(),brickVertices.end());
+    }
+    std::cout << "found " << prettyNumber(triVertices.size()/3)
+              << " triangles in the bricks" << std::endl;
+
+    if (umeshFileName != "") {
+      std::cout << "loading stitching elements from " << umeshFileName << std::endl;
+      UMesh::SP mesh = UMesh::loadFrom(umeshFileName);
+      if (!mesh->vertexTag.empty()) {
+        mesh->perVertex = std::make_shared<Attribute>();
+        mesh->perVertex->name = scalars.fieldName();
+        mesh->perVertex->values.resize(mesh->vertices.size());
+        parallel_for_blocked
+          (0,mesh->vertices.size(),64*1024,
+           [&](size_t begin, size_t end){
+             for (size_t i=begin;i<end;i++)
+               mesh->perVertex->values[i] = scalars[mesh->vertexTag[i]];
+           });
+      } else if (!mesh->perVertex)
+        throw std::runtime_error("dual mesh has neither vertex tags nor scalars");
+      std::vector<vec3f> elementVertices = extractIsoSurfaceSoup(mesh,isoValue);
+      std::cout << "found " << prettyNumber(elementVertices.size()/3)
+                << " triangles in the stitching elements" << std::endl;
+      triVertices.insert(triVertices.end(),elementVertices.begin(),elementVertices.end());
+    }
+
+    std::cout << "welding vertices" << std::endl;
+    UMesh::SP result = weldTriangleSoup(triVertices);
+    std::cout << "done extracting iso-surface, found " << result->toString() << std::endl;
+    if (outFileName != "") {
+      std::cout << "saving to " << outFileName << std::endl;
+      result->saveTo(outFileName);
+    }
+    if (objFileName != "") {
+      std::cout << "writing in OBJ format to " << objFileName << std::endl;
+      std::ofstream out(objFileName);
+      for (auto v : result->vertices)
+        out << "v " << v.x << " " << v.y << " " << v.z << std::endl;
+      for (auto t : result->triangles)
+        out << "f " << (t.x+1) << " " << (t.y+1) << " " << (t.z+1) << std::endl;
+    }
+    std::cout << "done" << std::endl;
+    return 0;
+  }
+
+} // ::gridlets
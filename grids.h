@@ -0,0 +1,566 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "umesh/math.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#ifdef __CUDACC__
+# define GRIDLETS_BOTH __host__ __device__
+#else
+# define GRIDLETS_BOTH /* host only */
+#endif
+
+namespace gridlets {
+
+  using umesh::vec3i;
+  using umesh::vec3f;
+  using umesh::box3f;
+
+  /*! spreads the lower 21 bits of n such that there are two zero
+    bits between each pair of bits */
+  GRIDLETS_BOTH inline unsigned long long separate_bits(unsigned long long n)
+  {
+    n &= 0b1111111111111111111111ull;
+    n = (n ^ (n << 32)) & 0b1111111111111111000000000000000000000000000000001111111111111111ull;
+    n = (n ^ (n << 16)) & 0b0000000011111111000000000000000011111111000000000000000011111111ull;
+    n = (n ^ (n <<  8)) & 0b1111000000001111000000001111000000001111000000001111000000001111ull;
+    n = (n ^ (n <<  4)) & 0b0011000011000011000011000011000011000011000011000011000011000011ull;
+    n = (n ^ (n <<  2)) & 0b1001001001001001001001001001001001001001001001001001001001001001ull;
+    return n;
+  }
+
+  /*! interleaves the lower 21 bits of x, y, and z into a 63-bit
+    morton code */
+  GRIDLETS_BOTH inline unsigned long long morton_encode3D(unsigned long long x, unsigned long long y, unsigned long long z)
+  {
+    return separate_bits(x) | (separate_bits(y) << 1) | (separate_bits(z) << 2);
+  }
+
+  /*! inverse of separate_bits: gathers every third bit of n */
+  GRIDLETS_BOTH inline unsigned long long compact_bits(unsigned long long n)
+  {
+    n &= 0b1001001001001001001001001001001001001001001001001001001001001001ull;
+    n = (n ^ (n >>  2)) & 0b0011000011000011000011000011000011000011000011000011000011000011ull;
+    n = (n ^ (n >>  4)) & 0b1111000000001111000000001111000000001111000000001111000000001111ull;
+    n = (n ^ (n >>  8)) & 0b0000000011111111000000000000000011111111000000000000000011111111ull;
+    n = (n ^ (n >> 16)) & 0b1111111111111111000000000000000000000000000000001111111111111111ull;
+    n = (n ^ (n >> 32)) & 0b1111111111111111111111ull;
+    return n;
+  }
+
+  GRIDLETS_BOTH inline vec3i morton_decode3D(unsigned long long code)
+  {
+    return vec3i(int(compact_bits(code)),int(compact_bits(code >> 1)),int(compact_bits(code >> 2)));
+  }
+
+  /*! 63-bit index of (x,y,z) along a 3D hilbert curve over a
+    2^21^3 grid; uses Skilling's transpose algorithm ("Programming the
+    Hilbert curve", 2004), then interleaves the transposed bits the
+    same way the morton code does */
+  GRIDLETS_BOTH inline unsigned long long hilbert_encode3D(unsigned int x, unsigned int y, unsigned int z)
+  {
+    unsigned int X[3] = { x, y, z };
+    const unsigned int M = 1u << 20;
+    // inverse undo
+    for (unsigned int Q = M; Q > 1; Q >>= 1) {
+      const unsigned int P = Q - 1;
+      for (int i = 0; i < 3; i++)
+        if (X[i] & Q)
+          X[0] ^= P;
+        else {
+          const unsigned int t = (X[0] ^ X[i]) & P;
+          X[0] ^= t;
+          X[i] ^= t;
+        }
+    }
+    // gray encode
+    X[1] ^= X[0];
+    X[2] ^= X[1];
+    unsigned int t = 0;
+    for (unsigned int Q = M; Q > 1; Q >>= 1)
+      if (X[2] & Q) t ^= Q - 1;
+    for (int i = 0; i < 3; i++)
+      X[i] ^= t;
+    // X[0] holds the most significant bit of each 3-bit digit
+    return separate_bits(X[2]) | (separate_bits(X[1]) << 1) | (separate_bits(X[0]) << 2);
+  }
+
+  /*! order in which the bricks of a level get written to the .grids
+    file; 'native' is whatever order the generator produces them in */
+  typedef enum { BRICK_ORDER_NATIVE, BRICK_ORDER_MORTON, BRICK_ORDER_HILBERT } BrickOrder;
+
+  inline BrickOrder parseBrickOrder(const std::string &name)
+  {
+    if (name == "native")  return BRICK_ORDER_NATIVE;
+    if (name == "morton" || name == "z") return BRICK_ORDER_MORTON;
+    if (name == "hilbert") return BRICK_ORDER_HILBERT;
+    throw std::runtime_error("unknown brick order '"+name+"' (use native, morton, or hilbert)");
+  }
+
+  /*! sort key of a brick whose lower corner is (x,y,z) in level cell
+    space, relative to the lower corner of all bricks of that level
+    (ie, non-negative) */
+  GRIDLETS_BOTH inline unsigned long long brickOrderKey(BrickOrder order, int x, int y, int z)
+  {
+    return order == BRICK_ORDER_HILBERT
+      ? hilbert_encode3D(x,y,z)
+      : morton_encode3D(x,y,z);
+  }
+
+  /*! .grids files come in two flavors: the original one is a plain
+    sequence of gridlets, each storing one scalarID (or -1) per
+    vertex; the extended one starts with a GridsHeader, whose flags
+    specify which optional data follows each gridlet's header */
+  struct GridsHeader {
+    /*! "GRIDLETS" - as first two ints of an original .grids file this
+      would be a brick at an x coordinate of over a billion cells */
+    static const uint64_t MAGIC = 0x5354454c44495247ull;
+
+    uint64_t magic   = MAGIC;
+    uint32_t version = 1;
+    uint32_t flags   = 0;
+  };
+
+  /*! each gridlet stores a cube occupancy bitmask (bit i set if cube
+    i of the brick - in x-fastest order - exists), and only the
+    scalarIDs of vertices that are actually used by any cube */
+  const uint32_t GRIDS_FLAG_OCCUPANCY = 1;
+
+  /*! "baked" gridlets: instead of scalarIDs, each gridlet stores the
+    vertex values themselves - as floats, or quantized to 16 or 8 bits
+    relative to a per-gridlet (min,max) that precedes the values. At
+    most one of these can be set, and only together with
+    GRIDS_FLAG_OCCUPANCY (there is no scalarID of -1 to mark unused
+    vertices) */
+  const uint32_t GRIDS_FLAG_VALUES_FLOAT  = 2;
+  const uint32_t GRIDS_FLAG_VALUES_UINT16 = 4;
+  const uint32_t GRIDS_FLAG_VALUES_UINT8  = 8;
+  const uint32_t GRIDS_FLAGS_VALUES
+    = GRIDS_FLAG_VALUES_FLOAT | GRIDS_FLAG_VALUES_UINT16 | GRIDS_FLAG_VALUES_UINT8;
+
+  /*! the baked-values flag for storing 32 (float), 16, or 8 bits per
+    value, as given to the tools' --bits options */
+  inline uint32_t gridsValueFlagForBits(int bits)
+  {
+    switch (bits) {
+    case 32: return GRIDS_FLAG_VALUES_FLOAT;
+    case 16: return GRIDS_FLAG_VALUES_UINT16;
+    case 8:  return GRIDS_FLAG_VALUES_UINT8;
+    default:
+      throw std::runtime_error("unsupported number of bits per value ("
+                               +std::to_string(bits)+"), has to be 32, 16, or 8");
+    }
+  }
+
+  /*! each gridlet stores the IDs of its face neighbors (see
+    Gridlet::neighbors) right after its lower/level/numCubes, so a
+    renderer can step from brick to brick without a BVH query */
+  const uint32_t GRIDS_FLAG_NEIGHBORS = 16;
+
+  /*! face neighbor encoding: a non-negative value is the index of the
+    (one) gridlet of the same level on the other side of the face;
+    otherwise it is one of these markers:
+    - NONE: nothing beyond the face, ie, a ray leaving through it
+      leaves the data (at least locally)
+    - MULTIPLE: several gridlets of the same level touch the face
+      (only with adaptive bricks)
+    - STITCH: no gridlet of the same level touches the face, but the
+      data continues beyond it - in stitching elements, or in bricks
+      of other levels - so a ray has to look up where it continues */
+  const int GRIDS_NEIGHBOR_NONE     = -1;
+  const int GRIDS_NEIGHBOR_MULTIPLE = -2;
+  const int GRIDS_NEIGHBOR_STITCH   = -3;
+
+  /*! bytes per stored vertex entry (scalarID or value) */
+  inline size_t bytesPerGridletEntry(uint32_t flags)
+  {
+    if (flags & GRIDS_FLAG_VALUES_UINT8)  return 1;
+    if (flags & GRIDS_FLAG_VALUES_UINT16) return 2;
+    return 4;
+  }
+
+  inline size_t numMaskWords(size_t numBits) { return (numBits+31)/32; }
+
+  inline bool isBitSet(const uint32_t *mask, size_t bit)
+  { return mask[bit/32] & (1u<<(bit%32)); }
+
+  /*! world-space bounds of the vertices of a gridlet with given
+    lower cell, level, and number of cubes */
+  inline box3f gridletWorldBounds(const vec3i &lower, int level, const vec3i &numCubes)
+  {
+    const float cellWidth = float(1<<level);
+    box3f bb;
+    bb.lower = (vec3f(lower)+vec3f(.5f))*cellWidth;
+    bb.upper = bb.lower + vec3f(numCubes)*cellWidth;
+    return bb;
+  }
+
+  /*! one gridlet ("brick") as stored in a .grids file: a block of
+    numCubes.x*numCubes.y*numCubes.z same-level dual cubes, storing
+    one scalarID per cube vertex (in x-fastest order), or -1 for
+    vertices that are not used by any cube. 'lower' is in level-L
+    cell space, i.e., vertex (i,j,k) of the brick is the center of
+    cell lower+(i,j,k) on level L */
+  struct Gridlet {
+    inline size_t numCubesTotal() const
+    {
+      return size_t(numCubes.x)*size_t(numCubes.y)*size_t(numCubes.z);
+    }
+
+    inline size_t numScalars() const
+    {
+      return size_t(numCubes.x+1)*size_t(numCubes.y+1)*size_t(numCubes.z+1);
+    }
+
+    /*! world-space bounds of the brick's vertices, i.e., of the
+      region it can actually interpolate in */
+    inline box3f worldBounds() const
+    { return gridletWorldBounds(lower,level,numCubes); }
+
+    vec3i lower;
+    int   level;
+    vec3i numCubes;
+    std::vector<int> scalarIDs;
+    /*! cube occupancy bits; only filled in when read from (or
+      written to) a file with GRIDS_FLAG_OCCUPANCY */
+    std::vector<uint32_t> cubeMask;
+    /*! vertex values (dequantized, 0 for unused vertices) of gridlets
+      read from a baked file; scalarIDs is empty for those */
+    std::vector<float> values;
+    /*! index (in the same file) of the gridlet on the other side of
+      each face, in -x,+x,-y,+y,-z,+z order, or a GRIDS_NEIGHBOR_*
+      marker; only read from (and written to) files with
+      GRIDS_FLAG_NEIGHBORS. A neighbor starts exactly where this
+      gridlet ends, but does not necessarily cover the whole face. */
+    int neighbors[6] = { GRIDS_NEIGHBOR_NONE, GRIDS_NEIGHBOR_NONE, GRIDS_NEIGHBOR_NONE,
+                         GRIDS_NEIGHBOR_NONE, GRIDS_NEIGHBOR_NONE, GRIDS_NEIGHBOR_NONE };
+  };
+
+  /*! derives cube occupancy from the scalarIDs: a dual cube exists
+    exactly if all of its eight corner cells exist on this level */
+  inline std::vector<uint32_t> computeCubeMask(const vec3i &numCubes, const int *scalarIDs)
+  {
+    std::vector<uint32_t> mask(numMaskWords(size_t(numCubes.x)*numCubes.y*numCubes.z),0u);
+    const size_t nx = numCubes.x+1, ny = numCubes.y+1;
+    size_t cubeID = 0;
+    for (int iz=0;iz<numCubes.z;iz++)
+      for (int iy=0;iy<numCubes.y;iy++)
+        for (int ix=0;ix<numCubes.x;ix++,cubeID++) {
+          bool valid = true;
+          for (int c=0;c<8 && valid;c++)
+            valid = scalarIDs[(ix+(c&1)) + nx*((iy+((c>>1)&1)) + ny*(iz+(c>>2)))] >= 0;
+          if (valid) mask[cubeID/32] |= (1u<<(cubeID%32));
+        }
+    return mask;
+  }
+
+  inline void writeGridsHeader(std::ostream &out, uint32_t flags)
+  {
+    if (flags == 0) return;
+    GridsHeader header;
+    header.flags = flags;
+    out.write((const char *)&header,sizeof(header));
+  }
+
+  /*! writes a gridlet's header, its face neighbors (with
+    GRIDS_FLAG_NEIGHBORS; all GRIDS_NEIGHBOR_NONE if null), and - with
+    GRIDS_FLAG_OCCUPANCY - its occupancy masks; returns false if all
+    vertex entries have to follow, true if only those of vertices set
+    in vertexMask */
+  inline bool writeGridletHeader(std::ostream &out,
+                                 const vec3i &lower, int level, const vec3i &numCubes,
+                                 const uint32_t *cubeMask,
+                                 const std::vector<uint32_t> &vertexMask,
+                                 size_t numStored,
+                                 uint32_t flags,
+                                 const int *neighbors=nullptr)
+  {
+    out.write((const char *)&lower,sizeof(lower));
+    out.write((const char *)&level,sizeof(level));
+    out.write((const char *)&numCubes,sizeof(numCubes));
+    if (flags & GRIDS_FLAG_NEIGHBORS) {
+      const int none[6] = { GRIDS_NEIGHBOR_NONE, GRIDS_NEIGHBOR_NONE, GRIDS_NEIGHBOR_NONE,
+                            GRIDS_NEIGHBOR_NONE, GRIDS_NEIGHBOR_NONE, GRIDS_NEIGHBOR_NONE };
+      out.write((const char *)(neighbors ? neighbors : none),6*sizeof(int));
+    }
+    if (!(flags & GRIDS_FLAG_OCCUPANCY))
+      return false;
+
+    const size_t numCubesTotal = size_t(numCubes.x)*size_t(numCubes.y)*size_t(numCubes.z);
+    uint32_t allOccupied = 1;
+    for (size_t i=0;i<numCubesTotal && allOccupied;i++)
+      allOccupied = isBitSet(cubeMask,i);
+    out.write((const char *)&allOccupied,sizeof(allOccupied));
+    if (allOccupied)
+      // all cubes exist, so do all vertices - nothing to compact
+      return false;
+
+    const int numStoredInt = (int)numStored;
+    out.write((const char *)cubeMask,numMaskWords(numCubesTotal)*sizeof(uint32_t));
+    out.write((const char *)vertexMask.data(),vertexMask.size()*sizeof(uint32_t));
+    out.write((const char *)&numStoredInt,sizeof(numStoredInt));
+    return true;
+  }
+
+  /*! writes one gridlet in the format given by 'flags'; cubeMask is
+    only used with GRIDS_FLAG_OCCUPANCY, and can be null (in which
+    case it gets derived from the scalarIDs); neighbors only with
+    GRIDS_FLAG_NEIGHBORS */
+  inline void writeGridlet(std::ostream &out,
+                           const vec3i &lower, int level, const vec3i &numCubes,
+                           const int *scalarIDs, const uint32_t *cubeMask,
+                           uint32_t flags,
+                           const int *neighbors=nullptr)
+  {
+    if (flags & GRIDS_FLAGS_VALUES)
+      throw std::runtime_error("writeGridlet: baked gridlets get written with writeBakedGridlet");
+    const size_t numScalars
+      = size_t(numCubes.x+1)*size_t(numCubes.y+1)*size_t(numCubes.z+1);
+    std::vector<uint32_t> derivedMask;
+    if ((flags & GRIDS_FLAG_OCCUPANCY) && !cubeMask) {
+      derivedMask = computeCubeMask(numCubes,scalarIDs);
+      cubeMask = derivedMask.data();
+    }
+    std::vector<uint32_t> vertexMask;
+    std::vector<int> compacted;
+    if (flags & GRIDS_FLAG_OCCUPANCY) {
+      vertexMask.resize(numMaskWords(numScalars),0u);
+      for (size_t i=0;i<numScalars;i++)
+        if (scalarIDs[i] >= 0) {
+          vertexMask[i/32] |= (1u<<(i%32));
+          compacted.push_back(scalarIDs[i]);
+        }
+    }
+    if (writeGridletHeader(out,lower,level,numCubes,cubeMask,vertexMask,compacted.size(),flags,neighbors))
+      out.write((const char *)compacted.data(),compacted.size()*sizeof(int));
+    else
+      out.write((const char *)scalarIDs,numScalars*sizeof(int));
+  }
+
+  /*! vertex (i.e., corner-of-an-existing-cube) occupancy bits of a
+    gridlet, x-fastest */
+  inline std::vector<uint32_t> computeVertexMask(const vec3i &numCubes, const uint32_t *cubeMask)
+  {
+    const int nx = numCubes.x+1, ny = numCubes.y+1;
+    std::vector<uint32_t> mask(numMaskWords(size_t(nx)*ny*(numCubes.z+1)),0u);
+    for (int iz=0;iz<numCubes.z;iz++)
+      for (int iy=0;iy<numCubes.y;iy++)
+        for (int ix=0;ix<numCubes.x;ix++) {
+          if (!isBitSet(cubeMask,ix+size_t(numCubes.x)*(iy+size_t(numCubes.y)*iz)))
+            continue;
+          for (int c=0;c<8;c++) {
+            const size_t v = (ix+(c&1)) + nx*((iy+((c>>1)&1)) + size_t(ny)*(iz+(c>>2)));
+            mask[v/32] |= (1u<<(v%32));
+          }
+        }
+    return mask;
+  }
+
+  /*! writes one baked gridlet: 'values' has one entry per vertex
+    (entries of vertices no existing cube uses get ignored). 'flags'
+    has to contain GRIDS_FLAG_OCCUPANCY and one GRIDS_FLAG_VALUES_*;
+    quantized values get stored relative to the (min,max) of the
+    gridlet's used vertex values */
+  inline void writeBakedGridlet(std::ostream &out,
+                                const vec3i &lower, int level, const vec3i &numCubes,
+                                const float *values, const uint32_t *cubeMask,
+                                uint32_t flags,
+                                const int *neighbors=nullptr)
+  {
+    if (!(flags & GRIDS_FLAG_OCCUPANCY) || !(flags & GRIDS_FLAGS_VALUES))
+      throw std::runtime_error("writeBakedGridlet: needs occupancy and value flags");
+    const size_t numScalars
+      = size_t(numCubes.x+1)*size_t(numCubes.y+1)*size_t(numCubes.z+1);
+    const std::vector<uint32_t> vertexMask = computeVertexMask(numCubes,cubeMask);
+    std::vector<float> stored;
+    for (size_t i=0;i<numScalars;i++)
+      if (isBitSet(vertexMask.data(),i))
+        stored.push_back(values[i]);
+    if (!writeGridletHeader(out,lower,level,numCubes,cubeMask,vertexMask,stored.size(),flags,neighbors))
+      stored.assign(values,values+numScalars);
+
+    if (flags & GRIDS_FLAG_VALUES_FLOAT) {
+      out.write((const char *)stored.data(),stored.size()*sizeof(float));
+      return;
+    }
+    float lo = stored.empty() ? 0.f : stored[0], hi = lo;
+    for (float v : stored) { lo = std::min(lo,v); hi = std::max(hi,v); }
+    out.write((const char *)&lo,sizeof(lo));
+    out.write((const char *)&hi,sizeof(hi));
+    const bool is8 = (flags & GRIDS_FLAG_VALUES_UINT8);
+    const float maxQ = is8 ? 255.f : 65535.f;
+    const float scale = hi > lo ? maxQ/(hi-lo) : 0.f;
+    std::vector<uint8_t>  q8;
+    std::vector<uint16_t> q16;
+    for (float v : stored) {
+      const float q = std::min(std::max((v-lo)*scale+.5f,0.f),maxQ);
+      if (is8) q8.push_back(uint8_t(q)); else q16.push_back(uint16_t(q));
+    }
+    if (is8)
+      out.write((const char *)q8.data(),q8.size());
+    else
+      out.write((const char *)q16.data(),q16.size()*sizeof(uint16_t));
+  }
+
+  inline void writeGridlet(std::ostream &out, const Gridlet &brick, uint32_t flags=0)
+  {
+    writeGridlet(out,brick.lower,brick.level,brick.numCubes,brick.scalarIDs.data(),
+                 brick.cubeMask.empty() ? nullptr : brick.cubeMask.data(),
+                 flags,brick.neighbors);
+  }
+
+  /*! reads one gridlet; returns false at end of file. compacted
+    scalarIDs get expanded again, so 'scalarIDs' always has one entry
+    (or -1) per vertex; likewise for the (dequantized) 'values' of
+    baked gridlets */
+  inline bool readGridlet(std::istream &in, Gridlet &brick, uint32_t flags=0)
+  {
+    in.read((char*)&brick.lower,sizeof(brick.lower));
+    in.read((char*)&brick.level,sizeof(brick.level));
+    in.read((char*)&brick.numCubes,sizeof(brick.numCubes));
+    if (!in.good())
+      return false;
+    if (flags & GRIDS_FLAG_NEIGHBORS)
+      in.read((char*)brick.neighbors,sizeof(brick.neighbors));
+    const size_t numScalars = brick.numScalars();
+    brick.cubeMask.clear();
+    // empty if all vertices have an entry
+    std::vector<uint32_t> vertexMask;
+    size_t numStored = numScalars;
+    if (flags & GRIDS_FLAG_OCCUPANCY) {
+      uint32_t allOccupied = 0;
+      in.read((char*)&allOccupied,sizeof(allOccupied));
+      brick.cubeMask.resize(numMaskWords(brick.numCubesTotal()));
+      if (allOccupied) {
+        std::fill(brick.cubeMask.begin(),brick.cubeMask.end(),~0u);
+        if (brick.numCubesTotal() % 32)
+          brick.cubeMask.back() = (1u<<(brick.numCubesTotal()%32))-1;
+      } else {
+        vertexMask.resize(numMaskWords(numScalars));
+        int numStoredInt = 0;
+        in.read((char*)brick.cubeMask.data(),brick.cubeMask.size()*sizeof(uint32_t));
+        in.read((char*)vertexMask.data(),vertexMask.size()*sizeof(uint32_t));
+        in.read((char*)&numStoredInt,sizeof(numStoredInt));
+        numStored = std::max(numStoredInt,0);
+      }
+    }
+    // which stored entry (if any) vertex i gets
+    auto forEachVertex = [&](const auto &assign) {
+      size_t next = 0;
+      for (size_t i=0;i<numScalars;i++)
+        if (vertexMask.empty() || (isBitSet(vertexMask.data(),i) && next < numStored))
+          assign(i,next++);
+        else
+          assign(i,size_t(-1));
+    };
+
+    if (!(flags & GRIDS_FLAGS_VALUES)) {
+      std::vector<int> stored(numStored);
+      in.read((char*)stored.data(),stored.size()*sizeof(int));
+      brick.scalarIDs.resize(numScalars);
+      brick.values.clear();
+      forEachVertex([&](size_t i, size_t entry){
+          brick.scalarIDs[i] = entry == size_t(-1) ? -1 : stored[entry];
+        });
+    } else {
+      float lo = 0.f, hi = 0.f;
+      if (!(flags & GRIDS_FLAG_VALUES_FLOAT)) {
+        in.read((char*)&lo,sizeof(lo));
+        in.read((char*)&hi,sizeof(hi));
+      }
+      const size_t entrySize = bytesPerGridletEntry(flags);
+      std::vector<uint8_t> stored(numStored*entrySize);
+      in.read((char*)stored.data(),stored.size());
+      const float step
+        = (flags & GRIDS_FLAG_VALUES_UINT8)  ? (hi-lo)/255.f
+        : (flags & GRIDS_FLAG_VALUES_UINT16) ? (hi-lo)/65535.f
+        : 0.f;
+      brick.scalarIDs.clear();
+      brick.values.resize(numScalars);
+      forEachVertex([&](size_t i, size_t entry){
+          float v = 0.f;
+          if (entry != size_t(-1) && entrySize == 4)
+            memcpy(&v,stored.data()+4*entry,sizeof(v));
+          else if (entry != size_t(-1) && entrySize == 2) {
+            uint16_t q;
+            memcpy(&q,stored.data()+2*entry,sizeof(q));
+            v = lo + q*step;
+          } else if (entry != size_t(-1))
+            v = lo + stored[entry]*step;
+          brick.values[i] = v;
+        });
+    }
+    if (!in.good())
+      throw std::runtime_error("truncated gridlet in .grids file");
+    return true;
+  }
+
+  /*! reads the header of a .grids file if it has one (and returns its
+    flags), or rewinds to the beginning for original-format files */
+  inline uint32_t readGridsHeader(std::istream &in)
+  {
+    GridsHeader header;
+    in.read((char*)&header,sizeof(header));
+    if (in.good() && header.magic == GridsHeader::MAGIC) {
+      if (header.version != 1)
+        throw std::runtime_error("unsupported .grids version");
+      return header.flags;
+    }
+    in.clear();
+    in.seekg(0);
+    return 0;
+  }
+
+  inline std::vector<Gridlet> readGrids(const std::string &fileName,
+                                        uint32_t *flagsInFile=nullptr)
+  {
+    std::ifstream in(fileName,std::ios::binary);
+    if (!in.good())
+      throw std::runtime_error("could not open grids file '"+fileName+"'");
+    const uint32_t flags = readGridsHeader(in);
+    if (flagsInFile) *flagsInFile = flags;
+    std::vector<Gridlet> bricks;
+    Gridlet brick;
+    while (readGridlet(in,brick,flags))
+      bricks.push_back(brick);
+    return bricks;
+  }
+
+  inline void writeGrids(const std::string &fileName,
+                         const std::vector<Gridlet> &bricks,
+                         uint32_t flags=0)
+  {
+    std::ofstream out(fileName,std::ios::binary);
+    if (!out.good())
+      throw std::runtime_error("could not create grids file '"+fileName+"'");
+    writeGridsHeader(out,flags);
+    for (auto &brick : bricks)
+      if (flags & GRIDS_FLAGS_VALUES)
+        writeBakedGridlet(out,brick.lower,brick.level,brick.numCubes,brick.values.data(),
+                          brick.cubeMask.data(),flags,brick.neighbors);
+      else
+        writeGridlet(out,brick,flags);
+  }
+
+} // ::gridlets
@@ -0,0 +1,91 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sys/stat.h>
+#include "scalars.h"
+#if UMESH_HAVE_TBB
+# include "tbb/parallel_sort.h"
+#endif
+
+namespace gridlets {
+
+  /*! sorts in parallel if built with TBB, serially otherwise */
+  template<typename T>
+  inline void sortInParallel(std::vector<T> &items)
+  {
+#if UMESH_HAVE_TBB
+    tbb::parallel_sort(items.begin(),items.end());
+#else
+    std::sort(items.begin(),items.end());
+#endif
+  }
+
+  /*! name of the partial dual mesh written by 'amrMakeDualMesh -o
+    <outFileName> --part <part>/<numParts>'; its .cubes and scalar
+    files get named after it the same way a single run's get named
+    after <outFileName>. amrMergeDual finds the parts by this name. */
+  inline std::string partFileName(const std::string &outFileName, int part, int numParts)
+  {
+    return outFileName+".part"+std::to_string(part)+"of"+std::to_string(numParts);
+  }
+
+  /*! name of the list of side files (.cubes, .cubeScalars,
+    .vertexScalars) a '--part' run wrote next to its partial mesh:
+    one name suffix - what follows "<partName>_" - per line */
+  inline std::string sideFileListName(const std::string &partName)
+  {
+    return partName+".sideFiles";
+  }
+
+  /*! number of cells in given .cells file (four ints per cell) */
+  inline size_t numCellsInFile(const std::string &cellsFileName)
+  {
+    struct stat st;
+    if (stat(cellsFileName.c_str(),&st) != 0)
+      throw std::runtime_error("could not stat cells file '"+cellsFileName+"'");
+    return size_t(st.st_size) / (4*sizeof(int));
+  }
+
+  /*! maps the scalars file of the cells in given .cells file */
+  inline MappedScalars mapScalars(const std::string &scalarsFileName,
+                                  const std::string &cellsFileName)
+  {
+    return MappedScalars(scalarsFileName,numCellsInFile(cellsFileName));
+  }
+
+  /*! opens an output file: truncated the first time this run opens
+    it, appended to after that (several input files can hold cubes
+    of the same level); returns whether this was the first time */
+  inline bool openOutput(std::ofstream &out, const std::string &fileName)
+  {
+    static std::set<std::string> openedBefore;
+    const bool firstTime = openedBefore.insert(fileName).second;
+    out.open(fileName, firstTime
+             ? std::ios_base::binary
+             : std::ios_base::binary|std::ios_base::app);
+    if (!out)
+      throw std::runtime_error("could not open '"+fileName+"' for writing");
+    return firstTime;
+  }
+
+} // ::gridlets
@@ -0,0 +1,101 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "grids.h"
+
+namespace gridlets {
+
+  /*! links of a level-of-detail pyramid of bricks, stored next to
+    its (baked) .grids file as "<name>.lod". The .grids file holds the
+    bricks of all levels, coarsest level first; brick IDs are indices
+    into that sequence. The children of a brick - the bricks of the
+    next finer level covering the same region - are consecutive. */
+  struct LodPyramid {
+    /*! "LODLINKS" */
+    static const uint64_t MAGIC = 0x534b4e494c444f4cull;
+
+    struct Level {
+      /*! cell level (cell width 2^level) of the level's bricks */
+      int level;
+      int firstBrick;
+      int numBricks;
+    };
+
+    struct Brick {
+      /*! byte offset and size of the brick in the .grids file, so a
+        viewer can fetch any subtree with one read per brick */
+      uint64_t offset;
+      uint32_t size;
+      /*! -1 for the bricks of the coarsest level */
+      int parent;
+      int firstChild;
+      int numChildren;
+    };
+
+    /*! file layout: MAGIC, number of levels, number of bricks,
+      followed by all levels (coarsest first) and all bricks */
+    void saveTo(const std::string &fileName) const
+    {
+      std::ofstream out(fileName,std::ios::binary);
+      if (!out.good())
+        throw std::runtime_error("could not open lod file '"+fileName+"'");
+      const uint64_t magic = MAGIC;
+      const int numLevels = (int)levels.size();
+      const int numBricks = (int)bricks.size();
+      out.write((const char *)&magic,sizeof(magic));
+      out.write((const char *)&numLevels,sizeof(numLevels));
+      out.write((const char *)&numBricks,sizeof(numBricks));
+      out.write((const char *)levels.data(),levels.size()*sizeof(Level));
+      out.write((const char *)bricks.data(),bricks.size()*sizeof(Brick));
+    }
+
+    static LodPyramid loadFrom(const std::string &fileName)
+    {
+      std::ifstream in(fileName,std::ios::binary);
+      uint64_t magic = 0;
+      in.read((char *)&magic,sizeof(magic));
+      if (!in.good() || magic != MAGIC)
+        throw std::runtime_error("'"+fileName+"' is not a lod file");
+      int numLevels = 0, numBricks = 0;
+      in.read((char *)&numLevels,sizeof(numLevels));
+      in.read((char *)&numBricks,sizeof(numBricks));
+      LodPyramid pyramid;
+      pyramid.levels.resize(std::max(numLevels,0));
+      pyramid.bricks.resize(std::max(numBricks,0));
+      in.read((char *)pyramid.levels.data(),pyramid.levels.size()*sizeof(Level));
+      in.read((char *)pyramid.bricks.data(),pyramid.bricks.size()*sizeof(Brick));
+      if (!in.good())
+        throw std::runtime_error("lod file '"+fileName+"' is truncated");
+      return pyramid;
+    }
+
+    std::vector<Level> levels;
+    std::vector<Brick> bricks;
+  };
+
+  /*! name of the .lod file that goes with given .grids file */
+  inline std::string lodFileNameOf(const std::string &gridsFileName)
+  {
+    const std::string ext = ".grids";
+    if (gridsFileName.size() > ext.size()
+        && gridsFileName.compare(gridsFileName.size()-ext.size(),ext.size(),ext) == 0)
+      return gridsFileName.substr(0,gridsFileName.size()-ext.size())+".lod";
+    return gridsFileName+".lod";
+  }
+
+} // ::gridlets
@@ -0,0 +1,318 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "umesh/UMesh.h"
+#include "grids.h"
+#include "scalars.h"
+#include "helpers.h"
+#include <cmath>
+#include <mutex>
+
+namespace gridlets {
+
+  using umesh::range1f;
+  using umesh::UMesh;
+
+  /*! value ranges sidecar of a .grids file ("<name>.ranges"): one
+    range1f (min,max of all vertex values of the brick's existing
+    cubes) per brick, in the same order as the bricks in the .grids
+    file */
+  inline std::vector<range1f> readBrickRanges(const std::string &fileName)
+  {
+    std::ifstream in(fileName,std::ios::binary);
+    if (!in.good())
+      throw std::runtime_error("could not open ranges file '"+fileName+"'");
+    std::vector<range1f> ranges;
+    range1f range;
+    while (in.read((char *)&range,sizeof(range)))
+      ranges.push_back(range);
+    return ranges;
+  }
+
+  /*! a uniform grid of value ranges over the whole data set - bricks
+    and stitching elements - that a renderer can directly use as its
+    majorant grid. Cell (i,j,k) covers origin+[(i,j,k),(i,j,k)+1)*cellWidth;
+    cells not overlapped by anything have an empty range. */
+  struct MajorantGrid {
+    /*! "MAJORANT" */
+    static const uint64_t MAGIC = 0x544e41524f4a414dull;
+
+    MajorantGrid() = default;
+
+    /*! grid of cells of given width that covers 'bounds', with all
+      ranges empty */
+    MajorantGrid(const box3f &bounds, float cellWidth)
+      : origin(bounds.lower), cellWidth(cellWidth)
+    {
+      const vec3f size = bounds.size();
+      dims = vec3i(std::max(1,int(std::ceil(size.x/cellWidth))),
+                   std::max(1,int(std::ceil(size.y/cellWidth))),
+                   std::max(1,int(std::ceil(size.z/cellWidth))));
+      ranges.resize(size_t(dims.x)*size_t(dims.y)*size_t(dims.z));
+    }
+
+    /*! extends the ranges of all cells overlapped by 'box' */
+    void splat(const box3f &box, const range1f &range)
+    {
+      const vec3i lo = cellOf(box.lower);
+      const vec3i hi = cellOf(box.upper);
+      for (int iz=lo.z;iz<=hi.z;iz++)
+        splatLayer(lo,hi,iz,range);
+    }
+
+    /*! splats all given boxes, in parallel; every z-layer of cells
+      has its own lock, so boxes only wait for each other where they
+      overlap the same layer */
+    void splat(const std::vector<std::pair<box3f,range1f>> &boxes)
+    {
+      std::vector<std::mutex> layerMutex(dims.z);
+      umesh::parallel_for_blocked(0,boxes.size(),16*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            const vec3i lo = cellOf(boxes[i].first.lower);
+            const vec3i hi = cellOf(boxes[i].first.upper);
+            for (int iz=lo.z;iz<=hi.z;iz++) {
+              std::lock_guard<std::mutex> lock(layerMutex[iz]);
+              splatLayer(lo,hi,iz,boxes[i].second);
+            }
+          }
+        });
+    }
+
+    /*! extends the ranges of cells [lo,hi] in layer 'iz' */
+    void splatLayer(const vec3i &lo, const vec3i &hi, int iz, const range1f &range)
+    {
+      for (int iy=lo.y;iy<=hi.y;iy++)
+        for (int ix=lo.x;ix<=hi.x;ix++)
+          ranges[ix+size_t(dims.x)*(iy+size_t(dims.y)*iz)].extend(range);
+    }
+
+    size_t numBytes() const { return ranges.size()*sizeof(range1f); }
+
+    /*! (clamped) cell that contains given point */
+    vec3i cellOf(const vec3f &p) const
+    {
+      const vec3f rel = (p-origin)*(1.f/cellWidth);
+      return vec3i(std::min(std::max(int(std::floor(rel.x)),0),dims.x-1),
+                   std::min(std::max(int(std::floor(rel.y)),0),dims.y-1),
+                   std::min(std::max(int(std::floor(rel.z)),0),dims.z-1));
+    }
+
+    /*! file layout: MAGIC, dims, origin, cellWidth, followed by one
+      range1f per cell (x-fastest) */
+    void saveTo(const std::string &fileName) const
+    {
+      std::ofstream out(fileName,std::ios::binary);
+      if (!out.good())
+        throw std::runtime_error("could not open majorants file '"+fileName+"'");
+      const uint64_t magic = MAGIC;
+      out.write((const char *)&magic,sizeof(magic));
+      out.write((const char *)&dims,sizeof(dims));
+      out.write((const char *)&origin,sizeof(origin));
+      out.write((const char *)&cellWidth,sizeof(cellWidth));
+      out.write((const char *)ranges.data(),ranges.size()*sizeof(range1f));
+    }
+
+    static MajorantGrid loadFrom(const std::string &fileName)
+    {
+      std::ifstream in(fileName,std::ios::binary);
+      uint64_t magic = 0;
+      in.read((char *)&magic,sizeof(magic));
+      if (!in.good() || magic != MAGIC)
+        throw std::runtime_error("'"+fileName+"' is not a majorants file");
+      MajorantGrid grid;
+      in.read((char *)&grid.dims,sizeof(grid.dims));
+      in.read((char *)&grid.origin,sizeof(grid.origin));
+      in.read((char *)&grid.cellWidth,sizeof(grid.cellWidth));
+      grid.ranges.resize(size_t(grid.dims.x)*size_t(grid.dims.y)*size_t(grid.dims.z));
+      in.read((char *)grid.ranges.data(),grid.ranges.size()*sizeof(range1f));
+      if (!in.good())
+        throw std::runtime_error("majorants file '"+fileName+"' is truncated");
+      return grid;
+    }
+
+    vec3f origin;
+    float cellWidth = 1.f;
+    vec3i dims { 0,0,0 };
+    std::vector<range1f> ranges;
+  };
+
+  /*! world-space bounds and value range of one stitching element; the
+    vertex values are looked up through the mesh's vertex tags, or
+    taken from its per-vertex scalars if it has no tags */
+  template<typename Prim>
+  inline std::pair<box3f,range1f> elementBoundsAndRange(const UMesh &mesh,
+                                                        const Prim &prim, int numVertices,
+                                                        const MappedScalars &scalars)
+  {
+    std::pair<box3f,range1f> result;
+    for (int i=0;i<numVertices;i++) {
+      const int vertexID = prim[i];
+      result.first.extend(mesh.vertices[vertexID]);
+      result.second.extend(mesh.vertexTag.empty()
+                           ? mesh.perVertex->values[vertexID]
+                           : scalars[mesh.vertexTag[vertexID]]);
+    }
+    return result;
+  }
+
+  /*! computes bounds and value range of all stitching elements of the
+    dual mesh (in parallel), in tets-pyrs-wedges-hexes order */
+  inline std::vector<std::pair<box3f,range1f>>
+  stitchingElementRanges(const UMesh &mesh, const MappedScalars &scalars)
+  {
+    if (mesh.vertexTag.empty() && !mesh.perVertex)
+      throw std::runtime_error("stitching mesh has neither vertex tags nor scalars");
+    const size_t numTets   = mesh.tets.size();
+    const size_t numPyrs   = mesh.pyrs.size();
+    const size_t numWedges = mesh.wedges.size();
+    std::vector<std::pair<box3f,range1f>> result(mesh.numVolumeElements());
+    umesh::parallel_for_blocked(0,result.size(),16*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          size_t ID = i;
+          if (ID < numTets)
+            { result[i] = elementBoundsAndRange(mesh,mesh.tets[ID],4,scalars); continue; }
+          ID -= numTets;
+          if (ID < numPyrs)
+            { result[i] = elementBoundsAndRange(mesh,mesh.pyrs[ID],5,scalars); continue; }
+          ID -= numPyrs;
+          if (ID < numWedges)
+            { result[i] = elementBoundsAndRange(mesh,mesh.wedges[ID],6,scalars); continue; }
+          ID -= numWedges;
+          result[i] = elementBoundsAndRange(mesh,mesh.hexes[ID],8,scalars);
+        }
+      });
+    return result;
+  }
+
+  /*! builds a majorant grid with cells of given width over the given
+    bricks (world-space bounds and value range of each), plus all
+    stitching elements of the dual mesh if that is not null. The cell
+    width gets doubled until the grid takes at most 'maxBytes'. */
+  inline MajorantGrid computeMajorantGrid(const std::vector<std::pair<box3f,range1f>> &bricks,
+                                          const UMesh *stitchingMesh,
+                                          const MappedScalars &scalars,
+                                          float cellWidth,
+                                          size_t maxBytes)
+  {
+    std::vector<std::pair<box3f,range1f>> elements;
+    if (stitchingMesh)
+      elements = stitchingElementRanges(*stitchingMesh,scalars);
+    box3f bounds;
+    for (auto &brick : bricks) bounds.extend(brick.first);
+    for (auto &element : elements) bounds.extend(element.first);
+    if (bounds.empty())
+      return MajorantGrid();
+
+    const vec3f size = bounds.size();
+    while (size_t(std::ceil(size.x/cellWidth))
+           *size_t(std::ceil(size.y/cellWidth))
+           *size_t(std::ceil(size.z/cellWidth))*sizeof(range1f) > maxBytes)
+      cellWidth *= 2.f;
+    MajorantGrid grid(bounds,cellWidth);
+    grid.splat(bricks);
+    grid.splat(elements);
+    return grid;
+  }
+
+  /*! the --scalars/--cells/--umesh and majorant grid options of the
+    amrMakeGrids tools */
+  struct MajorantOptions {
+    /*! if av[i] is one of our options, consumes it (and its value)
+      and returns true */
+    bool parse(char **av, int &i)
+    {
+      const std::string arg = av[i];
+      if (arg == "--scalars")
+        scalarsFileName = av[++i];
+      else if (arg == "--cells")
+        cellsFileName = av[++i];
+      else if (arg == "--umesh")
+        umeshFileName = av[++i];
+      else if (arg == "--majorant-width") {
+        cellWidth = std::stof(av[++i]);
+        if (!(cellWidth > 0.f))
+          throw std::runtime_error("--majorant-width must be positive");
+      }
+      else if (arg == "--majorant-mb") {
+        maxMB = std::stoul(av[++i]);
+        if (maxMB < 1)
+          throw std::runtime_error("--majorant-mb must be at least 1");
+      }
+      else
+        return false;
+      return true;
+    }
+
+    static std::string usage()
+    {
+      return " [--scalars <in.scalars> --cells <in.cells> [--umesh <dual.umesh>]"
+        " [--majorant-width <cells>] [--majorant-mb <MB>]]";
+    }
+
+    /*! maps the scalars if --scalars was given (null otherwise), after
+      checking that the options fit together */
+    MappedScalars::SP mapScalars() const
+    {
+      if (scalarsFileName == "") {
+        if (umeshFileName != "")
+          throw std::runtime_error("--umesh only makes sense with --scalars");
+        return {};
+      }
+      if (cellsFileName == "")
+        throw std::runtime_error("--scalars requires --cells (to know the number of cells)");
+      return std::make_shared<MappedScalars>(scalarsFileName,numCellsInFile(cellsFileName));
+    }
+
+    /*! computes and writes the majorant grid over the given bricks and
+      the --umesh stitching elements. Unless --majorant-width is given,
+      a cell is one macrocell of the coarsest level, in finest-level
+      cells. */
+    void writeMajorantGrid(const std::string &fileName,
+                           const std::vector<std::pair<box3f,range1f>> &bricks,
+                           int coarsestLevel,
+                           int macroCellWidth,
+                           const MappedScalars &scalars) const
+    {
+      UMesh::SP mesh;
+      MajorantGrid majorants;
+      const double seconds = umesh::timeOf([&]{
+          if (umeshFileName != "")
+            mesh = UMesh::loadFrom(umeshFileName);
+          majorants
+            = computeMajorantGrid(bricks,mesh.get(),scalars,
+                                  cellWidth > 0.f ? cellWidth : float(macroCellWidth<<coarsestLevel),
+                                  maxMB<<20);
+          majorants.saveTo(fileName);
+        });
+      std::cout << seconds << "s for the majorant grid ("
+                << majorants.dims << " cells of width " << majorants.cellWidth << ", "
+                << umesh::prettyNumber(majorants.numBytes()) << "B, over "
+                << umesh::prettyNumber(bricks.size()) << " bricks and "
+                << umesh::prettyNumber(mesh ? mesh->numVolumeElements() : 0)
+                << " stitching elements)" << std::endl;
+    }
+
+    std::string scalarsFileName, cellsFileName, umeshFileName;
+    /*! width of a majorant cell, in finest-level cells; 0 for one
+      macrocell of the coarsest level */
+    float  cellWidth = 0.f;
+    /*! the cells get widened until the grid fits into this */
+    size_t maxMB     = 256;
+  };
+
+} // ::gridlets
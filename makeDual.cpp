@@ -17,12 +17,18 @@
 #include "umesh/UMesh.h"
 #include "umesh/io/IO.h"
 #include "umesh/check.h"
+#include "umesh/FaceConn.h"
+#include "scalars.h"
+#include "grids.h"
+#include "helpers.h"
 // #include "tetty/UMesh.h"
 #include <set>
 #include <map>
 #include <fstream>
 #include <atomic>
 #include <array>
+#include <limits>
+#include <cstdio>
 
 #define DEBUG 0
 
@@ -88,10 +94,17 @@ namespace umesh {
     };
 
     void add(LogicalCell logical)
+    {
+      add(logical,(int)cellList.size());
+    }
+
+    /*! adds a cell with given scalarID - which is the cell's index in
+      the .cells file, even if only a subset of the cells gets added */
+    void add(LogicalCell logical, int scalarID)
     {
       Cell cell;
       (LogicalCell&)cell = logical;
-      cell.scalarID = cellList.size();
+      cell.scalarID = scalarID;
       // cells[cell] = (int)cellList.size();
       cellList.push_back(cell);
       // if (cells.size() != cellList.size())
@@ -195,6 +208,175 @@ namespace umesh {
   }
 
 
+  // ##################################################################
+  // domain decomposition, for running one process per part
+  // ##################################################################
+
+  /*! streams through a .cells file in blocks, calling
+    'lambda(cell,cellID)' for every cell, with 'cellID' the cell's
+    index in the file */
+  template<typename Lambda>
+  void forEachCell(const std::string &fileName, const Lambda &lambda)
+  {
+    std::ifstream in(fileName,std::ios::binary);
+    if (!in.good())
+      throw std::runtime_error("could not open cells file '"+fileName+"'");
+    std::vector<Exa::LogicalCell> block(1<<20);
+    size_t cellID = 0;
+    while (in) {
+      in.read((char*)block.data(),block.size()*sizeof(block[0]));
+      const size_t numRead = in.gcount()/sizeof(block[0]);
+      for (size_t i=0;i<numRead;i++)
+        lambda(block[i],cellID++);
+    }
+  }
+
+  /*! the range of morton codes (of the cells' lower corners, on the
+    finest level) owned by one part of a '--part i/N' run. since each
+    cell is aligned to its width, a cell covers the contiguous code
+    range [code(pos),code(pos)+8^level), so the parts are contiguous
+    pieces of the octree. Only owned cells generate dual cells; the
+    minCell rule in doCell() then makes sure every dual cell gets
+    generated by exactly one part. */
+  struct Partition {
+    /*! morton code of given (finest-level) position, or -1 if that is
+      outside of the domain (and thus cannot be in any cell) */
+    uint64_t codeOf(const vec3i &pos) const
+    {
+      const vec3i rel = pos - origin;
+      if (rel.x < 0 || rel.y < 0 || rel.z < 0 ||
+          rel.x >= (1<<21) || rel.y >= (1<<21) || rel.z >= (1<<21))
+        return uint64_t(-1);
+      return gridlets::morton_encode3D(rel.x,rel.y,rel.z);
+    }
+
+    bool owns(const Exa::LogicalCell &cell) const
+    {
+      if (numParts == 1) return true;
+      const uint64_t code = codeOf(cell.pos);
+      return code >= begin && code < end;
+    }
+
+    int      part = 0, numParts = 1;
+    vec3i    origin;
+    uint64_t begin = 0, end = uint64_t(-1);
+  };
+
+  Partition partition;
+
+  /*! computes the code range of part 'part' of 'numParts', such that
+    all parts get about the same number of cells. All parts compute
+    the same split points, from the same (regular) sample of the
+    cells, so they do not need to talk to each other */
+  Partition computePartition(const std::string &cellsFileName,
+                             int part, int numParts,
+                             size_t &numCells)
+  {
+    vec3i lower(std::numeric_limits<int>::max());
+    vec3i upper(std::numeric_limits<int>::min());
+    int maxLevel = 0;
+    numCells = 0;
+    forEachCell(cellsFileName,[&](const Exa::LogicalCell &cell, size_t){
+        lower = min(lower,cell.pos);
+        upper = max(upper,cell.pos+vec3i(1<<cell.level));
+        maxLevel = max(maxLevel,cell.level);
+        numCells++;
+      });
+    if (numCells == 0)
+      throw std::runtime_error("no cells in '"+cellsFileName+"'");
+
+    Partition partition;
+    partition.part     = part;
+    partition.numParts = numParts;
+    const int maxWidth = 1<<maxLevel;
+    partition.origin = vec3i(int(floorf(lower.x/float(maxWidth)))*maxWidth,
+                             int(floorf(lower.y/float(maxWidth)))*maxWidth,
+                             int(floorf(lower.z/float(maxWidth)))*maxWidth);
+    const vec3i extent = upper - partition.origin;
+    if (max(extent.x,max(extent.y,extent.z)) > (1<<21))
+      throw std::runtime_error("domain too large for 63-bit morton codes");
+
+    const size_t sampleRate = std::max(size_t(1),numCells/(1<<20));
+    std::vector<uint64_t> samples;
+    forEachCell(cellsFileName,[&](const Exa::LogicalCell &cell, size_t cellID){
+        if (cellID % sampleRate == 0)
+          samples.push_back(partition.codeOf(cell.pos));
+      });
+    gridlets::sortInParallel(samples);
+    if (part > 0)
+      partition.begin = samples[part*samples.size()/numParts];
+    if (part < numParts-1)
+      partition.end = samples[(part+1)*samples.size()/numParts];
+    return partition;
+  }
+
+  /*! reads the cells owned by the given part, plus the halo of
+    non-owned cells the owned cells' dual cells touch - i.e., every
+    cell containing one of the 26 neighbor-cell centers doCell() will
+    look up. Each cell keeps its index in the file as scalarID, so the
+    partial meshes refer to the same scalars as a single-process
+    run would. Returns the number of cells in the file. */
+  size_t readPartition(Exa &exa, const std::string &cellsFileName,
+                       int part, int numParts)
+  {
+    size_t numCells = 0;
+    partition = computePartition(cellsFileName,part,numParts,numCells);
+
+    forEachCell(cellsFileName,[&](const Exa::LogicalCell &cell, size_t cellID){
+        if (partition.owns(cell))
+          exa.add(cell,(int)cellID);
+      });
+    const size_t numOwned = exa.size();
+    std::sort(exa.cellList.begin(),exa.cellList.end());
+
+    // collect the (finest-level) positions of all neighbor-cell
+    // centers that no owned cell covers; only the borders of the part
+    // produce any of these
+    std::vector<uint64_t> probes;
+    std::mutex probesMutex;
+    parallel_for_blocked
+      (0,exa.size(),16*1024,
+       [&](size_t begin, size_t end){
+         std::vector<uint64_t> blockProbes;
+         for (size_t i=begin;i<end;i++) {
+           const Exa::Cell &cell = exa.cellList[i];
+           for (int dz=-1;dz<=1;dz++)
+             for (int dy=-1;dy<=1;dy++)
+               for (int dx=-1;dx<=1;dx++) {
+                 if (dx == 0 && dy == 0 && dz == 0) continue;
+                 const vec3f where = cell.neighbor(vec3i(dx,dy,dz)).center();
+                 int found;
+                 if (exa.find(found,where)) continue;
+                 const uint64_t code
+                   = partition.codeOf(vec3i(int(floorf(where.x)),
+                                            int(floorf(where.y)),
+                                            int(floorf(where.z))));
+                 if (code != uint64_t(-1))
+                   blockProbes.push_back(code);
+               }
+         }
+         std::lock_guard<std::mutex> lock(probesMutex);
+         probes.insert(probes.end(),blockProbes.begin(),blockProbes.end());
+       });
+    gridlets::sortInParallel(probes);
+    probes.erase(std::unique(probes.begin(),probes.end()),probes.end());
+
+    forEachCell(cellsFileName,[&](const Exa::LogicalCell &cell, size_t cellID){
+        if (partition.owns(cell)) return;
+        const uint64_t cellBegin = partition.codeOf(cell.pos);
+        const uint64_t cellEnd   = cellBegin + (1ull<<(3*cell.level));
+        auto it = std::lower_bound(probes.begin(),probes.end(),cellBegin);
+        if (it != probes.end() && *it < cellEnd)
+          exa.add(cell,(int)cellID);
+      });
+    std::cout << "part " << part << "/" << numParts << ": owns "
+              << prettyNumber(numOwned) << " of " << prettyNumber(numCells)
+              << " cells, plus " << prettyNumber(exa.size()-numOwned)
+              << " halo cells" << std::endl;
+    return numCells;
+  }
+
+
   // ##################################################################
   // managing output vertex and scalar generation
   // ##################################################################
@@ -205,6 +387,11 @@ namespace umesh {
   std::shared_ptr<UMesh> output;
   std::mutex outputMutex;
 
+  /*! if set, every emitted prim also gets its facets entered here,
+    so the face connectivity is known once the last prim got
+    emitted */
+  std::shared_ptr<FaceConn::Builder> faceConnBuilder;
+
   struct Vertex {
     inline float &operator[](int dim) { return pos[dim]; }
     inline const float &operator[](int dim) const { return pos[dim]; }
@@ -371,14 +558,23 @@ namespace umesh {
   
     sanityCheckTet(tet);
     
-    std::lock_guard<std::mutex> lock(outputMutex);
-    output->tets.push_back({(int)tet.x, (int)tet.y, (int)tet.z, (int)tet.w});
-  
-    static int nextPing = 1;
-    if (numTets++ >= nextPing) {
-      nextPing*=2;
-      printCounts();
+    const UMesh::Tet prim((int)tet.x, (int)tet.y, (int)tet.z, (int)tet.w);
+    size_t tetIdx;
+    {
+      std::lock_guard<std::mutex> lock(outputMutex);
+      tetIdx = output->tets.size();
+      output->tets.push_back(prim);
+
+      static int nextPing = 1;
+      if (numTets++ >= nextPing) {
+        nextPing*=2;
+        printCounts();
+      }
     }
+    // the builder does its own (sharded) locking, so prims from
+    // different threads get entered concurrently
+    if (faceConnBuilder)
+      faceConnBuilder->addTet(tetIdx,prim);
   };
 
   // ##################################################################
@@ -402,14 +598,22 @@ namespace umesh {
     sanityCheckFace({pyr[2],pyr[3],pyr[4]},(const vec4i&)pyr, pyr[4]);
     sanityCheckFace({pyr[3],pyr[0],pyr[4]},(const vec4i&)pyr, pyr[4]);
     
-    std::lock_guard<std::mutex> lock(outputMutex);
-    output->pyrs.push_back(pyr);
-
-    static int nextPing = 1;
-    if (numPyramids++ >= nextPing) {
-      nextPing*=2;
-      printCounts();
+    size_t pyrIdx;
+    {
+      std::lock_guard<std::mutex> lock(outputMutex);
+      pyrIdx = output->pyrs.size();
+      output->pyrs.push_back(pyr);
+
+      static int nextPing = 1;
+      if (numPyramids++ >= nextPing) {
+        nextPing*=2;
+        printCounts();
+      }
     }
+    // the builder does its own (sharded) locking, so prims from
+    // different threads get entered concurrently
+    if (faceConnBuilder)
+      faceConnBuilder->addPyr(pyrIdx,pyr);
   }
 
   void emitWedge(const std::array<Vertex,3> &front,
@@ -430,14 +634,22 @@ namespace umesh {
     else
       numWedgesTwisted++;
     
-    std::lock_guard<std::mutex> lock(outputMutex);
-    output->wedges.push_back(wedge);
-  
-    static int nextPing = 1;
-    if (numWedges++ >= nextPing) {
-      nextPing*=2;
-      printCounts();
+    size_t wedgeIdx;
+    {
+      std::lock_guard<std::mutex> lock(outputMutex);
+      wedgeIdx = output->wedges.size();
+      output->wedges.push_back(wedge);
+
+      static int nextPing = 1;
+      if (numWedges++ >= nextPing) {
+        nextPing*=2;
+        printCounts();
+      }
     }
+    // the builder does its own (sharded) locking, so prims from
+    // different threads get entered concurrently
+    if (faceConnBuilder)
+      faceConnBuilder->addWedge(wedgeIdx,wedge);
   }
 
 
@@ -468,29 +680,36 @@ namespace umesh {
     hex[6] = findOrEmitVertex(corner[6]);
     hex[7] = findOrEmitVertex(corner[7]);
   
-    std::lock_guard<std::mutex> lock(outputMutex);
-
-    if (perfect) {
-      Cube cube;
-      cube.lower = (const vec3f&)corner[0];
-      cube.level = level;
-      for (auto &v : corner) cube.lower = min(cube.lower,(const vec3f&)v);
-      for (int i=0;i<8;i++)
-        cube.scalarIDs[i] = corner[i].scalarID;
-      cubesOnLevel[level].push_back(cube);
-    } else
-      output->hexes.push_back(hex);
-
     if (perfect)
       numHexesPerfect++;
     else
       numHexesTwisted++;
   
-    static int nextPing = 1;
-    if (numHexes++ >= nextPing) {
-      nextPing*=2;
-      printCounts();
+    size_t hexIdx = 0;
+    {
+      std::lock_guard<std::mutex> lock(outputMutex);
+
+      if (perfect) {
+        Cube cube;
+        cube.lower = (const vec3f&)corner[0];
+        cube.level = level;
+        for (auto &v : corner) cube.lower = min(cube.lower,(const vec3f&)v);
+        for (int i=0;i<8;i++)
+          cube.scalarIDs[i] = corner[i].scalarID;
+        cubesOnLevel[level].push_back(cube);
+      } else {
+        hexIdx = output->hexes.size();
+        output->hexes.push_back(hex);
+      }
+
+      static int nextPing = 1;
+      if (numHexes++ >= nextPing) {
+        nextPing*=2;
+        printCounts();
+      }
     }
+    if (faceConnBuilder && !perfect)
+      faceConnBuilder->addHex(hexIdx,hex);
   }
 
   /*! if this gets called we know that one side of a general dual cell
@@ -885,15 +1104,20 @@ namespace umesh {
       (exa.cellList.size(),
        [&](size_t cellID){
          const Exa::Cell &cell = exa.cellList[cellID];
+         if (!partition.owns(cell))
+           // halo cell of a partitioned run
+           return;
          doCell(exa,cell);
        });
   }
 
 
-  void extractBricks(int level,
-                     const std::vector<Cube> &cubes,
-                     const std::string &outFileName
-                     )
+  /*! saves the cubes of a level to <out>_<level>.cubes, and returns
+    that file name */
+  std::string extractBricks(int level,
+                            const std::vector<Cube> &cubes,
+                            const std::string &outFileName
+                            )
   {
     std::string fileName = outFileName+"_"+std::to_string(level)+".cubes";    
     std::ofstream out(fileName,std::ios::binary);
@@ -902,6 +1126,48 @@ namespace umesh {
     std::cout << "Saving level-" << level << " cubes to " << fileName << std::endl;
     out.write((char*)cubes.data(),cubes.size()*sizeof(cubes[0]));
     std::cout << "...done" << std::endl;
+    return fileName;
+  }
+
+  /*! gathers the scalar field values for all dual-mesh vertices
+    (through their vertexTag, which is the scalarID of the cell the
+    vertex was generated for), in parallel */
+  std::vector<float> gatherVertexScalars(const gridlets::MappedScalars &scalars)
+  {
+    std::vector<float> values(output->vertices.size());
+    parallel_for_blocked
+      (0,values.size(),16*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           values[i] = scalars[output->vertexTag[i]];
+       });
+    return values;
+  }
+
+  /*! gathers the eight (vtk-order) corner values of every cube on a
+    given level, in the same order the cubes get saved in the
+    .cubes file, and saves them to <out>_<level>_<field>.cubeScalars
+    (whose name it returns) */
+  std::string extractCubeScalars(int level,
+                                 const std::vector<Cube> &cubes,
+                                 const gridlets::MappedScalars &scalars,
+                                 const std::string &outFileName)
+  {
+    std::vector<float> values(8*cubes.size());
+    parallel_for_blocked
+      (0,cubes.size(),4*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           for (int c=0;c<8;c++)
+             values[8*i+c] = scalars[cubes[i].scalarIDs[c]];
+       });
+    std::string fileName
+      = outFileName+"_"+std::to_string(level)+"_"+scalars.fieldName()+".cubeScalars";
+    std::cout << "Saving level-" << level << " '" << scalars.fieldName()
+              << "' cube scalars to " << fileName << std::endl;
+    std::ofstream out(fileName,std::ios::binary);
+    out.write((char*)values.data(),values.size()*sizeof(values[0]));
+    return fileName;
   }
 
 
@@ -909,45 +1175,127 @@ namespace umesh {
   {
     std::string cellsFileName = "";
     std::string outFileName = "";
+    std::string facesFileName = "";
+    CheckLevel checkLevel = UMESH_DEFAULT_CHECK_LEVEL;
+    std::vector<std::string> scalarsFileNames;
+    int part = 0, numParts = 1;
+    const std::string usage
+      = "./exa2umesh in.cells -o out.umesh [-s|--scalars in.scalars]* [--faces out.faces] [--check none|cheap|full] [--part i/N]\n";
     for (int i=1;i<ac;i++) {
       const std::string arg = av[i];
       if (arg == "-o")
         outFileName = av[++i];
+      else if (arg == "-s" || arg == "--scalars")
+        scalarsFileNames.push_back(av[++i]);
+      else if (arg == "--faces")
+        facesFileName = av[++i];
+      else if (arg == "--check")
+        checkLevel = checkLevelFromString(av[++i]);
+      else if (arg == "--part") {
+        const std::string spec = av[++i];
+        // %d rather than %i, which would read "010" as octal
+        int length = 0;
+        if (sscanf(spec.c_str(),"%d/%d%n",&part,&numParts,&length) != 2
+            || length != (int)spec.size()
+            || numParts < 1 || part < 0 || part >= numParts)
+          throw std::runtime_error("invalid --part '"+spec+"' (expected i/N, with 0<=i<N)");
+      }
       else if (arg[0] == '-')
-        throw std::runtime_error("./exa2umesh in.cells -o out.umesh [--boundary-only]\n");
+        throw std::runtime_error(usage);
       else if (arg == "-o")
         outFileName = arg;
       else {
         if (cellsFileName == "")
           cellsFileName = arg;
         else 
-          throw std::runtime_error("./exa2umesh in.cells -o out.umesh [--boundary-only]\n");
+          throw std::runtime_error(usage);
       }
     }
+    // every field's output files are named after it, so two fields
+    // of the same name would overwrite each other's
+    std::set<std::string> fieldNames;
+    for (auto &fileName : scalarsFileNames)
+      if (!fieldNames.insert(gridlets::MappedScalars::fieldNameOf(fileName)).second)
+        throw std::runtime_error("scalars file '"+fileName+"' has the same field name ('"
+                                 +gridlets::MappedScalars::fieldNameOf(fileName)
+                                 +"') as another -s file; rename one of them");
+    if (numParts > 1 && facesFileName != "")
+      throw std::runtime_error("--faces cannot be used with --part; ask amrMergeDual for the faces of the merged mesh instead");
+    if (numParts > 1)
+      // each part writes a partial mesh that amrMergeDual merges into
+      // the final output
+      outFileName = gridlets::partFileName(outFileName,part,numParts);
     cout.precision(10);
     Exa exa;
-    std::ifstream in_cells(cellsFileName);
     output = std::make_shared<UMesh>();
+    size_t numCells = 0;
+    if (numParts > 1) {
+      numCells = readPartition(exa,cellsFileName,part,numParts);
+    } else {
+      std::ifstream in_cells(cellsFileName);
   
-    while (!in_cells.eof()) {
-      Exa::LogicalCell cell;
-      in_cells.read((char*)&cell,sizeof(cell));
+      while (!in_cells.eof()) {
+        Exa::LogicalCell cell;
+        in_cells.read((char*)&cell,sizeof(cell));
     
-      if (!in_cells.good())
-        break;
+        if (!in_cells.good())
+          break;
       
-      exa.add(cell);
+        exa.add(cell);
+      }
+      numCells = exa.size();
     }
     std::cout << "done reading, found " << prettyNumber(exa.size()) << " cells" << std::endl;
 
-    output->perVertex = std::make_shared<Attribute>();
+    // scalar files get mapped, not read; values only get gathered
+    // once we know which cells actually became dual vertices
+    std::vector<gridlets::MappedScalars::SP> scalars;
+    for (auto fileName : scalarsFileNames) {
+      scalars.push_back(std::make_shared<gridlets::MappedScalars>(fileName,numCells));
+      std::cout << "mapped scalar field '" << scalars.back()->fieldName() << "' ("
+                << (scalars.back()->isDouble ? "double" : "float") << ")" << std::endl;
+    }
+
+    // without any scalars the mesh has no per-vertex attribute at
+    // all, rather than an empty one
+    if (!scalars.empty())
+      output->perVertex = std::make_shared<Attribute>();
+    if (facesFileName != "")
+      faceConnBuilder = std::make_shared<FaceConn::Builder>();
     
     process(exa);
 
+    // names (w/o the "<out>_" prefix) of all files written next to
+    // the mesh, which amrMergeDual needs to merge the parts
+    std::vector<std::string> sideFiles;
+    auto addSideFile = [&](const std::string &fileName){
+      sideFiles.push_back(fileName.substr(outFileName.size()+1));
+    };
+
+    // the first field goes into the umesh itself; umesh only has a
+    // single per-vertex attribute, so any additional ones get saved
+    // as raw float arrays in umesh vertex order
+    for (size_t f=0;f<scalars.size();f++) {
+      std::cout << "gathering vertex scalars for '" << scalars[f]->fieldName() << "'" << std::endl;
+      if (f == 0) {
+        output->perVertex->name   = scalars[f]->fieldName();
+        output->perVertex->values = gatherVertexScalars(*scalars[f]);
+      } else {
+        std::vector<float> values = gatherVertexScalars(*scalars[f]);
+        std::string fileName = outFileName+"_"+scalars[f]->fieldName()+".vertexScalars";
+        std::cout << "saving to " << fileName << std::endl;
+        std::ofstream out(fileName,std::ios::binary);
+        out.write((char*)values.data(),values.size()*sizeof(values[0]));
+        addSideFile(fileName);
+      }
+    }
+
     output->finalize();
     std::cout << "created umesh " << output->toString() << std::endl;
-    std::cout << "running sanity checks:" << std::endl;
-    sanityCheck(output);
+    if (checkLevel != CHECK_LEVEL_NONE) {
+      std::cout << "running sanity checks:" << std::endl;
+      sanityCheck(output,0,checkLevel);
+    }
     //io::saveBinaryUMesh(outFileName,output);
     std::cout << "saving to " << outFileName << std::endl;
 
@@ -955,8 +1303,22 @@ namespace umesh {
     PRINT(output->hexes.size());
     output->saveTo(outFileName);
 
+    if (faceConnBuilder) {
+      FaceConn::SP faceConn = faceConnBuilder->finalize();
+      std::cout << "saving " << prettyNumber(faceConn->faces.size())
+                << " shared faces to " << facesFileName << std::endl;
+      faceConn->saveTo(facesFileName);
+    }
+
     for (auto &level : cubesOnLevel) {
-      extractBricks(level.first,level.second,outFileName);
+      addSideFile(extractBricks(level.first,level.second,outFileName));
+      for (auto &field : scalars)
+        addSideFile(extractCubeScalars(level.first,level.second,*field,outFileName));
+    }
+    if (numParts > 1) {
+      std::ofstream list(gridlets::sideFileListName(outFileName));
+      for (auto &sideFile : sideFiles)
+        list << sideFile << std::endl;
     }
     // #if 1
     //     {
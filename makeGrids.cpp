@@ -21,11 +21,18 @@
 #include <cstring>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <fstream>
 #include <atomic>
 #include <array>
 #include <chrono>///
 #include "timer.h"
+#include "grids.h"
+#include "majorants.h"
+#include "helpers.h"
+#if UMESH_HAVE_TBB
+# include "tbb/parallel_sort.h"
+#endif
 
 
 #ifndef PRINT
@@ -43,6 +50,26 @@ using namespace std::chrono;
 
 int macroCellWidth = 8;
 const bool PRINT_EVERY_BRICK_SCALAR = false;
+gridlets::BrickOrder brickOrder = gridlets::BRICK_ORDER_NATIVE;
+/*! adaptive brick sizing: split bricks with a fill ratio below
+    minFillRatio, merge fully dense macrocells into bricks of up to
+    maxBrickExtent cubes per axis */
+bool  adaptiveBricks = false;
+float minFillRatio   = .5f;
+int   maxBrickExtent = 32;
+/*! store per-brick cube occupancy masks and compacted scalarIDs
+    (GRIDS_FLAG_OCCUPANCY) instead of -1 padded ones */
+bool  occupancyMasks = false;
+/*! store the IDs of each brick's six face neighbors
+    (GRIDS_FLAG_NEIGHBORS), computed in a post-pass over each level */
+bool  brickNeighbors = false;
+/*! with --scalars, every brick tracks the value range of the cubes
+    written into it; those get stored in a .ranges file next to each
+    .grids file, and splatted - together with the stitching elements
+    of the --umesh dual mesh - into one majorant grid */
+std::shared_ptr<gridlets::MappedScalars> scalars;
+std::vector<std::pair<box3f,range1f>> brickRangesOfAllLevels;
+int coarsestLevel = 0;
 
 struct Cube {
   vec3f lower;
@@ -103,6 +130,9 @@ struct Brick {
       * (numCubes.z+1);
     scalarIDs.resize(numScalars);
     std::fill(scalarIDs.begin(),scalarIDs.end(),-1);
+    cubeMask.resize(gridlets::numMaskWords(numCubes.x*numCubes.y*numCubes.z));
+    std::fill(cubeMask.begin(),cubeMask.end(),0u);
+    valueRange = range1f();
   }
   box3i dbg_bounds;
 
@@ -152,12 +182,17 @@ struct Brick {
     int vtkOrder[8] = { 0,1,3,2,4,5,7,6 };
     vec3i base = cellID(cube) - this->lower;
     if (dbg) PRINT(base);
+    int localCube = base.x + numCubes.x*(base.y + numCubes.y*base.z);
+    cubeMask[localCube/32] |= (1u<<(localCube%32));
     for (int iz=0;iz<2;iz++)
       for (int iy=0;iy<2;iy++)
         for (int ix=0;ix<2;ix++) {
           if (dbg) PRINT(vec3i(ix,iy,iz));
           write(base+vec3i(ix,iy,iz),cube.scalarIDs[vtkOrder[4*iz+2*iy+ix]], dbg);
         }
+    if (scalars)
+      for (int i=0;i<8;i++)
+        valueRange.extend((*scalars)[cube.scalarIDs[i]]);
   }
 
 
@@ -166,6 +201,11 @@ struct Brick {
   
   vec3i numCubes;
   std::vector<int> scalarIDs;
+  /*! one bit per cube (x-fastest), set when the cube gets written */
+  std::vector<uint32_t> cubeMask;
+  /*! range of the values of all cubes written so far (only tracked
+      with --scalars) */
+  range1f valueRange;
 };
 
 box3f worldBounds(const Brick &brick){
@@ -223,6 +263,178 @@ std::map<vec3i,Brick> makeBricksForLevel(int level,
   return mcBricks;
 }
 
+inline size_t numSlots(const box3i &box){
+  const vec3i n = box.size();
+  return size_t(n.x+1)*size_t(n.y+1)*size_t(n.z+1);
+}
+
+inline size_t volume(const box3i &box){
+  const vec3i n = box.size();
+  return size_t(n.x)*size_t(n.y)*size_t(n.z);
+}
+
+/*! recursively splits the bounding box of the given cubes at the
+    center of its largest extent until each part has a fill ratio of
+    at least minFillRatio; a split is only kept if it actually
+    reduces the number of scalar slots (ie, the splitting plane does
+    not duplicate more vertices than the empty space it removes) */
+void splitSparse(const std::vector<Cube> &cubes,
+                 std::vector<int> &cubeIDs,
+                 std::vector<std::pair<box3i,std::vector<int>>> &result){
+  box3i bounds;
+  for (int cubeID : cubeIDs)
+    bounds.extend(cellBounds(cubes[cubeID]));
+
+  if (cubeIDs.size() >= minFillRatio * volume(bounds)) {
+    result.push_back({bounds,std::move(cubeIDs)});
+    return;
+  }
+
+  const vec3i size = bounds.size();
+  const int dim = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+  if (size[dim] <= 1) {
+    // a single cell - nothing left to split
+    result.push_back({bounds,std::move(cubeIDs)});
+    return;
+  }
+  const int split = bounds.lower[dim] + size[dim]/2;
+  std::vector<int> lo, hi;
+  for (int cubeID : cubeIDs)
+    (cellID(cubes[cubeID])[dim] < split ? lo : hi).push_back(cubeID);
+  if (lo.empty() || hi.empty()) {
+    // would only recurse on the same set again
+    result.push_back({bounds,std::move(cubeIDs)});
+    return;
+  }
+
+  std::vector<std::pair<box3i,std::vector<int>>> parts;
+  splitSparse(cubes,lo,parts);
+  splitSparse(cubes,hi,parts);
+  size_t partSlots = 0;
+  for (auto &part : parts) partSlots += numSlots(part.first);
+
+  if (partSlots < numSlots(bounds)) {
+    for (auto &part : parts)
+      result.push_back(std::move(part));
+  } else {
+    // splitting doesn't pay off - keep this one as is
+    std::vector<int> all;
+    for (auto &part : parts)
+      all.insert(all.end(),part.second.begin(),part.second.end());
+    result.push_back({bounds,std::move(all)});
+  }
+}
+
+/*! adaptive alternative to makeBricksForLevel: sparse macrocells get
+    split into several smaller, denser bricks, and adjacent fully
+    dense macrocells get merged into larger bricks */
+std::vector<Brick> makeAdaptiveBricksForLevel(int level,
+                                              std::vector<Cube> &cubes){
+  auto start = high_resolution_clock::now();
+
+  std::map<vec3i,std::vector<int>> cubesInMC;
+  for (int cubeID=0;cubeID<(int)cubes.size();cubeID++)
+    cubesInMC[mcID(cubes[cubeID])].push_back(cubeID);
+
+  std::vector<vec3i> mcs;
+  std::vector<std::vector<int> *> mcCubeIDs;
+  for (auto &mc : cubesInMC) {
+    mcs.push_back(mc.first);
+    mcCubeIDs.push_back(&mc.second);
+  }
+
+  // fully dense macrocells are merge candidates; all others get split
+  // (in parallel, each macrocell on its own)
+  const size_t cubesPerMC = size_t(macroCellWidth)*macroCellWidth*macroCellWidth;
+  std::vector<std::vector<std::pair<box3i,std::vector<int>>>> splitBricks(mcs.size());
+  std::vector<char> isDense(mcs.size());
+  size_t slotsBefore = 0, volumeBefore = 0;
+  std::mutex statsMutex;
+  parallel_for(mcs.size(),[&](size_t mcIdx){
+      box3i bounds;
+      for (int cubeID : *mcCubeIDs[mcIdx])
+        bounds.extend(cellBounds(cubes[cubeID]));
+      {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        slotsBefore  += numSlots(bounds);
+        volumeBefore += volume(bounds);
+      }
+      isDense[mcIdx] = (mcCubeIDs[mcIdx]->size() == cubesPerMC);
+      if (!isDense[mcIdx])
+        splitSparse(cubes,*mcCubeIDs[mcIdx],splitBricks[mcIdx]);
+    });
+
+  std::vector<std::pair<box3i,std::vector<int>>> brickCubes;
+  for (auto &bricksOfMC : splitBricks)
+    for (auto &brick : bricksOfMC)
+      brickCubes.push_back(std::move(brick));
+
+  // greedily merge dense macrocells: grow along x, then extend the
+  // row along y, then the slab along z, as long as all macrocells in
+  // the way are dense and not yet taken, and the brick stays within
+  // maxBrickExtent cubes per axis
+  const int maxMCs = maxBrickExtent/macroCellWidth;
+  std::map<vec3i,size_t> denseMCs;
+  for (size_t mcIdx=0;mcIdx<mcs.size();mcIdx++)
+    if (isDense[mcIdx]) denseMCs[vec3i(mcs[mcIdx].z,mcs[mcIdx].y,mcs[mcIdx].x)] = mcIdx;
+  auto available = [&](const vec3i &mc)->bool {
+    auto it = denseMCs.find(vec3i(mc.z,mc.y,mc.x));
+    return it != denseMCs.end() && mcCubeIDs[it->second] != nullptr;
+  };
+  for (auto &dense : denseMCs) {
+    if (mcCubeIDs[dense.second] == nullptr) continue;
+    const vec3i begin = mcs[dense.second];
+    vec3i end = begin+vec3i(1);
+    while (end.x-begin.x < maxMCs && available(vec3i(end.x,begin.y,begin.z)))
+      end.x++;
+    for (bool grow=true; grow && end.y-begin.y < maxMCs; ) {
+      for (int x=begin.x;x<end.x && grow;x++)
+        grow = available(vec3i(x,end.y,begin.z));
+      if (grow) end.y++;
+    }
+    for (bool grow=true; grow && end.z-begin.z < maxMCs; ) {
+      for (int y=begin.y;y<end.y && grow;y++)
+        for (int x=begin.x;x<end.x && grow;x++)
+          grow = available(vec3i(x,y,end.z));
+      if (grow) end.z++;
+    }
+    std::vector<int> ids;
+    for (int z=begin.z;z<end.z;z++)
+      for (int y=begin.y;y<end.y;y++)
+        for (int x=begin.x;x<end.x;x++) {
+          const size_t mcIdx = denseMCs[vec3i(z,y,x)];
+          ids.insert(ids.end(),mcCubeIDs[mcIdx]->begin(),mcCubeIDs[mcIdx]->end());
+          mcCubeIDs[mcIdx] = nullptr;
+        }
+    brickCubes.push_back({box3i(begin*macroCellWidth,end*macroCellWidth),std::move(ids)});
+  }
+
+  std::vector<Brick> bricks(brickCubes.size());
+  parallel_for(bricks.size(),[&](size_t brickID){
+      bricks[brickID].create(brickCubes[brickID].first);
+      bricks[brickID].level = level;
+      for (int cubeID : brickCubes[brickID].second)
+        bricks[brickID].write(cubes[cubeID]);
+    });
+
+  size_t slotsAfter = 0, volumeAfter = 0;
+  for (auto &brick : brickCubes) {
+    slotsAfter  += numSlots(brick.first);
+    volumeAfter += volume(brick.first);
+  }
+  auto end = high_resolution_clock::now();
+  std::cout << "adaptive bricks for level " << level << ": "
+            << prettyNumber(mcs.size()) << " macrocells -> "
+            << prettyNumber(bricks.size()) << " bricks" << std::endl;
+  std::cout << "  fill ratio   : " << (cubes.size()/double(volumeBefore))
+            << " -> " << (cubes.size()/double(volumeAfter)) << std::endl;
+  std::cout << "  scalar slots : " << prettyNumber(slotsBefore)
+            << " -> " << prettyNumber(slotsAfter) << std::endl;
+  std::cout << "Time taken by makeAdaptiveBricksForLevel: "
+            << (end - start).count()/1000000000.0 << " s" << std::endl;
+  return bricks;
+}
+
 void printScalars(const Brick &brick){
   std::cout << "-------------------------" << std::endl; 
   std::cout << "printing scalars for brick.lower = " << brick.lower << ":" << std::endl;
@@ -261,13 +473,212 @@ void writeOBJ(std::ostream &out, const box3f &box){
   writeQuadOBJ(out,box.upper,-dy,-dz);
 }
 
-void writeBIN(std::ostream &out, const Brick &brick){
+/*! flags of the .grids files we write */
+uint32_t gridsFlags(){
+  return (occupancyMasks ? gridlets::GRIDS_FLAG_OCCUPANCY : 0)
+    | (brickNeighbors ? gridlets::GRIDS_FLAG_NEIGHBORS : 0);
+}
+
+void writeBIN(std::ostream &out, const Brick &brick, const int *neighbors=nullptr){
+  if (gridsFlags()) {
+    gridlets::writeGridlet(out,brick.lower,brick.level,brick.numCubes,
+                           brick.scalarIDs.data(),
+                           occupancyMasks ? brick.cubeMask.data() : nullptr,
+                           gridsFlags(),neighbors);
+    return;
+  }
   out.write((const char *)&brick.lower,sizeof(brick.lower));
   out.write((const char *)&brick.level,sizeof(brick.level));
   out.write((const char *)&brick.numCubes,sizeof(brick.numCubes));
   out.write((const char *)brick.scalarIDs.data(),brick.scalarIDs.size()*sizeof(brick.scalarIDs[0]));
 }
 
+/*! returns the bricks in the order they should be written in: map
+    order for 'native', or sorted along a morton/hilbert curve over
+    the bricks' lower corners */
+std::vector<const Brick *> orderBricks(std::vector<const Brick *> ordered){
+  if (brickOrder == gridlets::BRICK_ORDER_NATIVE || ordered.empty())
+    return ordered;
+
+  vec3i levelLower = ordered[0]->lower;
+  for (auto brick : ordered)
+    levelLower = min(levelLower,brick->lower);
+
+  std::vector<std::pair<uint64_t,const Brick *>> keys(ordered.size());
+  parallel_for(ordered.size(),[&](size_t i){
+      const vec3i rel = ordered[i]->lower - levelLower;
+      keys[i] = { gridlets::brickOrderKey(brickOrder,rel.x,rel.y,rel.z), ordered[i] };
+    });
+  // keys are unique since bricks of one level never share a lower corner
+#if UMESH_HAVE_TBB
+  tbb::parallel_sort(keys.begin(),keys.end());
+#else
+  std::sort(keys.begin(),keys.end());
+#endif
+  for (size_t i=0;i<keys.size();i++)
+    ordered[i] = keys[i].second;
+  return ordered;
+}
+
+struct MacroCellHash {
+  size_t operator()(const vec3i &mc) const
+  { return size_t(mc.x)*73856093 ^ size_t(mc.y)*19349663 ^ size_t(mc.z)*83492791; }
+};
+
+/*! macrocell that contains given cell (in level cell space) */
+vec3i mcOfCell(vec3i cid){
+  if (cid.x < 0) cid.x -= (macroCellWidth-1);
+  if (cid.y < 0) cid.y -= (macroCellWidth-1);
+  if (cid.z < 0) cid.z -= (macroCellWidth-1);
+  return cid / macroCellWidth;
+}
+
+/*! all AMR cells of the --cells file, to tell brick faces beyond
+    which the data continues (in stitching elements or bricks of other
+    levels) from those on the boundary of the data */
+struct CellLookup {
+  void load(const std::string &fileName){
+    std::ifstream in(fileName,std::ios::binary);
+    if (!in.good())
+      throw std::runtime_error("could not open cells file '"+fileName+"'");
+    struct { vec3i pos; int level; } cell;
+    while (in.read((char*)&cell,sizeof(cell))) {
+      if (cell.level >= (int)cellsOnLevel.size())
+        cellsOnLevel.resize(cell.level+1);
+      cellsOnLevel[cell.level].push_back(cell.pos);
+    }
+    for (auto &cells : cellsOnLevel)
+#if UMESH_HAVE_TBB
+      tbb::parallel_sort(cells.begin(),cells.end(),less);
+#else
+      std::sort(cells.begin(),cells.end(),less);
+#endif
+  }
+
+  static bool less(const vec3i &a, const vec3i &b){
+    return (a.x < b.x) || (a.x == b.x && ((a.y < b.y) || (a.y == b.y && a.z < b.z)));
+  }
+
+  /*! whether a cell of any level contains the given (world) point */
+  bool covers(const vec3f &point) const {
+    for (int level=0;level<(int)cellsOnLevel.size();level++) {
+      const float width = float(1<<level);
+      const vec3i pos(int(floorf(point.x/width))*(1<<level),
+                      int(floorf(point.y/width))*(1<<level),
+                      int(floorf(point.z/width))*(1<<level));
+      if (std::binary_search(cellsOnLevel[level].begin(),cellsOnLevel[level].end(),pos,less))
+        return true;
+    }
+    return false;
+  }
+
+  /*! lower corners of the cells, sorted, per level */
+  std::vector<std::vector<vec3i>> cellsOnLevel;
+};
+std::shared_ptr<CellLookup> cellLookup;
+
+/*! whether the data continues beyond the given face of a brick: the
+    brick's vertices on that face are the centers of a layer of AMR
+    cells of the brick's level, so there are (stitching or other-level)
+    cells beyond the face if any cell covers one of the centers of the
+    next layer of same-level cells */
+bool dataBeyondFace(const Brick &brick, int face){
+  const int dim   = face/2;
+  const int width = 1<<brick.level;
+  const int layer = (face % 2)
+    ? brick.lower[dim]+brick.numCubes[dim]+1
+    : brick.lower[dim]-1;
+  const int u = (dim+1)%3, v = (dim+2)%3;
+  for (int j=0;j<=brick.numCubes[v];j++)
+    for (int i=0;i<=brick.numCubes[u];i++) {
+      vec3i cell;
+      cell[dim] = layer;
+      cell[u]   = brick.lower[u]+i;
+      cell[v]   = brick.lower[v]+j;
+      if (cellLookup->covers(vec3f(cell*vec3i(width))+vec3f(.5f*width)))
+        return true;
+    }
+  return false;
+}
+
+/*! post-pass over the (ordered) bricks of a level: for each face, the
+    index of the brick on the other side, ie, the one that starts
+    exactly where this one ends along that axis and whose face
+    overlaps this one's (GRIDS_NEIGHBOR_MULTIPLE if there are several;
+    if there are none, GRIDS_NEIGHBOR_STITCH if the data continues
+    beyond the face, and GRIDS_NEIGHBOR_NONE if not). Candidates come
+    from a hash map from macrocells to the bricks overlapping them, so
+    every face only looks at the bricks in the one-cell-thick slab in
+    front of it. */
+std::vector<std::array<int,6>> computeBrickNeighbors(const std::vector<const Brick *> &bricks){
+  auto start = high_resolution_clock::now();
+  std::unordered_map<vec3i,std::vector<int>,MacroCellHash> bricksInMC;
+  for (int brickID=0;brickID<(int)bricks.size();brickID++) {
+    const vec3i lo = mcOfCell(bricks[brickID]->lower);
+    const vec3i hi = mcOfCell(bricks[brickID]->lower+bricks[brickID]->numCubes-vec3i(1));
+    for (int z=lo.z;z<=hi.z;z++)
+      for (int y=lo.y;y<=hi.y;y++)
+        for (int x=lo.x;x<=hi.x;x++)
+          bricksInMC[vec3i(x,y,z)].push_back(brickID);
+  }
+
+  std::vector<std::array<int,6>> neighbors(bricks.size());
+  parallel_for(bricks.size(),[&](size_t brickID){
+      const box3i self(bricks[brickID]->lower,bricks[brickID]->lower+bricks[brickID]->numCubes);
+      for (int face=0;face<6;face++) {
+        const int dim = face/2;
+        box3i slab = self;
+        if (face % 2) {
+          slab.lower[dim] = self.upper[dim];
+          slab.upper[dim] = self.upper[dim]+1;
+        } else {
+          slab.upper[dim] = self.lower[dim];
+          slab.lower[dim] = self.lower[dim]-1;
+        }
+        int found = gridlets::GRIDS_NEIGHBOR_NONE;
+        const vec3i lo = mcOfCell(slab.lower);
+        const vec3i hi = mcOfCell(slab.upper-vec3i(1));
+        for (int z=lo.z;z<=hi.z;z++)
+          for (int y=lo.y;y<=hi.y;y++)
+            for (int x=lo.x;x<=hi.x;x++) {
+              auto it = bricksInMC.find(vec3i(x,y,z));
+              if (it == bricksInMC.end()) continue;
+              for (int otherID : it->second) {
+                const box3i other(bricks[otherID]->lower,bricks[otherID]->lower+bricks[otherID]->numCubes);
+                bool touches = (face % 2)
+                  ? other.lower[dim] == self.upper[dim]
+                  : other.upper[dim] == self.lower[dim];
+                for (int d=0;d<3 && touches;d++)
+                  if (d != dim)
+                    touches = other.lower[d] < self.upper[d] && other.upper[d] > self.lower[d];
+                if (!touches || otherID == found) continue;
+                found = (found == gridlets::GRIDS_NEIGHBOR_NONE)
+                  ? otherID : gridlets::GRIDS_NEIGHBOR_MULTIPLE;
+              }
+            }
+        if (found == gridlets::GRIDS_NEIGHBOR_NONE && dataBeyondFace(*bricks[brickID],face))
+          found = gridlets::GRIDS_NEIGHBOR_STITCH;
+        neighbors[brickID][face] = found;
+      }
+    });
+
+  size_t numFaces[4] = { 0,0,0,0 };
+  for (auto &n : neighbors)
+    for (int id : n)
+      numFaces[id >= 0 ? 0 : -id]++;
+  auto end = high_resolution_clock::now();
+  std::cout << "brick faces with a neighbor: " << prettyNumber(numFaces[0])
+            << ", continuing in other elements: "
+            << prettyNumber(numFaces[-gridlets::GRIDS_NEIGHBOR_STITCH])
+            << ", on the boundary: "
+            << prettyNumber(numFaces[-gridlets::GRIDS_NEIGHBOR_NONE])
+            << ", with several: "
+            << prettyNumber(numFaces[-gridlets::GRIDS_NEIGHBOR_MULTIPLE]) << std::endl;
+  std::cout << "Time taken by computeBrickNeighbors: "
+            << (end - start).count()/1000000000.0 << " s" << std::endl;
+  return neighbors;
+}
+
 void makeGridsFor(const std::string &fileName){
   std::cout << "==================================================================" << std::endl;
   std::cout << "making grids for " << fileName << std::endl;
@@ -281,20 +692,32 @@ void makeGridsFor(const std::string &fileName){
   int rc = sscanf(ext,"_%i.cubes",&level);
   if (rc != 1) 
     throw std::runtime_error("'"+fileName+"' is not a cubes file!?");
+  coarsestLevel = std::max(coarsestLevel,level);
 
   std::vector<Cube> cubes;
   std::ifstream in(fileName,std::ios::binary);
   while (!in.eof()) {
     Cube cube;
     in.read((char*)&cube,sizeof(cube));
+    if (!in.good()) break;
     cubes.push_back(cube);
   }
-  std::map<vec3i,Brick> bricks
-    = makeBricksForLevel(level,cubes);
+  std::map<vec3i,Brick> mcBricks;
+  std::vector<Brick> adaptiveBricks;
+  std::vector<const Brick *> bricks;
+  if (::adaptiveBricks) {
+    adaptiveBricks = makeAdaptiveBricksForLevel(level,cubes);
+    for (auto &brick : adaptiveBricks)
+      bricks.push_back(&brick);
+  } else {
+    mcBricks = makeBricksForLevel(level,cubes);
+    for (auto &brick : mcBricks)
+      bricks.push_back(&brick.second);
+  }
 
   if(PRINT_EVERY_BRICK_SCALAR){
     for (auto &brick: bricks){
-      printScalars(brick.second);
+      printScalars(*brick);
     }
   }
 
@@ -302,10 +725,10 @@ void makeGridsFor(const std::string &fileName){
  int numBricksGenerated = 0;
  int numCubesInBricks = 0;
  int numScalarsInBricks = 0;
-  for (auto &brick : bricks) {
+  for (auto brick : bricks) {
     numBricksGenerated++;
-    numCubesInBricks += brick.second.numCubes.x*brick.second.numCubes.y*brick.second.numCubes.z;
-    numScalarsInBricks += brick.second.scalarIDs.size();
+    numCubesInBricks += brick->numCubes.x*brick->numCubes.y*brick->numCubes.z;
+    numScalarsInBricks += brick->scalarIDs.size();
   }
   PRINT(numBricksGenerated);
   PRINT(numCubesInBricks);
@@ -325,22 +748,32 @@ void makeGridsFor(const std::string &fileName){
   PRINT(prettyNumber(totalCubesInBricks));
   PRINT(prettyNumber(totalScalarsInBricks));
 
-  static int fileID=0;
-  std::ofstream out;
-
-  std::string outName = "./outputGrids/orig_out_level_"+std::to_string(level)+".grids";
-
-  if (fileID++ == 0)
-    out.open(outName, std::ios_base::binary);
-  else
-    out.open(outName, std::ios_base::binary|std::ios_base::app);
-  for (auto &brick : bricks) {
-    writeBIN(out, brick.second);
+  std::ofstream out, rangesOut;
+
+  std::string outName = "./outputGrids/orig_out_level_"+std::to_string(level);
+
+  if (gridlets::openOutput(out, outName+".grids"))
+    gridlets::writeGridsHeader(out, gridsFlags());
+  if (scalars)
+    gridlets::openOutput(rangesOut, outName+".ranges");
+  const std::vector<const Brick *> ordered = orderBricks(bricks);
+  std::vector<std::array<int,6>> neighbors;
+  if (brickNeighbors)
+    neighbors = computeBrickNeighbors(ordered);
+  for (size_t brickID=0;brickID<ordered.size();brickID++) {
+    const Brick *brick = ordered[brickID];
+    writeBIN(out, *brick, brickNeighbors ? neighbors[brickID].data() : nullptr);
+    if (scalars) {
+      rangesOut.write((const char *)&brick->valueRange,sizeof(brick->valueRange));
+      brickRangesOfAllLevels.push_back
+        ({gridlets::gridletWorldBounds(brick->lower,brick->level,brick->numCubes),
+          brick->valueRange});
+    }
   }
 #else
   std::ofstream out("./outputGrids/out.obj");
-  for (auto &brick : bricks) {
-    writeOBJ(out,worldBounds(brick.second));
+  for (auto brick : bricks) {
+    writeOBJ(out,worldBounds(*brick));
   }
 #endif
 }
@@ -348,8 +781,60 @@ void makeGridsFor(const std::string &fileName){
 int main(int ac, char **av){
   gridlets::timer t_sum;
 
-  for (int i=1;i<ac;i++)
-    makeGridsFor(av[i]);
+  std::vector<std::string> fileNames;
+  gridlets::MajorantOptions majorantOptions;
+  for (int i=1;i<ac;i++) {
+    if (majorantOptions.parse(av,i))
+      continue;
+    const std::string arg = av[i];
+    if (arg == "--order")
+      brickOrder = gridlets::parseBrickOrder(av[++i]);
+    else if (arg == "--adaptive")
+      adaptiveBricks = true;
+    else if (arg == "--min-fill") {
+      minFillRatio = std::stof(av[++i]);
+      if (!(minFillRatio > 0.f && minFillRatio <= 1.f))
+        throw std::runtime_error("--min-fill must be in (0,1]");
+    }
+    else if (arg == "--max-extent") {
+      maxBrickExtent = std::stoi(av[++i]);
+      // dense bricks are merged from whole macrocells, so they can't
+      // get any smaller than one
+      if (maxBrickExtent < macroCellWidth)
+        throw std::runtime_error("--max-extent must be at least the macrocell width ("
+                                 +std::to_string(macroCellWidth)+")");
+    }
+    else if (arg == "--occupancy")
+      occupancyMasks = true;
+    else if (arg == "--neighbors")
+      brickNeighbors = true;
+    else if (arg[0] == '-')
+      throw std::runtime_error("./amrMakeGrids [--order native|morton|hilbert]"
+                               " [--adaptive [--min-fill <ratio>] [--max-extent <cubes>]]"
+                               " [--occupancy] [--neighbors --cells <in.cells>]"
+                               +gridlets::MajorantOptions::usage()+
+                               " in_<level>.cubes+");
+    else
+      fileNames.push_back(arg);
+  }
+
+  scalars = majorantOptions.mapScalars();
+
+  if (brickNeighbors) {
+    if (majorantOptions.cellsFileName == "")
+      throw std::runtime_error("--neighbors requires --cells (to tell faces continuing"
+                               " in stitching elements from boundary faces)");
+    cellLookup = std::make_shared<CellLookup>();
+    cellLookup->load(majorantOptions.cellsFileName);
+  }
+
+  for (auto fileName : fileNames)
+    makeGridsFor(fileName);
+
+  if (scalars)
+    majorantOptions.writeMajorantGrid("./outputGrids/orig_out.majorants",
+                                      brickRangesOfAllLevels,coarsestLevel,
+                                      macroCellWidth,*scalars);
 
   std::cout << t_sum.elapsed() << "s for all levels" << std::endl; 
 
@@ -26,8 +26,13 @@
 #include <array>
 #include <chrono>
 #include "timer.h"
+#include "grids.h"
+#include "majorants.h"
+#include "helpers.h"
 #include <thrust/device_vector.h>
 #include <thrust/scan.h>
+#include <thrust/sort.h>
+#include <climits>
 #include <iomanip>
 
 
@@ -47,6 +52,15 @@ using namespace std::chrono;
 const int macroCellWidth = 8;
 const bool PRINT_EVERY_BRICK_SCALAR = false;
 const bool PRINT_STAT = false;
+gridlets::BrickOrder brickOrder = gridlets::BRICK_ORDER_NATIVE;
+// store per-brick cube occupancy masks and compacted scalarIDs
+bool occupancyMasks = false;
+// with --scalars, per-brick value ranges get computed in kernel 4 and
+// written as .ranges files, plus one majorant grid over all bricks
+// (and the stitching elements of the --umesh dual mesh)
+std::shared_ptr<gridlets::MappedScalars> scalars;
+std::vector<std::pair<box3f,range1f>> brickRangesOfAllLevels;
+int coarsestLevel = 0;
 
 template <typename T>
 inline T __host__ __device__ iDivUp(T a, T b){
@@ -62,11 +76,16 @@ struct Cube{
 struct Brick{
   Brick(int lvl){
     level = lvl;
+    numCubes = vec3i(0);
+    offset = 0;
+    numScalars = 0;
+    maskOffset = 0;
+    cubeMask = nullptr;
   }
 
   box3i dbg_bounds;
 
-  __device__ void setAttributes(box3i &bounds, int offsetFirst, int offsetLast){
+  __device__ void setAttributes(box3i &bounds, int offsetFirst, int offsetLast, int maskOffsetFirst){
     dbg_bounds = bounds;
     lower = bounds.lower;
 
@@ -76,6 +95,7 @@ struct Brick{
 
     offset = offsetFirst;
     numScalars = offsetLast - offsetFirst;
+    maskOffset = maskOffsetFirst;
   }
 
   vec3i lower;
@@ -84,8 +104,28 @@ struct Brick{
   int *scalarIDs;
   int offset;
   int numScalars;
+  // cube occupancy bits (x-fastest), only with occupancyMasks
+  unsigned int *cubeMask;
+  int maskOffset;
+  // value range of the brick's cubes, only with --scalars
+  range1f valueRange;
 };
 
+/* maps a float to an unsigned int with the same ordering, so value
+   ranges can be computed with integer atomicMin/atomicMax
+*/
+__device__ inline unsigned int orderedFloatBits(float f){
+  unsigned int bits = __float_as_uint(f);
+  return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+inline float fromOrderedFloatBits(unsigned int bits){
+  bits = (bits & 0x80000000u) ? (bits & 0x7fffffffu) : ~bits;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
 vec3i make_vec3i(vec3f v) { return {int(v.x), int(v.y), int(v.z)}; }
 vec3f make_vec3f(vec3i v) { return {float(v.x), float(v.y), float(v.z)}; }
 
@@ -218,8 +258,9 @@ __global__ void setBoundsAndCubes(vec3f *cubesLower, vec3i levelSizeInMC, vec3i
 
 // kernel 2
 /*  calculates the max number of scalars for each macrocell
+    (and, if requested, the number of occupancy mask words)
 */
-__global__ void calcMaxNumOfScalars(int numberOfMC, box3i *mcBounds, int *maxNumOfScalars){
+__global__ void calcMaxNumOfScalars(int numberOfMC, box3i *mcBounds, int *maxNumOfScalars, int *numMaskWords){
   int brickNum = blockIdx.x * blockDim.x + threadIdx.x;
   
   if (brickNum < numberOfMC){
@@ -227,6 +268,8 @@ __global__ void calcMaxNumOfScalars(int numberOfMC, box3i *mcBounds, int *maxNum
     int y = mcBounds[brickNum].upper.y - mcBounds[brickNum].lower.y;
     int z = mcBounds[brickNum].upper.z - mcBounds[brickNum].lower.z;
     maxNumOfScalars[brickNum] = (x+1) * (y+1) * (z+1);
+    if (numMaskWords)
+      numMaskWords[brickNum] = (x * y * z + 31) / 32;
   }
 }
 
@@ -243,24 +286,38 @@ __device__ void setResultScalarArrToEmpty(int *resultScalarsArr, int start, int
 /*  creates brick by writing its attributes 
     brick is empty if brick.numCubes == 0
 */
-__global__ void createBricks(Brick *mcBricks, int *resultScalarsArr, int totalNumOfMC, int *offsetScalars, int *offsetCubes, box3i *mcBounds){
+__global__ void createBricks(Brick *mcBricks, int *resultScalarsArr, int totalNumOfMC, int *offsetScalars, int *offsetCubes, box3i *mcBounds,
+                             int *offsetMasks, unsigned int *resultMaskArr){
   int brickNum = blockIdx.x * blockDim.x + threadIdx.x;
 
   if(brickNum < totalNumOfMC && offsetCubes[brickNum]!=0){
     //set all scalars to empty = -1
     setResultScalarArrToEmpty(resultScalarsArr, offsetScalars[brickNum], offsetScalars[brickNum+1] - 1);
 
-    mcBricks[brickNum].setAttributes(mcBounds[brickNum], offsetScalars[brickNum], offsetScalars[brickNum+1]);
+    //no cube is occupied until written
+    int maskOffset = 0;
+    if (resultMaskArr){
+      maskOffset = offsetMasks[brickNum];
+      for (int i = maskOffset; i < offsetMasks[brickNum+1]; i++)
+        resultMaskArr[i] = 0u;
+    }
+
+    mcBricks[brickNum].setAttributes(mcBounds[brickNum], offsetScalars[brickNum], offsetScalars[brickNum+1], maskOffset);
   }
 }
 
 __device__ void writeCube(vec3f &cubeLower, Brick &brick, int *scalars, int offset, int *resultScalarArray, 
-                          int cellIDx, int cellIDy, int cellIDz){
+                          int cellIDx, int cellIDy, int cellIDz, unsigned int *resultMaskArray){
 
   int baseX = cellIDx - brick.lower.x;
   int baseY = cellIDy - brick.lower.y;
   int baseZ = cellIDz - brick.lower.z;
 
+  if (resultMaskArray){
+    int localCube = baseX + brick.numCubes.x * (baseY + brick.numCubes.y * baseZ);
+    atomicOr(&resultMaskArray[brick.maskOffset + localCube / 32], 1u << (localCube % 32));
+  }
+
   int vtkOrder[8] = {0, 1, 3, 2, 4, 5, 7, 6};
 
   // index within brickx, levelSizeInMC.y, levelSizeInMC.z
@@ -278,10 +335,12 @@ __device__ void writeCube(vec3f &cubeLower, Brick &brick, int *scalars, int offs
 /*  writes scalars of each cube into one array 
     index within array is determined by linear brick number and the number 
     of scalars in previous bricks
+    (with cubeValues, also extends the value range of the cube's brick)
 */
 __global__ void writeScalars(vec3f *cubesLower, int *scalars, Brick *mcBricks,
                                 int level, int totalNumOfCubes, int *offsetScalars, int *resultScalarsArr, 
-                                vec3i levelLower, vec3i levelSizeInMC){
+                                vec3i levelLower, vec3i levelSizeInMC, unsigned int *resultMaskArr,
+                                float *cubeValues, unsigned int *rangeMinBits, unsigned int *rangeMaxBits){
   
   int cubeNum = blockIdx.x * blockDim.x + threadIdx.x;
 
@@ -299,11 +358,44 @@ __global__ void writeScalars(vec3f *cubesLower, int *scalars, Brick *mcBricks,
       cubesScalars[i] = scalars[cubeNum*8+i];
     }
 
-    writeCube(cubesLower[cubeNum], mcBricks[linearMcIDX], cubesScalars, offsetScalars[linearMcIDX], resultScalarsArr, cellIDx, cellIDy, cellIDz);
+    writeCube(cubesLower[cubeNum], mcBricks[linearMcIDX], cubesScalars, offsetScalars[linearMcIDX], resultScalarsArr, cellIDx, cellIDy, cellIDz,
+              resultMaskArr);
+
+    if (cubeValues){
+      float lo = cubeValues[cubeNum*8], hi = lo;
+      for (int i=1; i<8; i++){
+        lo = fminf(lo, cubeValues[cubeNum*8+i]);
+        hi = fmaxf(hi, cubeValues[cubeNum*8+i]);
+      }
+      atomicMin(&rangeMinBits[linearMcIDX], orderedFloatBits(lo));
+      atomicMax(&rangeMaxBits[linearMcIDX], orderedFloatBits(hi));
+    }
   } 
 
 }
 
+// optional kernel 5
+/*  computes the morton/hilbert key of each brick's lower corner
+    (relative to the lowest cell of the level); empty macrocells get
+    the largest key, so they end up behind all actual bricks
+*/
+__global__ void computeBrickOrderKeys(Brick *mcBricks, int totalNumOfMC, gridlets::BrickOrder order,
+                                      int levelLowerX, int levelLowerY, int levelLowerZ,
+                                      unsigned long long *keys, int *brickIDs){
+  int brickNum = blockIdx.x * blockDim.x + threadIdx.x;
+
+  if (brickNum < totalNumOfMC){
+    const Brick &brick = mcBricks[brickNum];
+    keys[brickNum] = (brick.numCubes.x == 0)
+      ? ULLONG_MAX
+      : gridlets::brickOrderKey(order,
+                                brick.lower.x - levelLowerX,
+                                brick.lower.y - levelLowerY,
+                                brick.lower.z - levelLowerZ);
+    brickIDs[brickNum] = brickNum;
+  }
+}
+
 // writes statistics for one level
 void writeStat(int level, int numOfBricks, int numOfCubes, float kernel1, float kernel2, float kernel3, float kernel4, float totalKernelTime, float thrustPrefSum, 
               float step1, float step2, float step3, float totalStepTime){
@@ -315,7 +407,7 @@ void writeStat(int level, int numOfBricks, int numOfCubes, float kernel1, float
     return;
   }
 
-  outFile << "level = " << level << ", number of generated cubes = " << numOfCubes-1 << ", number of generated bricks = " << numOfBricks << std::endl;
+  outFile << "level = " << level << ", number of generated cubes = " << numOfCubes << ", number of generated bricks = " << numOfBricks << std::endl;
 
   outFile << "+" << std::setfill('-') << std::setw(20) << "+" << std::setw(24) << "+" << std::setw(18) << "+" << std::endl;
   outFile << std::left << std::setfill(' ') << std::setw(20)<< "|" << "|" << std::setw(23) << "GPU (incl. alloc/cpy)" << "|" << std::setw(17) << "GPU (kernel only)" <<"|" << std::endl;
@@ -342,7 +434,9 @@ void writeStat(int level, int numOfBricks, int numOfCubes, float kernel1, float
     level-L cell space to world coordinates, take cell (i,j,k) and get
     lower=((i,j,k)+.5f)*(1<<L), and upper = lower+(1<<L) */
 std::vector<Brick> makeBricksForLevel(int level,
-                                      std::vector<vec3f> &cubesLower, std::vector<int> &scalarsArray, int *&resultScalarArray){
+                                      std::vector<vec3f> &cubesLower, std::vector<int> &scalarsArray, int *&resultScalarArray,
+                                      std::vector<int> &brickWriteOrder, unsigned int *&resultMaskArray,
+                                      const std::vector<float> &cubeValues){
   auto start = high_resolution_clock::now();
 
   gridlets::timer t;
@@ -426,7 +520,12 @@ std::vector<Brick> makeBricksForLevel(int level,
             << std::endl;
   t.reset();
   
-  calcMaxNumOfScalars<<<iDivUp(numberOfMC, numThreads), numThreads>>>(numberOfMC, ptr_mcBounds, ptr_maxNumOfScalars);
+  // offsets for occupancy masks, same scheme as for the scalars
+  int *ptr_maskOffsets = nullptr;
+  if (occupancyMasks)
+    cudaMalloc((void **)&ptr_maskOffsets, (numberOfMC + 1) * sizeof(int));
+
+  calcMaxNumOfScalars<<<iDivUp(numberOfMC, numThreads), numThreads>>>(numberOfMC, ptr_mcBounds, ptr_maxNumOfScalars, ptr_maskOffsets);
   std::cout << __LINE__ << " " << t.elapsed() << "s kernel 2 run time\n"
             << std::endl;
 
@@ -440,6 +539,13 @@ std::vector<Brick> makeBricksForLevel(int level,
   int totalNumberOfScalars;
   cudaMemcpy(&totalNumberOfScalars, ptr_maxNumOfScalars + numberOfMC, sizeof(int), cudaMemcpyDeviceToHost);
 
+  int totalNumberOfMaskWords = 0;
+  if (occupancyMasks){
+    thrust::device_ptr<int> thr_ptr_maskOffsets = thrust::device_pointer_cast(ptr_maskOffsets);
+    thrust::exclusive_scan(thr_ptr_maskOffsets, thr_ptr_maskOffsets + numberOfMC + 1, thr_ptr_maskOffsets);
+    cudaMemcpy(&totalNumberOfMaskWords, ptr_maskOffsets + numberOfMC, sizeof(int), cudaMemcpyDeviceToHost);
+  }
+
   std::cout << __LINE__ << " " << t.elapsed() << "s prefixsum run time\n"
             << std::endl;
   float prefixSumTime = t.elapsed();
@@ -460,6 +566,9 @@ std::vector<Brick> makeBricksForLevel(int level,
 
   cudaMalloc((void **)&ptr_mcBricks, numberOfMC * sizeof(Brick));
   cudaMalloc((void **)&ptr_resultScalarsArray, totalNumberOfScalars * sizeof(int));
+  unsigned int *ptr_resultMaskArray = nullptr;
+  if (occupancyMasks)
+    cudaMalloc((void **)&ptr_resultMaskArray, totalNumberOfMaskWords * sizeof(unsigned int));
   std::cout << __LINE__ << " " << t.elapsed() << "s kernel 3 alloc. \n"
             << std::endl;
   t.reset();
@@ -469,7 +578,8 @@ std::vector<Brick> makeBricksForLevel(int level,
             << std::endl;
   t.reset();
  
-  createBricks<<<iDivUp(numberOfMC, numThreads), numThreads>>>(ptr_mcBricks, ptr_resultScalarsArray, numberOfMC, ptr_maxNumOfScalars, ptr_offsetsCubes, ptr_mcBounds);
+  createBricks<<<iDivUp(numberOfMC, numThreads), numThreads>>>(ptr_mcBricks, ptr_resultScalarsArray, numberOfMC, ptr_maxNumOfScalars, ptr_offsetsCubes, ptr_mcBounds,
+                                                               ptr_maskOffsets, ptr_resultMaskArray);
   std::cout << __LINE__ << " " << t.elapsed() << "s kernel 3 run time\n" << std::endl;
   float kernel3Time= t.elapsed();
   t.reset();
@@ -491,18 +601,69 @@ std::vector<Brick> makeBricksForLevel(int level,
   t.reset();
   
   cudaMemcpy(ptr_scalarsArray, &scalarsArray[0], 8 * numOfCubes * sizeof(int), cudaMemcpyHostToDevice);
+
+  // cube corner values and per-macrocell ranges (as ordered float bits)
+  float *ptr_cubeValues = nullptr;
+  unsigned int *ptr_rangeMinBits = nullptr;
+  unsigned int *ptr_rangeMaxBits = nullptr;
+  if (!cubeValues.empty()){
+    cudaMalloc((void **)&ptr_cubeValues, numOfCubes * 8 * sizeof(float));
+    cudaMalloc((void **)&ptr_rangeMinBits, numberOfMC * sizeof(unsigned int));
+    cudaMalloc((void **)&ptr_rangeMaxBits, numberOfMC * sizeof(unsigned int));
+    cudaMemcpy(ptr_cubeValues, &cubeValues[0], 8 * numOfCubes * sizeof(float), cudaMemcpyHostToDevice);
+    cudaMemset(ptr_rangeMinBits, 0xff, numberOfMC * sizeof(unsigned int));
+    cudaMemset(ptr_rangeMaxBits, 0, numberOfMC * sizeof(unsigned int));
+  }
   std::cout << __LINE__ << " " << t.elapsed() << "s kernel 4 copy\n" << std::endl;
   t.reset();
 
   writeScalars<<<iDivUp(numOfCubes, numThreads), numThreads>>>(ptr_cubesLower, ptr_scalarsArray, ptr_mcBricks, 
                                                               level, numOfCubes, ptr_maxNumOfScalars, ptr_resultScalarsArray, 
-                                                              mcID(lowestCube), levelSizeInMC);
+                                                              mcID(lowestCube), levelSizeInMC, ptr_resultMaskArray,
+                                                              ptr_cubeValues, ptr_rangeMinBits, ptr_rangeMaxBits);
   std::cout << __LINE__ << " " << t.elapsed() << "s kernel 4 run time\n" << std::endl;
   float kernel4Time = t.elapsed();
   t.reset();
 
+  // order in which bricks get written; stays empty for native (linear macrocell) order
+  brickWriteOrder.clear();
+  if (brickOrder != gridlets::BRICK_ORDER_NATIVE){
+    unsigned long long *ptr_brickKeys;
+    int *ptr_brickIDs;
+    cudaMalloc((void **)&ptr_brickKeys, numberOfMC * sizeof(unsigned long long));
+    cudaMalloc((void **)&ptr_brickIDs, numberOfMC * sizeof(int));
+
+    const vec3i levelCellLower = cellID(lowestCube);
+    computeBrickOrderKeys<<<iDivUp(numberOfMC, numThreads), numThreads>>>(ptr_mcBricks, numberOfMC, brickOrder,
+                                                                          levelCellLower.x, levelCellLower.y, levelCellLower.z,
+                                                                          ptr_brickKeys, ptr_brickIDs);
+    thrust::sort_by_key(thrust::device_pointer_cast(ptr_brickKeys),
+                        thrust::device_pointer_cast(ptr_brickKeys) + numberOfMC,
+                        thrust::device_pointer_cast(ptr_brickIDs));
+
+    brickWriteOrder.resize(numberOfMC);
+    cudaMemcpy(&brickWriteOrder[0], ptr_brickIDs, numberOfMC * sizeof(int), cudaMemcpyDeviceToHost);
+    cudaFree(ptr_brickKeys);
+    cudaFree(ptr_brickIDs);
+    std::cout << __LINE__ << " " << t.elapsed() << "s brick ordering\n" << std::endl;
+    t.reset();
+  }
+
   cudaMemcpy(&mcBricks[0], ptr_mcBricks, numberOfMC * sizeof(Brick), cudaMemcpyDeviceToHost);
   cudaMemcpy(&resultScalarArray[0], ptr_resultScalarsArray, totalNumberOfScalars * sizeof(int), cudaMemcpyDeviceToHost);
+  if (occupancyMasks){
+    resultMaskArray = new unsigned int[totalNumberOfMaskWords];
+    cudaMemcpy(&resultMaskArray[0], ptr_resultMaskArray, totalNumberOfMaskWords * sizeof(unsigned int), cudaMemcpyDeviceToHost);
+  }
+  if (!cubeValues.empty()){
+    std::vector<unsigned int> rangeMinBits(numberOfMC), rangeMaxBits(numberOfMC);
+    cudaMemcpy(&rangeMinBits[0], ptr_rangeMinBits, numberOfMC * sizeof(unsigned int), cudaMemcpyDeviceToHost);
+    cudaMemcpy(&rangeMaxBits[0], ptr_rangeMaxBits, numberOfMC * sizeof(unsigned int), cudaMemcpyDeviceToHost);
+    for (size_t i = 0; i < numberOfMC; i++){
+      mcBricks[i].valueRange.lower = fromOrderedFloatBits(rangeMinBits[i]);
+      mcBricks[i].valueRange.upper = fromOrderedFloatBits(rangeMaxBits[i]);
+    }
+  }
   std::cout << __LINE__ << " " << t.elapsed() << "s copy result to CPU\n"
             << std::endl;
   t.reset();
@@ -512,6 +673,11 @@ std::vector<Brick> makeBricksForLevel(int level,
   cudaFree(ptr_scalarsArray);
   cudaFree(ptr_maxNumOfScalars);
   cudaFree(ptr_resultScalarsArray);
+  cudaFree(ptr_maskOffsets);
+  cudaFree(ptr_resultMaskArray);
+  cudaFree(ptr_cubeValues);
+  cudaFree(ptr_rangeMinBits);
+  cudaFree(ptr_rangeMaxBits);
 
   std::cout << __LINE__ << " " << t.elapsed() << "s free after kernel 4\n" << std::endl;
 
@@ -520,6 +686,8 @@ std::vector<Brick> makeBricksForLevel(int level,
   // set pointers: Brick-> resultScalarArray
   for (size_t i = 0; i < numberOfMC; i++){
     mcBricks[i].scalarIDs = &resultScalarArray[mcBricks[i].offset];
+    if (resultMaskArray)
+      mcBricks[i].cubeMask = &resultMaskArray[mcBricks[i].maskOffset];
   }
 
   auto timeAfterThirdStep = high_resolution_clock::now();
@@ -594,6 +762,11 @@ void writeOBJ(std::ostream &out, const box3f &box){
 }
 
 void writeBIN(std::ostream &out, const Brick &brick){
+  if (occupancyMasks){
+    gridlets::writeGridlet(out, brick.lower, brick.level, brick.numCubes,
+                           brick.scalarIDs, brick.cubeMask, gridlets::GRIDS_FLAG_OCCUPANCY);
+    return;
+  }
   out.write((const char *)&brick.lower, sizeof(brick.lower));
   out.write((const char *)&brick.level, sizeof(brick.level));
   out.write((const char *)&brick.numCubes, sizeof(brick.numCubes));
@@ -613,6 +786,7 @@ void makeGridsFor(const std::string &fileName){
   int rc = sscanf(ext, "_%i.cubes", &level);
   if (rc != 1)
     throw std::runtime_error("'" + fileName + "' is not a cubes file!?");
+  coarsestLevel = std::max(coarsestLevel, level);
 
   std::vector<vec3f> cubesLower;
   std::vector<int> scalarsArray;
@@ -624,6 +798,8 @@ void makeGridsFor(const std::string &fileName){
   while (!in.eof()){
     Cube cube;
     in.read((char *)&cube, sizeof(cube));
+    if (!in.good())
+      break;
     cubesLower.push_back(cube.lower);
     //PRINT(cube.lower);
     for (int j = 0; j < 8; j++){
@@ -633,10 +809,25 @@ void makeGridsFor(const std::string &fileName){
 
   std::cout << t2.elapsed() << "s for copying cubes from file " << std::endl;
 
+  // corner values of all cubes, for the bricks' value ranges
+  std::vector<float> cubeValues;
+  if (scalars){
+    cubeValues.resize(scalarsArray.size());
+    parallel_for_blocked(0, scalarsArray.size(), 64*1024, [&](size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++)
+          cubeValues[i] = (*scalars)[scalarsArray[i]];
+      });
+  }
+
   // scalars for each brick are stored here consecutively
   int *resultScalarArray = NULL;
 
-  std::vector<Brick> bricks = makeBricksForLevel(level, cubesLower, scalarsArray, resultScalarArray);
+  // occupancy bits for each brick are stored here consecutively
+  unsigned int *resultMaskArray = NULL;
+
+  std::vector<int> brickWriteOrder;
+  std::vector<Brick> bricks = makeBricksForLevel(level, cubesLower, scalarsArray, resultScalarArray, brickWriteOrder, resultMaskArray,
+                                                 cubeValues);
 
 #if 1
   int numBricksGenerated = 0;
@@ -668,18 +859,33 @@ void makeGridsFor(const std::string &fileName){
   PRINT(prettyNumber(totalCubesInBricks));
   PRINT(prettyNumber(totalScalarsInBricks));
   
-  static int fileID = 0;
-  std::ofstream out;
-
-  std::string outName = "./outputGrids/cuda_k4_level_"+std::to_string(level)+".grids";
-
-  if (fileID++ == 0)
-    out.open(outName, std::ios_base::binary);
-  else
-    out.open(outName, std::ios_base::binary | std::ios_base::app);
-  for (auto &brick : bricks){
-    if(brick.numCubes.x != 0){
-      writeBIN(out, brick);
+  std::ofstream out, rangesOut;
+
+  std::string outName = "./outputGrids/cuda_k4_level_"+std::to_string(level);
+
+  if (gridlets::openOutput(out, outName + ".grids"))
+    gridlets::writeGridsHeader(out, occupancyMasks ? gridlets::GRIDS_FLAG_OCCUPANCY : 0);
+  if (scalars)
+    gridlets::openOutput(rangesOut, outName + ".ranges");
+  auto writeBrick = [&](const Brick &brick){
+    writeBIN(out, brick);
+    if (scalars){
+      rangesOut.write((const char *)&brick.valueRange, sizeof(brick.valueRange));
+      brickRangesOfAllLevels.push_back
+        ({gridlets::gridletWorldBounds(brick.lower, brick.level, brick.numCubes), brick.valueRange});
+    }
+  };
+  if (brickWriteOrder.empty()){
+    for (auto &brick : bricks){
+      if(brick.numCubes.x != 0){
+        writeBrick(brick);
+      }
+    }
+  } else {
+    for (int brickID : brickWriteOrder){
+      if(bricks[brickID].numCubes.x != 0){
+        writeBrick(bricks[brickID]);
+      }
     }
   }
 #else
@@ -691,11 +897,31 @@ void makeGridsFor(const std::string &fileName){
 #endif
 
   delete[] resultScalarArray;
+  delete[] resultMaskArray;
 }
 
 int main(int ac, char **av){
   gridlets::timer t_sum;
 
+  std::vector<std::string> fileNames;
+  gridlets::MajorantOptions majorantOptions;
+  for (int i = 1; i < ac; i++){
+    if (majorantOptions.parse(av, i))
+      continue;
+    const std::string arg = av[i];
+    if (arg == "--order")
+      brickOrder = gridlets::parseBrickOrder(av[++i]);
+    else if (arg == "--occupancy")
+      occupancyMasks = true;
+    else if (arg[0] == '-')
+      throw std::runtime_error("./amrMakeGrids_cuda4 [--order native|morton|hilbert] [--occupancy]"
+                               + gridlets::MajorantOptions::usage() + " in_<level>.cubes+");
+    else
+      fileNames.push_back(arg);
+  }
+
+  scalars = majorantOptions.mapScalars();
+
   if(PRINT_STAT){
     std::ofstream outFile;
     outFile.open ("stat.txt", std::ofstream::out | std::ofstream::app);
@@ -706,17 +932,22 @@ int main(int ac, char **av){
       std::cout << "Error opening file!" << std::endl;
     }
 
-    for (int i = 1; i < ac; i++){
-      outFile << av[i] << std::endl; 
-      makeGridsFor(av[i]);
+    for (auto fileName : fileNames){
+      outFile << fileName << std::endl; 
+      makeGridsFor(fileName);
     }    
   }
   else{
-    for (int i = 1; i < ac; i++){
-      makeGridsFor(av[i]);
+    for (auto fileName : fileNames){
+      makeGridsFor(fileName);
     }
   }
 
+  if (scalars)
+    majorantOptions.writeMajorantGrid("./outputGrids/cuda_k4.majorants",
+                                      brickRangesOfAllLevels, coarsestLevel,
+                                      macroCellWidth, *scalars);
+
   std::cout << t_sum.elapsed() << "s for all levels" << std::endl; 
   t_sum.reset();
 }
@@ -0,0 +1,430 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds a level-of-detail pyramid of baked bricks over an AMR data
+   set, for previewing it before the full-resolution gridlets are
+   loaded. Each cell of a level of detail holds the volume-weighted
+   average of all AMR cells (or parts of cells) inside it. AMR cells
+   coarser than the level get split, so they fill the gaps between the
+   finer ones. Each coarser level averages the cells of the one below,
+   up to a single root brick. All levels go into one baked .grids
+   file, coarsest level first, so a viewer can stream the overview
+   before the rest; parent/child links between the bricks go into a
+   .lod file next to it (see lod.h). */
+
+#include "umesh/UMesh.h"
+#include "grids.h"
+#include "scalars.h"
+#include "lod.h"
+#include "helpers.h"
+#include <sstream>
+#include <chrono>
+#include <cmath>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  struct LogicalCell {
+    vec3i pos;
+    int   level;
+  };
+
+  /*! one cell of a level of detail: the sums of value*volume, and of
+    volume, over all (parts of) AMR cells inside it */
+  struct LodCell {
+    inline bool operator<(const LodCell &other) const { return code < other.code; }
+    inline float value() const { return float(weightedSum/volume); }
+
+    /*! morton code of the cell's position in its level's cell space,
+      relative to the pyramid's origin */
+    uint64_t code;
+    double   weightedSum;
+    double   volume;
+  };
+
+  /*! the bricks of one level of detail, ordered by the morton code
+    of their position in brick space, and already serialized */
+  struct LodLevelBricks {
+    int level;
+    std::vector<uint64_t>    codes;
+    std::vector<std::string> baked;
+  };
+
+  std::vector<LogicalCell> readCells(const std::string &fileName)
+  {
+    std::ifstream in(fileName,std::ios::binary|std::ios::ate);
+    if (!in.good())
+      throw std::runtime_error("could not open '"+fileName+"'");
+    const size_t numBytes = in.tellg();
+    if (numBytes % sizeof(LogicalCell))
+      throw std::runtime_error("size of '"+fileName+"' is not a multiple of a cell's size");
+    std::vector<LogicalCell> cells(numBytes/sizeof(LogicalCell));
+    in.seekg(0);
+    in.read((char*)cells.data(),numBytes);
+    return cells;
+  }
+
+  inline int floorDiv(int a, int b) { return a >= 0 ? a/b : -((-a+b-1)/b); }
+
+  /*! number of LOD cells on every level in [minLevel,topLevel]: AMR
+    cells at least as fine as a level merge into their ancestors
+    there, coarser ones cover 8^(cellLevel-level) cells of it. Sorts
+    all cells along a morton curve once; the ancestors of a level are
+    then runs in that order. */
+  std::vector<size_t> countLodCells(const std::vector<LogicalCell> &cells,
+                                    const vec3i &origin, int minLevel, int topLevel)
+  {
+    struct Key {
+      inline bool operator<(const Key &other) const { return code < other.code; }
+      uint64_t code;
+      int      level;
+    };
+    std::vector<Key> keys(cells.size());
+    parallel_for_blocked
+      (0,cells.size(),64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           const vec3i p = (cells[i].pos-origin) / (1<<minLevel);
+           keys[i] = { morton_encode3D(p.x,p.y,p.z), cells[i].level };
+         }
+       });
+    sortInParallel(keys);
+
+    std::vector<size_t> counts(topLevel+1,0);
+    parallel_for(topLevel+1-minLevel,[&](int i){
+        const int level = minLevel+i;
+        const int shift = 3*(level-minLevel);
+        uint64_t prevAncestor = ~0ull;
+        size_t count = 0;
+        for (auto &key : keys)
+          if (key.level > level)
+            count += 1ull<<(3*(key.level-level));
+          else if ((key.code >> shift) != prevAncestor) {
+            prevAncestor = key.code >> shift;
+            count++;
+          }
+        counts[level] = count;
+      });
+    return counts;
+  }
+
+  /*! merges runs of (sorted) LOD cells that have the same code after
+    dropping 'shift' bits; with a shift of 3, that turns one level of
+    detail into the next coarser one */
+  std::vector<LodCell> mergeLodCells(const std::vector<LodCell> &parts, int shift)
+  {
+    std::vector<LodCell> merged;
+    for (auto &part : parts) {
+      const uint64_t code = part.code >> shift;
+      if (!merged.empty() && merged.back().code == code) {
+        merged.back().weightedSum += part.weightedSum;
+        merged.back().volume      += part.volume;
+      } else
+        merged.push_back({ code, part.weightedSum, part.volume });
+    }
+    return merged;
+  }
+
+  /*! computes the (sorted) cells of the finest level of detail */
+  std::vector<LodCell> buildLodCells(const std::vector<LogicalCell> &cells,
+                                     const MappedScalars &scalars,
+                                     const vec3i &origin, int level)
+  {
+    std::vector<uint64_t> offsets(cells.size());
+    parallel_for_blocked
+      (0,cells.size(),64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           offsets[i] = cells[i].level > level ? 1ull<<(3*(cells[i].level-level)) : 1;
+       });
+    const uint64_t numParts = parallel_exclusive_scan(offsets.data(),offsets.data(),offsets.size());
+
+    std::vector<LodCell> parts(numParts);
+    parallel_for_blocked
+      (0,cells.size(),16*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           const LogicalCell cell = cells[i];
+           const double value = scalars[i];
+           const vec3i p = (cell.pos-origin) / (1<<level);
+           if (cell.level <= level) {
+             const double volume = std::ldexp(1.,3*cell.level);
+             parts[offsets[i]] = { morton_encode3D(p.x,p.y,p.z), value*volume, volume };
+             continue;
+           }
+           const int n = 1<<(cell.level-level);
+           const double volume = std::ldexp(1.,3*level);
+           LodCell *part = &parts[offsets[i]];
+           for (int iz=0;iz<n;iz++)
+             for (int iy=0;iy<n;iy++)
+               for (int ix=0;ix<n;ix++)
+                 *part++ = { morton_encode3D(p.x+ix,p.y+iy,p.z+iz), value*volume, volume };
+         }
+       });
+    sortInParallel(parts);
+    return mergeLodCells(parts,0);
+  }
+
+  /*! makes the bricks of one level of detail: every brick with at
+    least one cube (a cube exists where all eight corner cells exist),
+    plus the parent of every brick of the next finer level, so all of
+    those have one */
+  LodLevelBricks makeLevelBricks(const std::vector<LodCell> &cells,
+                                 int level, const vec3i &origin, int brickSize,
+                                 const std::vector<uint64_t> &childCodes,
+                                 uint32_t flags)
+  {
+    std::vector<uint64_t> candidates(cells.size()+childCodes.size());
+    parallel_for_blocked
+      (0,cells.size(),64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           const vec3i b = morton_decode3D(cells[i].code) / brickSize;
+           candidates[i] = morton_encode3D(b.x,b.y,b.z);
+         }
+       });
+    for (size_t i=0;i<childCodes.size();i++)
+      candidates[cells.size()+i] = childCodes[i] >> 3;
+    sortInParallel(candidates);
+    candidates.erase(std::unique(candidates.begin(),candidates.end()),candidates.end());
+
+    auto findCell = [&](const vec3i &p) -> const LodCell * {
+      const LodCell key = { morton_encode3D(p.x,p.y,p.z), 0., 0. };
+      auto it = std::lower_bound(cells.begin(),cells.end(),key);
+      return (it != cells.end() && it->code == key.code) ? &*it : nullptr;
+    };
+
+    const vec3i numCubes(brickSize);
+    const vec3i levelOrigin = origin / (1<<level);
+    const int nv = brickSize+1;
+    std::vector<std::string> baked(candidates.size());
+    std::vector<int> keep(candidates.size(),0);
+    parallel_for(candidates.size(),[&](size_t brickID){
+        const vec3i first = morton_decode3D(candidates[brickID]) * vec3i(brickSize);
+        std::vector<float>   values(size_t(nv)*nv*nv,0.f);
+        std::vector<uint8_t> exists(values.size(),0);
+        size_t i = 0;
+        for (int iz=0;iz<nv;iz++)
+          for (int iy=0;iy<nv;iy++)
+            for (int ix=0;ix<nv;ix++,i++)
+              if (const LodCell *cell = findCell(first+vec3i(ix,iy,iz))) {
+                values[i] = cell->value();
+                exists[i] = 1;
+              }
+        std::vector<uint32_t> cubeMask(numMaskWords(size_t(brickSize)*brickSize*brickSize),0u);
+        size_t cubeID = 0, numExisting = 0;
+        for (int iz=0;iz<brickSize;iz++)
+          for (int iy=0;iy<brickSize;iy++)
+            for (int ix=0;ix<brickSize;ix++,cubeID++) {
+              bool valid = true;
+              for (int c=0;c<8 && valid;c++)
+                valid = exists[(ix+(c&1)) + nv*((iy+((c>>1)&1)) + nv*(iz+(c>>2)))];
+              if (!valid) continue;
+              cubeMask[cubeID/32] |= (1u<<(cubeID%32));
+              numExisting++;
+            }
+        auto child = std::lower_bound(childCodes.begin(),childCodes.end(),candidates[brickID] << 3);
+        const bool isParent = child != childCodes.end() && (*child >> 3) == candidates[brickID];
+        if (numExisting == 0 && !isParent)
+          return;
+        std::ostringstream out;
+        writeBakedGridlet(out,levelOrigin+first,level,numCubes,
+                          values.data(),cubeMask.data(),flags);
+        baked[brickID] = out.str();
+        keep[brickID] = 1;
+      });
+
+    LodLevelBricks result;
+    result.level = level;
+    for (size_t brickID=0;brickID<candidates.size();brickID++)
+      if (keep[brickID]) {
+        result.codes.push_back(candidates[brickID]);
+        result.baked.push_back(std::move(baked[brickID]));
+      }
+    return result;
+  }
+
+  void usage(const std::string error="")
+  {
+    if (error != "")
+      std::cerr << "Error : " << error  << "\n\n";
+
+    std::cout << "Usage: ./amrMakeLOD <in.cells> -s <in.scalars> -o <out.grids>" << std::endl;
+    std::cout << "         [--budget <MB>] [--finest-level <level>] [--brick-size <n>] [--bits 32|16|8]" << std::endl;
+    std::cout << "--budget       : approximate size of the output; picks the finest level of" << std::endl;
+    std::cout << "                 detail whose pyramid fits into it (default 100)" << std::endl;
+    std::cout << "--finest-level : use this finest level instead of the one --budget picks" << std::endl;
+    std::cout << "--brick-size   : cubes per brick and axis (default 8)" << std::endl;
+    std::cout << "--bits         : 32 stores floats; 16 and 8 quantize each value relative to" << std::endl;
+    std::cout << "                 the min/max of its brick (default 32)" << std::endl;
+    std::cout << "the brick links get written to <out>.lod" << std::endl;
+    exit (error != "");
+  };
+
+  extern "C" int main(int ac, char **av)
+  {
+    std::string cellsFileName;
+    std::string scalarsFileName;
+    std::string outFileName;
+    double budgetMB = 100.;
+    int finestLevel = -1;
+    int brickSize = 8;
+    int bits = 32;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "-o")
+        outFileName = av[++i];
+      else if (arg == "-s" || arg == "--scalars")
+        scalarsFileName = av[++i];
+      else if (arg == "--budget")
+        budgetMB = std::stod(av[++i]);
+      else if (arg == "--finest-level")
+        finestLevel = std::stoi(av[++i]);
+      else if (arg == "--brick-size")
+        brickSize = std::stoi(av[++i]);
+      else if (arg == "--bits")
+        bits = std::stoi(av[++i]);
+      else if (arg[0] != '-')
+        cellsFileName = arg;
+      else
+        usage("unknown cmd-line arg '"+arg+"'");
+    }
+    if (cellsFileName == "") usage("no cells file specified");
+    if (scalarsFileName == "") usage("no scalars file specified");
+    if (outFileName == "") usage("no output file specified");
+    if (brickSize < 2) usage("--brick-size has to be at least 2");
+    const uint32_t valueFlag = gridsValueFlagForBits(bits);
+    const uint32_t flags = GRIDS_FLAG_OCCUPANCY | valueFlag;
+
+    const auto begin = std::chrono::steady_clock::now();
+    std::vector<LogicalCell> cells = readCells(cellsFileName);
+    if (cells.empty())
+      throw std::runtime_error("no cells in '"+cellsFileName+"'");
+    MappedScalars scalars(scalarsFileName,cells.size());
+
+    // the pyramid's origin is aligned to the power of two that is at
+    // least the data's extent, so every level's cell space starts at
+    // an integer cell, and the parent of (level) cell p is cell p/2
+    vec3i lower = cells[0].pos, upper = cells[0].pos;
+    int minLevel = cells[0].level, maxLevel = cells[0].level;
+    for (auto &cell : cells) {
+      lower = min(lower,cell.pos);
+      upper = max(upper,cell.pos+vec3i(1<<cell.level));
+      minLevel = std::min(minLevel,cell.level);
+      maxLevel = std::max(maxLevel,cell.level);
+    }
+    const vec3i size = upper-lower;
+    const int extent = std::max(size.x,std::max(size.y,size.z));
+    int alignLevel = 0;
+    while ((1<<alignLevel) < extent) alignLevel++;
+    const int align = 1<<alignLevel;
+    const vec3i origin(floorDiv(lower.x,align)*align,
+                       floorDiv(lower.y,align)*align,
+                       floorDiv(lower.z,align)*align);
+    if (alignLevel+1-minLevel > 21)
+      throw std::runtime_error("data set too large for 21-bit morton codes on its finest level");
+
+    const double bytesPerCell
+      = bytesPerGridletEntry(flags) * std::pow((brickSize+1.)/brickSize,3);
+    const std::vector<size_t> counts = countLodCells(cells,origin,minLevel,alignLevel);
+    if (finestLevel < 0) {
+      finestLevel = alignLevel;
+      double estimate = 0.;
+      for (int level=alignLevel;level>=minLevel;level--) {
+        estimate += counts[level]*bytesPerCell;
+        if (estimate > budgetMB*1e6) break;
+        finestLevel = level;
+      }
+    }
+    finestLevel = std::min(std::max(finestLevel,minLevel),alignLevel);
+    std::cout << "AMR levels " << minLevel << ".." << maxLevel << "; finest level of detail "
+              << finestLevel << " (" << prettyNumber(counts[finestLevel]) << " cells)" << std::endl;
+
+    // build levels from finest to coarsest, until one brick is left
+    std::vector<LodLevelBricks> levels;
+    std::vector<LodCell> lodCells = buildLodCells(cells,scalars,origin,finestLevel);
+    std::vector<uint64_t> childCodes;
+    for (int level=finestLevel;;level++) {
+      levels.push_back(makeLevelBricks(lodCells,level,origin,brickSize,childCodes,flags));
+      size_t numBytes = 0;
+      for (auto &brick : levels.back().baked) numBytes += brick.size();
+      std::cout << " level " << level << ": " << prettyNumber(lodCells.size()) << " cells, "
+                << prettyNumber(levels.back().codes.size()) << " bricks, "
+                << prettyNumber(numBytes) << "B" << std::endl;
+      if (levels.back().codes.size() <= 1 || level >= alignLevel+1)
+        break;
+      childCodes = levels.back().codes;
+      lodCells = mergeLodCells(lodCells,3);
+    }
+    if (levels.back().codes.empty())
+      throw std::runtime_error("no cell of the finest level of detail has a full cube around it");
+    std::reverse(levels.begin(),levels.end());
+
+    // links: within each level, bricks are in morton order, so the
+    // children of a brick (whose codes only differ in their lowest
+    // three bits) are consecutive
+    LodPyramid pyramid;
+    uint64_t offset = sizeof(GridsHeader);
+    for (size_t levelID=0;levelID<levels.size();levelID++) {
+      const LodLevelBricks &lb = levels[levelID];
+      const int firstBrick = (int)pyramid.bricks.size();
+      pyramid.levels.push_back({ lb.level, firstBrick, (int)lb.codes.size() });
+      for (size_t i=0;i<lb.codes.size();i++) {
+        LodPyramid::Brick brick;
+        brick.offset      = offset;
+        brick.size        = (uint32_t)lb.baked[i].size();
+        brick.parent      = -1;
+        brick.firstChild  = -1;
+        brick.numChildren = 0;
+        offset += lb.baked[i].size();
+        if (levelID > 0) {
+          const LodLevelBricks &parents = levels[levelID-1];
+          const size_t parentID
+            = std::lower_bound(parents.codes.begin(),parents.codes.end(),lb.codes[i] >> 3)
+            - parents.codes.begin();
+          brick.parent = pyramid.levels[levelID-1].firstBrick + (int)parentID;
+          LodPyramid::Brick &parent = pyramid.bricks[brick.parent];
+          if (parent.numChildren++ == 0)
+            parent.firstChild = firstBrick + (int)i;
+        }
+        pyramid.bricks.push_back(brick);
+      }
+    }
+
+    std::ofstream out(outFileName,std::ios::binary);
+    if (!out.good())
+      throw std::runtime_error("could not create grids file '"+outFileName+"'");
+    writeGridsHeader(out,flags);
+    for (auto &lb : levels)
+      for (auto &brick : lb.baked)
+        out.write(brick.data(),brick.size());
+    out.close();
+    if (!out.good())
+      throw std::runtime_error("error writing grids file '"+outFileName+"'");
+    pyramid.saveTo(lodFileNameOf(outFileName));
+
+    const double seconds = std::chrono::duration<double>
+      (std::chrono::steady_clock::now()-begin).count();
+    std::cout << "wrote " << levels.size() << " levels of detail (" << prettyNumber(pyramid.bricks.size())
+              << " bricks, " << prettyNumber(offset) << "B) to " << outFileName << " and "
+              << lodFileNameOf(outFileName) << " in " << seconds << "s" << std::endl;
+    return 0;
+  }
+
+} // ::gridlets
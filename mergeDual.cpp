@@ -0,0 +1,358 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* merges the partial dual meshes written by N 'amrMakeDualMesh
+   --part i/N' runs into the same outputs a single run would have
+   written. Every dual vertex is the center of a cell, and carries
+   that cell's scalarID as its vertexTag, so vertices shared by
+   several parts get welded by sorting on that tag - no geometric
+   comparisons needed. The .cubes and .cubeScalars files only refer to
+   scalarIDs, and just get concatenated. */
+
+#include "umesh/UMesh.h"
+#include "umesh/check.h"
+#include "umesh/FaceConn.h"
+#include "helpers.h"
+#include <fstream>
+#include <cstring>
+#include <atomic>
+#include <map>
+#include <set>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  /*! one vertex of one part, sorted by the cell it was generated for */
+  struct VertexRef {
+    size_t tag;
+    int    part;
+    int    vertexID;
+  };
+
+  inline bool operator<(const VertexRef &a, const VertexRef &b)
+  {
+    return (a.tag < b.tag)
+      || (a.tag == b.tag && a.part < b.part)
+      || (a.tag == b.tag && a.part == b.part && a.vertexID < b.vertexID);
+  }
+
+  /*! result of welding the parts' vertices */
+  struct Welding {
+    /*! index of the first vertex of each part in 'mergedID' */
+    std::vector<size_t> partBegin;
+    /*! merged vertex ID of every vertex of every part */
+    std::vector<int>    mergedID;
+    /*! for every merged vertex, one part vertex it came from */
+    std::vector<VertexRef> source;
+  };
+
+  Welding weldVertices(const std::vector<UMesh::SP> &parts)
+  {
+    Welding welding;
+    welding.partBegin.resize(parts.size()+1);
+    welding.partBegin[0] = 0;
+    for (size_t p=0;p<parts.size();p++) {
+      if (parts[p]->vertexTag.size() != parts[p]->vertices.size())
+        throw std::runtime_error("part "+std::to_string(p)
+                                 +" has no vertex tags - not written by amrMakeDualMesh --part?");
+      welding.partBegin[p+1] = welding.partBegin[p] + parts[p]->vertices.size();
+    }
+    const size_t numVertices = welding.partBegin.back();
+
+    std::vector<VertexRef> refs(numVertices);
+    for (size_t p=0;p<parts.size();p++)
+      parallel_for_blocked
+        (0,parts[p]->vertices.size(),64*1024,
+         [&](size_t begin, size_t end){
+           for (size_t i=begin;i<end;i++)
+             refs[welding.partBegin[p]+i] = { parts[p]->vertexTag[i],(int)p,(int)i };
+         });
+    sortInParallel(refs);
+
+    // the first ref of each tag becomes a merged vertex
+    std::vector<int> isFirst(numVertices);
+    std::atomic<size_t> numMismatches(0);
+    parallel_for_blocked
+      (0,numVertices,64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           isFirst[i] = (i == 0 || refs[i].tag != refs[i-1].tag);
+           if (!isFirst[i]
+               && parts[refs[i].part]->vertices[refs[i].vertexID]
+               != parts[refs[i-1].part]->vertices[refs[i-1].vertexID])
+             numMismatches++;
+         }
+       });
+    if (numMismatches)
+      throw std::runtime_error(prettyNumber(numMismatches)
+                               +" vertices with the same tag have different positions"
+                               " - parts are not from the same cells file?");
+    std::vector<int> firstID(numVertices);
+    const size_t numMerged
+      = parallel_exclusive_scan(isFirst.data(),firstID.data(),numVertices);
+    if (numMerged >= (1ull<<31))
+      throw std::runtime_error("amrMergeDual: merged vertex count "
+                               +std::to_string(numMerged)
+                               +" exceeds int32 index range (max "
+                               +std::to_string((1ull<<31)-1)+")");
+
+    welding.mergedID.resize(numVertices);
+    welding.source.resize(numMerged);
+    parallel_for_blocked
+      (0,numVertices,64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           const int newID = firstID[i] + isFirst[i] - 1;
+           welding.mergedID[welding.partBegin[refs[i].part]+refs[i].vertexID] = newID;
+           if (isFirst[i])
+             welding.source[newID] = refs[i];
+         }
+       });
+    std::cout << "welded " << prettyNumber(numVertices) << " part vertices into "
+              << prettyNumber(numMerged) << " vertices" << std::endl;
+    return welding;
+  }
+
+  /*! appends the prims of all parts, with their vertex indices
+    remapped to the merged vertices */
+  template<typename Prim>
+  void mergePrims(std::vector<Prim> &merged,
+                  const std::vector<UMesh::SP> &parts,
+                  std::vector<Prim> UMesh::*prims,
+                  const Welding &welding)
+  {
+    for (size_t p=0;p<parts.size();p++) {
+      const std::vector<Prim> &in = (*parts[p]).*prims;
+      const size_t offset = merged.size();
+      merged.resize(offset+in.size());
+      const int *mergedID = welding.mergedID.data()+welding.partBegin[p];
+      parallel_for_blocked
+        (0,in.size(),16*1024,
+         [&](size_t begin, size_t end){
+           for (size_t i=begin;i<end;i++) {
+             Prim prim = in[i];
+             for (int c=0;c<Prim::numVertices;c++)
+               prim[c] = mergedID[prim[c]];
+             merged[offset+i] = prim;
+           }
+         });
+    }
+  }
+
+  /*! gathers a per-vertex array of the merged mesh from the parts'
+    per-vertex arrays */
+  std::vector<float> mergeVertexValues(const std::vector<std::vector<float>> &partValues,
+                                       const Welding &welding)
+  {
+    std::vector<float> values(welding.source.size());
+    parallel_for_blocked
+      (0,values.size(),64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           values[i] = partValues[welding.source[i].part][welding.source[i].vertexID];
+       });
+    return values;
+  }
+
+  std::vector<char> readFile(const std::string &fileName)
+  {
+    std::ifstream in(fileName,std::ios::binary|std::ios::ate);
+    if (!in.good())
+      throw std::runtime_error("could not open '"+fileName+"'");
+    std::vector<char> bytes((size_t)in.tellg());
+    in.seekg(0);
+    in.read(bytes.data(),bytes.size());
+    return bytes;
+  }
+
+  /*! the suffixes ("0.cubes", "0_density.cubeScalars",
+    "temp.vertexScalars", ...) of the files makeDual wrote next to
+    the given part */
+  /*! the side files the given part wrote, as listed by its
+    amrMakeDualMesh run - not whatever else happens to lie next to
+    it, like files of an older run with other fields or levels */
+  std::vector<std::string> sideFileSuffixes(const std::string &partName)
+  {
+    const std::string listName = sideFileListName(partName);
+    std::ifstream in(listName);
+    if (!in.good())
+      throw std::runtime_error("could not open '"+listName+"'");
+    std::vector<std::string> suffixes;
+    for (std::string line; std::getline(in,line); )
+      if (line != "")
+        suffixes.push_back(line);
+    return suffixes;
+  }
+
+  bool endsWith(const std::string &s, const std::string &ext)
+  {
+    return s.size() >= ext.size() && s.compare(s.size()-ext.size(),ext.size(),ext) == 0;
+  }
+
+  /*! the scalar fields a part was written with: the one in its mesh,
+    plus those of its .vertexScalars files */
+  std::set<std::string> fieldsOf(const UMesh &part,
+                                 const std::vector<std::string> &suffixes)
+  {
+    std::set<std::string> fields;
+    if (part.perVertex)
+      fields.insert(part.perVertex->name);
+    const std::string ext = ".vertexScalars";
+    for (auto &suffix : suffixes)
+      if (endsWith(suffix,ext))
+        fields.insert(suffix.substr(0,suffix.size()-ext.size()));
+    return fields;
+  }
+
+  extern "C" int main(int ac, char **av)
+  {
+    std::string outFileName = "";
+    std::string facesFileName = "";
+    int numParts = 0;
+    CheckLevel checkLevel = UMESH_DEFAULT_CHECK_LEVEL;
+    const std::string usage
+      = "./amrMergeDual out.umesh --parts N [--faces out.faces] [--check none|cheap|full]\n"
+      "(merges out.umesh.part<i>of<N> etc, as written by 'amrMakeDualMesh ... -o out.umesh --part i/N')";
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "--parts") {
+        const std::string count = av[++i];
+        size_t length = 0;
+        numParts = std::stoi(count,&length);
+        if (length != count.size())
+          throw std::runtime_error("invalid --parts '"+count+"'");
+      }
+      else if (arg == "--faces")
+        facesFileName = av[++i];
+      else if (arg == "--check")
+        checkLevel = checkLevelFromString(av[++i]);
+      else if (arg[0] == '-')
+        throw std::runtime_error(usage);
+      else if (outFileName == "")
+        outFileName = arg;
+      else
+        throw std::runtime_error(usage);
+    }
+    if (outFileName == "" || numParts < 1)
+      throw std::runtime_error(usage);
+
+    std::vector<UMesh::SP> parts;
+    for (int p=0;p<numParts;p++) {
+      const std::string partName = partFileName(outFileName,p,numParts);
+      std::cout << "loading " << partName << std::endl;
+      parts.push_back(UMesh::loadFrom(partName));
+    }
+
+    Welding welding = weldVertices(parts);
+
+    UMesh::SP merged = std::make_shared<UMesh>();
+    merged->vertices.resize(welding.source.size());
+    merged->vertexTag.resize(welding.source.size());
+    parallel_for_blocked
+      (0,welding.source.size(),64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           const VertexRef &src = welding.source[i];
+           merged->vertices[i]  = parts[src.part]->vertices[src.vertexID];
+           merged->vertexTag[i] = src.tag;
+         }
+       });
+    if (parts[0]->perVertex) {
+      std::vector<std::vector<float>> partValues;
+      for (auto part : parts) {
+        if (!part->perVertex)
+          throw std::runtime_error("parts do not agree on having scalars");
+        partValues.push_back(part->perVertex->values);
+      }
+      merged->perVertex = std::make_shared<Attribute>();
+      merged->perVertex->name   = parts[0]->perVertex->name;
+      merged->perVertex->values = mergeVertexValues(partValues,welding);
+    }
+    mergePrims(merged->tets,  parts,&UMesh::tets,  welding);
+    mergePrims(merged->pyrs,  parts,&UMesh::pyrs,  welding);
+    mergePrims(merged->wedges,parts,&UMesh::wedges,welding);
+    mergePrims(merged->hexes, parts,&UMesh::hexes, welding);
+
+    merged->finalize();
+    std::cout << "created umesh " << merged->toString() << std::endl;
+    if (checkLevel != CHECK_LEVEL_NONE) {
+      std::cout << "running sanity checks:" << std::endl;
+      sanityCheck(merged,0,checkLevel);
+    }
+    std::cout << "saving to " << outFileName << std::endl;
+    merged->saveTo(outFileName);
+
+    if (facesFileName != "") {
+      FaceConn::SP faceConn = FaceConn::compute(merged);
+      std::cout << "saving " << prettyNumber(faceConn->faces.size())
+                << " shared faces to " << facesFileName << std::endl;
+      faceConn->saveTo(facesFileName);
+    }
+
+    // cubes, cube scalars, and additional vertex scalars; a part
+    // without, e.g., any cubes on some level simply has no such file,
+    // but all parts have to have been written with the same fields
+    std::map<std::string,std::vector<int>> partsOfSuffix;
+    std::set<std::string> fields;
+    for (int p=0;p<numParts;p++) {
+      const std::vector<std::string> suffixes
+        = sideFileSuffixes(partFileName(outFileName,p,numParts));
+      for (auto suffix : suffixes)
+        partsOfSuffix[suffix].push_back(p);
+      if (p == 0)
+        fields = fieldsOf(*parts[p],suffixes);
+      else if (fieldsOf(*parts[p],suffixes) != fields)
+        throw std::runtime_error("part "+std::to_string(p)
+                                 +" was written with other scalar fields than part 0");
+    }
+    for (auto &it : partsOfSuffix) {
+      const std::string &suffix = it.first;
+      const std::string fileName = outFileName+"_"+suffix;
+      if (endsWith(suffix,".cubes") || endsWith(suffix,".cubeScalars")) {
+        // same part order for the cubes and their scalars, so they
+        // stay in sync
+        std::cout << "concatenating " << fileName << std::endl;
+        std::ofstream out(fileName,std::ios::binary);
+        for (int p : it.second) {
+          std::vector<char> bytes
+            = readFile(partFileName(outFileName,p,numParts)+"_"+suffix);
+          out.write(bytes.data(),bytes.size());
+        }
+      } else if (endsWith(suffix,".vertexScalars")) {
+        if ((int)it.second.size() != numParts)
+          throw std::runtime_error("not all parts have '"+suffix+"'");
+        std::vector<std::vector<float>> partValues(numParts);
+        for (int p=0;p<numParts;p++) {
+          std::vector<char> bytes
+            = readFile(partFileName(outFileName,p,numParts)+"_"+suffix);
+          if (bytes.size() != parts[p]->vertices.size()*sizeof(float))
+            throw std::runtime_error("'"+suffix+"' of part "+std::to_string(p)
+                                     +" does not match its vertices");
+          partValues[p].resize(parts[p]->vertices.size());
+          memcpy(partValues[p].data(),bytes.data(),bytes.size());
+        }
+        std::vector<float> values = mergeVertexValues(partValues,welding);
+        std::cout << "saving " << fileName << std::endl;
+        std::ofstream out(fileName,std::ios::binary);
+        out.write((char*)values.data(),values.size()*sizeof(values[0]));
+      } else
+        std::cout << "ignoring unknown part file '" << suffix << "'" << std::endl;
+    }
+    return 0;
+  }
+
+} // ::gridlets
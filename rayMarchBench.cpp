@@ -0,0 +1,349 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* CPU reference ray marcher over the bricks and stitching elements of
+   an AMR data set, as a throughput benchmark for changes to the
+   gridlet layout: renders a few frames of an emission-absorption
+   volume rendering with fixed-step sampling, and reports rays and
+   samples per second. Tiles of the image get rendered in parallel;
+   the rays of a tile march as one packet, so every step of the packet
+   is one batched Sampler query (BVH location of all points, then one
+   vectorized interpolation loop). */
+
+#include "sampler.h"
+#include "helpers.h"
+#include <chrono>
+#include <cmath>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  struct Camera {
+    /*! direction of the ray through the center of pixel (x,y) */
+    inline vec3f dir(int x, int y) const
+    {
+      const float u = (x+.5f)/width*2.f-1.f;
+      const float v = 1.f-(y+.5f)/height*2.f;
+      return normalize(forward + u*du + v*dv);
+    }
+
+    vec3f origin, forward, du, dv;
+    int   width, height;
+  };
+
+  Camera makeCamera(const vec3f &from, const vec3f &at, const vec3f &up,
+                    float fovy, int width, int height)
+  {
+    Camera camera;
+    camera.origin  = from;
+    camera.forward = normalize(at-from);
+    const vec3f right = normalize(cross(camera.forward,up));
+    const vec3f realUp = cross(right,camera.forward);
+    const float tanHalf = tanf(fovy*float(M_PI)/360.f);
+    camera.dv = realUp * tanHalf;
+    camera.du = right * (tanHalf*width/height);
+    camera.width  = width;
+    camera.height = height;
+    return camera;
+  }
+
+  /*! parametric interval in which the ray overlaps the box; empty if
+    t0 > t1 */
+  inline void clipRay(const box3f &box, const vec3f &org, const vec3f &dir,
+                      float &t0, float &t1)
+  {
+    t0 = 0.f;
+    t1 = INFINITY;
+    for (int d=0;d<3;d++) {
+      const float rcp = 1.f/(fabsf(dir[d]) < 1e-20f ? copysignf(1e-20f,dir[d]) : dir[d]);
+      const float tLo = (box.lower[d]-org[d])*rcp;
+      const float tHi = (box.upper[d]-org[d])*rcp;
+      t0 = std::max(t0,std::min(tLo,tHi));
+      t1 = std::min(t1,std::max(tLo,tHi));
+    }
+  }
+
+  /*! simple blue-white-red color map over [0,1] */
+  inline vec3f colorMap(float f)
+  {
+    return f < .5f
+      ? vec3f(2.f*f,2.f*f,1.f)
+      : vec3f(1.f,2.f-2.f*f,2.f-2.f*f);
+  }
+
+  struct RenderStats {
+    size_t numSamples = 0;
+    size_t numHits    = 0;
+  };
+
+  struct Renderer {
+    /*! renders one tile: all of its rays march as one packet, and
+      drop out of it when they leave the bounds or get opaque */
+    RenderStats renderTile(int tileX, int tileY) const
+    {
+      RenderStats stats;
+      const int x0 = tileX*tileSize, y0 = tileY*tileSize;
+      const int x1 = std::min(x0+tileSize,camera.width);
+      const int y1 = std::min(y0+tileSize,camera.height);
+
+      struct Ray { vec3f dir; float t, tEnd; vec3f color; float alpha; int pixel; };
+      std::vector<Ray> active;
+      for (int y=y0;y<y1;y++)
+        for (int x=x0;x<x1;x++) {
+          Ray ray;
+          ray.dir = camera.dir(x,y);
+          clipRay(bounds,camera.origin,ray.dir,ray.t,ray.tEnd);
+          ray.color = vec3f(0.f);
+          ray.alpha = 0.f;
+          ray.pixel = x+camera.width*y;
+          if (ray.t <= ray.tEnd)
+            active.push_back(ray);
+          else
+            frame[ray.pixel] = vec3f(0.f);
+        }
+
+      std::vector<vec3f> points(active.size());
+      std::vector<float> values(active.size());
+      std::vector<float> stepSizes(active.size());
+      const float stepAlpha = 1.f-expf(-density*step);
+      while (!active.empty()) {
+        // the last step of a ray gets shortened to end at tEnd, so its
+        // sample stays inside the bounds
+        for (size_t i=0;i<active.size();i++) {
+          stepSizes[i] = std::min(step,active[i].tEnd-active[i].t);
+          points[i] = camera.origin + (active[i].t+.5f*stepSizes[i])*active[i].dir;
+        }
+        sampler->sample(values.data(),points.data(),active.size());
+        stats.numSamples += active.size();
+
+        size_t numActive = 0;
+        for (size_t i=0;i<active.size();i++) {
+          Ray ray = active[i];
+          const float value = values[i];
+          if (!std::isnan(value)) {
+            stats.numHits++;
+            const float f = std::min(std::max((value-valueRange.lower)*rcpValueRange,0.f),1.f);
+            const float a = f*(stepSizes[i] == step
+                               ? stepAlpha
+                               : 1.f-expf(-density*stepSizes[i]));
+            ray.color = ray.color + ((1.f-ray.alpha)*a)*colorMap(f);
+            ray.alpha += (1.f-ray.alpha)*a;
+          }
+          const bool lastStep = (stepSizes[i] < step) || (ray.t+step >= ray.tEnd);
+          ray.t += stepSizes[i];
+          if (!lastStep && ray.alpha < .99f)
+            active[numActive++] = ray;
+          else
+            frame[ray.pixel] = ray.color;
+        }
+        active.resize(numActive);
+      }
+      return stats;
+    }
+
+    Sampler::SP sampler;
+    Camera      camera;
+    box3f       bounds;
+    range1f     valueRange;
+    float       rcpValueRange;
+    float       step;
+    float       density;
+    int         tileSize;
+    mutable std::vector<vec3f> frame;
+  };
+
+  void savePPM(const std::string &fileName, const std::vector<vec3f> &pixels,
+               int width, int height)
+  {
+    std::ofstream out(fileName,std::ios::binary);
+    if (!out.good())
+      throw std::runtime_error("could not create image file '"+fileName+"'");
+    out << "P6\n" << width << " " << height << "\n255\n";
+    for (auto &pixel : pixels)
+      for (int c=0;c<3;c++) {
+        const uint8_t byte = uint8_t(std::min(std::max(pixel[c],0.f),1.f)*255.f+.5f);
+        out.write((const char *)&byte,1);
+      }
+  }
+
+  void usage(const std::string error="")
+  {
+    if (error != "")
+      std::cerr << "Error : " << error  << "\n\n";
+
+    std::cout << "Usage: ./amrRayMarchBench --cells <in.cells> -s <in.scalars>" << std::endl;
+    std::cout << "         [--grids <in.grids>]* [--umesh <dual.umesh>]" << std::endl;
+    std::cout << "         [--size <w> <h>] [--from <x> <y> <z>] [--at <x> <y> <z>] [--up <x> <y> <z>] [--fovy <deg>]" << std::endl;
+    std::cout << "         [--step <dt>] [--density <d>] [--range <lo> <hi>] [--tile <n>] [--frames <n>] [-o <image.ppm>]" << std::endl;
+    std::cout << "--size    : image resolution (default 512 512)" << std::endl;
+    std::cout << "--from/at : camera position and look-at point (default: looking at the center" << std::endl;
+    std::cout << "            of the data's bounds from outside, along a diagonal)" << std::endl;
+    std::cout << "--step    : world-space sampling distance (default .5, half a finest cell)" << std::endl;
+    std::cout << "--density : extinction at the top of the value range (default 4/diagonal)" << std::endl;
+    std::cout << "--range   : value range the transfer function ramps over (default: of the scalars)" << std::endl;
+    std::cout << "--tile    : tile size in pixels; the rays of a tile march as one packet (default 16)" << std::endl;
+    std::cout << "--frames  : number of frames to render and time (default 3)" << std::endl;
+    exit (error != "");
+  };
+
+  extern "C" int main(int ac, char **av)
+  {
+    std::string cellsFileName;
+    std::string scalarsFileName;
+    std::string umeshFileName;
+    std::string imageFileName;
+    std::vector<std::string> gridsFileNames;
+    int width = 512, height = 512;
+    vec3f from, at, up(0.f,1.f,0.f);
+    bool haveFrom = false, haveAt = false;
+    float fovy = 60.f;
+    float step = .5f;
+    float density = 0.f;
+    range1f valueRange;
+    int tileSize = 16;
+    int numFrames = 3;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "--cells")
+        cellsFileName = av[++i];
+      else if (arg == "-s" || arg == "--scalars")
+        scalarsFileName = av[++i];
+      else if (arg == "--grids")
+        gridsFileNames.push_back(av[++i]);
+      else if (arg == "--umesh")
+        umeshFileName = av[++i];
+      else if (arg == "-o")
+        imageFileName = av[++i];
+      else if (arg == "--size") {
+        width  = std::stoi(av[++i]);
+        height = std::stoi(av[++i]);
+      } else if (arg == "--from") {
+        from.x = std::stof(av[++i]);
+        from.y = std::stof(av[++i]);
+        from.z = std::stof(av[++i]);
+        haveFrom = true;
+      } else if (arg == "--at") {
+        at.x = std::stof(av[++i]);
+        at.y = std::stof(av[++i]);
+        at.z = std::stof(av[++i]);
+        haveAt = true;
+      } else if (arg == "--up") {
+        up.x = std::stof(av[++i]);
+        up.y = std::stof(av[++i]);
+        up.z = std::stof(av[++i]);
+      } else if (arg == "--fovy")
+        fovy = std::stof(av[++i]);
+      else if (arg == "--step")
+        step = std::stof(av[++i]);
+      else if (arg == "--density")
+        density = std::stof(av[++i]);
+      else if (arg == "--range") {
+        valueRange.lower = std::stof(av[++i]);
+        valueRange.upper = std::stof(av[++i]);
+      } else if (arg == "--tile")
+        tileSize = std::stoi(av[++i]);
+      else if (arg == "--frames")
+        numFrames = std::stoi(av[++i]);
+      else
+        usage("unknown cmd-line arg '"+arg+"'");
+    }
+    if (cellsFileName == "") usage("no cells file specified");
+    if (scalarsFileName == "") usage("no scalars file specified");
+    if (gridsFileNames.empty() && umeshFileName == "")
+      usage("neither grids nor umesh file specified");
+    if (width <= 0 || height <= 0) usage("invalid image size");
+    if (step <= 0.f) usage("step has to be positive");
+    if (tileSize <= 0) usage("invalid tile size");
+    if (numFrames <= 0) usage("need at least one frame");
+
+    Renderer renderer;
+    const double buildTime = timeOf([&]{
+        renderer.sampler = Sampler::load(cellsFileName,scalarsFileName,
+                                         gridsFileNames,umeshFileName);
+      });
+    renderer.bounds = renderer.sampler->getBounds();
+    if (renderer.bounds.empty())
+      throw std::runtime_error("nothing to render (no bricks or elements)");
+    std::cout << "loaded and built sampler over " << prettyNumber(renderer.sampler->numBricks()) << " bricks and "
+              << prettyNumber(renderer.sampler->numElements()) << " stitching elements in "
+              << buildTime << "s; bounds " << renderer.bounds << std::endl;
+
+    if (valueRange.lower > valueRange.upper) {
+      MappedScalars scalars = mapScalars(scalarsFileName,cellsFileName);
+      std::vector<range1f> blockRanges(divRoundUp(scalars.size(),size_t(64*1024)));
+      parallel_for(blockRanges.size(),[&](size_t blockID){
+          const size_t end = std::min(scalars.size(),(blockID+1)*64*1024);
+          for (size_t i=blockID*64*1024;i<end;i++)
+            blockRanges[blockID].extend(scalars[i]);
+        });
+      for (auto &range : blockRanges) valueRange.extend(range);
+    }
+    const float diagonal = length(renderer.bounds.size());
+    const vec3f center = renderer.bounds.center();
+    if (!haveAt)   at = center;
+    if (!haveFrom) from = center + normalize(vec3f(.7f,.5f,1.f))*(1.2f*diagonal);
+    renderer.camera = makeCamera(from,at,up,fovy,width,height);
+    renderer.valueRange = valueRange;
+    renderer.rcpValueRange = valueRange.upper > valueRange.lower
+      ? 1.f/(valueRange.upper-valueRange.lower) : 0.f;
+    renderer.step = step;
+    renderer.density = density > 0.f ? density : 4.f/diagonal;
+    renderer.tileSize = tileSize;
+    renderer.frame.resize(size_t(width)*height);
+
+    const int numTilesX = divRoundUp(width,tileSize);
+    const int numTilesY = divRoundUp(height,tileSize);
+    std::cout << "rendering " << numFrames << " frames of " << width << "x" << height
+              << " in " << numTilesX*numTilesY << " tiles of " << tileSize << "x" << tileSize
+              << ", step " << step << ", value range " << valueRange << std::endl;
+    std::vector<RenderStats> tileStats(size_t(numTilesX)*numTilesY);
+    double bestTime = INFINITY, totalTime = 0.;
+    for (int frameID=0;frameID<numFrames;frameID++) {
+      const auto begin = std::chrono::steady_clock::now();
+      parallel_for(tileStats.size(),[&](size_t tileID){
+          tileStats[tileID] = renderer.renderTile(int(tileID % numTilesX),int(tileID / numTilesX));
+        });
+      const double time = std::chrono::duration<double>
+        (std::chrono::steady_clock::now()-begin).count();
+      bestTime = std::min(bestTime,time);
+      totalTime += time;
+    }
+    RenderStats stats;
+    for (auto &tile : tileStats) {
+      stats.numSamples += tile.numSamples;
+      stats.numHits    += tile.numHits;
+    }
+
+    const size_t numRays = size_t(width)*height;
+    std::cout << "frame time: " << prettyDouble(bestTime) << "s best, "
+              << prettyDouble(totalTime/numFrames) << "s average" << std::endl;
+    std::cout << "rays/s    : " << prettyNumber(size_t(numRays/bestTime)) << std::endl;
+    std::cout << "samples/s : " << prettyNumber(size_t(stats.numSamples/bestTime))
+              << " (" << prettyNumber(stats.numSamples) << " samples per frame, "
+              << int(100.*stats.numHits/std::max(stats.numSamples,size_t(1)))
+              << "% inside a brick or element)" << std::endl;
+
+    if (imageFileName != "") {
+      savePPM(imageFileName,renderer.frame,width,height);
+      std::cout << "saved last frame to " << imageFileName << std::endl;
+    }
+    return 0;
+  }
+
+} // ::gridlets
@@ -0,0 +1,394 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* reorders the cells (and thus, the scalarIDs) of an AMR data set
+   into a locality-preserving order, rewrites the scalar files in
+   that order, and remaps all scalarIDs stored in the derived .grids,
+   .cubes, and dual .umesh files, so a renderer fetching the scalars
+   of one brick touches a few contiguous pages instead of scattering
+   all over the .scalars file */
+
+#include "umesh/UMesh.h"
+#include "scalars.h"
+#include "grids.h"
+#include "helpers.h"
+#include <fstream>
+#include <cstring>
+#include <atomic>
+#include <array>
+#include <filesystem>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  struct LogicalCell {
+    vec3i pos;
+    int   level;
+  };
+
+  /*! same layout as the cubes makeDual writes into the .cubes files */
+  struct Cube {
+    vec3f lower;
+    int   level;
+    std::array<int,8> scalarIDs;
+  };
+
+  template<typename T>
+  std::vector<T> readArray(const std::string &fileName)
+  {
+    std::ifstream in(fileName,std::ios::binary|std::ios::ate);
+    if (!in.good())
+      throw std::runtime_error("could not open '"+fileName+"'");
+    const size_t numBytes = in.tellg();
+    if (numBytes % sizeof(T))
+      throw std::runtime_error("size of '"+fileName+"' is not a multiple of its record size");
+    std::vector<T> items(numBytes/sizeof(T));
+    in.seekg(0);
+    in.read((char*)items.data(),numBytes);
+    return items;
+  }
+
+  template<typename T>
+  void writeArray(const std::string &fileName, const std::vector<T> &items)
+  {
+    std::ofstream out(fileName,std::ios::binary);
+    if (!out.good())
+      throw std::runtime_error("could not create '"+fileName+"'");
+    out.write((const char*)items.data(),items.size()*sizeof(T));
+  }
+
+  // ##################################################################
+  // computing the permutation
+  // ##################################################################
+
+  /*! orders the cells by level, and within each level by the morton
+    code of the cell's position in that level's cell space */
+  std::vector<int> computeMortonOrder(const std::vector<LogicalCell> &cells)
+  {
+    std::map<int,vec3i> levelLower;
+    for (auto &cell : cells) {
+      vec3i cellPos = cell.pos / (1<<cell.level);
+      auto it = levelLower.find(cell.level);
+      if (it == levelLower.end())
+        levelLower[cell.level] = cellPos;
+      else
+        it->second = min(it->second,cellPos);
+    }
+    std::vector<vec3i> lowerOf(levelLower.rbegin()->first+1);
+    for (auto &ll : levelLower) lowerOf[ll.first] = ll.second;
+
+    struct Key {
+      inline bool operator<(const Key &other) const
+      {
+        return (level < other.level)
+          || (level == other.level && code < other.code)
+          || (level == other.level && code == other.code && cellID < other.cellID);
+      }
+      uint64_t code;
+      int      level;
+      int      cellID;
+    };
+    std::vector<Key> keys(cells.size());
+    parallel_for_blocked
+      (0,cells.size(),64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           const LogicalCell cell = cells[i];
+           const vec3i p = cell.pos / (1<<cell.level) - lowerOf[cell.level];
+           keys[i] = { morton_encode3D(p.x,p.y,p.z), cell.level, (int)i };
+         }
+       });
+    sortInParallel(keys);
+
+    std::vector<int> newToOld(cells.size());
+    parallel_for_blocked
+      (0,keys.size(),64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           newToOld[i] = keys[i].cellID;
+       });
+    return newToOld;
+  }
+
+  /*! orders the scalars in the order they are first referenced by
+    the bricks of the given .grids files (files and bricks in the
+    order given); scalars not referenced by any brick (ie, those only
+    used by the dual mesh's stitching elements) go to the end, in
+    their original order */
+  std::vector<int> computeBrickOrder(size_t numCells,
+                                     const std::vector<std::string> &gridsFileNames)
+  {
+    std::vector<std::atomic<uint64_t>> firstUse(numCells);
+    parallel_for_blocked
+      (0,numCells,64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           firstUse[i] = uint64_t(-1);
+       });
+
+    uint64_t slotOffset = 0;
+    for (auto fileName : gridsFileNames) {
+      std::cout << "reading bricks from " << fileName << std::endl;
+      std::vector<Gridlet> bricks = readGrids(fileName);
+      std::vector<uint64_t> brickOffset(bricks.size());
+      for (size_t i=0;i<bricks.size();i++) {
+        brickOffset[i] = slotOffset;
+        slotOffset += bricks[i].numScalars();
+      }
+      parallel_for
+        (bricks.size(),
+         [&](size_t brickID){
+           const Gridlet &brick = bricks[brickID];
+           for (size_t i=0;i<brick.scalarIDs.size();i++) {
+             const int scalarID = brick.scalarIDs[i];
+             if (scalarID < 0) continue;
+             if (size_t(scalarID) >= numCells)
+               throw std::runtime_error("brick in '"+fileName+"' references a scalarID beyond the number of cells");
+             const uint64_t slot = brickOffset[brickID]+i;
+             uint64_t prev = firstUse[scalarID];
+             while (slot < prev && !firstUse[scalarID].compare_exchange_weak(prev,slot));
+           }
+         });
+    }
+
+    std::vector<std::pair<uint64_t,int>> keys(numCells);
+    parallel_for_blocked
+      (0,numCells,64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           keys[i] = { firstUse[i].load(), (int)i };
+       });
+    sortInParallel(keys);
+
+    std::vector<int> newToOld(numCells);
+    parallel_for_blocked
+      (0,numCells,64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           newToOld[i] = keys[i].second;
+       });
+    return newToOld;
+  }
+
+  // ##################################################################
+  // applying the permutation
+  // ##################################################################
+
+  /*! rewrites the given scalar file in the new order, in chunks of
+    a few million scalars each, and w/o changing its type */
+  void reorderScalars(const MappedScalars &scalars,
+                      const std::vector<int> &newToOld,
+                      const std::string &outFileName)
+  {
+    std::ofstream out(outFileName,std::ios::binary);
+    if (!out.good())
+      throw std::runtime_error("could not create '"+outFileName+"'");
+    const size_t scalarSize = scalars.bytesPerScalar();
+    const char *src = (const char *)scalars.data();
+    const size_t chunkSize = 1ull<<24;
+    std::vector<char> chunk(std::min(chunkSize,newToOld.size())*scalarSize);
+    for (size_t chunkBegin=0;chunkBegin<newToOld.size();chunkBegin+=chunkSize) {
+      const size_t chunkEnd = std::min(chunkBegin+chunkSize,newToOld.size());
+      parallel_for_blocked
+        (chunkBegin,chunkEnd,16*1024,
+         [&](size_t begin, size_t end){
+           for (size_t i=begin;i<end;i++)
+             memcpy(chunk.data()+(i-chunkBegin)*scalarSize,
+                    src+size_t(newToOld[i])*scalarSize,
+                    scalarSize);
+         });
+      out.write(chunk.data(),(chunkEnd-chunkBegin)*scalarSize);
+    }
+  }
+
+  void remapGrids(const std::string &inFileName,
+                  const std::vector<int> &oldToNew,
+                  const std::string &outFileName)
+  {
+    uint32_t flags = 0;
+    std::vector<Gridlet> bricks = readGrids(inFileName,&flags);
+    parallel_for
+      (bricks.size(),
+       [&](size_t brickID){
+         for (auto &scalarID : bricks[brickID].scalarIDs)
+           if (scalarID >= 0) scalarID = oldToNew[scalarID];
+       });
+    writeGrids(outFileName,bricks,flags);
+  }
+
+  void remapCubes(const std::string &inFileName,
+                  const std::vector<int> &oldToNew,
+                  const std::string &outFileName)
+  {
+    std::vector<Cube> cubes = readArray<Cube>(inFileName);
+    parallel_for_blocked
+      (0,cubes.size(),16*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           for (auto &scalarID : cubes[i].scalarIDs)
+             scalarID = oldToNew[scalarID];
+       });
+    writeArray(outFileName,cubes);
+  }
+
+  void remapUMesh(const std::string &inFileName,
+                  const std::vector<int> &oldToNew,
+                  const std::string &outFileName)
+  {
+    UMesh::SP mesh = UMesh::loadFrom(inFileName);
+    if (mesh->vertexTag.size() != mesh->vertices.size())
+      throw std::runtime_error("'"+inFileName+"' has no per-vertex scalarIDs (vertexTag) to remap");
+    parallel_for_blocked
+      (0,mesh->vertexTag.size(),16*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           mesh->vertexTag[i] = oldToNew[mesh->vertexTag[i]];
+       });
+    mesh->saveTo(outFileName);
+  }
+
+  void usage(const std::string error="")
+  {
+    if (error != "")
+      std::cerr << "Error : " << error  << "\n\n";
+
+    std::cout << "Usage: ./amrReorderScalars <in.cells> -o <outDir>" << std::endl;
+    std::cout << "         [--order morton|bricks] [--permutation <in.perm>]" << std::endl;
+    std::cout << "         [-s|--scalars <in.scalars>]* [--grids <in.grids>]*" << std::endl;
+    std::cout << "         [--cubes <in.cubes>]* [--umesh <in.umesh>]*" << std::endl;
+    std::cout << "--order morton : per level, order cells along a morton curve (default)" << std::endl;
+    std::cout << "--order bricks : order scalars as they are first referenced by the given .grids files" << std::endl;
+    std::cout << "--permutation  : apply a previously computed <outDir>/scalarOrder.perm (eg, to further time steps)" << std::endl;
+    std::cout << "all given files get rewritten into <outDir>, under the same file name," << std::endl;
+    std::cout << "together with the reordered .cells file and the permutation itself (scalarOrder.perm)" << std::endl;
+    exit (error != "");
+  };
+
+  std::string outPath(const std::string &outDir, const std::string &inFileName)
+  {
+    return (std::filesystem::path(outDir) / std::filesystem::path(inFileName).filename()).string();
+  }
+
+  extern "C" int main(int ac, char **av)
+  {
+    std::string cellsFileName;
+    std::string outDir;
+    std::string order = "morton";
+    std::string permFileName;
+    std::vector<std::string> scalarsFileNames;
+    std::vector<std::string> gridsFileNames;
+    std::vector<std::string> cubesFileNames;
+    std::vector<std::string> umeshFileNames;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "-o")
+        outDir = av[++i];
+      else if (arg == "--order")
+        order = av[++i];
+      else if (arg == "--permutation")
+        permFileName = av[++i];
+      else if (arg == "-s" || arg == "--scalars")
+        scalarsFileNames.push_back(av[++i]);
+      else if (arg == "--grids")
+        gridsFileNames.push_back(av[++i]);
+      else if (arg == "--cubes")
+        cubesFileNames.push_back(av[++i]);
+      else if (arg == "--umesh")
+        umeshFileNames.push_back(av[++i]);
+      else if (arg[0] != '-')
+        cellsFileName = arg;
+      else
+        usage("unknown cmd-line arg '"+arg+"'");
+    }
+    if (cellsFileName == "") usage("no input cells file specified");
+    if (outDir == "") usage("no output directory specified");
+    if (order != "morton" && order != "bricks") usage("unknown order '"+order+"'");
+    if (order == "bricks" && gridsFileNames.empty() && permFileName == "")
+      usage("brick order requires at least one --grids file");
+    std::filesystem::create_directories(outDir);
+
+    std::cout << "reading cells from " << cellsFileName << std::endl;
+    std::vector<LogicalCell> cells = readArray<LogicalCell>(cellsFileName);
+    std::cout << "found " << prettyNumber(cells.size()) << " cells" << std::endl;
+    if (cells.empty() || cells.size() >= 0x7fffffffull)
+      throw std::runtime_error("invalid number of cells");
+
+    std::vector<int> newToOld;
+    if (permFileName != "") {
+      std::cout << "reading permutation from " << permFileName << std::endl;
+      newToOld = readArray<int>(permFileName);
+      if (newToOld.size() != cells.size())
+        throw std::runtime_error("permutation does not match the number of cells");
+    } else if (order == "morton") {
+      std::cout << "computing morton order of cells" << std::endl;
+      newToOld = computeMortonOrder(cells);
+    } else {
+      std::cout << "computing brick-major order of scalars" << std::endl;
+      newToOld = computeBrickOrder(cells.size(),gridsFileNames);
+    }
+
+    std::vector<int> oldToNew(newToOld.size(),-1);
+    parallel_for_blocked
+      (0,newToOld.size(),64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           const int oldID = newToOld[i];
+           if (oldID < 0 || size_t(oldID) >= oldToNew.size())
+             throw std::runtime_error("invalid permutation");
+           oldToNew[oldID] = (int)i;
+         }
+       });
+    for (auto newID : oldToNew)
+      if (newID < 0) throw std::runtime_error("invalid permutation (not a bijection)");
+
+    {
+      std::vector<LogicalCell> reordered(cells.size());
+      parallel_for_blocked
+        (0,cells.size(),64*1024,
+         [&](size_t begin, size_t end){
+           for (size_t i=begin;i<end;i++)
+             reordered[i] = cells[newToOld[i]];
+         });
+      std::cout << "saving reordered cells to " << outPath(outDir,cellsFileName) << std::endl;
+      writeArray(outPath(outDir,cellsFileName),reordered);
+      writeArray(outPath(outDir,"scalarOrder.perm"),newToOld);
+    }
+
+    for (auto fileName : scalarsFileNames) {
+      std::cout << "reordering scalars " << fileName << std::endl;
+      MappedScalars scalars(fileName,cells.size());
+      reorderScalars(scalars,newToOld,outPath(outDir,fileName));
+    }
+    for (auto fileName : gridsFileNames) {
+      std::cout << "remapping bricks " << fileName << std::endl;
+      remapGrids(fileName,oldToNew,outPath(outDir,fileName));
+    }
+    for (auto fileName : cubesFileNames) {
+      std::cout << "remapping cubes " << fileName << std::endl;
+      remapCubes(fileName,oldToNew,outPath(outDir,fileName));
+    }
+    for (auto fileName : umeshFileNames) {
+      std::cout << "remapping dual mesh " << fileName << std::endl;
+      remapUMesh(fileName,oldToNew,outPath(outDir,fileName));
+    }
+    std::cout << "done" << std::endl;
+    return 0;
+  }
+
+} // ::gridlets
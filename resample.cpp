@@ -0,0 +1,180 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* resamples the bricks and stitching elements of an AMR data set onto
+   a uniform grid over a given box, and writes that as a raw float
+   volume (x fastest). The volume gets computed and written one slab of
+   z-slices at a time, so the output can be much larger than memory. */
+
+#include "sampler.h"
+#include <chrono>
+#include <future>
+#include <cmath>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  void usage(const std::string error="")
+  {
+    if (error != "")
+      std::cerr << "Error : " << error  << "\n\n";
+
+    std::cout << "Usage: ./amrResample --cells <in.cells> -s <in.scalars>" << std::endl;
+    std::cout << "         [--grids <in.grids>]* [--umesh <dual.umesh>]" << std::endl;
+    std::cout << "         --dims <nx> <ny> <nz> -o <out.raw>" << std::endl;
+    std::cout << "         [--box <x0> <y0> <z0> <x1> <y1> <z1>] [--fill <value>] [--slab-size <numSlices>]" << std::endl;
+    std::cout << "--dims      : resolution of the output volume; voxel (i,j,k) gets sampled" << std::endl;
+    std::cout << "              at its center, box.lower+(i+.5,j+.5,k+.5)*box.size()/dims" << std::endl;
+    std::cout << "--box       : world-space region to resample (default: bounds of all" << std::endl;
+    std::cout << "              bricks and elements); only bricks and elements overlapping" << std::endl;
+    std::cout << "              it get loaded" << std::endl;
+    std::cout << "--fill      : value for voxels not covered by any brick or element (default 0)" << std::endl;
+    std::cout << "--slab-size : number of z-slices computed (and kept in memory) at a time" << std::endl;
+    std::cout << "              (default: as many as fit into 64M voxels)" << std::endl;
+    exit (error != "");
+  };
+
+  extern "C" int main(int ac, char **av)
+  {
+    std::string cellsFileName;
+    std::string scalarsFileName;
+    std::string umeshFileName;
+    std::string outFileName;
+    std::vector<std::string> gridsFileNames;
+    vec3i dims(0);
+    box3f box;
+    float fillValue = 0.f;
+    int slabSize = 0;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "--cells")
+        cellsFileName = av[++i];
+      else if (arg == "-s" || arg == "--scalars")
+        scalarsFileName = av[++i];
+      else if (arg == "--grids")
+        gridsFileNames.push_back(av[++i]);
+      else if (arg == "--umesh")
+        umeshFileName = av[++i];
+      else if (arg == "-o")
+        outFileName = av[++i];
+      else if (arg == "--dims") {
+        dims.x = std::stoi(av[++i]);
+        dims.y = std::stoi(av[++i]);
+        dims.z = std::stoi(av[++i]);
+      } else if (arg == "--box") {
+        box.lower.x = std::stof(av[++i]);
+        box.lower.y = std::stof(av[++i]);
+        box.lower.z = std::stof(av[++i]);
+        box.upper.x = std::stof(av[++i]);
+        box.upper.y = std::stof(av[++i]);
+        box.upper.z = std::stof(av[++i]);
+        if (box.empty()) usage("empty box");
+      } else if (arg == "--fill")
+        fillValue = std::stof(av[++i]);
+      else if (arg == "--slab-size")
+        slabSize = std::stoi(av[++i]);
+      else
+        usage("unknown cmd-line arg '"+arg+"'");
+    }
+    if (cellsFileName == "") usage("no cells file specified");
+    if (scalarsFileName == "") usage("no scalars file specified");
+    if (outFileName == "") usage("no output file specified");
+    if (gridsFileNames.empty() && umeshFileName == "")
+      usage("neither grids nor umesh file specified");
+    if (dims.x <= 0 || dims.y <= 0 || dims.z <= 0)
+      usage("no (or invalid) output dims specified");
+
+    const auto beginLoad = std::chrono::steady_clock::now();
+    Sampler::SP sampler = Sampler::load(cellsFileName,scalarsFileName,
+                                        gridsFileNames,umeshFileName,box);
+    if (box.empty()) box = sampler->getBounds();
+    const double loadTime = std::chrono::duration<double>
+      (std::chrono::steady_clock::now()-beginLoad).count();
+    std::cout << "built sampler over " << prettyNumber(sampler->numBricks()) << " bricks and "
+              << prettyNumber(sampler->numElements()) << " stitching elements in "
+              << loadTime << "s" << std::endl;
+    if (box.empty())
+      throw std::runtime_error("nothing to resample (no bricks or elements)");
+
+    const size_t sliceSize = size_t(dims.x)*size_t(dims.y);
+    if (slabSize <= 0)
+      slabSize = int(std::max(size_t(1),(size_t(64)<<20)/sliceSize));
+    slabSize = std::min(slabSize,dims.z);
+    std::cout << "resampling " << box << " to " << dims << " voxels, in slabs of "
+              << slabSize << " slices" << std::endl;
+
+    std::ofstream out(outFileName,std::ios::binary);
+    if (!out.good())
+      throw std::runtime_error("could not open output file '"+outFileName+"'");
+
+    // two slab buffers: one gets sampled while the previous one is
+    // still being written out
+    std::vector<float> slab[2] = {
+      std::vector<float>(sliceSize*slabSize),
+      std::vector<float>(sliceSize*slabSize)
+    };
+    std::future<void> pendingWrite;
+    const vec3f voxelSize(box.size().x/dims.x,
+                          box.size().y/dims.y,
+                          box.size().z/dims.z);
+    size_t numMisses = 0;
+    const auto beginResample = std::chrono::steady_clock::now();
+    for (int slabBegin=0, slabID=0;slabBegin<dims.z;slabBegin+=slabSize, slabID++) {
+      const int numSlices = std::min(slabSize,dims.z-slabBegin);
+      float *values = slab[slabID%2].data();
+      const size_t numRows = size_t(dims.y)*numSlices;
+      std::vector<size_t> rowMisses(numRows);
+      parallel_for(numRows,[&](size_t rowID){
+          const int iy = int(rowID % dims.y);
+          const int iz = slabBegin + int(rowID / dims.y);
+          std::vector<vec3f> points(dims.x);
+          for (int ix=0;ix<dims.x;ix++)
+            points[ix] = box.lower + (vec3f(ix,iy,iz)+vec3f(.5f))*voxelSize;
+          float *rowValues = values + rowID*dims.x;
+          sampler->sample(rowValues,points.data(),dims.x);
+          for (int ix=0;ix<dims.x;ix++)
+            if (std::isnan(rowValues[ix])) {
+              rowValues[ix] = fillValue;
+              rowMisses[rowID]++;
+            }
+        });
+      for (auto misses : rowMisses) numMisses += misses;
+
+      if (pendingWrite.valid()) pendingWrite.get();
+      pendingWrite = std::async(std::launch::async,[&out,values,numSlices,sliceSize]{
+          out.write((const char *)values,numSlices*sliceSize*sizeof(float));
+        });
+    }
+    if (pendingWrite.valid()) pendingWrite.get();
+    out.close();
+    if (!out.good())
+      throw std::runtime_error("error writing output file '"+outFileName+"'");
+    const double resampleTime = std::chrono::duration<double>
+      (std::chrono::steady_clock::now()-beginResample).count();
+
+    const size_t numVoxels = sliceSize*dims.z;
+    std::cout << "wrote " << prettyNumber(numVoxels) << " voxels (" << dims.x << "x"
+              << dims.y << "x" << dims.z << " floats) to " << outFileName
+              << " in " << resampleTime << "s (" << prettyNumber(size_t(numVoxels/resampleTime))
+              << " voxels/s); " << prettyNumber(numMisses) << " voxels outside of"
+              << " all bricks and elements were set to " << fillValue << std::endl;
+    return 0;
+  }
+
+} // ::gridlets
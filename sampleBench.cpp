@@ -0,0 +1,176 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* builds a Sampler over the bricks of the given .grids files and the
+   stitching elements of the dual umesh, and reports how many random
+   point samples per second it answers - in batches, and one point at
+   a time */
+
+#include "sampler.h"
+#include "helpers.h"
+#include <random>
+#include <cmath>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  /*! samples at every brick vertex and every stitching element
+    vertex, where interpolation has to reproduce the cell's scalar;
+    returns number of mismatches */
+  size_t checkVertices(const Sampler &sampler,
+                       const std::vector<Gridlet> &bricks,
+                       UMesh::SP mesh,
+                       const MappedScalars &scalars)
+  {
+    std::vector<vec3f> points;
+    std::vector<float> expected;
+    for (auto &brick : bricks) {
+      const float cellWidth = float(1<<brick.level);
+      const vec3f origin = brick.worldBounds().lower;
+      const bool baked = !brick.values.empty();
+      const std::vector<uint32_t> used
+        = baked ? computeVertexMask(brick.numCubes,brick.cubeMask.data()) : std::vector<uint32_t>();
+      size_t i = 0;
+      for (int iz=0;iz<=brick.numCubes.z;iz++)
+        for (int iy=0;iy<=brick.numCubes.y;iy++)
+          for (int ix=0;ix<=brick.numCubes.x;ix++,i++)
+            if (baked ? isBitSet(used.data(),i) : brick.scalarIDs[i] >= 0) {
+              points.push_back(origin+vec3f(ix,iy,iz)*cellWidth);
+              expected.push_back(baked ? brick.values[i] : scalars[brick.scalarIDs[i]]);
+            }
+    }
+    if (mesh)
+      for (size_t i=0;i<mesh->vertices.size();i++) {
+        points.push_back(mesh->vertices[i]);
+        expected.push_back(mesh->vertexTag.empty()
+                           ? mesh->perVertex->values[i]
+                           : scalars[mesh->vertexTag[i]]);
+      }
+    std::vector<float> values(points.size());
+    sampler.sample(values.data(),points.data(),points.size());
+    size_t numWrong = 0;
+    for (size_t i=0;i<points.size();i++)
+      if (!(fabsf(values[i]-expected[i]) <= 1e-3f*std::max(1.f,fabsf(expected[i])))) {
+        if (numWrong++ < 10)
+          std::cout << " mismatch at " << points[i] << ": sampled " << values[i]
+                    << ", expected " << expected[i] << std::endl;
+      }
+    std::cout << "checked " << prettyNumber(points.size()) << " vertices, "
+              << prettyNumber(numWrong) << " mismatches" << std::endl;
+    return numWrong;
+  }
+
+  void usage(const std::string error="")
+  {
+    if (error != "")
+      std::cerr << "Error : " << error  << "\n\n";
+
+    std::cout << "Usage: ./amrSampleBench --cells <in.cells> -s <in.scalars>" << std::endl;
+    std::cout << "         [--grids <in.grids>]* [--umesh <dual.umesh>]" << std::endl;
+    std::cout << "         [-n <numSamples>] [--check]" << std::endl;
+    std::cout << "-n      : number of random points (in the bounds of all bricks and elements)" << std::endl;
+    std::cout << "--check : also sample at all brick and element vertices, and make sure" << std::endl;
+    std::cout << "          that reproduces the scalars there" << std::endl;
+    exit (error != "");
+  };
+
+  extern "C" int main(int ac, char **av)
+  {
+    std::string cellsFileName;
+    std::string scalarsFileName;
+    std::string umeshFileName;
+    std::vector<std::string> gridsFileNames;
+    size_t numSamples = 10000000;
+    bool check = false;
+    for (int i=1;i<ac;i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "--cells")
+        cellsFileName = av[++i];
+      else if (arg == "-s" || arg == "--scalars")
+        scalarsFileName = av[++i];
+      else if (arg == "--grids")
+        gridsFileNames.push_back(av[++i]);
+      else if (arg == "--umesh")
+        umeshFileName = av[++i];
+      else if (arg == "-n")
+        numSamples = std::stoull(av[++i]);
+      else if (arg == "--check")
+        check = true;
+      else
+        usage("unknown cmd-line arg '"+arg+"'");
+    }
+    if (cellsFileName == "") usage("no cells file specified");
+    if (scalarsFileName == "") usage("no scalars file specified");
+    if (gridsFileNames.empty() && umeshFileName == "")
+      usage("neither grids nor umesh file specified");
+
+    Sampler::SP sampler;
+    const double buildTime = timeOf([&]{
+        sampler = Sampler::load(cellsFileName,scalarsFileName,gridsFileNames,umeshFileName);
+      });
+    std::cout << "loaded and built sampler over " << prettyNumber(sampler->numBricks()) << " bricks and "
+              << prettyNumber(sampler->numElements()) << " stitching elements in "
+              << buildTime << "s; bounds " << sampler->getBounds() << std::endl;
+
+    const box3f bounds = sampler->getBounds();
+    std::vector<vec3f> points(numSamples);
+    parallel_for_blocked(0,numSamples,64*1024,[&](size_t begin, size_t end){
+        std::mt19937 rng((unsigned)begin);
+        std::uniform_real_distribution<float> uniform(0.f,1.f);
+        for (size_t i=begin;i<end;i++)
+          points[i] = bounds.lower + vec3f(uniform(rng),uniform(rng),uniform(rng))*bounds.size();
+      });
+
+    std::vector<float> batched(numSamples);
+    const double batchTime = timeOf([&]{
+        sampler->sample(batched.data(),points.data(),numSamples);
+      });
+    size_t numHits = 0;
+    for (auto v : batched) numHits += !std::isnan(v);
+    std::cout << "batched   : " << prettyNumber(size_t(numSamples/batchTime))
+              << " samples/s (" << prettyNumber(numHits) << " of "
+              << prettyNumber(numSamples) << " points inside)" << std::endl;
+
+    std::vector<float> single(numSamples);
+    const double singleTime = timeOf([&]{
+        for (size_t i=0;i<numSamples;i++)
+          single[i] = sampler->sample(points[i]);
+      });
+    std::cout << "one by one: " << prettyNumber(size_t(numSamples/singleTime))
+              << " samples/s (single thread)" << std::endl;
+    for (size_t i=0;i<numSamples;i++)
+      if (!(batched[i] == single[i]) && !(std::isnan(batched[i]) && std::isnan(single[i])))
+        throw std::runtime_error("batched and single-point samples differ!");
+
+    if (check) {
+      // the check needs the inputs themselves, not just the sampler
+      MappedScalars scalars = mapScalars(scalarsFileName,cellsFileName);
+      std::vector<Gridlet> bricks;
+      for (auto fileName : gridsFileNames) {
+        std::vector<Gridlet> levelBricks = readGrids(fileName);
+        bricks.insert(bricks.end(),levelBricks.begin(),levelBricks.end());
+      }
+      UMesh::SP mesh = umeshFileName == "" ? UMesh::SP() : UMesh::loadFrom(umeshFileName);
+      if (checkVertices(*sampler,bricks,mesh,scalars) != 0)
+        return 1;
+    }
+    return 0;
+  }
+
+} // ::gridlets
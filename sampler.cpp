@@ -0,0 +1,569 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "sampler.h"
+#include "helpers.h"
+#include "umesh/radixSort.h"
+#include <limits>
+
+namespace gridlets {
+
+  using namespace umesh;
+
+  /*! prim type of bricks in the BVH's prim refs (umesh itself never
+    creates prim refs of type INVALID); all other prims are stitching
+    elements */
+  static const UMesh::PrimType BRICK = UMesh::INVALID;
+
+  /*! max number of prims per BVH leaf */
+  static const size_t maxLeafSize = 4;
+
+  /*! number of points that get located (and then interpolated)
+    together */
+  static const size_t batchSize = 256;
+
+  /*! how far (in parametric space) a point may be outside an element
+    or brick and still count as inside; makes sure points on shared
+    faces do not fall through the cracks */
+  static const float eps = 1e-4f;
+
+  // ##################################################################
+  // interpolation in stitching elements
+  // ##################################################################
+
+  /*! tets can be inverted directly; everything is relative to the
+    first vertex to keep float precision independent of where in
+    the domain the element is */
+  inline bool sampleTet(float &value, const vec3f &p,
+                        const vec3f v[4], const float f[4])
+  {
+    const vec3f e1 = v[1]-v[0], e2 = v[2]-v[0], e3 = v[3]-v[0];
+    const vec3f d  = p-v[0];
+    const float det = dot(e1,cross(e2,e3));
+    if (det == 0.f) return false;
+    const float u = dot(d,cross(e2,e3)) / det;
+    const float w = dot(e1,cross(d,e3)) / det;
+    const float t = dot(e1,cross(e2,d)) / det;
+    if (u < -eps || w < -eps || t < -eps || u+w+t > 1.f+eps) return false;
+    value = f[0] + u*(f[1]-f[0]) + w*(f[2]-f[0]) + t*(f[3]-f[0]);
+    return true;
+  }
+
+  /*! shape functions (and their derivatives wrt the parametric
+    coordinates r,s,t) of the VTK-ordered pyramid */
+  struct PyrShape {
+    enum { N = 5 };
+    static vec3f start() { return vec3f(.5f,.5f,.25f); }
+    static bool inside(const vec3f &u)
+    {
+      return u.x >= -eps && u.x <= 1.f+eps
+        &&   u.y >= -eps && u.y <= 1.f+eps
+        &&   u.z >= -eps && u.z <= 1.f+eps;
+    }
+    static void eval(const vec3f &u, float w[N], vec3f dw[N])
+    {
+      const float r = u.x, s = u.y, t = u.z;
+      const float a = 1.f-r, b = 1.f-s, c = 1.f-t;
+      w[0] = a*b*c; dw[0] = vec3f(-b*c,-a*c,-a*b);
+      w[1] = r*b*c; dw[1] = vec3f( b*c,-r*c,-r*b);
+      w[2] = r*s*c; dw[2] = vec3f( s*c, r*c,-r*s);
+      w[3] = a*s*c; dw[3] = vec3f(-s*c, a*c,-a*s);
+      w[4] = t;     dw[4] = vec3f(0.f,0.f,1.f);
+    }
+  };
+
+  /*! shape functions of the VTK-ordered wedge */
+  struct WedgeShape {
+    enum { N = 6 };
+    static vec3f start() { return vec3f(1.f/3.f,1.f/3.f,.5f); }
+    static bool inside(const vec3f &u)
+    {
+      return u.x >= -eps && u.y >= -eps && u.x+u.y <= 1.f+eps
+        &&   u.z >= -eps && u.z <= 1.f+eps;
+    }
+    static void eval(const vec3f &u, float w[N], vec3f dw[N])
+    {
+      const float r = u.x, s = u.y, t = u.z;
+      const float q = 1.f-r-s, c = 1.f-t;
+      w[0] = q*c; dw[0] = vec3f(-c,-c,-q);
+      w[1] = r*c; dw[1] = vec3f( c,0.f,-r);
+      w[2] = s*c; dw[2] = vec3f(0.f, c,-s);
+      w[3] = q*t; dw[3] = vec3f(-t,-t, q);
+      w[4] = r*t; dw[4] = vec3f( t,0.f, r);
+      w[5] = s*t; dw[5] = vec3f(0.f, t, s);
+    }
+  };
+
+  /*! shape functions of the VTK-ordered hex */
+  struct HexShape {
+    enum { N = 8 };
+    static vec3f start() { return vec3f(.5f); }
+    static bool inside(const vec3f &u) { return PyrShape::inside(u); }
+    static void eval(const vec3f &u, float w[N], vec3f dw[N])
+    {
+      const float r = u.x, s = u.y, t = u.z;
+      const float a = 1.f-r, b = 1.f-s, c = 1.f-t;
+      w[0] = a*b*c; dw[0] = vec3f(-b*c,-a*c,-a*b);
+      w[1] = r*b*c; dw[1] = vec3f( b*c,-r*c,-r*b);
+      w[2] = r*s*c; dw[2] = vec3f( s*c, r*c,-r*s);
+      w[3] = a*s*c; dw[3] = vec3f(-s*c, a*c,-a*s);
+      w[4] = a*b*t; dw[4] = vec3f(-b*t,-a*t, a*b);
+      w[5] = r*b*t; dw[5] = vec3f( b*t,-r*t, r*b);
+      w[6] = r*s*t; dw[6] = vec3f( s*t, r*t, r*s);
+      w[7] = a*s*t; dw[7] = vec3f(-s*t, a*t, a*s);
+    }
+  };
+
+  /*! finds the parametric coordinates of 'p' in the given element by
+    newton iteration on its (iso-parametric) shape functions, and
+    interpolates the vertex values there; returns false if p is not
+    inside */
+  template<typename Shape>
+  inline bool sampleElement(float &value, const vec3f &p,
+                            const vec3f v[Shape::N], const float f[Shape::N])
+  {
+    float w[Shape::N];
+    vec3f dw[Shape::N];
+    const vec3f d = p - v[0];
+    vec3f u = Shape::start();
+    for (int iter=0;iter<16;iter++) {
+      Shape::eval(u,w,dw);
+      vec3f x(0.f), dr(0.f), ds(0.f), dt(0.f);
+      for (int i=1;i<Shape::N;i++) {
+        const vec3f vi = v[i]-v[0];
+        x  = x  + w[i]*vi;
+        dr = dr + dw[i].x*vi;
+        ds = ds + dw[i].y*vi;
+        dt = dt + dw[i].z*vi;
+      }
+      const vec3f res = d - x;
+      const float det = dot(dr,cross(ds,dt));
+      if (det == 0.f) return false;
+      const vec3f du = vec3f(dot(res,cross(ds,dt)),
+                             dot(dr,cross(res,dt)),
+                             dot(dr,cross(ds,res))) * (1.f/det);
+      u = u + du;
+      if (fabsf(du.x) < 1e-6f && fabsf(du.y) < 1e-6f && fabsf(du.z) < 1e-6f)
+        break;
+    }
+    if (!Shape::inside(u)) return false;
+    Shape::eval(u,w,dw);
+    value = 0.f;
+    for (int i=0;i<Shape::N;i++)
+      value += w[i]*f[i];
+    return true;
+  }
+
+  template<typename Shape, typename Prim>
+  inline bool sampleElement(float &value, const vec3f &p,
+                            const Prim &prim,
+                            const std::vector<vec3f> &vertices,
+                            const std::vector<float> &vertexValues)
+  {
+    vec3f v[Shape::N];
+    float f[Shape::N];
+    for (int i=0;i<Shape::N;i++) {
+      v[i] = vertices[prim[i]];
+      f[i] = vertexValues[prim[i]];
+    }
+    return sampleElement<Shape>(value,p,v,f);
+  }
+
+  // ##################################################################
+  // construction
+  // ##################################################################
+
+  Sampler::Sampler(const std::vector<Gridlet> &allBricks,
+                   UMesh::SP stitchingMesh,
+                   const MappedScalars &scalars,
+                   const box3f &region)
+    : mesh(stitchingMesh)
+  {
+    const bool cull = !region.empty();
+
+    // ------------------------------------------------------------------
+    // bricks: gather all vertex values (and cube masks) into flat
+    // arrays
+    // ------------------------------------------------------------------
+    std::vector<const Gridlet *> inBricks;
+    for (auto &brick : allBricks)
+      if (!cull || brick.worldBounds().overlaps(region))
+        inBricks.push_back(&brick);
+    bricks.resize(inBricks.size());
+    for (size_t brickID=0;brickID<inBricks.size();brickID++) {
+      const Gridlet &in = *inBricks[brickID];
+      Brick &brick = bricks[brickID];
+      brick.cellWidth = float(1<<in.level);
+      brick.origin    = in.worldBounds().lower;
+      brick.numCubes  = in.numCubes;
+      brick.valueOffset
+        = brickID ? bricks[brickID-1].valueOffset + inBricks[brickID-1]->numScalars() : 0;
+      brick.maskOffset
+        = brickID ? bricks[brickID-1].maskOffset + numMaskWords(inBricks[brickID-1]->numCubesTotal()) : 0;
+    }
+    if (!bricks.empty()) {
+      brickValues.resize(bricks.back().valueOffset+inBricks.back()->numScalars());
+      cubeMasks.resize(bricks.back().maskOffset+numMaskWords(inBricks.back()->numCubesTotal()));
+    }
+    parallel_for(bricks.size(),[&](size_t brickID){
+        const Gridlet &in = *inBricks[brickID];
+        const Brick &brick = bricks[brickID];
+        if (!in.values.empty())
+          std::copy(in.values.begin(),in.values.end(),brickValues.begin()+brick.valueOffset);
+        else
+          for (size_t i=0;i<in.numScalars();i++) {
+            const int scalarID = in.scalarIDs[i];
+            brickValues[brick.valueOffset+i] = scalarID < 0 ? 0.f : scalars[scalarID];
+          }
+        const std::vector<uint32_t> mask
+          = in.cubeMask.empty()
+          ? computeCubeMask(in.numCubes,in.scalarIDs.data())
+          : in.cubeMask;
+        std::copy(mask.begin(),mask.end(),cubeMasks.begin()+brick.maskOffset);
+      });
+
+    // ------------------------------------------------------------------
+    // stitching elements (those overlapping the region, if any), and
+    // their vertex values
+    // ------------------------------------------------------------------
+    std::vector<UMesh::PrimRef> elements;
+    if (mesh) {
+      elements = mesh->createVolumePrimRefs();
+      if (cull) {
+        const size_t blockSize = 64*1024;
+        const size_t numBlocks = divRoundUp(elements.size(),blockSize);
+        std::vector<size_t> numKept(numBlocks), keptOffset(numBlocks);
+        std::vector<uint8_t> keep(elements.size());
+        parallel_for(numBlocks,[&](size_t blockID){
+            const size_t end = std::min(elements.size(),(blockID+1)*blockSize);
+            for (size_t i=blockID*blockSize;i<end;i++) {
+              keep[i] = mesh->getBounds(elements[i]).overlaps(region);
+              numKept[blockID] += keep[i];
+            }
+          });
+        std::vector<UMesh::PrimRef> kept
+          (parallel_exclusive_scan(numKept.data(),keptOffset.data(),numBlocks));
+        parallel_for(numBlocks,[&](size_t blockID){
+            const size_t end = std::min(elements.size(),(blockID+1)*blockSize);
+            size_t out = keptOffset[blockID];
+            for (size_t i=blockID*blockSize;i<end;i++)
+              if (keep[i]) kept[out++] = elements[i];
+          });
+        elements.swap(kept);
+      }
+
+      if (mesh->vertexTag.empty() && !mesh->perVertex)
+        throw std::runtime_error("stitching mesh has neither vertex tags nor scalars");
+      if (mesh->vertexTag.empty())
+        vertexValues = mesh->perVertex->values;
+      else if (!cull) {
+        vertexValues.resize(mesh->vertices.size());
+        parallel_for_blocked(0,mesh->vertices.size(),64*1024,[&](size_t begin, size_t end){
+            for (size_t i=begin;i<end;i++)
+              vertexValues[i] = scalars[mesh->vertexTag[i]];
+          });
+      } else {
+        // only look up the scalars of vertices the remaining elements
+        // actually use
+        std::vector<uint8_t> used(mesh->vertices.size());
+        for (auto prim : elements)
+          switch (prim.type) {
+          case UMesh::TET:
+            for (int k=0;k<4;k++) used[mesh->tets[prim.ID][k]] = 1;
+            break;
+          case UMesh::PYR:
+            for (int k=0;k<5;k++) used[mesh->pyrs[prim.ID][k]] = 1;
+            break;
+          case UMesh::WEDGE:
+            for (int k=0;k<6;k++) used[mesh->wedges[prim.ID][k]] = 1;
+            break;
+          case UMesh::HEX:
+            for (int k=0;k<8;k++) used[mesh->hexes[prim.ID][k]] = 1;
+            break;
+          default:
+            break;
+          }
+        vertexValues.resize(mesh->vertices.size());
+        parallel_for_blocked(0,mesh->vertices.size(),64*1024,[&](size_t begin, size_t end){
+            for (size_t i=begin;i<end;i++)
+              vertexValues[i] = used[i] ? scalars[mesh->vertexTag[i]] : 0.f;
+          });
+      }
+    }
+
+    buildBVH(elements);
+  }
+
+  Sampler::SP Sampler::load(const std::string &cellsFileName,
+                            const std::string &scalarsFileName,
+                            const std::vector<std::string> &gridsFileNames,
+                            const std::string &umeshFileName,
+                            const box3f &region)
+  {
+    MappedScalars scalars = mapScalars(scalarsFileName,cellsFileName);
+
+    // bricks outside the region get dropped right when they are read,
+    // so they never all have to be in memory at once
+    std::vector<Gridlet> bricks;
+    for (auto fileName : gridsFileNames) {
+      std::ifstream in(fileName,std::ios::binary);
+      if (!in.good())
+        throw std::runtime_error("could not open grids file '"+fileName+"'");
+      const uint32_t flags = readGridsHeader(in);
+      Gridlet brick;
+      while (readGridlet(in,brick,flags))
+        if (region.empty() || brick.worldBounds().overlaps(region))
+          bricks.push_back(brick);
+    }
+    UMesh::SP mesh;
+    if (umeshFileName != "")
+      mesh = UMesh::loadFrom(umeshFileName);
+    return std::make_shared<Sampler>(bricks,mesh,scalars,region);
+  }
+
+  void Sampler::buildBVH(const std::vector<UMesh::PrimRef> &elements)
+  {
+    const size_t numBricks = bricks.size();
+    const size_t numPrims  = numBricks + elements.size();
+    prims.resize(numPrims);
+    primBounds.resize(numPrims);
+    bounds = box3f();
+    if (numPrims == 0) return;
+
+    parallel_for_blocked(0,numBricks,16*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++)
+          prims[i] = UMesh::PrimRef(BRICK,i);
+      });
+    std::copy(elements.begin(),elements.end(),prims.begin()+numBricks);
+
+    // ------------------------------------------------------------------
+    // sort prims along a morton curve over their centers
+    // ------------------------------------------------------------------
+    const size_t blockSize = 64*1024;
+    const size_t numBlocks = divRoundUp(numPrims,blockSize);
+    std::vector<box3f> blockBounds(numBlocks), blockCentBounds(numBlocks);
+    parallel_for(numBlocks,[&](size_t blockID){
+        box3f primsBounds, centBounds;
+        const size_t end = std::min(numPrims,(blockID+1)*blockSize);
+        for (size_t i=blockID*blockSize;i<end;i++) {
+          const UMesh::PrimRef prim = prims[i];
+          box3f &bb = primBounds[i];
+          if (prim.type == BRICK) {
+            const Brick &brick = bricks[prim.ID];
+            bb.lower = brick.origin;
+            bb.upper = brick.origin + vec3f(brick.numCubes)*brick.cellWidth;
+          } else
+            bb = mesh->getBounds(prim);
+          primsBounds.extend(bb);
+          centBounds.extend(bb.center());
+        }
+        blockBounds[blockID] = primsBounds;
+        blockCentBounds[blockID] = centBounds;
+      });
+    box3f centBounds;
+    for (size_t blockID=0;blockID<numBlocks;blockID++) {
+      bounds.extend(blockBounds[blockID]);
+      centBounds.extend(blockCentBounds[blockID]);
+    }
+
+    struct KeyAndPrim {
+      uint64_t key;
+      uint64_t primID;
+    };
+    std::vector<KeyAndPrim> sorted(numPrims);
+    const vec3f size = centBounds.size();
+    const float maxCell = float((1<<21)-1);
+    const vec3f scale(size.x > 0.f ? maxCell/size.x : 0.f,
+                      size.y > 0.f ? maxCell/size.y : 0.f,
+                      size.z > 0.f ? maxCell/size.z : 0.f);
+    parallel_for_blocked(0,numPrims,blockSize,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const vec3f cell = (primBounds[i].center()-centBounds.lower)*scale;
+          sorted[i].key = morton_encode3D(uint64_t(cell.x),uint64_t(cell.y),uint64_t(cell.z));
+          sorted[i].primID = i;
+        }
+      });
+    radixSort(sorted.data(),numPrims,63,[](const KeyAndPrim &kp){ return kp.key; });
+    {
+      std::vector<UMesh::PrimRef> unsortedPrims = prims;
+      std::vector<box3f> unsortedBounds = primBounds;
+      parallel_for_blocked(0,numPrims,blockSize,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            prims[i] = unsortedPrims[sorted[i].primID];
+            primBounds[i] = unsortedBounds[sorted[i].primID];
+          }
+        });
+    }
+
+    // ------------------------------------------------------------------
+    // build the (complete) tree over them: leaves first, then one
+    // level after another up to the root
+    // ------------------------------------------------------------------
+    bvhDepth = 0;
+    while (divRoundUp(numPrims,size_t(1)<<bvhDepth) > maxLeafSize) bvhDepth++;
+    nodeBounds.resize((size_t(2)<<bvhDepth)-1);
+    const size_t numLeaves = size_t(1)<<bvhDepth;
+    parallel_for_blocked(0,numLeaves,1024,[&](size_t begin, size_t end){
+        for (size_t j=begin;j<end;j++) {
+          box3f bb;
+          for (size_t i=(j*numPrims)>>bvhDepth;i<((j+1)*numPrims)>>bvhDepth;i++)
+            bb.extend(primBounds[i]);
+          nodeBounds[numLeaves-1+j] = bb;
+        }
+      });
+    for (int depth=bvhDepth-1;depth>=0;--depth) {
+      const size_t first = (size_t(1)<<depth)-1;
+      parallel_for_blocked(0,size_t(1)<<depth,1024,[&](size_t begin, size_t end){
+          for (size_t j=begin;j<end;j++) {
+            box3f bb = nodeBounds[2*(first+j)+1];
+            bb.extend(nodeBounds[2*(first+j)+2]);
+            nodeBounds[first+j] = bb;
+          }
+        });
+    }
+  }
+
+  // ##################################################################
+  // queries
+  // ##################################################################
+
+  float Sampler::sample(const vec3f &point) const
+  {
+    float value;
+    sampleBatch(&value,&point,1);
+    return value;
+  }
+
+  void Sampler::sample(float *values, const vec3f *points, size_t numPoints) const
+  {
+    parallel_for_blocked(0,numPoints,batchSize,[&](size_t begin, size_t end){
+        sampleBatch(values+begin,points+begin,end-begin);
+      });
+  }
+
+  void Sampler::sampleBatch(float *values, const vec3f *points, size_t numPoints) const
+  {
+    // brick samples of this batch, as structure of arrays: which point
+    // they are for, their cube's eight corner values (in x-fastest
+    // order), and the point's position within that cube
+    uint32_t hitPoint[batchSize];
+    float    corner[8][batchSize];
+    float    fx[batchSize], fy[batchSize], fz[batchSize];
+    size_t   numBrickHits = 0;
+
+    const size_t numLeaves = size_t(1)<<bvhDepth;
+    const size_t numPrims  = prims.size();
+    for (size_t pointID=0;pointID<numPoints;pointID++) {
+      const vec3f p = points[pointID];
+      values[pointID] = std::numeric_limits<float>::quiet_NaN();
+
+      size_t stack[64];
+      int    stackPtr = 0;
+      if (numPrims) stack[stackPtr++] = 0;
+      bool found = false;
+      while (stackPtr > 0 && !found) {
+        const size_t nodeID = stack[--stackPtr];
+        const box3f &nb = nodeBounds[nodeID];
+        if (p.x < nb.lower.x || p.y < nb.lower.y || p.z < nb.lower.z ||
+            p.x > nb.upper.x || p.y > nb.upper.y || p.z > nb.upper.z)
+          continue;
+        if (nodeID < numLeaves-1) {
+          stack[stackPtr++] = 2*nodeID+2;
+          stack[stackPtr++] = 2*nodeID+1;
+          continue;
+        }
+        const size_t j = nodeID-(numLeaves-1);
+        for (size_t i=(j*numPrims)>>bvhDepth;
+             !found && i<((j+1)*numPrims)>>bvhDepth;i++) {
+          const box3f &pb = primBounds[i];
+          if (p.x < pb.lower.x || p.y < pb.lower.y || p.z < pb.lower.z ||
+              p.x > pb.upper.x || p.y > pb.upper.y || p.z > pb.upper.z)
+            continue;
+          const UMesh::PrimRef prim = prims[i];
+          switch (prim.type) {
+          case BRICK: {
+            const Brick &brick = bricks[prim.ID];
+            const vec3f local = (p - brick.origin) * (1.f/brick.cellWidth);
+            const vec3i cube = min(vec3i(int(local.x),int(local.y),int(local.z)),
+                                   brick.numCubes-vec3i(1));
+            const size_t cubeID
+              = cube.x + brick.numCubes.x*size_t(cube.y + brick.numCubes.y*size_t(cube.z));
+            if (!isBitSet(cubeMasks.data()+brick.maskOffset,cubeID)) break;
+            const size_t nx = brick.numCubes.x+1;
+            const size_t nxy = nx*(brick.numCubes.y+1);
+            const float *v
+              = brickValues.data() + brick.valueOffset + cube.x + nx*cube.y + nxy*cube.z;
+            const size_t hitID = numBrickHits++;
+            hitPoint[hitID] = uint32_t(pointID);
+            corner[0][hitID] = v[0];
+            corner[1][hitID] = v[1];
+            corner[2][hitID] = v[nx];
+            corner[3][hitID] = v[nx+1];
+            corner[4][hitID] = v[nxy];
+            corner[5][hitID] = v[nxy+1];
+            corner[6][hitID] = v[nxy+nx];
+            corner[7][hitID] = v[nxy+nx+1];
+            fx[hitID] = local.x - cube.x;
+            fy[hitID] = local.y - cube.y;
+            fz[hitID] = local.z - cube.z;
+            found = true;
+          } break;
+          case UMesh::TET: {
+            const UMesh::Tet &tet = mesh->tets[prim.ID];
+            vec3f v[4];
+            float f[4];
+            for (int k=0;k<4;k++) {
+              v[k] = mesh->vertices[tet[k]];
+              f[k] = vertexValues[tet[k]];
+            }
+            found = sampleTet(values[pointID],p,v,f);
+          } break;
+          case UMesh::PYR:
+            found = sampleElement<PyrShape>(values[pointID],p,mesh->pyrs[prim.ID],
+                                            mesh->vertices,vertexValues);
+            break;
+          case UMesh::WEDGE:
+            found = sampleElement<WedgeShape>(values[pointID],p,mesh->wedges[prim.ID],
+                                              mesh->vertices,vertexValues);
+            break;
+          case UMesh::HEX:
+            found = sampleElement<HexShape>(values[pointID],p,mesh->hexes[prim.ID],
+                                            mesh->vertices,vertexValues);
+            break;
+          default:
+            break;
+          }
+        }
+      }
+    }
+
+    // trilinear interpolation of all brick samples, branch-free and
+    // over contiguous arrays, so it vectorizes
+    float result[batchSize];
+    for (size_t i=0;i<numBrickHits;i++) {
+      const float c00 = corner[0][i] + fx[i]*(corner[1][i]-corner[0][i]);
+      const float c10 = corner[2][i] + fx[i]*(corner[3][i]-corner[2][i]);
+      const float c01 = corner[4][i] + fx[i]*(corner[5][i]-corner[4][i]);
+      const float c11 = corner[6][i] + fx[i]*(corner[7][i]-corner[6][i]);
+      const float c0  = c00 + fy[i]*(c10-c00);
+      const float c1  = c01 + fy[i]*(c11-c01);
+      result[i] = c0 + fz[i]*(c1-c0);
+    }
+    for (size_t i=0;i<numBrickHits;i++)
+      values[hitPoint[i]] = result[i];
+  }
+
+} // ::gridlets
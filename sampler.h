@@ -0,0 +1,112 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "umesh/UMesh.h"
+#include "grids.h"
+#include "scalars.h"
+
+namespace gridlets {
+
+  using umesh::UMesh;
+
+  /*! answers scalar-field queries at arbitrary points of an AMR data
+    set in its "gridlets + stitching elements" form: points inside an
+    existing cube of a brick get interpolated trilinearly from the
+    cube's eight vertices, points inside a stitching element of the
+    dual mesh get interpolated with that element's (tet, pyramid,
+    wedge, or hex) shape functions. Both kinds of prims sit in one
+    BVH.
+
+    The sampler keeps its own copy of all brick and element vertex
+    values, so the scalars it was built from are no longer needed
+    afterwards. */
+  struct Sampler {
+    typedef std::shared_ptr<Sampler> SP;
+
+    /*! builds a sampler over the given bricks and stitching elements;
+      the bricks' scalarIDs and the mesh's vertex tags refer into
+      'scalars' (baked bricks bring their own values, and a mesh
+      without vertex tags has to come with its own per-vertex
+      scalars). The mesh can be null.
+
+      If 'region' is not empty, only bricks and elements overlapping
+      it are used (and only their scalars get looked up), so the
+      sampler only answers queries inside that region. */
+    Sampler(const std::vector<Gridlet> &bricks,
+            UMesh::SP stitchingMesh,
+            const MappedScalars &scalars,
+            const box3f &region = box3f());
+
+    /*! loads all given .grids files and the stitching umesh (if
+      umeshFileName is not empty), and maps the scalars of the given
+      .cells file. With a non-empty region, bricks not overlapping it
+      get skipped while reading. */
+    static Sampler::SP load(const std::string &cellsFileName,
+                            const std::string &scalarsFileName,
+                            const std::vector<std::string> &gridsFileNames,
+                            const std::string &umeshFileName,
+                            const box3f &region = box3f());
+
+    /*! value at given point, or NaN if the point is neither inside an
+      existing brick cube nor inside a stitching element */
+    float sample(const vec3f &point) const;
+
+    /*! samples all given points. Points get processed in parallel
+      batches; per batch, all points first get located in the BVH,
+      then all brick samples get interpolated in one branch-free loop
+      over the batch (which the compiler vectorizes). */
+    void sample(float *values, const vec3f *points, size_t numPoints) const;
+
+    /*! bounds of all (used) bricks and stitching elements */
+    box3f getBounds() const { return bounds; }
+
+    size_t numBricks() const { return bricks.size(); }
+    size_t numElements() const { return prims.size() - bricks.size(); }
+
+    /*! a brick, with its vertex values stored in brickValues */
+    struct Brick {
+      /*! world-space position of vertex (0,0,0) */
+      vec3f    origin;
+      float    cellWidth;
+      vec3i    numCubes;
+      uint64_t valueOffset;
+      uint64_t maskOffset;
+    };
+
+  private:
+    void buildBVH(const std::vector<UMesh::PrimRef> &elements);
+    void sampleBatch(float *values, const vec3f *points, size_t numPoints) const;
+
+    std::vector<Brick>    bricks;
+    std::vector<float>    brickValues;
+    std::vector<uint32_t> cubeMasks;
+
+    UMesh::SP             mesh;
+    std::vector<float>    vertexValues;
+
+    /*! the BVH is a complete binary tree over the prims sorted along
+      a morton curve: node j on depth d covers prims
+      [(j*N)>>d,((j+1)*N)>>d), and is stored at index (1<<d)-1+j */
+    int                          bvhDepth = 0;
+    std::vector<box3f>           nodeBounds;
+    std::vector<UMesh::PrimRef>  prims;
+    std::vector<box3f>           primBounds;
+    box3f                        bounds;
+  };
+
+} // ::gridlets
@@ -0,0 +1,125 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald, 2023 Maria Zhumabaeva                     //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace gridlets {
+
+  /*! read-only, memory-mapped view of a raw .scalars file, i.e., one
+    float (or double) per cell, in the same order the cells appear
+    in the .cells file - which is what every scalarID in the dual
+    mesh, the .cubes and the .grids files refers to.
+
+    The file gets mmapped rather than read, so gathering the values
+    referenced by a (sparse) set of scalarIDs only faults in the
+    pages that actually get touched, and does not require a second
+    copy of a potentially 100GB file in memory. */
+  struct MappedScalars {
+    typedef std::shared_ptr<MappedScalars> SP;
+
+    /*! map given file; 'numCells' is the number of cells in the
+      corresponding .cells file, and is used to determine whether the
+      file stores floats or doubles */
+    MappedScalars(const std::string &fileName, size_t numCells)
+      : fileName(fileName), numCells(numCells)
+    {
+      fd = open(fileName.c_str(),O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("could not open scalars file '"+fileName+"'");
+      struct stat st;
+      if (fstat(fd,&st) != 0) {
+        close(fd);
+        throw std::runtime_error("could not stat scalars file '"+fileName+"'");
+      }
+      numBytes = (size_t)st.st_size;
+      if (numBytes == numCells*sizeof(float))
+        isDouble = false;
+      else if (numBytes == numCells*sizeof(double))
+        isDouble = true;
+      else {
+        close(fd);
+        throw std::runtime_error("scalars file '"+fileName+"' has "
+                                 +std::to_string(numBytes)+" bytes, which is neither "
+                                 +std::to_string(numCells)+" floats nor doubles");
+      }
+      if (numBytes > 0) {
+        base = mmap(nullptr,numBytes,PROT_READ,MAP_SHARED,fd,0);
+        if (base == MAP_FAILED) {
+          close(fd);
+          throw std::runtime_error("could not mmap scalars file '"+fileName+"'");
+        }
+      }
+    }
+
+    ~MappedScalars()
+    {
+      if (base) munmap(base,numBytes);
+      if (fd >= 0) close(fd);
+    }
+
+    MappedScalars(const MappedScalars &) = delete;
+    MappedScalars &operator=(const MappedScalars &) = delete;
+
+    /*! returns scalar of given cell, converted to float if required */
+    inline float operator[](size_t scalarID) const
+    {
+      return isDouble
+        ? (float)((const double *)base)[scalarID]
+        : ((const float *)base)[scalarID];
+    }
+
+    inline size_t size() const { return numCells; }
+
+    /*! raw access to the mapped values, in their on-disk type */
+    inline const void *data() const { return base; }
+    inline size_t bytesPerScalar() const
+    { return isDouble ? sizeof(double) : sizeof(float); }
+
+    /*! name under which this field gets stored - the file's base
+      name, w/o directory and extension */
+    std::string fieldName() const { return fieldNameOf(fileName); }
+
+    /*! field name of the given scalars file; two files with the same
+      base name in different directories get the same one */
+    static std::string fieldNameOf(const std::string &fileName)
+    {
+      std::string name = fileName;
+      const size_t slash = name.find_last_of('/');
+      if (slash != std::string::npos) name = name.substr(slash+1);
+      const size_t dot = name.find_last_of('.');
+      if (dot != std::string::npos && dot > 0) name = name.substr(0,dot);
+      return name;
+    }
+
+    const std::string fileName;
+    const size_t      numCells;
+    bool              isDouble = false;
+
+  private:
+    int    fd       = -1;
+    void  *base     = nullptr;
+    size_t numBytes = 0;
+  };
+
+} // ::gridlets
@@ -0,0 +1,100 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* times FaceConn::compute (facet refs bucketed by smallest vertex) against
+   the comparison-sort path on a given mesh, and checks that both
+   produce the same faces */ 
+
+#include "umesh/UMesh.h"
+#include "umesh/FaceConn.h"
+
+namespace umesh {
+
+  void usage(const std::string &error = "")
+  {
+    if (error != "") std::cout << "Error: " << error << std::endl << std::endl;
+
+    std::cout << "usage: umeshBenchFaceConn in.umesh [--skip-reference]" << std::endl;
+    exit(error != "");
+  }
+
+  inline bool operator==(const FaceConn::PrimFacetRef &a,
+                         const FaceConn::PrimFacetRef &b)
+  {
+    if (a.primIdx < 0 || b.primIdx < 0)
+      return a.primIdx < 0 && b.primIdx < 0;
+    return a.primIdx == b.primIdx
+      && a.primType == b.primType
+      && a.facetIdx == b.facetIdx;
+  }
+  
+  bool sameFaces(const FaceConn &reference, const FaceConn &bucketed)
+  {
+    if (reference.faces.size() != bucketed.faces.size())
+      return false;
+    for (size_t i=0;i<bucketed.faces.size();i++) {
+      const FaceConn::SharedFace &a = reference.faces[i];
+      const FaceConn::SharedFace &b = bucketed.faces[i];
+      for (int j=0;j<4;j++)
+        if (a.vertexIdx[j] != b.vertexIdx[j]) return false;
+      if (!(a.onFront == b.onFront) || !(a.onBack == b.onBack))
+        return false;
+    }
+    return true;
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    std::string inFileName;
+    bool skipReference = false;
+    for (int i = 1; i < ac; i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "--skip-reference")
+        skipReference = true;
+      else if (arg[0] != '-')
+        inFileName = arg;
+      else
+        usage("unknown cmdline arg " + arg);
+    }
+    if (inFileName == "") usage("no input file specified");
+    
+    std::cout << "loading umesh from " << inFileName << std::endl;
+    UMesh::SP in = UMesh::loadFrom(inFileName);
+    std::cout << "computing faces for " << in->toString() << std::endl;
+
+    FaceConn::SP bucketed;
+    const double bucketedTime = timeOf([&](){ bucketed = FaceConn::compute(in); });
+    std::cout << "bucketed facet refs     : " << bucketedTime << "s, "
+              << prettyNumber(bucketed->faces.size()) << " faces" << std::endl;
+    if (skipReference) return 0;
+      
+    FaceConn::SP reference;
+    const double referenceTime
+      = timeOf([&](){ reference = FaceConn::computeWithComparisonSort(in); });
+    std::cout << "comparison sort         : " << referenceTime << "s, "
+              << prettyNumber(reference->faces.size()) << " faces" << std::endl;
+    std::cout << "speedup                 : " << (referenceTime/bucketedTime) << "x" << std::endl;
+    
+    if (!sameFaces(*reference,*bucketed)) {
+      std::cout << "ERROR: faces differ!" << std::endl;
+      return 1;
+    }
+    std::cout << "both give the same faces" << std::endl;
+    return 0;
+  }  
+} // ::umesh
@@ -0,0 +1,104 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* times the parallel, sort-based TetConn::computeFrom against the
+   serial, std::map-based reference implementation on a given mesh,
+   and checks that both produce the same connectivity */ 
+
+#include "umesh/UMesh.h"
+#include "umesh/TetConn.h"
+#include "umesh/tetrahedralize.h"
+#include <cstring>
+
+namespace umesh {
+
+  void usage(const std::string &error = "")
+  {
+    if (error != "") std::cout << "Error: " << error << std::endl << std::endl;
+
+    std::cout << "usage: umeshBenchTetConn in.umesh [--skip-serial]" << std::endl;
+    std::cout << "(meshes with non-tet elements get tetrahedralized first)" << std::endl;
+    exit(error != "");
+  }
+
+  bool sameConnectivity(const TetConn &a, const TetConn &b)
+  {
+    if (a.tetFaces.size() != b.tetFaces.size() ||
+        a.faces.size() != b.faces.size())
+      return false;
+    for (size_t i=0;i<a.tetFaces.size();i++)
+      for (int j=0;j<4;j++)
+        if (a.tetFaces[i][j] != b.tetFaces[i][j]) return false;
+    for (size_t i=0;i<a.faces.size();i++) {
+      const TetConn::Face &fa = a.faces[i];
+      const TetConn::Face &fb = b.faces[i];
+      if (fa.index != fb.index) return false;
+      for (int side=0;side<2;side++)
+        if (fa.tetIdx[side] != fb.tetIdx[side] ||
+            fa.facetIdx[side] != fb.facetIdx[side])
+          return false;
+    }
+    return true;
+  }
+  
+  extern "C" int main(int ac, char **av)
+  {
+    std::string inFileName;
+    bool skipSerial = false;
+    for (int i = 1; i < ac; i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "--skip-serial")
+        skipSerial = true;
+      else if (arg[0] != '-')
+        inFileName = arg;
+      else
+        usage("unknown cmdline arg " + arg);
+    }
+    if (inFileName == "") usage("no input file specified");
+    
+    std::cout << "loading umesh from " << inFileName << std::endl;
+    UMesh::SP in = UMesh::loadFrom(inFileName);
+    if (!in->pyrs.empty() ||
+        !in->wedges.empty() ||
+        !in->hexes.empty()) {
+      std::cout << "tetrahedralizing " << in->toString() << std::endl;
+      in = tetrahedralize(in);
+    }
+    std::cout << "computing connectivity for " << prettyNumber(in->tets.size())
+              << " tets" << std::endl;
+
+    TetConn parallel;
+    const double parallelTime = timeOf([&](){ parallel.computeFrom(*in); });
+    std::cout << "parallel (radix sort) : " << parallelTime << "s, "
+              << prettyNumber(parallel.faces.size()) << " faces" << std::endl;
+    if (skipSerial) return 0;
+      
+    TetConn serial;
+    const double serialTime = timeOf([&](){ serial.computeFromSerial(*in); });
+    std::cout << "serial (std::map)     : " << serialTime << "s, "
+              << prettyNumber(serial.faces.size()) << " faces" << std::endl;
+    std::cout << "speedup               : " << (serialTime/parallelTime) << "x" << std::endl;
+    
+    if (!sameConnectivity(serial,parallel)) {
+      std::cout << "ERROR: serial and parallel connectivity differ!" << std::endl;
+      return 1;
+    }
+    std::cout << "both connectivities are identical" << std::endl;
+    return 0;
+  }  
+} // ::umesh
@@ -17,7 +17,7 @@
 #include "umesh/UMesh.h"
 #include "umesh/io/IO.h"
 #include <fstream>
-#include <map>
+#include <algorithm>
 
 #ifndef PRINT
 #ifdef __CUDA_ARCH__
@@ -75,39 +75,79 @@ namespace umesh {
     grid(/*pos*/{4,0,0}, /*count(in x,y,z)*/{1,2,2}, /*level*/2);
   }
 
-  void addOrOverWriteCells(std::map<vec3i,int> &grid,
-                           vec3i worldPos,
-                           vec3i worldSize,
-                           int level)
-  {
-    int cellWidth = 1<<level;
-    for (int iz=0;iz<worldSize.z;iz+=cellWidth)
-      for (int iy=0;iy<worldSize.y;iy+=cellWidth)
-        for (int ix=0;ix<worldSize.x;ix+=cellWidth) {
-          vec3i pos = worldPos+vec3i{ix,iy,iz};
-          grid[pos] = level;
-        }
-  }
+  /*! a set of cells in which later-added cells overwrite earlier
+      ones at the same position; cells get collected in a plain
+      vector, and only resolved - by a stable sort on position,
+      keeping the last cell added at each - once all have been added */
+  struct CellGrid {
+    void addOrOverWriteCells(vec3i worldPos,
+                             vec3i worldSize,
+                             int level)
+    {
+      const int cellWidth = 1<<level;
+      const vec3i count((worldSize.x+cellWidth-1)/cellWidth,
+                        (worldSize.y+cellWidth-1)/cellWidth,
+                        (worldSize.z+cellWidth-1)/cellWidth);
+      const size_t begin = cells.size();
+      cells.resize(begin+size_t(count.x)*count.y*count.z);
+      parallel_for(count.z,[&](int iz){
+          size_t cellID = begin+size_t(iz)*count.x*count.y;
+          for (int iy=0;iy<count.y;iy++)
+            for (int ix=0;ix<count.x;ix++)
+              cells[cellID++]
+                = { worldPos+vec3i{ix,iy,iz}*cellWidth, level };
+        });
+    }
+
+    /*! same order as operator<(vec3i,vec3i) - and thus, the
+        std::map<vec3i,int> this used to use - without that
+        operator's type punning, which the optimizer does not
+        reliably honor on vec3is inside other structs */
+    static bool lessThan(const vec3i &a, const vec3i &b)
+    {
+      if (a.y != b.y) return uint32_t(a.y) < uint32_t(b.y);
+      if (a.x != b.x) return uint32_t(a.x) < uint32_t(b.x);
+      return uint32_t(a.z) < uint32_t(b.z);
+    }
+
+    /*! returns the surviving cells, ordered by position */
+    std::vector<std::pair<vec3i,int>> finalize() const
+    {
+      std::vector<std::pair<vec3i,int>> sorted = cells;
+      std::stable_sort(sorted.begin(),sorted.end(),
+                       [](const std::pair<vec3i,int> &a,
+                          const std::pair<vec3i,int> &b)
+                       { return lessThan(a.first,b.first); });
+      std::vector<std::pair<vec3i,int>> result;
+      for (size_t i=0;i<sorted.size();i++)
+        if (i+1 == sorted.size() || sorted[i+1].first != sorted[i].first)
+          result.push_back(sorted[i]);
+      return result;
+    }
+
+    std::vector<std::pair<vec3i,int>> cells;
+  };
+
   /* 
      something more coplex, with a mix of 4s, 2s, and 1s.
   */
   void test4()
   {
-    std::map<vec3i,int> grid; 
-    addOrOverWriteCells(grid,{0,0,0},{8,4,4},1);
-    addOrOverWriteCells(grid,{0,0,0},{8,2,2},0);
+    CellGrid grid; 
+    grid.addOrOverWriteCells({0,0,0},{8,4,4},1);
+    grid.addOrOverWriteCells({0,0,0},{8,2,2},0);
 
-    // addOrOverWriteCells(grid,{0,0,0},{4,4,4},1);
-    // addOrOverWriteCells(grid,{0,0,0},{4,2,2},0);
+    // grid.addOrOverWriteCells({0,0,0},{4,4,4},1);
+    // grid.addOrOverWriteCells({0,0,0},{4,2,2},0);
     
-    // addOrOverWriteCells(grid,{0,0,0},{8,8,8},1);
-    // addOrOverWriteCells(grid,{0,0,0},{8,4,4},0);
+    // grid.addOrOverWriteCells({0,0,0},{8,8,8},1);
+    // grid.addOrOverWriteCells({0,0,0},{8,4,4},0);
     
-    // addOrOverWriteCells(grid,{0,8,0},{8,8,16},1);
-    // addOrOverWriteCells(grid,{14,0,12},{2,8,4},0);
-    // addOrOverWriteCells(grid,{6,8,6},{2,2,8},0);
+    // grid.addOrOverWriteCells({0,8,0},{8,8,16},1);
+    // grid.addOrOverWriteCells({14,0,12},{2,8,4},0);
+    // grid.addOrOverWriteCells({6,8,6},{2,2,8},0);
 
-    for (auto &cell : grid) {
+    for (auto &cell : grid.finalize()) {
       vec3i pos = cell.first;
       int level = cell.second;
       float scalar = 1e-5f*length(vec3f(pos));
@@ -120,15 +160,15 @@ namespace umesh {
 
   void test5()
   {
-    std::map<vec3i,int> grid; 
-    addOrOverWriteCells(grid,{0,0,0},{16,16,16},2);
-    addOrOverWriteCells(grid,{0,0,8},{16,8,8},1);
-    addOrOverWriteCells(grid,{0,8,0},{8,8,16},1);
+    CellGrid grid; 
+    grid.addOrOverWriteCells({0,0,0},{16,16,16},2);
+    grid.addOrOverWriteCells({0,0,8},{16,8,8},1);
+    grid.addOrOverWriteCells({0,8,0},{8,8,16},1);
     
-    // addOrOverWriteCells(grid,{4,8,4},{4,4,4},0);
-    addOrOverWriteCells(grid,{0,0,12},{2,2,2},0);
+    // grid.addOrOverWriteCells({4,8,4},{4,4,4},0);
+    grid.addOrOverWriteCells({0,0,12},{2,2,2},0);
 
-    for (auto &cell : grid) {
+    for (auto &cell : grid.finalize()) {
       vec3i pos = cell.first;
       int level = cell.second;
       float scalar = 1e-5f*length(vec3f(pos));
@@ -137,7 +177,7 @@ namespace umesh {
       cells.write((char*)&level,sizeof(level));
       scalars.write((char*)&scalar,sizeof(scalar));
     }
-    PRINT(grid.size());
+    PRINT(grid.finalize().size());
   }
   
   
@@ -17,6 +17,7 @@
 #include "umesh/io/ugrid32.h"
 #include "umesh/io/UMesh.h"
 #include "umesh/extractIsoSurface.h"
+#include <sstream>
 
 namespace umesh {
 
@@ -25,13 +26,30 @@ namespace umesh {
     if (error != "")
       std::cerr << "Error : " << error  << "\n\n";
 
-    std::cout << "Usage: ./umeshExtractIsoSurface <in.umesh> -iso scalarValue (-o <out.umesh> | --obj file.obj)" << std::endl;;
+    std::cout << "Usage: ./umeshExtractIsoSurface <in.umesh> (-iso scalarValue)+ (-o <out.umesh> | --obj file.obj)" << std::endl;;
+    std::cout << "       -iso can be given multiple times (or as a comma-separated list with --iso-values);" << std::endl;
+    std::cout << "       all iso-surfaces then get extracted in a single pass, and saved as" << std::endl;
+    std::cout << "       <out>_iso<i>.umesh / <file>_iso<i>.obj, with i the index of the iso-value" << std::endl;
     exit (error != "");
   };
   
+  /*! with a single iso-value, output goes to the given file; with
+      multiple ones, iso-surface 'i' goes to <base>_iso<i><ext> */
+  std::string fileNameFor(const std::string &fileName, size_t i, size_t numIsoValues)
+  {
+    if (numIsoValues == 1) return fileName;
+    const size_t dot = fileName.find_last_of('.');
+    const size_t slash = fileName.find_last_of('/');
+    const bool hasExt = dot != std::string::npos
+      && (slash == std::string::npos || dot > slash);
+    const std::string base = hasExt ? fileName.substr(0,dot) : fileName;
+    const std::string ext  = hasExt ? fileName.substr(dot) : "";
+    return base+"_iso"+std::to_string(i)+ext;
+  }
+  
   extern "C" int main(int ac, char **av)
   {
-    float isoValue = std::numeric_limits<float>::infinity();
+    std::vector<float> isoValues;
     std::string inFileName;
     std::string outFileName;
     std::string objFileName;
@@ -44,7 +62,13 @@ namespace umesh {
       else if (arg == "-o")
         outFileName = av[++i];
       else if (arg == "-iso" || arg == "--iso-value" || arg == "--iso")
-        isoValue = std::stof(av[++i]);
+        isoValues.push_back(std::stof(av[++i]));
+      else if (arg == "--iso-values") {
+        std::stringstream list(av[++i]);
+        std::string value;
+        while (std::getline(list,value,','))
+          isoValues.push_back(std::stof(value));
+      }
       else if (arg == "--obj")
         objFileName = av[++i];
       else if (arg[0] != '-')
@@ -56,7 +80,7 @@ namespace umesh {
     if (inFileName == "") usage("no input file specified");
     if (outFileName == "" && objFileName == "") usage("neither obj nor umesh output file specified");
     
-    if (isoValue == std::numeric_limits<float>::infinity())
+    if (isoValues.empty())
       usage("no iso-value specified");
     
     std::cout << "loading umesh from " << inFileName << std::endl;
@@ -74,21 +98,27 @@ namespace umesh {
       std::cout << UMESH_TERMINAL_DEFAULT << std::endl;
     }
     
-    UMesh::SP result = extractIsoSurface(in,isoValue);
-    std::cout << "done extracting isovalue, found " << result->toString() << std::endl;
-    if (outFileName != "") {
-      std::cout << "saving to " << outFileName << std::endl;
-      result->saveTo(outFileName);
-    }
-    if (objFileName != "") {
-      std::cout << "writing in OBJ format to " << objFileName << std::endl;
-      std::cout << UMESH_TERMINAL_RED << "# WARNING - this can take a while!"
-                << UMESH_TERMINAL_DEFAULT << std::endl;
-      std::ofstream out(objFileName);
-      for (auto v : result->vertices)
-        out << "v " << v.x << " " << v.y << " " << v.z << std::endl;
-      for (auto t : result->triangles)
-        out << "f " << (t.x+1) << " " << (t.y+1) << " " << (t.z+1) << std::endl;
+    std::vector<UMesh::SP> results = extractIsoSurfaces(in,isoValues);
+    for (size_t i=0;i<results.size();i++) {
+      UMesh::SP result = results[i];
+      std::cout << "done extracting isovalue " << isoValues[i]
+                << ", found " << result->toString() << std::endl;
+      if (outFileName != "") {
+        const std::string fileName = fileNameFor(outFileName,i,results.size());
+        std::cout << "saving to " << fileName << std::endl;
+        result->saveTo(fileName);
+      }
+      if (objFileName != "") {
+        const std::string fileName = fileNameFor(objFileName,i,results.size());
+        std::cout << "writing in OBJ format to " << fileName << std::endl;
+        std::cout << UMESH_TERMINAL_RED << "# WARNING - this can take a while!"
+                  << UMESH_TERMINAL_DEFAULT << std::endl;
+        std::ofstream out(fileName);
+        for (auto v : result->vertices)
+          out << "v " << v.x << " " << v.y << " " << v.z << std::endl;
+        for (auto t : result->triangles)
+          out << "f " << (t.x+1) << " " << (t.y+1) << " " << (t.z+1) << std::endl;
+      }
     }
       
     std::cout << "done all ..." << std::endl;
@@ -97,7 +97,7 @@ namespace umesh {
       return UMesh::loadFrom(fileName);
     
     if (fileName.substr(fileName.size()-8) == ".ugrid64")
-      return io::UGrid64Loader::load(fileName);
+      return io::UGrid64Loader::loadMapped(fileName);
 
     throw std::runtime_error("could not determine input format"
                              " (only supporting ugrid64 or umesh for now)");
@@ -94,7 +94,7 @@ namespace umesh {
     if (outFileName == "") usage("no output file specified");
     
     std::cout << "loading off from " << ugridFileName << " + " << scalarsFileName << std::endl;
-    UMesh::SP in = io::UGrid64Loader::load(ugridFileName,scalarsFileName);
+    UMesh::SP in = io::UGrid64Loader::loadMapped(ugridFileName,scalarsFileName);
     if (scalarsFileName == "")
       for (size_t i=0;i<in->vertices.size();i++)
         in->vertexTag.push_back(i);
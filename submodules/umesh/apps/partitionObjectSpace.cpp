@@ -24,7 +24,8 @@
 #include "umesh/io/ugrid32.h"
 #include "umesh/io/UMesh.h"
 #include "umesh/RemeshHelper.h"
-#include <queue>
+#include "umesh/partition.h"
+#include <sstream>
 
 namespace umesh {
 
@@ -44,68 +45,19 @@ namespace umesh {
     exit( error != "");
   }
 
-  struct Brick {
-    std::vector<UMesh::PrimRef> prims;
-    box3f bounds;
-    box3f centBounds;
-  };
-
-  void split(UMesh::SP mesh,
-             Brick *in,
-             Brick *out[2])
-  {
-    // PING;
-    // PRINT(in->prims.size());
-    // PRINT(in->bounds);
-    // PRINT(in->centBounds);
-
-    if (in->centBounds.lower == in->centBounds.upper)
-      throw std::runtime_error("can't split this any more ...");
-
-    int dim = arg_max(in->centBounds.size());
-    float pos = in->centBounds.center()[dim];
-    std::cout << "splitting brick\tw/ bounds " << in->bounds << " cent " << in->centBounds << std::endl;
-    std::cout << "splitting at " << char('x'+dim) << "=" << pos << std::endl;
-
-    out[0] = new Brick;
-    out[1] = new Brick;
-    for (auto prim : in->prims) {
-      const box3f pb = mesh->getBounds(prim);
-      int side = (pb.center()[dim] < pos) ? 0 : 1;
-      out[side]->prims.push_back(prim);
-      out[side]->bounds.extend(pb);
-      out[side]->centBounds.extend(pb.center());
-    }
-    std::cout << "done splitting " << prettyNumber(in->prims.size()) << " prims\tw/ bounds " << in->bounds << std::endl;
-    std::cout << "into L = " << prettyNumber(out[0]->prims.size()) << " prims\tw/ bounds " << out[0]->bounds << std::endl;
-    std::cout << " and R = " << prettyNumber(out[1]->prims.size()) << " prims\tw/ bounds " << out[1]->bounds << std::endl;
-  }
-  
-  void createInitialBrick(std::priority_queue<std::pair<int,Brick *>> &bricks,
-                          UMesh::SP in)
-  {
-    Brick *brick = new Brick;
-    in->createVolumePrimRefs(brick->prims);
-    for (auto prim : brick->prims) {
-      const box3f pb = in->getBounds(prim);
-      brick->bounds.extend(pb);
-      brick->centBounds.extend(pb.center());
-    }
-           
-    bricks.push({(int)brick->prims.size(),brick});
-  }
-
   void writeBrick(UMesh::SP in,
                   const std::string &fileBase,
-                  Brick *brick)
+                  const Brick &brick)
   {
     UMesh::SP out = std::make_shared<UMesh>();
     RemeshHelper indexer(*out);
-    for (auto prim : brick->prims) 
-      indexer.add(in,prim);
+    indexer.add(in,brick.prims);
     const std::string fileName = fileBase+".umesh";
-    std::cout << "saving out " << fileName
-              << " w/ " << prettyNumber(out->size()) << " prims" << std::endl;
+    // bricks get written in parallel, so print each line in one go
+    std::stringstream msg;
+    msg << "saving out " << fileName
+        << " w/ " << prettyNumber(out->size()) << " prims\n";
+    std::cout << msg.str() << std::flush;
     io::saveBinaryUMesh(fileName,out);
   }
   
@@ -113,8 +65,8 @@ namespace umesh {
   {
     std::string inFileName;
     std::string outFileBase;
-    int leafThreshold = 1<<30;
-    int maxBricks = 1<<30;
+    int leafThreshold = 0;
+    int maxBricks = 0;
     
     for (int i=1;i<ac;i++) {
       const std::string arg = av[i];
@@ -122,8 +74,8 @@ namespace umesh {
         outFileBase = av[++i];
       else if (arg == "-lt" || arg == "--leaf-threshold")
         leafThreshold = atoi(av[++i]);
-      else if (arg == "-mb" || arg == "--max-bricks")
-        leafThreshold = atoi(av[++i]);
+      else if (arg == "-n" || arg == "-mb" || arg == "--max-bricks")
+        maxBricks = atoi(av[++i]);
       else if (arg[0] != '-')
         inFileName = arg;
       else
@@ -132,42 +84,23 @@ namespace umesh {
     
     if (outFileBase == "") usage("no output file name specified");
     if (inFileName == "") usage("no input file name specified");
-    if (leafThreshold == 1<<30 && maxBricks == 1<<30)
+    if (leafThreshold == 0 && maxBricks == 0)
       usage("neither leaf threshold nor max bricks specified");
     std::cout << "loading umesh from " << inFileName << std::endl;
     UMesh::SP in = io::loadBinaryUMesh(inFileName);
     std::cout << "done loading, found " << in->toString() << std::endl;
 
-    std::priority_queue<std::pair<int,Brick *>> bricks;
-    createInitialBrick(bricks,in);
-    
-    while (bricks.size() < maxBricks) {
-      auto biggest = bricks.top(); 
-      std::cout << "########### currently having " << bricks.size()
-                << " bricks, biggest of which has "
-                << prettyNumber(biggest.first) << " prims" << std::endl;
-      if (biggest.first < leafThreshold)
-        break;
-      bricks.pop();
-
-      std::cout << "splitting..." << std::endl;
-      Brick *half[2];
-      split(in,biggest.second,half);
-      bricks.push({(int)half[0]->prims.size(),half[0]});
-      bricks.push({(int)half[1]->prims.size(),half[1]});
-      delete biggest.second;
-    }
+    std::vector<Brick> bricks
+      = partitionObjectSpace(in,maxBricks,leafThreshold);
+    std::cout << "created " << bricks.size() << " bricks" << std::endl;
 
-    char ext[20];
-    std::vector<box3f> brickBounds;
-    for (int brickID=0;!bricks.empty();brickID++) {
-      Brick *brick = bricks.top().second;
-      bricks.pop();
-      sprintf(ext,"_%05d",brickID);
-      writeBrick(in,outFileBase+ext,brick);
-      brickBounds.push_back(brick->bounds);
-      delete brick;
-    }
+    std::vector<box3f> brickBounds(bricks.size());
+    parallel_for(bricks.size(),[&](size_t brickID){
+        char ext[20];
+        sprintf(ext,"_%05d",int(brickID));
+        writeBrick(in,outFileBase+ext,bricks[brickID]);
+        brickBounds[brickID] = bricks[brickID].bounds;
+      });
 
     std::ofstream boundsFile(outFileBase+".bounds",std::ios::binary);
     io::writeVector(boundsFile,brickBounds);
@@ -24,7 +24,8 @@
 #include "umesh/io/ugrid32.h"
 #include "umesh/io/UMesh.h"
 #include "umesh/RemeshHelper.h"
-#include <queue>
+#include "umesh/partition.h"
+#include <sstream>
 
 namespace umesh {
 
@@ -49,88 +50,34 @@ namespace umesh {
     exit( error != "");
   }
 
-  struct Brick {
-    std::vector<UMesh::PrimRef> prims;
-    box3f domain;
-  };
-
-  void split(UMesh::SP mesh,
-             Brick *in,
-             Brick *out[2])
-  {
-    if (in->domain.lower == in->domain.upper)
-      throw std::runtime_error("can't split this any more ...");
-
-    int dim = arg_max(in->domain.size());
-    float pos = in->domain.center()[dim];
-    std::cout << "splitting brick\tw/ domain " << in->domain << std::endl;
-    std::cout << "splitting at " << char('x'+dim) << "=" << pos << std::endl;
-
-    Brick *l = out[0] = new Brick;
-    Brick *r = out[1] = new Brick;
-    l->domain = r->domain = in->domain;
-    l->domain.upper[dim] = pos;
-    r->domain.lower[dim] = pos;
-    box3f lBounds, rBounds;
-
-    for (auto prim : in->prims) {
-      const box3f pb = mesh->getBounds(prim);
-      if (pb.overlaps(l->domain)) {
-        l->prims.push_back(prim);
-        lBounds.extend(pb);
-      }
-      if (pb.overlaps(r->domain)) {
-        r->prims.push_back(prim);
-        rBounds.extend(pb);
-      }
-    }
-    l->domain = intersection(l->domain,lBounds);
-    r->domain = intersection(r->domain,rBounds);
-    
-    std::cout << "done splitting " << prettyNumber(in->prims.size()) << " prims\tw/ domain " << in->domain << std::endl;
-    std::cout << "into L = " << prettyNumber(out[0]->prims.size()) << " prims\tw/ domain " << out[0]->domain << std::endl;
-    std::cout << " and R = " << prettyNumber(out[1]->prims.size()) << " prims\tw/ domain " << out[1]->domain << std::endl;
-  }
-  
-  void createInitialBrick(std::priority_queue<std::pair<int,Brick *>> &bricks,
-                          UMesh::SP in)
-  {
-    Brick *brick = new Brick;
-    in->createVolumePrimRefs(brick->prims);
-    box3f bounds;
-    for (auto prim : brick->prims) {
-      const box3f pb = in->getBounds(prim);
-      bounds.extend(pb);
-    }
-    brick->domain = bounds;
-    bricks.push({(int)brick->prims.size(),brick});
-  }
-
   void writeBrick(UMesh::SP in,
                   const std::string &fileBase,
-                  Brick *brick,
+                  const Brick &brick,
                   range1f &valueRange)
   {
     UMesh::SP out = std::make_shared<UMesh>();
     RemeshHelper indexer(*out);
 
     valueRange = range1f();
-    for (auto pr : brick->prims)
+    for (auto pr : brick.prims)
       valueRange.extend(in->getValueRange(pr));
     
+    // bricks get written in parallel, so print each line in one go
+    std::stringstream msg;
     if (primRefsOnly) {
       const std::string fileName = fileBase+".primRefs";
-      std::cout << "saving out " << fileName
-                << " w/ " << prettyNumber(brick->prims.size()) << " primsRefs" << std::endl;
+      msg << "saving out " << fileName
+          << " w/ " << prettyNumber(brick.prims.size()) << " primsRefs\n";
+      std::cout << msg.str() << std::flush;
       std::ofstream out(fileName,std::ios::binary);
-      io::writeVector(out,brick->prims);
+      io::writeVector(out,brick.prims);
       io::writeElement(out,valueRange);
     } else {
-      for (auto prim : brick->prims) 
-        indexer.add(in,prim);
+      indexer.add(in,brick.prims);
       const std::string fileName = fileBase+".umesh";
-      std::cout << "saving out " << fileName
-                << " w/ " << prettyNumber(out->size()) << " prims" << std::endl;
+      msg << "saving out " << fileName
+          << " w/ " << prettyNumber(out->size()) << " prims\n";
+      std::cout << msg.str() << std::flush;
       io::saveBinaryUMesh(fileName,out);
     }
   }
@@ -139,8 +86,8 @@ namespace umesh {
   {
     std::string inFileName;
     std::string outFileBase;
-    int leafThreshold = 1<<30;
-    int maxBricks = 1<<30;
+    int leafThreshold = 0;
+    int maxBricks = 0;
     
     for (int i=1;i<ac;i++) {
       const std::string arg = av[i];
@@ -162,53 +109,25 @@ namespace umesh {
 
     if (outFileBase == "") usage("no output file name specified");
     if (inFileName == "") usage("no input file name specified");
-    if (leafThreshold == 1<<30 && maxBricks == 1<<30)
+    if (leafThreshold == 0 && maxBricks == 0)
       usage("neither leaf threshold nor max bricks specified");
 
     std::cout << "loading umesh from " << inFileName << std::endl;
     UMesh::SP in = io::loadBinaryUMesh(inFileName);
     std::cout << "done loading, found " << in->toString() << std::endl;
     
-    std::priority_queue<std::pair<int,Brick *>> bricks;
-    createInitialBrick(bricks,in);
-    
-    while (bricks.size() < maxBricks) {
-      auto biggest = bricks.top(); 
-      std::cout << "########### currently having " << bricks.size()
-                << " bricks, biggest of which has "
-                << prettyNumber(biggest.first) << " prims" << std::endl;
-      if (biggest.first < leafThreshold)
-        break;
-      bricks.pop();
-
-      std::cout << "splitting..." << std::endl;
-      Brick *half[2];
-      split(in,biggest.second,half);
-      for (int i=0;i<2;i++) {
-        if (half[i]->prims.empty() ||
-            reduce_min(half[i]->domain.size()) == 0.f) {
-          std::cout << "WARNING: got invalid split, dropping!" << std::endl;
-          delete half[i];
-        }
-        else
-          bricks.push({ (int)half[i]->prims.size(),half[i]});
-      }
-      delete biggest.second;
-    }
-
-    char ext[20];
-    std::vector<box3f> brickDomains;
-    std::vector<range1f> valueRanges;
-    for (int brickID=0;!bricks.empty();brickID++) {
-      Brick *brick = bricks.top().second;
-      bricks.pop();
-      sprintf(ext,"_%05d",brickID);
-      range1f valueRange;
-      writeBrick(in,outFileBase+ext,brick,valueRange);
-      brickDomains.push_back(brick->domain);
-      valueRanges.push_back(valueRange);
-      delete brick;
-    }
+    std::vector<Brick> bricks
+      = partitionSpatially(in,maxBricks,leafThreshold);
+    std::cout << "created " << bricks.size() << " bricks" << std::endl;
+
+    std::vector<box3f> brickDomains(bricks.size());
+    std::vector<range1f> valueRanges(bricks.size());
+    parallel_for(bricks.size(),[&](size_t brickID){
+        char ext[20];
+        sprintf(ext,"_%05d",int(brickID));
+        writeBrick(in,outFileBase+ext,bricks[brickID],valueRanges[brickID]);
+        brickDomains[brickID] = bricks[brickID].domain;
+      });
 
     std::ofstream boundsFile(outFileBase+".domains",std::ios::binary);
     std::cout << "writing " << brickDomains.size() << " brick domains" << std::endl;
@@ -25,17 +25,22 @@ namespace umesh {
     if (error != "")
       std::cerr << "\nError : " << error  << "\n\n";
 
-    std::cout << "Usage: ./umeshSanityCheck <in.umesh>\n\n";
+    std::cout << "Usage: ./umeshSanityCheck <in.umesh> [--level none|cheap|full]\n\n";
+    std::cout << "--level : cheap only checks index ranges, full (default) also\n";
+    std::cout << "          checks that no face is shared by more than two prims\n\n";
     exit(error != "");
   };
   
   extern "C" int main(int ac, char **av)
   {
     std::string inFileName;
+    CheckLevel level = CHECK_LEVEL_FULL;
     for (int i=1;i<ac;i++) {
       const std::string arg = av[i];
       if (arg == "-h")
         usage();
+      else if (arg == "--level")
+        level = checkLevelFromString(av[++i]);
       else if (arg[0] != '-')
         inFileName = arg;
       else
@@ -48,7 +53,7 @@ namespace umesh {
     UMesh::SP in = io::loadBinaryUMesh(inFileName);
 
     std::cout << "UMesh info:\n" << in->toString(false) << std::endl;
-    sanityCheck(in);
+    sanityCheck(in,0,level);
     std::cout << "all sanity checks went through ..." << std::endl;
   }
   
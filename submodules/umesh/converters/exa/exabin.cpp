@@ -1,5 +1,5 @@
 // ======================================================================== //
-// Copyright 2018-2019 Ingo Wald                                            //
+// Copyright 2018-2021 Ingo Wald                                            //
 //                                                                          //
 // Licensed under the Apache License, Version 2.0 (the "License");          //
 // you may not use this file except in compliance with the License.         //
@@ -15,81 +15,163 @@
 // ======================================================================== //
 
 #include "exabin.h"
+#include "umesh/radixSort.h"
 #include <fstream>
 #include <map>
 
-namespace tetty {
+namespace umesh {
   namespace io {
 
+    /*! offset of hex corner i (in VTK order), in units of cell width */
+    static const vec3i cornerOffset[8] = {
+      {0,0,0},{1,0,0},{1,1,0},{0,1,0},
+      {0,0,1},{1,0,1},{1,1,1},{0,1,1}
+    };
+
+    inline vec3i cornerOf(const ExaCell &cell, int i)
+    { return cell.pos + cornerOffset[i]*(1<<cell.level); }
+
+    std::vector<ExaCell> readExaCells(const std::string &cellsFileName)
+    {
+      std::ifstream in(cellsFileName,std::ios::binary|std::ios::ate);
+      if (!in.good())
+        throw std::runtime_error("Unable to open file " + cellsFileName);
+      const size_t numBytes = in.tellg();
+      if (numBytes % sizeof(ExaCell))
+        throw std::runtime_error("size of " + cellsFileName
+                                 + " is not a multiple of the cell size");
+      in.seekg(0);
+      std::vector<ExaCell> cells(numBytes / sizeof(ExaCell));
+      readArray(in,cells.data(),cells.size());
+      std::cout << "#exabin: read " << prettyNumber(cells.size()) << " cells" << std::endl;
+      return cells;
+    }
 
     size_t getOrAddVertex(vec3i pos, std::map<vec3i,size_t> &mapping, UMesh::SP umesh)
     {
       auto it = mapping.find(pos);
       if (it != mapping.end()) return it->second;
 
-      size_t newID = umesh->vertex.size();
-      assert(vec3i(vec3f(pos)) == pos);
-      umesh->vertex.push_back(vec3f(pos));
+      size_t newID = umesh->vertices.size();
+      umesh->vertices.push_back(vec3f(pos));
       mapping[pos] = newID;
       return newID;
     }
 
-    UMesh::SP importExaBin(const std::string &hexFileName,
-                           const std::string &scalarFileName)
+    UMesh::SP importExaBinSerial(const std::vector<ExaCell> &cells)
     {
-      std::ifstream hexFile(hexFileName);
-      if (!hexFile.is_open()) 
-        throw std::runtime_error(std::string("Unable to open file " + hexFileName));
-      assert(hexFile.good());
-      
-      std::ifstream scalarFile(scalarFileName);
-      assert(scalarFile.good());
-      if (!scalarFile.is_open()) 
-        throw std::runtime_error(std::string("Unable to open file " + scalarFileName));
-      
       UMesh::SP result = std::make_shared<UMesh>();
-      result->perHex = std::make_shared<Attribute>();
-      // result->perHex->value.push_back((float)inScalar);
-
       std::map<vec3i,size_t> vertexID;
-      
-      struct ExaHex {
-        vec3i pos;
-        int   level;
-      };
-      int nextPing = 1;
-      while (!hexFile.eof()) {
-        assert(!scalarFile.eof());
-        ExaHex inHex;
-        float inScalar;
-
-        assert(hexFile.good());
-        hexFile.read((char*)&inHex,sizeof(inHex));
-        assert(scalarFile.good());
-        scalarFile.read((char*)&inScalar,sizeof(inScalar));
-        int width = 1 << inHex.level;
-
+      for (auto &cell : cells) {
         UMesh::Hex hex;
-        hex.base.x = (int)getOrAddVertex(inHex.pos+vec3i(0,0,0)*width,vertexID,result);
-        hex.base.y = (int)getOrAddVertex(inHex.pos+vec3i(0,0,1)*width,vertexID,result);
-        hex.base.z = (int)getOrAddVertex(inHex.pos+vec3i(0,1,1)*width,vertexID,result);
-        hex.base.w = (int)getOrAddVertex(inHex.pos+vec3i(0,1,0)*width,vertexID,result);
-        hex.top.x = (int)getOrAddVertex(inHex.pos+vec3i(1,0,0)*width,vertexID,result);
-        hex.top.y = (int)getOrAddVertex(inHex.pos+vec3i(1,0,1)*width,vertexID,result);
-        hex.top.z = (int)getOrAddVertex(inHex.pos+vec3i(1,1,1)*width,vertexID,result);
-        hex.top.w = (int)getOrAddVertex(inHex.pos+vec3i(1,1,0)*width,vertexID,result);
-
+        for (int i=0;i<8;i++)
+          hex[i] = (int)getOrAddVertex(cornerOf(cell,i),vertexID,result);
         result->hexes.push_back(hex);
-        result->perHex->value.push_back((float)inScalar);
+      }
+      result->finalize();
+      return result;
+    }
+
+    /*! one corner of one cell: its (packed) position, and which
+        corner of which cell it is (ie, 8*cellID+cornerID) */
+    struct CornerUse {
+      uint64_t key;
+      uint64_t useID;
+    };
+
+    UMesh::SP importExaBin(const std::vector<ExaCell> &cells)
+    {
+      UMesh::SP result = std::make_shared<UMesh>();
+      const size_t numCells = cells.size();
+      const size_t numUses  = 8*numCells;
+      if (numCells == 0) return result;
 
-        if (result->hexes.size() >= nextPing) {
-          std::cout << "#exabin: now have " << prettyNumber(result->hexes.size()) << " hexes ..." << std::endl;
-          nextPing += nextPing;
-        }
+      // ------------------------------------------------------------------
+      // find range of corner coordinates, so we know how many bits to
+      // use per dimension of the corner keys
+      // ------------------------------------------------------------------
+      const size_t blockSize = 64*1024;
+      const size_t numBlocks = divRoundUp(numCells,blockSize);
+      std::vector<vec3i> blockLower(numBlocks), blockUpper(numBlocks);
+      parallel_for(numBlocks,[&](size_t blockID){
+          vec3i lo = cells[blockID*blockSize].pos;
+          vec3i hi = lo;
+          const size_t end = std::min(numCells,(blockID+1)*blockSize);
+          for (size_t cellID=blockID*blockSize;cellID<end;cellID++) {
+            lo = min(lo,cornerOf(cells[cellID],0));
+            hi = max(hi,cornerOf(cells[cellID],6));
+          }
+          blockLower[blockID] = lo;
+          blockUpper[blockID] = hi;
+        });
+      vec3i lower = blockLower[0], upper = blockUpper[0];
+      for (size_t blockID=1;blockID<numBlocks;blockID++) {
+        lower = min(lower,blockLower[blockID]);
+        upper = max(upper,blockUpper[blockID]);
       }
+      int bitsPerDim = 1;
+      for (int d=0;d<3;d++)
+        bitsPerDim = std::max(bitsPerDim,
+                              bitsRequiredFor(size_t(int64_t(upper[d])-lower[d])+1));
+      if (3*bitsPerDim > 64)
+        throw std::runtime_error("exa cell coordinates span too wide a range for 64-bit corner keys");
+
+      // ------------------------------------------------------------------
+      // sort all corner uses by position
+      // ------------------------------------------------------------------
+      std::vector<CornerUse> uses(numUses);
+      parallel_for(numBlocks,[&](size_t blockID){
+          const size_t end = std::min(numCells,(blockID+1)*blockSize);
+          for (size_t cellID=blockID*blockSize;cellID<end;cellID++)
+            for (int i=0;i<8;i++) {
+              const vec3i c = cornerOf(cells[cellID],i) - lower;
+              uses[8*cellID+i].key
+                = (uint64_t(c.x) << (2*bitsPerDim))
+                | (uint64_t(c.y) << bitsPerDim)
+                | uint64_t(c.z);
+              uses[8*cellID+i].useID = 8*cellID+i;
+            }
+        });
+      radixSort(uses.data(),numUses,3*bitsPerDim,
+                [](const CornerUse &use){ return use.key; });
+
+      // ------------------------------------------------------------------
+      // the sort is stable, so the first use in each run of equal keys
+      // is that vertex's first use in cell order; numbering those with
+      // a prefix sum gives vertex IDs in order of first use
+      // ------------------------------------------------------------------
+      std::vector<uint64_t> vertexOfUse(numUses,0);
+      parallel_for_blocked(0,numUses,blockSize,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++)
+            if (i == 0 || uses[i].key != uses[i-1].key)
+              vertexOfUse[uses[i].useID] = 1;
+        });
+      const size_t numVertices
+        = parallel_exclusive_scan(vertexOfUse.data(),vertexOfUse.data(),numUses);
+      if (numVertices >= (1ull<<31))
+        throw std::runtime_error("too many vertices for 32-bit vertex indices");
+
+      result->vertices.resize(numVertices);
+      result->hexes.resize(numCells);
+      parallel_for_blocked(0,numUses,blockSize,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) {
+            // no point is a corner of more than eight cells, so this
+            // walks back at most seven steps
+            size_t first = i;
+            while (first > 0 && uses[first-1].key == uses[i].key) first--;
+            const size_t firstUse = uses[first].useID;
+            const int vertexID = int(vertexOfUse[firstUse]);
+            const size_t useID = uses[i].useID;
+            result->hexes[useID/8][int(useID%8)] = vertexID;
+            if (first == i)
+              result->vertices[vertexID]
+                = vec3f(cornerOf(cells[firstUse/8],int(firstUse%8)));
+          }
+        });
+
       result->finalize();
       return result;
     }
 
-  } // ::tetty::io
-} // ::tetty
+  } // ::umesh::io
+} // ::umesh
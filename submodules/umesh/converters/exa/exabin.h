@@ -1,5 +1,5 @@
 // ======================================================================== //
-// Copyright 2018-2019 Ingo Wald                                            //
+// Copyright 2018-2021 Ingo Wald                                            //
 //                                                                          //
 // Licensed under the Apache License, Version 2.0 (the "License");          //
 // you may not use this file except in compliance with the License.         //
@@ -16,14 +16,35 @@
 
 #pragma once
 
-#include "tetty/io/IO.h"
-#include "tetty/umesh/UMesh.h"
+#include "umesh/io/IO.h"
+#include "umesh/UMesh.h"
 
-namespace tetty {
+namespace umesh {
   namespace io {
 
-    UMesh::SP importExaBin(const std::string &hexFileName,
-                           const std::string &scalarFileName);
+    /*! one cell of an exa .cells file */
+    struct ExaCell {
+      vec3i pos;
+      int   level;
+    };
 
-  } // ::tetty::io
-} // ::tetty
+    /*! reads all cells of an exa .cells file */
+    std::vector<ExaCell> readExaCells(const std::string &cellsFileName);
+
+    /*! turns each cell into one hex (in VTK order, and in the same
+        order as the cells - so a per-cell scalars file applies to the
+        hexes as is), with corners shared between cells welded into
+        one vertex. Vertices are numbered in order of first use.
+
+        Computes integer corner keys for all cells in parallel,
+        radix-sorts them, and numbers the unique ones with a prefix
+        sum over their first uses. */
+    UMesh::SP importExaBin(const std::vector<ExaCell> &cells);
+
+    /*! same as importExaBin(), but welds corners by looking them up
+        in a std::map, one after another; same result, only much
+        slower - kept as a reference */
+    UMesh::SP importExaBinSerial(const std::vector<ExaCell> &cells);
+
+  } // ::umesh::io
+} // ::umesh
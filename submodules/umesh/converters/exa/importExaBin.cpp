@@ -0,0 +1,99 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* converts an exa .cells file into a cell-centered hex mesh (one hex
+   per cell, in cell order, so the matching .scalars file holds one
+   value per hex) */
+
+#include "exabin.h"
+
+namespace umesh {
+
+  void usage(const std::string &error = "")
+  {
+    if (error != "") std::cout << "Error: " << error << std::endl << std::endl;
+
+    std::cout << "usage: umeshImportExaBin in.cells -o out.umesh [--serial|--check]" << std::endl;
+    std::cout << "--serial : weld vertices with the serial, std::map-based reference" << std::endl;
+    std::cout << "--check  : run both, and make sure they produce the same mesh" << std::endl;
+    exit(error != "");
+  }
+
+  bool sameMesh(const UMesh &a, const UMesh &b)
+  {
+    if (a.vertices.size() != b.vertices.size() ||
+        a.hexes.size() != b.hexes.size())
+      return false;
+    for (size_t i=0;i<a.vertices.size();i++)
+      if (a.vertices[i] != b.vertices[i]) return false;
+    for (size_t i=0;i<a.hexes.size();i++)
+      for (int j=0;j<8;j++)
+        if (a.hexes[i][j] != b.hexes[i][j]) return false;
+    return true;
+  }
+
+  extern "C" int main(int ac, char **av)
+  {
+    std::string inFileName;
+    std::string outFileName;
+    bool serial = false;
+    bool check  = false;
+    for (int i = 1; i < ac; i++) {
+      const std::string arg = av[i];
+      if (arg == "-h")
+        usage();
+      else if (arg == "-o")
+        outFileName = av[++i];
+      else if (arg == "--serial")
+        serial = true;
+      else if (arg == "--check")
+        check = true;
+      else if (arg[0] != '-')
+        inFileName = arg;
+      else
+        usage("unknown cmd-line arg '"+arg+"'");
+    }
+    if (inFileName == "") usage("no input file specified");
+    if (outFileName == "" && !check) usage("no output file specified");
+
+    std::vector<io::ExaCell> cells = io::readExaCells(inFileName);
+    UMesh::SP mesh;
+    const double t = timeOf([&]{
+        mesh = serial ? io::importExaBinSerial(cells) : io::importExaBin(cells);
+      });
+    std::cout << "done importing (" << (serial ? "serial" : "parallel")
+              << ", " << t << "s), found " << mesh->toString() << std::endl;
+
+    if (check) {
+      UMesh::SP ref;
+      const double tRef = timeOf([&]{
+          ref = serial ? io::importExaBin(cells) : io::importExaBinSerial(cells);
+        });
+      std::cout << "other path took " << tRef << "s" << std::endl;
+      if (!sameMesh(*mesh,*ref))
+        throw std::runtime_error("parallel and serial exa import differ!");
+      std::cout << "both paths produced the same mesh" << std::endl;
+    }
+
+    if (outFileName != "") {
+      std::cout << "saving to " << outFileName << std::endl;
+      mesh->saveTo(outFileName);
+    }
+    std::cout << "done ..." << std::endl;
+    return 0;
+  }
+
+} // ::umesh
@@ -24,6 +24,10 @@
 #include <algorithm>
 #include <string.h>
 #include <fstream>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
 
 #ifndef PRINT
 #ifdef __CUDA_ARCH__
@@ -77,21 +81,25 @@ namespace umesh {
       shold then end up next to each other after sorting) */
   struct FacetComparator {
     inline 
-    bool operator()(const Facet &a, const Facet &b) const {
+    bool operator()(const vec4i &a, const vec4i &b) const {
       return
-        (a.vertexIdx.x < b.vertexIdx.x)
+        (a.x < b.x)
         ||
-        ((a.vertexIdx.x == b.vertexIdx.x) &&
-         (a.vertexIdx.y <  b.vertexIdx.y))
+        ((a.x == b.x) &&
+         (a.y <  b.y))
         ||
-        ((a.vertexIdx.x == b.vertexIdx.x) &&
-         (a.vertexIdx.y == b.vertexIdx.y) &&
-         (a.vertexIdx.z <  b.vertexIdx.z))
+        ((a.x == b.x) &&
+         (a.y == b.y) &&
+         (a.z <  b.z))
         ||
-        ((a.vertexIdx.x == b.vertexIdx.x) &&
-         (a.vertexIdx.y == b.vertexIdx.y) &&
-         (a.vertexIdx.z == b.vertexIdx.z) &&
-         (a.vertexIdx.w <  b.vertexIdx.w));
+        ((a.x == b.x) &&
+         (a.y == b.y) &&
+         (a.z == b.z) &&
+         (a.w <  b.w));
+    }
+    inline 
+    bool operator()(const Facet &a, const Facet &b) const {
+      return (*this)(a.vertexIdx,b.vertexIdx);
     }
   };
 
@@ -530,20 +538,370 @@ namespace umesh {
   void postfixSum(uint64_t *faceIndices,
                  size_t numFacets)
   {
-    size_t sum = 0;
-    for (size_t i=0;i<numFacets;i++) {
-      size_t old = faceIndices[i];
-      sum += old;
-      faceIndices[i] = sum;
+    parallel_inclusive_scan(faceIndices,faceIndices,numFacets);
+  }
+
+
+  // ==================================================================
+  // bucketed path: facets counting-sorted by their smallest vertex
+  // ==================================================================
+
+  /*! a facet in compressed form: its prim ref (prim index, type and
+      facet index) packed into a single 64-bit word, with two spare
+      bits for the facet's orientation and for tagging the first
+      facet of every face once those are known; its vertex indices
+      get re-computed from the prim whenever they're needed - 8 bytes
+      per facet instead of the 32 bytes of a 'Facet' */
+  enum { REF_FIRST_OF_FACE = 1, REF_ORIENTATION = 2 };
+  
+  inline uint64_t packRef(const PrimFacetRef &prim)
+  {
+    return (uint64_t(prim.primIdx) << 8)
+      | (uint64_t(prim.primType) << 5)
+      | (uint64_t(prim.facetIdx) << 2);
+  }
+
+  inline PrimFacetRef unpackRef(uint64_t ref)
+  {
+    PrimFacetRef prim;
+    prim.facetIdx = (ref >> 2) & 7;
+    prim.primType = (ref >> 5) & 7;
+    prim.primIdx  = int64_t(ref >> 8);
+    return prim;
+  }
+
+  /*! writes the facets of prim #jobIdx (in the same tets-pyrs-wedges-
+      hexes numbering as writeFacets()) to 'facets', and returns how
+      many there are */
+  inline int writePrimFacets(Facet *facets, size_t jobIdx, const InputMesh &mesh)
+  {
+    if (jobIdx < mesh.numTets) {
+      writeTetFacets(facets,jobIdx,mesh);
+      return 4;
+    }
+    jobIdx -= mesh.numTets;
+    if (jobIdx < mesh.numPyrs) {
+      writePyrFacets(facets,jobIdx,mesh);
+      return 5;
     }
+    jobIdx -= mesh.numPyrs;
+    if (jobIdx < mesh.numWedges) {
+      writeWedgeFacets(facets,jobIdx,mesh);
+      return 5;
+    }
+    jobIdx -= mesh.numWedges;
+    writeHexFacets(facets,jobIdx,mesh);
+    return 6;
+  }
+
+  /*! re-computes the (canonically ordered) facet that given packed
+      ref refers to */
+  inline Facet facetOf(uint64_t ref, const InputMesh &mesh)
+  {
+    const PrimFacetRef prim = unpackRef(ref);
+    Facet primFacets[6];
+    switch (prim.primType) {
+    case UMesh::TET:   writeTetFacets(primFacets,prim.primIdx,mesh); break;
+    case UMesh::PYR:   writePyrFacets(primFacets,prim.primIdx,mesh); break;
+    case UMesh::WEDGE: writeWedgeFacets(primFacets,prim.primIdx,mesh); break;
+    default:           writeHexFacets(primFacets,prim.primIdx,mesh); break;
+    }
+    Facet facet = primFacets[prim.facetIdx];
+    computeUniqueVertexOrder(facet);
+    return facet;
+  }
+
+  /*! calls 'lambda(facet)' for every (canonically ordered) facet of
+      every prim, in parallel */
+  template<typename Lambda>
+  void forEachFacet(const InputMesh &mesh, const Lambda &lambda)
+  {
+    const size_t numPrims
+      = mesh.numTets
+      + mesh.numPyrs
+      + mesh.numWedges
+      + mesh.numHexes;
+    parallel_for_blocked
+      (0,numPrims,1024,
+       [&](size_t begin, size_t end) {
+         Facet primFacets[6];
+         for (size_t primIdx=begin;primIdx<end;primIdx++) {
+           const int numPrimFacets = writePrimFacets(primFacets,primIdx,mesh);
+           for (int i=0;i<numPrimFacets;i++) {
+             computeUniqueVertexOrder(primFacets[i]);
+             lambda(primFacets[i]);
+           }
+         }
+       });
   }
 
+  inline bool sameVertices(const vec4i &a, const vec4i &b)
+  { return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w; }
+  
+  /*! computes all shared faces without ever storing full facets:
+      since the canonical vertex order puts a facet's smallest vertex
+      first, a counting sort on that vertex puts all facets of a face
+      into the same (small) bucket, in the same bucket order as
+      FacetComparator. So: count the facets per bucket and
+      prefix-sum those counts, scatter each facet's packed prim ref
+      into its bucket, then sort each bucket on the remaining three
+      vertex indices and count its faces, prefix-sum those counts
+      to get face IDs, and finally assemble the faces bucket by
+      bucket. Peak memory is 8 bytes per facet plus 16 per vertex
+      (vs 40 per facet for comparison sort plus face indices), and
+      gives exactly the faces of the comparison-sort path - including
+      the one bogus face that collects all degenerate facets */
+  std::vector<SharedFace> computeFacesBucketed(const InputMesh &mesh,
+                                               size_t numVertices)
+  {
+    /* count facets per bucket; after the scatter below each counter
+       has moved on to the end of its bucket, ie, to the begin of
+       the next one */
+    std::unique_ptr<std::atomic<uint64_t>[]>
+      bucketCursor(new std::atomic<uint64_t>[numVertices]);
+    parallel_for_blocked(0,numVertices,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) bucketCursor[i] = 0;
+      });
+    std::atomic<size_t> numDegenerate(0);
+    forEachFacet(mesh,[&](const Facet &facet){
+        if (facet.vertexIdx.x < 0)
+          numDegenerate.fetch_add(1,std::memory_order_relaxed);
+        else
+          bucketCursor[facet.vertexIdx.x].fetch_add(1,std::memory_order_relaxed);
+      });
+    std::vector<uint64_t> bucketBegin(numVertices);
+    parallel_for_blocked(0,numVertices,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) bucketBegin[i] = bucketCursor[i].load();
+      });
+    const size_t numValidFacets
+      = parallel_exclusive_scan(bucketBegin.data(),bucketBegin.data(),numVertices);
+    parallel_for_blocked(0,numVertices,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) bucketCursor[i] = bucketBegin[i];
+      });
+
+    std::vector<uint64_t> refs(numValidFacets);
+    forEachFacet(mesh,[&](const Facet &facet){
+        if (facet.vertexIdx.x < 0) return;
+        refs[bucketCursor[facet.vertexIdx.x].fetch_add(1,std::memory_order_relaxed)]
+          = packRef(facet.prim);
+      });
+    auto bucketRange = [&](size_t bucket, size_t &begin, size_t &end) {
+      begin = bucket ? bucketCursor[bucket-1].load(std::memory_order_relaxed) : 0;
+      end   = bucketCursor[bucket].load(std::memory_order_relaxed);
+    };
+    
+    /* sort every bucket, tag each facet's orientation and the first
+       facet of every face, and count the bucket's faces (re-using
+       bucketBegin, which isn't needed any more) */
+    struct BucketFacet {
+      vec4i    vertexIdx;
+      uint64_t ref;
+    };
+    parallel_for_blocked
+      (0,numVertices,1024,
+       [&](size_t blockBegin, size_t blockEnd) {
+         std::vector<BucketFacet> bucket;
+         for (size_t b=blockBegin;b<blockEnd;b++) {
+           size_t begin, end;
+           bucketRange(b,begin,end);
+           bucket.resize(end-begin);
+           for (size_t i=begin;i<end;i++) {
+             const Facet facet = facetOf(refs[i],mesh);
+             bucket[i-begin]
+               = { facet.vertexIdx,
+                   refs[i] | (facet.orientation ? REF_ORIENTATION : 0) };
+           }
+           std::sort(bucket.begin(),bucket.end(),
+                     [](const BucketFacet &a, const BucketFacet &b) {
+                       return FacetComparator()(a.vertexIdx,b.vertexIdx);
+                     });
+           size_t numBucketFaces = 0;
+           for (size_t i=0;i<bucket.size();i++) {
+             refs[begin+i] = bucket[i].ref;
+             if (i == 0 || !sameVertices(bucket[i].vertexIdx,bucket[i-1].vertexIdx)) {
+               refs[begin+i] |= REF_FIRST_OF_FACE;
+               numBucketFaces++;
+             }
+           }
+           bucketBegin[b] = numBucketFaces;
+         }
+       });
+    const size_t numFirstFace = numDegenerate ? 1 : 0;
+    const size_t numFaces
+      = numFirstFace
+      + parallel_exclusive_scan(bucketBegin.data(),bucketBegin.data(),numVertices);
+
+    std::vector<SharedFace> faces(numFaces);
+    clearFaces(faces.data(),numFirstFace);
+    parallel_for_blocked
+      (0,numVertices,1024,
+       [&](size_t blockBegin, size_t blockEnd) {
+         PrimFacetRef clearPrim = { 0,0,-1 };
+         clearPrim.primIdx = -1;
+         for (size_t b=blockBegin;b<blockEnd;b++) {
+           size_t begin, end;
+           bucketRange(b,begin,end);
+           SharedFace *face = faces.data() + numFirstFace + bucketBegin[b];
+           for (size_t i=begin;i<end;i++) {
+             const uint64_t ref = refs[i];
+             if (i > begin && (ref & REF_FIRST_OF_FACE))
+               ++face;
+             if (ref & REF_FIRST_OF_FACE) {
+               face->vertexIdx = facetOf(ref,mesh).vertexIdx;
+               face->onFront = face->onBack = clearPrim;
+             }
+             const PrimFacetRef prim = unpackRef(ref);
+             auto &side = (ref & REF_ORIENTATION) ? face->onFront : face->onBack;
+             if (!(side.primIdx < 0)) {
+               PRINT(face->vertexIdx);
+               PRINT(face->onFront);
+               PRINT(face->onBack);
+               PRINT(prim);
+               throw std::runtime_error("side is used twice!?");
+             }
+             side = prim;
+           }
+         }
+       });
+    return faces;
+  }
+  
+  // ==================================================================
+  // incremental builder: hash-based facet matching
+  // ==================================================================
+
+  struct FacetKeyHash {
+    inline size_t operator()(const vec4i &idx) const
+    {
+      uint64_t h = uint32_t(idx.x);
+      h = h * 0x9e3779b97f4a7c15ull + uint32_t(idx.y);
+      h = h * 0x9e3779b97f4a7c15ull + uint32_t(idx.z);
+      h = h * 0x9e3779b97f4a7c15ull + uint32_t(idx.w);
+      return size_t(h ^ (h >> 29));
+    }
+  };
+  struct FacetKeyEqual {
+    inline bool operator()(const vec4i &a, const vec4i &b) const
+    { return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w; }
+  };
+
+  /*! one part of the builder's hash table, with its own lock; the
+      shard a facet goes to is determined by its (canonically
+      ordered) vertex indices, so both facets of a face always end
+      up in the same shard */
+  struct FaceConn::Builder::Shard {
+    std::mutex mutex;
+    std::unordered_map<vec4i,SharedFace,FacetKeyHash,FacetKeyEqual> faces;
+  };
+
+  /* enough shards that threads rarely ever wait on each other */
+  enum { numBuilderShards = 256 };
+
+  FaceConn::Builder::Builder()
+  {
+    for (int i=0;i<numBuilderShards;i++)
+      shards.push_back(std::make_shared<Shard>());
+  }
+
+  /*! brings the given facets into unique vertex order, and enters
+      each one into the face it belongs to, creating that face if this
+      is its first facet */
+  inline void addFacets(std::vector<std::shared_ptr<FaceConn::Builder::Shard>> &shards,
+                        Facet *facets, int numFacets, size_t primIdx)
+  {
+    PrimFacetRef clearPrim = { 0,0,-1 };
+    clearPrim.primIdx = -1;
+    for (int i=0;i<numFacets;i++) {
+      Facet &facet = facets[i];
+      facet.prim.primIdx = primIdx;
+      computeUniqueVertexOrder(facet);
+      if (facet.vertexIdx.x < 0)
+        // degenerate facet, no face
+        continue;
+
+      const size_t hash = FacetKeyHash()(facet.vertexIdx);
+      FaceConn::Builder::Shard &shard = *shards[(hash >> 16) % numBuilderShards];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.faces.find(facet.vertexIdx);
+      if (it == shard.faces.end()) {
+        SharedFace newFace;
+        newFace.vertexIdx = facet.vertexIdx;
+        newFace.onFront = newFace.onBack = clearPrim;
+        it = shard.faces.insert({facet.vertexIdx,newFace}).first;
+      }
+      SharedFace &face = it->second;
+      auto &side = facet.orientation ? face.onFront : face.onBack;
+      if (!(side.primIdx < 0)) {
+        PRINT(facet);
+        PRINT(face.onFront);
+        PRINT(face.onBack);
+        throw std::runtime_error("side is used twice!?");
+      }
+      side = facet.prim;
+    }
+  }
+
+  /* the per-prim facet writers all work on an 'InputMesh', so we
+     hand them one that contains only the given prim */
+  void FaceConn::Builder::addTet(size_t tetIdx, const UMesh::Tet &tet)
+  {
+    InputMesh mesh = {};
+    mesh.tets = (Tet*)&tet; mesh.numTets = 1;
+    Facet facets[4];
+    writeTetFacets(facets,0,mesh);
+    addFacets(shards,facets,4,tetIdx);
+  }
+
+  void FaceConn::Builder::addPyr(size_t pyrIdx, const UMesh::Pyr &pyr)
+  {
+    InputMesh mesh = {};
+    mesh.pyrs = (Pyr*)&pyr; mesh.numPyrs = 1;
+    Facet facets[5];
+    writePyrFacets(facets,0,mesh);
+    addFacets(shards,facets,5,pyrIdx);
+  }
+
+  void FaceConn::Builder::addWedge(size_t wedgeIdx, const UMesh::Wedge &wedge)
+  {
+    InputMesh mesh = {};
+    mesh.wedges = (Wedge*)&wedge; mesh.numWedges = 1;
+    Facet facets[5];
+    writeWedgeFacets(facets,0,mesh);
+    addFacets(shards,facets,5,wedgeIdx);
+  }
+
+  void FaceConn::Builder::addHex(size_t hexIdx, const UMesh::Hex &hex)
+  {
+    InputMesh mesh = {};
+    mesh.hexes = (Hex*)&hex; mesh.numHexes = 1;
+    Facet facets[6];
+    writeHexFacets(facets,0,mesh);
+    addFacets(shards,facets,6,hexIdx);
+  }
+
+  FaceConn::SP FaceConn::Builder::finalize()
+  {
+    std::vector<size_t> shardBegin(shards.size());
+    for (size_t i=0;i<shards.size();i++)
+      shardBegin[i] = shards[i]->faces.size();
+    const size_t numFaces
+      = parallel_exclusive_scan(shardBegin.data(),shardBegin.data(),shards.size());
+
+    FaceConn::SP faceConn = std::make_shared<FaceConn>();
+    faceConn->faces.resize(numFaces);
+    parallel_for(shards.size(),[&](size_t shardID){
+        size_t faceID = shardBegin[shardID];
+        for (auto &it : shards[shardID]->faces)
+          faceConn->faces[faceID++] = it.second;
+      });
+    return faceConn;
+  }
 
   // ==================================================================
   // aaaand ... wrap it all together
   // ==================================================================
 
-std::vector<SharedFace> computeFaces(UMesh::SP input)
+  std::vector<SharedFace> computeFacesWithComparisonSort(UMesh::SP input)
   {
     assert(input);
     std::chrono::steady_clock::time_point
@@ -592,6 +950,14 @@ std::vector<SharedFace> computeFaces(UMesh::SP input)
     return faces;
   }
 
+  std::vector<SharedFace> computeFaces(UMesh::SP input)
+  {
+    assert(input);
+    InputMesh mesh;
+    setupInput(mesh,input);
+    return computeFacesBucketed(mesh,input->vertices.size());
+  }
+  
   /*! given a unstructured mesh, compute the face-connectivity for
     this mesh. Note this _sohuld_ work even for curved/bilinear faces,
     but will error out for meshes with bad connectivyt (faces with
@@ -603,6 +969,15 @@ std::vector<SharedFace> computeFaces(UMesh::SP input)
     return faceConn;
   }
 
+  /*! same as compute(), but using the original comparison sort over
+      full 'Facet's; only kept for verification and benchmarking */
+  FaceConn::SP FaceConn::computeWithComparisonSort(UMesh::SP input)
+  {
+    FaceConn::SP faceConn = std::make_shared<FaceConn>();
+    faceConn->faces = computeFacesWithComparisonSort(input);
+    return faceConn;
+  }
+
   /*! write - binary - to given file */
   void FaceConn::write(std::ostream &out) const
   {
@@ -72,6 +72,37 @@ namespace umesh {
         (faces with more than two owning prims) */
     static FaceConn::SP compute(UMesh::SP mesh);
 
+    /*! same as compute(), but sorting full facets with a comparison
+        sort rather than bucketing packed facet refs by their
+        smallest vertex; gives the same faces in the same order (both
+        collect all degenerate facets in one bogus first face with
+        vertex indices -1), but needs about five times the memory,
+        and is only kept for verification and benchmarking */
+    static FaceConn::SP computeWithComparisonSort(UMesh::SP mesh);
+
+    /*! builds the face connectivity incrementally, from prims that
+        get added one by one - from any number of threads, and in any
+        order - while a mesh is still being generated (eg, by the AMR
+        dual-mesh generator). Facets of the same face get paired up
+        through a sharded hash table as they come in, so there is no
+        global facet sort at the end. Gives the same faces as
+        compute() on the final mesh, but in a different order, and
+        without the bogus face for degenerate facets. */
+    struct Builder {
+      Builder();
+
+      void addTet(size_t tetIdx, const UMesh::Tet &tet);
+      void addPyr(size_t pyrIdx, const UMesh::Pyr &pyr);
+      void addWedge(size_t wedgeIdx, const UMesh::Wedge &wedge);
+      void addHex(size_t hexIdx, const UMesh::Hex &hex);
+
+      /*! returns all faces added so far */
+      FaceConn::SP finalize();
+
+      struct Shard;
+      std::vector<std::shared_ptr<Shard>> shards;
+    };
+
     /*! write - binary - to given file */
     void saveTo(const std::string &fileName) const;
     
@@ -15,9 +15,12 @@
 // ======================================================================== //
 
 #include "RemeshHelper.h"
+#include "umesh/radixSort.h"
 # ifdef UMESH_HAVE_TBB
 #  include "tbb/parallel_sort.h"
 # endif
+#include <atomic>
+#include <algorithm>
 
 namespace umesh {
 
@@ -25,6 +28,13 @@ namespace umesh {
     : target(target)
   {}
 
+  void RemeshHelper::mapBulkAddedVertices()
+  {
+    for (size_t i=0;i<numBulkAddedVertices;i++)
+      knownVertices[target.vertices[i]] = uint32_t(i);
+    numBulkAddedVertices = 0;
+  }
+  
   /*! given a vertex v, return its ID in the target mesh's vertex
     array (if present), or add it (if not). To afterwards allow the
     using libnray to look up which of the inptu vertices ended up
@@ -33,6 +43,7 @@ namespace umesh {
     functoin of the one that uses a float scalar, not mixed */
    uint32_t RemeshHelper::getID(const vec3f &v, size_t tag)
   {
+    if (numBulkAddedVertices) mapBulkAddedVertices();
     auto it = knownVertices.find(v);
     if (it != knownVertices.end()) {
       return it->second;
@@ -50,6 +61,7 @@ namespace umesh {
    uint32_t RemeshHelper::getID(const vec3f &v)
   {
     assert(!target.perVertex);
+    if (numBulkAddedVertices) mapBulkAddedVertices();
     auto it = knownVertices.find(v);
     if (it != knownVertices.end()) {
       return it->second;
@@ -69,6 +81,7 @@ namespace umesh {
     uses a size_t tag, not mixed */
    uint32_t RemeshHelper::getID(const vec3f &v, float scalar)
   {
+    if (numBulkAddedVertices) mapBulkAddedVertices();
     auto it = knownVertices.find(v);
     if (it != knownVertices.end()) {
       return it->second;
@@ -173,221 +186,402 @@ namespace umesh {
     }
   }
 
+  // ==================================================================
+  // parallel building blocks
+  // ==================================================================
 
-
-
-  struct BigVertex {
-    vec3f pos;
-    float scalar;
-    uint32_t orgID;
-    int active;;
-  };
-
-  inline bool operator<(const BigVertex &a,
-                        const BigVertex &b)
+  /*! pointer to, and number of, the vertex indices of the given prim */
+  inline const int *primVertices(const UMesh &mesh, UMesh::PrimRef primRef, int &N)
   {
-    return a.pos < b.pos;
+    switch (primRef.type) {
+    case UMesh::TRI:   N = 3; return &mesh.triangles[primRef.ID].x;
+    case UMesh::QUAD:  N = 4; return &mesh.quads[primRef.ID].x;
+    case UMesh::TET:   N = 4; return &mesh.tets[primRef.ID].x;
+    case UMesh::PYR:   N = 5; return &mesh.pyrs[primRef.ID][0];
+    case UMesh::WEDGE: N = 6; return &mesh.wedges[primRef.ID][0];
+    case UMesh::HEX:   N = 8; return &mesh.hexes[primRef.ID][0];
+    default:
+      throw std::runtime_error("un-implemented prim type?");
+    }
   }
-  
-  void removeDuplicatesAndUnusedVertices(UMesh::SP mesh)
-  {
-    std::cout << "parallel reindexing : init for " << mesh->toString() << std::endl;
-    std::vector<BigVertex> vertices(mesh->vertices.size());
 
-    // generate list of _all_ vertices, in 'fat' layout that can easily be re-ordered
+  /*! calls 'lambda(index)' for every vertex index of every prim in
+      the given array, in parallel; the lambda may modify the index */
+  template<typename T, typename Lambda>
+  void forEachIndex(std::vector<T> &prims, const Lambda &lambda)
+  {
     parallel_for_blocked
-      (0,vertices.size(),16*1024,
-       [&](size_t begin, size_t end) {
-         for (size_t i=begin;i<end;i++) {
-           vertices[i].pos = mesh->vertices[i];
-           vertices[i].scalar = mesh->perVertex->values[i];
-           vertices[i].orgID = i;
-           vertices[i].active = false;
+      (0,prims.size(),16*1024,
+       [&](size_t begin, size_t end){
+         for (size_t primID=begin;primID<end;primID++) {
+           T &prim = prims[primID];
+           for (int i=0;i<T::numVertices;i++)
+             lambda(prim[i]);
          }
        });
+  }
 
-    // mark 
-    for (auto &prim : mesh->triangles) {
-      for (int i=0;i<prim.numVertices;i++)
-        vertices[prim[i]].active = true;
-    }
-    for (auto &prim : mesh->quads) {
-      for (int i=0;i<prim.numVertices;i++)
-        vertices[prim[i]].active = true;
-    }
-    parallel_for_blocked
-      (0,mesh->tets.size(),1024*64,
-       [&](size_t begin, size_t end){
-        for (size_t primID=begin;primID<end;primID++){
-          auto &prim = mesh->tets[primID];
-          for (int i=0;i<prim.numVertices;i++)
-            vertices[prim[i]].active = true;
-        }});
-    for (auto &prim : mesh->pyrs) {
-      for (int i=0;i<prim.numVertices;i++)
-        vertices[prim[i]].active = true;
-    }
-    for (auto &prim : mesh->wedges) {
-      for (int i=0;i<prim.numVertices;i++)
-        vertices[prim[i]].active = true;
+  /*! calls 'lambda(index)' for every vertex index of every prim (of
+      any type) in the mesh */
+  template<typename Lambda>
+  void forEachIndex(UMesh &mesh, const Lambda &lambda)
+  {
+    forEachIndex(mesh.triangles,lambda);
+    forEachIndex(mesh.quads,lambda);
+    forEachIndex(mesh.tets,lambda);
+    forEachIndex(mesh.pyrs,lambda);
+    forEachIndex(mesh.wedges,lambda);
+    forEachIndex(mesh.hexes,lambda);
+  }
+
+  /*! one bit per vertex, set for all vertices used by any prim; bits
+      get set with atomic or's, so marking runs in parallel over all
+      prims */
+  struct UsedVertexMask {
+    UsedVertexMask(UMesh &mesh)
+      : numVertices(mesh.vertices.size()),
+        numWords((numVertices+31)/32),
+        bits(new std::atomic<uint32_t>[numWords])
+    {
+      parallel_for_blocked(0,numWords,64*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++) bits[i] = 0u;
+        });
+      forEachIndex(mesh,[&](int idx){
+          bits[idx/32].fetch_or(1u<<(idx%32),std::memory_order_relaxed);
+        });
     }
-    for (auto &prim : mesh->hexes) {
-      for (int i=0;i<prim.numVertices;i++)
-        vertices[prim[i]].active = true;
+
+    inline bool isUsed(size_t vertexID) const
+    { return bits[vertexID/32].load(std::memory_order_relaxed) & (1u<<(vertexID%32)); }
+
+    /*! computes, for every vertex, its index among the used vertices
+        (or -1 if unused), and returns the number of used vertices */
+    size_t computeCompactIDs(std::vector<int> &newID) const
+    {
+      std::vector<size_t> wordBegin(numWords);
+      parallel_for_blocked(0,numWords,64*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++)
+            wordBegin[i] = __builtin_popcount(bits[i].load());
+        });
+      const size_t numUsed
+        = parallel_exclusive_scan(wordBegin.data(),wordBegin.data(),numWords);
+      newID.resize(numVertices);
+      parallel_for_blocked(0,numWords,16*1024,[&](size_t begin, size_t end){
+          for (size_t w=begin;w<end;w++) {
+            const uint32_t word = bits[w].load();
+            size_t ID = wordBegin[w];
+            for (size_t i=32*w;i<std::min(numVertices,32*(w+1));i++)
+              newID[i] = (word & (1u<<(i%32))) ? int(ID++) : -1;
+          }
+        });
+      return numUsed;
     }
+    
+    const size_t numVertices;
+    const size_t numWords;
+    std::unique_ptr<std::atomic<uint32_t>[]> bits;
+  };
+
+  /*! moves every vertex (and its scalar and tag, where present) to
+      position newID[i] of a new vertex array with numNewVertices
+      entries; vertices with newID[i] < 0 are dropped. If several
+      vertices map to the same ID, 'isRepresentative(i)' has to
+      select exactly one of them */
+  template<typename IsRepresentative>
+  void compactVertices(UMesh &mesh, const std::vector<int> &newID,
+                       size_t numNewVertices,
+                       const IsRepresentative &isRepresentative)
+  {
+    std::vector<vec3f> vertices(numNewVertices);
+    std::vector<float> values(mesh.perVertex ? numNewVertices : 0);
+    std::vector<size_t> vertexTag(mesh.vertexTag.empty() ? 0 : numNewVertices);
+    parallel_for_blocked(0,newID.size(),64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          if (newID[i] < 0 || !isRepresentative(i)) continue;
+          vertices[newID[i]] = mesh.vertices[i];
+          if (!values.empty())    values[newID[i]]    = mesh.perVertex->values[i];
+          if (!vertexTag.empty()) vertexTag[newID[i]] = mesh.vertexTag[i];
+        }
+      });
+    mesh.vertices = std::move(vertices);
+    if (mesh.perVertex) mesh.perVertex->values = std::move(values);
+    mesh.vertexTag = std::move(vertexTag);
+  }
+  
+  // ==================================================================
+  // adding many prims at once
+  // ==================================================================
+
+  /*! one use of an input vertex, packed into 64 bits: the input
+      vertex ID in the upper, and the 'slot' in the lower half, where
+      'slot' is the index of this use among all uses, in prim order
+      (ie, prim i's uses are slots useBegin[i]...useBegin[i]+N-1) */
+  inline uint64_t packVertexUse(uint32_t vertexID, uint32_t slot)
+  { return (uint64_t(vertexID) << 32) | slot; }
+  inline uint32_t vertexOfUse(uint64_t use) { return uint32_t(use >> 32); }
+  inline uint32_t slotOfUse(uint64_t use)   { return uint32_t(use); }
 
+  /*! one distinct input vertex, with the first slot that used it */
+  struct UsedVertex {
+    vec3f    pos;
+    uint32_t vertexID;
+    uint32_t firstSlot;
+    /*! its index in distinct-vertex order */
+    uint32_t usedID;
+  };
+  
+  /*! adds all given prims of the other mesh; has the same result as
+      calling add(otherMesh,primRef) for each of them in order (same
+      vertices, in the same order, with the same scalars or tags;
+      same prims), but runs in parallel, with sorts instead of the
+      std::map lookups: vertex uses get sorted by input vertex ID to
+      find the distinct input vertices, those get sorted by position
+      to find the ones that become the same output vertex, and output
+      vertices get numbered by a prefix sum over the first use of
+      each, which is the order add() would have created them in. Only
+      works on a target that is still empty, and for less than 4G
+      vertex uses; for others this falls back to adding one prim
+      after another. */
+  void RemeshHelper::add(UMesh::SP otherMesh,
+                         const std::vector<UMesh::PrimRef> &primRefs)
+  {
+    auto addOneByOne = [&]() {
+      for (auto primRef : primRefs)
+        add(otherMesh,primRef);
+    };
+    if (!knownVertices.empty() || !target.vertices.empty())
+      return addOneByOne();
+    const UMesh &in = *otherMesh;
+    const bool withScalars = (bool)in.perVertex;
+    const bool withTags    = !withScalars && !in.vertexTag.empty();
+    if (!withScalars && !withTags && target.perVertex)
+      throw std::runtime_error("can't translate a vertex from another mesh that has neither scalars not vertex tags");
 
+    // ------------------------------------------------------------------
+    // all vertex uses, and the distinct vertices among them
+    // ------------------------------------------------------------------
+    std::vector<uint64_t> useBegin(primRefs.size());
+    parallel_for_blocked(0,primRefs.size(),64*1024,[&](size_t begin, size_t end){
+        int N;
+        for (size_t primID=begin;primID<end;primID++) {
+          primVertices(in,primRefs[primID],N);
+          useBegin[primID] = N;
+        }
+      });
+    const size_t numUses
+      = parallel_exclusive_scan(useBegin.data(),useBegin.data(),primRefs.size());
+    if (numUses >= (1ull<<32))
+      return addOneByOne();
+    const size_t numSlots = numUses;
+    std::vector<uint64_t> uses(numUses);
+    parallel_for_blocked(0,primRefs.size(),16*1024,[&](size_t begin, size_t end){
+        for (size_t primID=begin;primID<end;primID++) {
+          int N;
+          const int *idx = primVertices(in,primRefs[primID],N);
+          for (int i=0;i<N;i++)
+            uses[useBegin[primID]+i]
+              = packVertexUse(idx[i],uint32_t(useBegin[primID]+i));
+        }
+      });
+    // uses are generated in slot order, and the radix sort is stable,
+    // so this sorts by (vertexID,slot)
+    radixSort(uses.data(),numUses,bitsRequiredFor(in.vertices.size()),
+              [](uint64_t use){ return use >> 32; });
 
+    auto firstUseOfVertex = [&](size_t i)
+    { return i == 0 || vertexOfUse(uses[i]) != vertexOfUse(uses[i-1]); };
+    // usedID[i] = number of distinct vertices up to (and including)
+    // the one of use i, so that one's index is usedID[i]-1
+    std::vector<uint32_t> usedID(numUses);
+    parallel_for_blocked(0,numUses,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) usedID[i] = firstUseOfVertex(i);
+      });
+    const size_t numUsed
+      = parallel_inclusive_scan(usedID.data(),usedID.data(),numUses);
+    std::vector<UsedVertex> used(numUsed);
+    parallel_for_blocked(0,numUses,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++)
+          if (firstUseOfVertex(i))
+            used[usedID[i]-1] = { in.vertices[vertexOfUse(uses[i])],
+                                  vertexOfUse(uses[i]), slotOfUse(uses[i]),
+                                  usedID[i]-1 };
+      });
 
+    // ------------------------------------------------------------------
+    // merge distinct vertices at the same position, and number the
+    // merged ones in order of first use
+    // ------------------------------------------------------------------
+    auto byPosThenSlot = [](const UsedVertex &a, const UsedVertex &b)
+    {
+      return (a.pos < b.pos) || (!(b.pos < a.pos) && a.firstSlot < b.firstSlot);
+    };
+# ifdef UMESH_HAVE_TBB
+    tbb::parallel_sort(used.begin(),used.end(),byPosThenSlot);
+# else
+    std::sort(used.begin(),used.end(),byPosThenSlot);
+# endif
+    auto firstAtPos = [&](size_t i)
+    { return i == 0 || used[i-1].pos < used[i].pos; };
     
+    std::vector<uint32_t> slotNewID(numSlots,0);
+    parallel_for_blocked(0,numUsed,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++)
+          if (firstAtPos(i)) slotNewID[used[i].firstSlot] = 1;
+      });
+    const size_t numNewVertices
+      = parallel_exclusive_scan(slotNewID.data(),slotNewID.data(),numSlots);
+    if (numNewVertices >= (1ull<<31))
+      throw std::runtime_error("RemeshHelper: merged vertex count "
+                               +std::to_string(numNewVertices)
+                               +" exceeds int32 index range (max "
+                               +std::to_string((1ull<<31)-1)+")");
 
+    target.vertices.resize(numNewVertices);
+    if (withScalars) {
+      if (!target.perVertex)
+        target.perVertex = std::make_shared<Attribute>();
+      target.perVertex->values.resize(numNewVertices);
+    }
+    if (withTags)
+      target.vertexTag.resize(numNewVertices);
+    std::vector<int> newIDOfUsed(numUsed);
+    parallel_for_blocked(0,numUsed,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          if (!firstAtPos(i)) continue;
+          const UsedVertex &first = used[i];
+          const int ID = int(slotNewID[first.firstSlot]);
+          target.vertices[ID] = first.pos;
+          if (withScalars) target.perVertex->values[ID] = in.perVertex->values[first.vertexID];
+          if (withTags)    target.vertexTag[ID] = in.vertexTag[first.vertexID];
+          for (size_t j=i;j<numUsed && (j==i || !firstAtPos(j));j++)
+            newIDOfUsed[used[j].usedID] = ID;
+        }
+      });
+    
+    // ------------------------------------------------------------------
+    // translate every use
+    // ------------------------------------------------------------------
+    std::vector<int> translated(numSlots);
+    parallel_for_blocked(0,numUses,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++)
+          translated[slotOfUse(uses[i])] = newIDOfUsed[usedID[i]-1];
+      });
+    
+    // ------------------------------------------------------------------
+    // and write the prims, per type, in order, dropping triangles and
+    // tets that became degenerate
+    // ------------------------------------------------------------------
+    auto keep = [&](size_t primID) {
+      const int *idx = &translated[useBegin[primID]];
+      switch (primRefs[primID].type) {
+      case UMesh::TRI: return noDuplicates(*(const Triangle*)idx);
+      case UMesh::TET: return noDuplicates(*(const Tet*)idx);
+      default: return true;
+      }
+    };
+    std::vector<uint64_t> outID(primRefs.size());
+    auto writePrims = [&](UMesh::PrimType type, auto &prims) {
+      using T = typename std::decay<decltype(prims[0])>::type;
+      parallel_for_blocked(0,primRefs.size(),64*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++)
+            outID[i] = (primRefs[i].type == type) && keep(i);
+        });
+      const size_t numNew
+        = parallel_exclusive_scan(outID.data(),outID.data(),primRefs.size());
+      const size_t numOld = prims.size();
+      prims.resize(numOld+numNew);
+      parallel_for_blocked(0,primRefs.size(),64*1024,[&](size_t begin, size_t end){
+          for (size_t i=begin;i<end;i++)
+            if (primRefs[i].type == type && keep(i))
+              prims[numOld+outID[i]] = *(const T*)&translated[useBegin[i]];
+        });
+    };
+    writePrims(UMesh::TRI,target.triangles);
+    writePrims(UMesh::QUAD,target.quads);
+    writePrims(UMesh::TET,target.tets);
+    writePrims(UMesh::PYR,target.pyrs);
+    writePrims(UMesh::WEDGE,target.wedges);
+    writePrims(UMesh::HEX,target.hexes);
+
+    numBulkAddedVertices = numNewVertices;
+  }
 
+  // ==================================================================
+  // cleaning up an existing mesh
+  // ==================================================================
+  
+  /*! removes all vertices not used by any prim, and merges all used
+      ones at the same position into one; in parallel. Output
+      vertices are sorted by position; of several input vertices at
+      the same position the one with the lowest index provides the
+      scalar and tag */
+  void removeDuplicatesAndUnusedVertices(UMesh::SP mesh)
+  {
+    std::cout << "parallel reindexing : init for " << mesh->toString() << std::endl;
+    std::vector<int> usedID;
+    const size_t numUsed = UsedVertexMask(*mesh).computeCompactIDs(usedID);
+
+    // generate list of all used vertices, in 'fat' layout that can
+    // easily be re-ordered
+    std::vector<std::pair<vec3f,uint32_t>> vertices(numUsed);
+    parallel_for_blocked
+      (0,usedID.size(),64*1024,
+       [&](size_t begin, size_t end) {
+         for (size_t i=begin;i<end;i++)
+           if (usedID[i] >= 0)
+             vertices[usedID[i]] = { mesh->vertices[i], uint32_t(i) };
+       });
     
     std::cout << "parallel reindexing - sorting vertices to find duplicates" << std::endl;
+    auto byPosThenID
+      = [](const std::pair<vec3f,uint32_t> &a, const std::pair<vec3f,uint32_t> &b)
+      { return (a.first < b.first) || (!(b.first < a.first) && a.second < b.second); };
 # ifdef UMESH_HAVE_TBB
-    tbb::parallel_sort(vertices.data(),vertices.data()+vertices.size());
+    tbb::parallel_sort(vertices.begin(),vertices.end(),byPosThenID);
 # else
-    std::sort(vertices.data(),vertices.data()+vertices.size());
+    std::sort(vertices.begin(),vertices.end(),byPosThenID);
 # endif
 
     std::cout << "parallel reindexing - finding unique used vertices" << std::endl;
-    int curID = -1;
-    std::vector<int> newID(vertices.size());
-    for (size_t i=0;i<vertices.size();i++) {
-      if (!vertices[i].active) {
-        newID[vertices[i].orgID] = -1;
-        continue;
-      }
-      
-      if (i==0 || vertices[i].pos != vertices[i-1].pos)
-        ++curID;
-      
-      vertices[curID].pos = vertices[i].pos;
-      vertices[curID].scalar = vertices[i].scalar;
-      newID[vertices[i].orgID] = curID;
-    }
-    int numNewVertices = curID;
+    auto firstAtPos = [&](size_t i)
+    { return i == 0 || vertices[i-1].first < vertices[i].first; };
+    std::vector<uint64_t> uniqueID(numUsed);
+    parallel_for_blocked(0,numUsed,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) uniqueID[i] = firstAtPos(i);
+      });
+    const size_t numNewVertices
+      = parallel_exclusive_scan(uniqueID.data(),uniqueID.data(),numUsed);
     std::cout << "num vertices found : " << numNewVertices << std::endl;
-    mesh->vertices.resize(numNewVertices);
-    mesh->perVertex->values.resize(numNewVertices);
-    for (int i=0;i<numNewVertices;i++) {
-      mesh->vertices[i] = vertices[i].pos;
-      mesh->perVertex->values[i] = vertices[i].scalar;
-    }
+    
+    std::vector<int>     newID(mesh->vertices.size(),-1);
+    std::vector<uint8_t> isRepresentative(mesh->vertices.size(),0);
+    parallel_for_blocked(0,numUsed,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          if (!firstAtPos(i)) continue;
+          isRepresentative[vertices[i].second] = 1;
+          for (size_t j=i;j<numUsed && (j==i || !firstAtPos(j));j++)
+            newID[vertices[j].second] = int(uniqueID[i]);
+        }
+      });
     vertices.clear();
+    compactVertices(*mesh,newID,numNewVertices,
+                    [&](size_t i){ return isRepresentative[i]; });
 
     std::cout << "parallel reindexing - translating indices" << std::endl;
-    for (auto &prim : mesh->triangles) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
-    for (auto &prim : mesh->quads) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
-    parallel_for_blocked
-      (0,mesh->tets.size(),1024*64,
-       [&](size_t begin, size_t end){
-        for (size_t primID=begin;primID<end;primID++){
-          auto &prim = mesh->tets[primID];
-          for (int i=0;i<prim.numVertices;i++)
-            prim[i] = newID[prim[i]];
-        }});
-    for (auto &prim : mesh->pyrs) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
-    for (auto &prim : mesh->wedges) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
-    for (auto &prim : mesh->hexes) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
+    forEachIndex(*mesh,[&](int &idx){ idx = newID[idx]; });
   }
 
+  /*! removed all vertices that are not used by any prim, and
+      re-indexes all prims with the new vertex/value array indices
+      after this compaction; in parallel, and keeping the used
+      vertices in their original order */
   void removeUnusedVertices(UMesh::SP mesh)
   {
-    std::vector<uint8_t> isUsed(mesh->vertices.size());
-    for (auto &flag : isUsed) flag = false;
-    
-    // mark 
-    for (auto &prim : mesh->triangles) {
-      for (int i=0;i<prim.numVertices;i++)
-        isUsed[prim[i]] = true;
-    }
-    for (auto &prim : mesh->quads) {
-      for (int i=0;i<prim.numVertices;i++)
-        isUsed[prim[i]] = true;
-    }
-    parallel_for_blocked
-      (0,mesh->tets.size(),1024*64,
-       [&](size_t begin, size_t end){
-        for (size_t primID=begin;primID<end;primID++){
-          auto &prim = mesh->tets[primID];
-          for (int i=0;i<prim.numVertices;i++)
-            isUsed[prim[i]] = true;
-        }});
-    for (auto &prim : mesh->pyrs) {
-      for (int i=0;i<prim.numVertices;i++)
-        isUsed[prim[i]] = true;
-    }
-    for (auto &prim : mesh->wedges) {
-      for (int i=0;i<prim.numVertices;i++)
-        isUsed[prim[i]] = true;
-    }
-    for (auto &prim : mesh->hexes) {
-      for (int i=0;i<prim.numVertices;i++)
-        isUsed[prim[i]] = true;
-    }
-
-    std::vector<int> newID(mesh->vertices.size());
-    int curID = 0;
-    for (int i=0;i<newID.size();i++) {
-      if (isUsed[i]) {
-        mesh->vertices[curID] = mesh->vertices[i];
-        if (mesh->perVertex)
-          mesh->perVertex->values[curID] = mesh->perVertex->values[i];
-        newID[i] = curID++;
-      } else {
-        // won't get used, anyway....
-        newID[i] = -1;
-      }
-    }
-    std::cout << "done compacting vertex array, num vertices found " << curID << std::endl;
-    mesh->vertices.resize(curID);
-    mesh->perVertex->values.resize(curID);
-
-    
-    for (auto &prim : mesh->triangles) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
-    for (auto &prim : mesh->quads) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
-    parallel_for_blocked
-      (0,mesh->tets.size(),1024*64,
-       [&](size_t begin, size_t end){
-        for (size_t primID=begin;primID<end;primID++){
-          auto &prim = mesh->tets[primID];
-          for (int i=0;i<prim.numVertices;i++)
-            prim[i] = newID[prim[i]];
-        }});
-    for (auto &prim : mesh->pyrs) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
-    for (auto &prim : mesh->wedges) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
-    for (auto &prim : mesh->hexes) {
-      for (int i=0;i<prim.numVertices;i++)
-        prim[i] = newID[prim[i]];
-    }
+    std::vector<int> newID;
+    const size_t numUsed = UsedVertexMask(*mesh).computeCompactIDs(newID);
+    compactVertices(*mesh,newID,numUsed,[](size_t){ return true; });
+    std::cout << "done compacting vertex array, num vertices found " << numUsed << std::endl;
+    forEachIndex(*mesh,[&](int &idx){ idx = newID[idx]; });
   }
   
 } // ::umesh
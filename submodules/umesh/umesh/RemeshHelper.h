@@ -65,13 +65,26 @@ namespace umesh {
     { translate((uint32_t*)indices,N,otherMesh); }
 
     void add(UMesh::SP otherMesh, UMesh::PrimRef primRef);
+
+    /*! adds all the given prims of the other mesh at once, in
+        parallel; same result as calling add() for each of them, in
+        order */
+    void add(UMesh::SP otherMesh, const std::vector<UMesh::PrimRef> &primRefs);
     
     std::map<vec3f,uint32_t> knownVertices;
+
+    /*! number of (leading) target vertices created by a bulk add()
+        that are not yet in knownVertices; those only get entered
+        once another vertex gets looked up */
+    size_t numBulkAddedVertices = 0;
+    void mapBulkAddedVertices();
     
     UMesh &target;
     // std::vector<size_t> vertexTag;
   };
   
+  /*! removes all vertices not used by any prim, merges used ones at
+      the same position, and re-indexes all prims accordingly */
   void removeDuplicatesAndUnusedVertices(UMesh::SP mesh);
 
   /*! removed all vertices that are not used by any prim, and
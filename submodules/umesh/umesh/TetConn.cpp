@@ -16,6 +16,7 @@
 
 #include "TetConn.h"
 #include "umesh/io/IO.h"
+#include "umesh/radixSort.h"
 #include <fstream>
 
 namespace umesh {
@@ -46,9 +47,9 @@ namespace umesh {
     std::map<vec3i,int> faceIndex;
   };
   
-  TetConnHelper::TetConnHelper(TetConn &out,
-                               const UMesh &in)
-    : out(out), in(in)
+  /*! throws if given mesh is not a tet mesh we can index with
+      32-bit ints */
+  void checkTetConnInput(const UMesh &in)
   {
     if (!in.wedges.empty() ||
         !in.pyrs.empty() ||
@@ -61,6 +62,13 @@ namespace umesh {
       throw std::runtime_error("number of input vertices too large - would overflow");
     if (in.tets.size() >= (1ull<<31))
       throw std::runtime_error("number of input vertices too large - would overflow");
+  }
+  
+  TetConnHelper::TetConnHelper(TetConn &out,
+                               const UMesh &in)
+    : out(out), in(in)
+  {
+    checkTetConnInput(in);
       
     out.faces.clear();
       
@@ -187,11 +195,125 @@ namespace umesh {
     return conn;
   }
   
+  /*! one facet of one tet, with its vertex indices sorted (so all
+      facets of the same face have the same indices), and the side of
+      the face it is on */
+  struct TetFacet {
+    vec3i   index;
+    int     tetIdx;
+    uint8_t facetIdx;
+    uint8_t side;
+  };
+  
   /*! compute connectivity from given umesh; the original umesh will
     not be altered, and vertex and tet IDs in connectivity will
     refer to original umesh. Will throw an error for umeshes with
-    any volume prims that are not tets */
-  void TetConn::computeFrom(const UMesh &umesh)
+    any volume prims that are not tets.
+
+    Emits all 4*numTets facets into a flat array, radix-sorts them
+    by their (bit-packed) sorted vertex indices, and pairs up the
+    facets of each face - all in parallel. The sort is stable, so
+    the first facet of each face is the one with the lowest
+    (tet,facet) index; numbering faces in that order produces the
+    same face IDs as the incremental computeFromSerial() */
+  void TetConn::computeFrom(const UMesh &in)
+  {
+    checkTetConnInput(in);
+    
+    const size_t numTets   = in.tets.size();
+    const size_t numFacets = 4*numTets;
+    std::vector<TetFacet> facets(numFacets);
+    parallel_for_blocked
+      (0,numTets,16*1024,
+       [&](size_t begin, size_t end){
+         for (size_t tetIdx=begin;tetIdx<end;tetIdx++) {
+           const vec4i index = in.tets[tetIdx];
+           /* same facets (and orientation) as in TetConnHelper::pushTet */
+           const vec3i facetIndices[4] = {
+             {index[1],index[3],index[2]},
+             {index[0],index[2],index[3]},
+             {index[0],index[3],index[1]},
+             {index[0],index[1],index[2]}
+           };
+           for (int facetIdx=0;facetIdx<4;facetIdx++) {
+             TetFacet &facet = facets[4*tetIdx+facetIdx];
+             vec3i indices = facetIndices[facetIdx];
+             int side = 0;
+             for (int i=0;i<3;i++) 
+               for (int j=0;j<i;j++) 
+                 if (indices[i] < indices[j]) {
+                   std::swap(indices[i],indices[j]);
+                   side = 1-side;
+                 }
+             facet.index    = indices;
+             facet.tetIdx   = (int)tetIdx;
+             facet.facetIdx = (uint8_t)facetIdx;
+             facet.side     = (uint8_t)side;
+           }
+         }
+       });
+
+    const int bitsPerIndex = bitsRequiredFor(in.vertices.size());
+    radixSort(facets.data(),numFacets,3*bitsPerIndex,
+              [bitsPerIndex](const TetFacet &facet){
+                RadixKey key;
+                key.insert((uint32_t)facet.index.x,0);
+                key.insert((uint32_t)facet.index.y,bitsPerIndex);
+                key.insert((uint32_t)facet.index.z,2*bitsPerIndex);
+                return key;
+              });
+
+    /* flag, per (tet,facet), whether that facet is the first of its
+       face; a prefix sum over those flags then numbers the faces in
+       order of first use */
+    if (numFacets >= (1ull<<32))
+      /* every face has at most two facets */
+      throw std::runtime_error
+        ("too many faces - can't index with 32-bit (signed) ints");
+    std::vector<uint32_t> faceOfFacet(numFacets,0);
+    parallel_for_blocked
+      (0,numFacets,64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++)
+           if (i == 0 || facets[i].index != facets[i-1].index)
+             faceOfFacet[4*size_t(facets[i].tetIdx)+facets[i].facetIdx] = 1;
+       });
+    const size_t numFaces
+      = parallel_exclusive_scan(faceOfFacet.data(),faceOfFacet.data(),numFacets);
+    if (numFaces >= (1ull<<31))
+      throw std::runtime_error
+        ("too many faces - can't index with 32-bit (signed) ints");
+
+    faces.clear();
+    faces.resize(numFaces);
+    tetFaces.clear();
+    tetFaces.resize(numTets,vec4i(-1));
+    parallel_for_blocked
+      (0,numFacets,64*1024,
+       [&](size_t begin, size_t end){
+         for (size_t i=begin;i<end;i++) {
+           if (i > 0 && facets[i].index == facets[i-1].index)
+             continue;
+           const int faceIdx
+             = (int)faceOfFacet[4*size_t(facets[i].tetIdx)+facets[i].facetIdx];
+           TetConn::Face face;
+           face.index = facets[i].index;
+           for (size_t j=i;j<numFacets && facets[j].index == face.index;j++) {
+             const TetFacet &facet = facets[j];
+             if (face.tetIdx[facet.side] != -1)
+               throw std::runtime_error("face with more than one tet on same side!?");
+             face.tetIdx[facet.side]   = facet.tetIdx;
+             face.facetIdx[facet.side] = facet.facetIdx;
+             tetFaces[facet.tetIdx][facet.facetIdx] = faceIdx;
+           }
+           faces[faceIdx] = face;
+         }
+       });
+  }
+
+  /*! reference implementation of computeFrom(), building the face
+    index incrementally in a std::map, on a single thread */
+  void TetConn::computeFromSerial(const UMesh &umesh)
   {
     TetConnHelper(*this,umesh);
   }
@@ -47,6 +47,12 @@ namespace umesh {
         any volume prims that are not tets */
     void computeFrom(const UMesh &umesh);
 
+    /*! reference implementation of computeFrom() that builds the
+        face index incrementally, in a std::map, on a single thread;
+        produces exactly the same result as computeFrom(), and is only
+        kept around for verification and benchmarking */
+    void computeFromSerial(const UMesh &umesh);
+
     struct Face {
       /*! vertex indices */
       vec3i   index;
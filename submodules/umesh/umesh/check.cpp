@@ -15,6 +15,8 @@
 // ======================================================================== //
 
 #include "umesh/check.h"
+#include "umesh/radixSort.h"
+#include <atomic>
 
 namespace umesh {
 
@@ -32,12 +34,212 @@ namespace umesh {
 #endif
 #endif
 
-  
-#if UMESH_ENABLE_SANITY_CHECKS
+
+  CheckLevel checkLevelFromString(const std::string &level)
+  {
+    if (level == "none")  return CHECK_LEVEL_NONE;
+    if (level == "cheap") return CHECK_LEVEL_CHEAP;
+    if (level == "full")  return CHECK_LEVEL_FULL;
+    throw std::runtime_error("unknown check level '"+level
+                             +"' (expected none, cheap, or full)");
+  }
+
+  // ==================================================================
+  // cheap checks: vertex index ranges
+  // ==================================================================
+
+  /*! returns the index of the first prim that has a vertex index
+      outside [0,numVertices), or prims.size() if there is none */
+  template<typename T>
+  size_t findFirstBadPrim(const std::vector<T> &prims, size_t numVertices)
+  {
+    std::atomic<size_t> firstBad(prims.size());
+    parallel_for_blocked
+      (0,prims.size(),16*1024,
+       [&](size_t begin, size_t end){
+         for (size_t primID=begin;primID<end;primID++) {
+           const T &p = prims[primID];
+           bool bad = false;
+           for (int i=0;i<T::numVertices;i++)
+             bad |= (p[i] < 0) | (size_t(p[i]) >= numVertices);
+           if (!bad) continue;
+           size_t current = firstBad;
+           while (primID < current
+                  && !firstBad.compare_exchange_weak(current,primID));
+           return;
+         }
+       });
+    return firstBad;
+  }
+
+  template<typename T>
+  void checkIndices(const std::vector<T> &prims, size_t numVertices,
+                    const std::string &primType)
+  {
+    const size_t primID = findFirstBadPrim(prims,numVertices);
+    if (primID == prims.size()) return;
+
+    const T &p = prims[primID];
+    std::string indices;
+    for (int i=0;i<T::numVertices;i++)
+      indices += (i ? "," : "")+std::to_string(p[i]);
+    const std::string where
+      = primType+" #"+std::to_string(primID)+" ("+indices+"), with "
+      + std::to_string(numVertices)+" vertices";
+    for (int i=0;i<T::numVertices;i++)
+      if (p[i] < 0)
+        throw std::runtime_error("#check: mesh has negative index!? in "+where);
+    throw std::runtime_error("#check: mesh has index greater than vertex array size!? in "+where);
+  }
+
+  // ==================================================================
+  // full checks: no face shared by more than two prims
+  // ==================================================================
+
+  /*! brings the vertex indices of a face (w<0 for triangles) into an
+      order that is the same for all prims sharing this face, with
+      quads that have collapsed into triangles becoming triangles;
+      returns false if the face has collapsed into a line or point */
+  inline bool canonicalFace(vec4i &face)
+  {
+    vec4i sorted = face;
+    const int numIndices = (face.w < 0) ? 3 : 4;
+    std::sort(&sorted.x,&sorted.x+numIndices);
+    int numUnique = 1;
+    for (int i=1;i<numIndices;i++)
+      if (sorted[i] != sorted[i-1]) sorted[numUnique++] = sorted[i];
+    if (numUnique < 3)
+      return false;
+    if (numUnique == 3) {
+      face = vec4i(sorted.x,sorted.y,sorted.z,-1);
+      return true;
+    }
+    // proper quad: start at the smallest index, walk towards the
+    // smaller of its two neighbors
+    int first = 0;
+    for (int i=1;i<4;i++)
+      if (face[i] < face[first]) first = i;
+    vec4i rotated(face[first],face[(first+1)%4],face[(first+2)%4],face[(first+3)%4]);
+    if (rotated.w < rotated.y) std::swap(rotated.y,rotated.w);
+    face = rotated;
+    return true;
+  }
+
+  inline void packFaceKey(uint64_t &key, const vec4i &face, int bitsPerIndex)
+  {
+    key
+      = (uint64_t(face.x) << (3*bitsPerIndex))
+      | (uint64_t(face.y) << (2*bitsPerIndex))
+      | (uint64_t(face.z) << (1*bitsPerIndex))
+      | uint64_t(face.w+1);
+  }
+  inline void packFaceKey(RadixKey &key, const vec4i &face, int bitsPerIndex)
+  {
+    key = RadixKey();
+    key.insert(uint64_t(face.x),3*bitsPerIndex);
+    key.insert(uint64_t(face.y),2*bitsPerIndex);
+    key.insert(uint64_t(face.z),1*bitsPerIndex);
+    key.insert(uint64_t(face.w+1),0);
+  }
+
+  /*! collapsed faces get a key larger than any valid one, so they
+      all end up at the end of the sorted array */
+  inline void packCollapsedFaceKey(uint64_t &key, int bitsPerIndex)
+  { key = 1ull << (4*bitsPerIndex); }
+  inline void packCollapsedFaceKey(RadixKey &key, int bitsPerIndex)
+  { key = RadixKey(); key.insert(1,4*bitsPerIndex); }
+
+  /*! writes the keys of all faces of the given prims, 'numFaces' per
+      prim, through the 'faceOf(prim,faceID)' lambda */
+  template<typename KeyT, typename T, typename FaceOf>
+  void writeFaceKeys(KeyT *keys, const std::vector<T> &prims, int numFaces,
+                     int bitsPerIndex, const FaceOf &faceOf)
+  {
+    parallel_for_blocked
+      (0,prims.size(),16*1024,
+       [&](size_t begin, size_t end){
+         for (size_t primID=begin;primID<end;primID++)
+           for (int f=0;f<numFaces;f++) {
+             vec4i face = faceOf(prims[primID],f);
+             KeyT &key = keys[numFaces*primID+f];
+             if (canonicalFace(face))
+               packFaceKey(key,face,bitsPerIndex);
+             else
+               packCollapsedFaceKey(key,bitsPerIndex);
+           }
+       });
+  }
+
+  /*! collects the keys of all faces of all volume prims, radix-sorts
+      them, and checks that no key appears more than twice; returns
+      the number of unique faces */
+  template<typename KeyT>
+  size_t checkSharedFaces(const UMesh &mesh, int bitsPerIndex)
+  {
+    const size_t numFaces
+      = 4*mesh.tets.size()
+      + 5*mesh.pyrs.size()
+      + 5*mesh.wedges.size()
+      + 6*mesh.hexes.size();
+    std::vector<KeyT> keys(numFaces);
+    KeyT *out = keys.data();
+    writeFaceKeys(out,mesh.tets,4,bitsPerIndex,[](const Tet &p, int f){
+        static const int face[4][3] = {{0,1,2},{0,1,3},{0,2,3},{1,2,3}};
+        return vec4i(p[face[f][0]],p[face[f][1]],p[face[f][2]],-1);
+      });
+    out += 4*mesh.tets.size();
+    writeFaceKeys(out,mesh.pyrs,5,bitsPerIndex,[](const Pyr &p, int f){
+        if (f == 4) return vec4i(p[0],p[1],p[2],p[3]);
+        return vec4i(p[f],p[(f+1)%4],p[4],-1);
+      });
+    out += 5*mesh.pyrs.size();
+    writeFaceKeys(out,mesh.wedges,5,bitsPerIndex,[](const Wedge &p, int f){
+        static const int face[5][4]
+          = {{0,2,1,-1},{3,4,5,-1},{0,3,5,2},{1,2,5,4},{0,1,4,3}};
+        return vec4i(p[face[f][0]],p[face[f][1]],p[face[f][2]],
+                     face[f][3] < 0 ? -1 : p[face[f][3]]);
+      });
+    out += 5*mesh.wedges.size();
+    writeFaceKeys(out,mesh.hexes,6,bitsPerIndex,[](const Hex &p, int f){
+        static const int face[6][4]
+          = {{0,1,2,3},{4,7,6,5},{0,4,5,1},{2,6,7,3},{1,5,6,2},{0,3,7,4}};
+        return vec4i(p[face[f][0]],p[face[f][1]],p[face[f][2]],p[face[f][3]]);
+      });
+
+    radixSort(keys.data(),numFaces,4*bitsPerIndex+1,
+              [](const KeyT &key){ return key; });
+
+    KeyT collapsedKey;
+    packCollapsedFaceKey(collapsedKey,bitsPerIndex);
+    const size_t numValid
+      = std::partition_point(keys.begin(),keys.end(),
+                             [&](const KeyT &key){ return key != collapsedKey; })
+      - keys.begin();
+
+    std::atomic<bool>   usedMoreThanTwice(false);
+    std::atomic<size_t> numUnique(0);
+    parallel_for_blocked
+      (0,numValid,64*1024,
+       [&](size_t begin, size_t end){
+         size_t localUnique = 0;
+         for (size_t i=begin;i<end;i++) {
+           localUnique += (i == 0 || keys[i] != keys[i-1]);
+           if (i+2 < numValid && keys[i] == keys[i+2])
+             usedMoreThanTwice = true;
+         }
+         numUnique += localUnique;
+       });
+    if (usedMoreThanTwice)
+      throw std::runtime_error("face is used more than twice...");
+    return numUnique;
+  }
+
   /*! perform some sanity checking of the given mesh (checking indices
     are valid, etc) */
-  void sanityCheck(UMesh::SP mesh, uint32_t flags)
+  void sanityCheck(UMesh::SP mesh, uint32_t flags, CheckLevel level)
   {
+    if (level == CHECK_LEVEL_NONE) return;
+    
     if (!mesh) throw std::runtime_error("#check: null umesh");
     if ((mesh->numVolumeElements() == 0)
         &&
@@ -47,132 +249,28 @@ namespace umesh {
                 << "num volume elements in mesh is 0!?" << std::endl;
     if (mesh->perVertex && mesh->perVertex->values.size() != mesh->vertices.size())
       throw std::runtime_error("attribute size doesn't match vertex array size");
-    
-    for (auto p : mesh->tets) {
-      for (int i=0;i<p.numVertices;i++) {
-        if (p[i] < 0) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-          throw std::runtime_error("#check: mesh has negative index!?");
-        }
-        if (p[i] >= mesh->vertices.size()) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-          throw std::runtime_error("#check: mesh has index greater than vertex array size!?");
-        }
-      }
-    }
 
-    for (auto p : mesh->pyrs) {
-      for (int i=0;i<p.numVertices;i++) {
-        if (p[i] < 0) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-          throw std::runtime_error("#check: mesh has negative index!?");
-        }
-        if (p[i] >= mesh->vertices.size()) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-           throw std::runtime_error("#check: mesh has index greater than vertex array size!?");
-        }
-      }
-    }
-
-    for (auto p : mesh->wedges) {
-      for (int i=0;i<p.numVertices;i++) {
-        if (p[i] < 0) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-          throw std::runtime_error("#check: mesh has negative index!?");
-        }
-        if (p[i] >= mesh->vertices.size())  {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-          throw std::runtime_error("#check: mesh has index greater than vertex array size!?");
-        }
-      }
-    }
-
-    for (auto p : mesh->hexes) {
-      for (int i=0;i<p.numVertices;i++) {
-        if (p[i] < 0)  {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-          throw std::runtime_error("#check: mesh has negative index!?");
-        }
-        if (p[i] >= mesh->vertices.size()) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-           throw std::runtime_error("#check: mesh has index greater than vertex array size!?");
-        }
-      }
-    }
-
-    for (auto p : mesh->triangles) {
-      for (int i=0;i<p.numVertices;i++) {
-        if (p[i] < 0)  {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-          throw std::runtime_error("#check: mesh has negative index!?");
-        }
-        if (p[i] >= mesh->vertices.size()) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-           throw std::runtime_error("#check: mesh has index greater than vertex array size!?");
-        }
-      }
-    }
-      
-    for (auto p : mesh->quads) {
-      for (int i=0;i<p.numVertices;i++) {
-        if (p[i] < 0) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-           throw std::runtime_error("#check: mesh has negative index!?");
-        }
-        if (p[i] >= mesh->vertices.size()) {
-          PRINT(mesh->vertices.size());
-          PRINT(p);
-           throw std::runtime_error("#check: mesh has index greater than vertex array size!?");
-        }
-      }
-    }
-
-    // ok, let's go crazy here - create list of all tet faces, and
-    // check that none is used more than twice.
-    std::cout << "sanity checking for duplicate tri faces..." << std::flush;
-    std::map<vec3i,int> triFaceCounts;
-    for (auto p : mesh->tets) {
-      std::vector<vec3i> faces;
-      faces.push_back({p.x,p.y,p.z});
-      faces.push_back({p.x,p.y,p.w});
-      faces.push_back({p.x,p.z,p.w});
-      faces.push_back({p.y,p.z,p.w});
-      for (auto face : faces) {
-        std::sort(&face.x,&face.x+3);
-        triFaceCounts[face]++;
-        if (triFaceCounts[face] > 2)
-          throw std::runtime_error("tri face is used more than twice...");
-      }
-    }
-
-
-    for (auto p : mesh->pyrs) {
-      std::vector<vec3i> faces;
-      faces.push_back({p[0],p[1],p[4]});
-      faces.push_back({p[1],p[2],p[4]});
-      faces.push_back({p[2],p[3],p[4]});
-      faces.push_back({p[3],p[0],p[4]});
-      for (auto face : faces) {
-        std::sort(&face.x,&face.x+3);
-        triFaceCounts[face]++;
-        if (triFaceCounts[face] > 2)
-          throw std::runtime_error("tri face is used more than twice...");
-      }
-    }
-    std::cout << " passed" << std::endl;
+    const size_t numVertices = mesh->vertices.size();
+    checkIndices(mesh->tets,numVertices,"tet");
+    checkIndices(mesh->pyrs,numVertices,"pyramid");
+    checkIndices(mesh->wedges,numVertices,"wedge");
+    checkIndices(mesh->hexes,numVertices,"hex");
+    checkIndices(mesh->triangles,numVertices,"triangle");
+    checkIndices(mesh->quads,numVertices,"quad");
 
+    if (level == CHECK_LEVEL_CHEAP) return;
+    
+    // ok, let's go crazy here - sort the (canonically ordered) faces
+    // of all volume prims, and check that none is used more than
+    // twice.
+    std::cout << "sanity checking for faces used more than twice..." << std::flush;
+    /* w gets stored as w+1, plus one bit for tagging collapsed faces */
+    const int bitsPerIndex = bitsRequiredFor(numVertices+1);
+    const size_t numFaces
+      = (4*bitsPerIndex+1 <= 64)
+      ? checkSharedFaces<uint64_t>(*mesh,bitsPerIndex)
+      : checkSharedFaces<RadixKey>(*mesh,bitsPerIndex);
+    std::cout << " passed (" << prettyNumber(numFaces) << " faces)" << std::endl;
   }
-#endif
   
 } // :: umesh
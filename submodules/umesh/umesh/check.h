@@ -27,13 +27,35 @@ namespace umesh {
   /* if specified, the sanity checker will ignore 'no volume prims' */
 #define CHECK_FLAG_MESH_IS_SURFACE (1<<0)
 
+  /*! how much checking sanityCheck() does; each level includes all
+      checks of the levels before it */
+  typedef enum {
+    /*! no checks at all */
+    CHECK_LEVEL_NONE = 0,
+    /*! linear-time checks only: attribute size, and all prims'
+        vertex indices being in range */
+    CHECK_LEVEL_CHEAP,
+    /*! also checks that no face (tri or quad) is shared by more
+        than two prims; sorts all faces, so more expensive */
+    CHECK_LEVEL_FULL
+  } CheckLevel;
+
+  /*! the level sanityCheck() uses if none is specified: checks are
+      off unless enabled at compile time through
+      UMESH_ENABLE_SANITY_CHECKS */
 #if UMESH_ENABLE_SANITY_CHECKS
-  /*! perform some sanity checking of the given mesh (checking indices
-    are valid, etc) */
-  void sanityCheck(UMesh::SP umesh, uint32_t flags = 0);
+# define UMESH_DEFAULT_CHECK_LEVEL CHECK_LEVEL_FULL
 #else
-  inline void sanityCheck(UMesh::SP umesh, uint32_t flags = 0)
-  { /* sanity checks disabled by flag */ }
+# define UMESH_DEFAULT_CHECK_LEVEL CHECK_LEVEL_NONE
 #endif
   
+  /*! parses "none", "cheap", or "full"; throws on anything else */
+  CheckLevel checkLevelFromString(const std::string &level);
+
+  /*! perform some sanity checking of the given mesh (checking indices
+    are valid, etc), in parallel; throws a std::runtime_error on the
+    first problem found */
+  void sanityCheck(UMesh::SP umesh, uint32_t flags = 0,
+                   CheckLevel level = UMESH_DEFAULT_CHECK_LEVEL);
+  
 } // :: umesh
@@ -15,11 +15,9 @@
 // ======================================================================== //
 
 #include "umesh/extractIsoSurface.h"
-#include <iterator>
-#if UMESH_HAVE_TBB
-# include "tbb/parallel_sort.h"
-#endif
+#include "umesh/radixSort.h"
 #include <algorithm>
+#include <limits>
 #include <string.h>
 
 namespace umesh {
@@ -296,20 +294,21 @@ namespace umesh {
     uint32_t idx;
   };
 
-  struct FatVertexCompare {
-    inline bool operator()(const FatVertex &a, const FatVertex &b) const
-    {
-      return memcmp(&a,&b,sizeof(a)) < 0; // a.pos < b.pos;
-    }
-  };
-  
+  inline bool isSmaller(const vec4f &a, const vec4f &b)
+  {
+    if (a.x != b.x) return a.x < b.x;
+    if (a.y != b.y) return a.y < b.y;
+    if (a.z != b.z) return a.z < b.z;
+    return a.w < b.w;
+  }
+
   /*! run marhing-cubes on given 8-vertex hexahedraon, in VTK vertex
       ordering; and write every potentially gnerated triangle into the
       'out' array, using three full vertices for each triangle (we'll
       worry about vertex indexing later on */
-  void process(std::vector<FatVertex> &out,
-               const vec4f vertex[8],
-               const float isoValue)
+  void isoSurfaceHex(std::vector<vec3f> &out,
+                     const vec4f vertex[8],
+                     const float isoValue)
   {
     int index = 0;
     for (int i=0;i<8;i++)
@@ -323,8 +322,13 @@ namespace umesh {
       vec3f triVertex[3];
       for (int ii=0; ii<3; ii++) {
         const int8_t *vert = vtkMarchingCubes_edges[edge[ii]];
-        const vec4f v0 = ((vertex[vert[0]]));
-        const vec4f v1 = ((vertex[vert[1]]));
+        vec4f v0 = ((vertex[vert[0]]));
+        vec4f v1 = ((vertex[vert[1]]));
+        /* always interpolate from the lexicographically smaller end,
+           so two elements sharing this edge (in whatever order they
+           list its vertices) produce bit-identical vertices, which
+           the weld below can then merge */
+        if (isSmaller(v1,v0)) std::swap(v0,v1);
         const double t
           = (v1.w == v0.w)
           ? 0.f
@@ -340,163 +344,218 @@ namespace umesh {
       if (triVertex[1] == triVertex[2]) continue;
       
       for (int j=0;j<3;j++)
-        out.push_back({triVertex[j],0});
+        out.push_back(triVertex[j]);
     }
   }
 
-  /*! blow a tet up into a hex (by replicating vertices), then run MC
-      tables on that hex */
-  void process(std::vector<FatVertex> &out,
-               UMesh::SP in,
-               const UMesh::Tet &tet,
-               const float isoValue)
+  /*! blow a tet up into a hex (by replicating vertices) */
+  inline void loadAsHex(vec4f asHex[8], const UMesh &in, const UMesh::Tet &tet)
   {
-    const vec4f a(in->vertices[tet.x],in->perVertex->values[tet.x]);
-    const vec4f b(in->vertices[tet.y],in->perVertex->values[tet.y]);
-    const vec4f c(in->vertices[tet.z],in->perVertex->values[tet.z]);
-    const vec4f d(in->vertices[tet.w],in->perVertex->values[tet.w]);
-    vec4f asHex[8] = { a,b,c,c, d,d,d,d };
-#if 0
-    float lo = min(min(a.w,b.w),min(c.w,d.w));
-    float hi = max(max(a.w,b.w),max(c.w,d.w));
-    if (isoValue >= lo && isoValue <= hi) {
-      out.push_back({vec3f(a),0});
-      out.push_back({vec3f(b),0});
-      out.push_back({vec3f(c),0});
-
-      out.push_back({vec3f(a),0});
-      out.push_back({vec3f(b),0});
-      out.push_back({vec3f(d),0});
-
-      out.push_back({vec3f(a),0});
-      out.push_back({vec3f(c),0});
-      out.push_back({vec3f(d),0});
-
-      out.push_back({vec3f(b),0});
-      out.push_back({vec3f(c),0});
-      out.push_back({vec3f(d),0});
-    }
-#else
-    process(out,asHex,isoValue);
-#endif
+    const vec4f a(in.vertices[tet.x],in.perVertex->values[tet.x]);
+    const vec4f b(in.vertices[tet.y],in.perVertex->values[tet.y]);
+    const vec4f c(in.vertices[tet.z],in.perVertex->values[tet.z]);
+    const vec4f d(in.vertices[tet.w],in.perVertex->values[tet.w]);
+    asHex[0] = a; asHex[1] = b; asHex[2] = c; asHex[3] = c;
+    asHex[4] = d; asHex[5] = d; asHex[6] = d; asHex[7] = d;
   }
 
-  /*! blow a pyr up into a hex (by replicating vertices), then run MC
-      tables on that hex */
-  void process(std::vector<FatVertex> &out,
-               UMesh::SP in,
-               const UMesh::Pyr &pyr,
-               const float isoValue)
+  /*! blow a pyr up into a hex (by replicating vertices) */
+  inline void loadAsHex(vec4f asHex[8], const UMesh &in, const UMesh::Pyr &pyr)
   {
-    const vec4f v0(in->vertices[pyr[0]],in->perVertex->values[pyr[0]]);
-    const vec4f v1(in->vertices[pyr[1]],in->perVertex->values[pyr[1]]);
-    const vec4f v2(in->vertices[pyr[2]],in->perVertex->values[pyr[2]]);
-    const vec4f v3(in->vertices[pyr[3]],in->perVertex->values[pyr[3]]);
-    const vec4f v4(in->vertices[pyr[4]],in->perVertex->values[pyr[4]]);
-    vec4f asHex[8] = { v0,v1,v2,v3, v4,v4,v4,v4 };
-    process(out,asHex,isoValue);
+    for (int i=0;i<4;i++)
+      asHex[i] = vec4f(in.vertices[pyr[i]],in.perVertex->values[pyr[i]]);
+    const vec4f v4(in.vertices[pyr[4]],in.perVertex->values[pyr[4]]);
+    asHex[4] = v4; asHex[5] = v4; asHex[6] = v4; asHex[7] = v4;
   }
   
-  /*! blow a wedge up into a hex (by replicating vertices), then run MC
-      tables on that hex */
-  void process(std::vector<FatVertex> &out,
-               UMesh::SP in,
-               const UMesh::Wedge &wedge,
-               const float isoValue)
+  /*! blow a wedge up into a hex (by replicating vertices) */
+  inline void loadAsHex(vec4f asHex[8], const UMesh &in, const UMesh::Wedge &wedge)
   {
-    const vec4f v0(in->vertices[wedge[0]],in->perVertex->values[wedge[0]]);
-    const vec4f v1(in->vertices[wedge[1]],in->perVertex->values[wedge[1]]);
-    const vec4f v2(in->vertices[wedge[2]],in->perVertex->values[wedge[2]]);
-    const vec4f v3(in->vertices[wedge[3]],in->perVertex->values[wedge[3]]);
-    const vec4f v4(in->vertices[wedge[4]],in->perVertex->values[wedge[4]]);
-    const vec4f v5(in->vertices[wedge[5]],in->perVertex->values[wedge[5]]);
-    vec4f asHex[8] = { v0,v1,v4,v3,v2,v2,v5,v5 };
-    process(out,asHex,isoValue);
+    vec4f v[6];
+    for (int i=0;i<6;i++)
+      v[i] = vec4f(in.vertices[wedge[i]],in.perVertex->values[wedge[i]]);
+    asHex[0] = v[0]; asHex[1] = v[1]; asHex[2] = v[4]; asHex[3] = v[3];
+    asHex[4] = v[2]; asHex[5] = v[2]; asHex[6] = v[5]; asHex[7] = v[5];
   }
   
-  /*! convert our hex representation to 8x{vec3f+scalar}, then run MC
-      tabless */
-  void process(std::vector<FatVertex> &out,
-               UMesh::SP in,
-               const UMesh::Hex &hex,
-               const float isoValue)
+  /*! convert our hex representation to 8x{vec3f+scalar} */
+  inline void loadAsHex(vec4f asHex[8], const UMesh &in, const UMesh::Hex &hex)
   {
-    const vec4f v0(in->vertices[hex[0]],in->perVertex->values[hex[0]]);
-    const vec4f v1(in->vertices[hex[1]],in->perVertex->values[hex[1]]);
-    const vec4f v2(in->vertices[hex[2]],in->perVertex->values[hex[2]]);
-    const vec4f v3(in->vertices[hex[3]],in->perVertex->values[hex[3]]);
-    const vec4f v4(in->vertices[hex[4]],in->perVertex->values[hex[4]]);
-    const vec4f v5(in->vertices[hex[5]],in->perVertex->values[hex[5]]);
-    const vec4f v6(in->vertices[hex[6]],in->perVertex->values[hex[6]]);
-    const vec4f v7(in->vertices[hex[7]],in->perVertex->values[hex[7]]);
-    vec4f asHex[8] = { v0,v1,v2,v3,v4,v5,v6,v7 };
-    process(out,asHex,isoValue);
+    for (int i=0;i<8;i++)
+      asHex[i] = vec4f(in.vertices[hex[i]],in.perVertex->values[hex[i]]);
   }
-  
-  void doIsoSurfacePyrs(std::vector<FatVertex> &out,
-                        std::mutex &mutex,
-                        UMesh::SP in,
-                        size_t begin,
-                        size_t end,
-                        const float isoValue)
+
+  /*! load element 'elementID' of the combined range of "all tets,
+      then all pyrs, then all wedges, then all hexes" as a (possibly
+      degenerate) hex */
+  inline void loadAsHex(vec4f asHex[8], const UMesh &in, size_t elementID)
   {
-    std::vector<FatVertex> localVertices;
-    for (size_t i=begin;i<end;i++)
-      process(localVertices,in,in->pyrs[i],isoValue);
+    const size_t pyrsBegin   = in.tets.size();
+    const size_t wedgesBegin = pyrsBegin+in.pyrs.size();
+    const size_t hexesBegin  = wedgesBegin+in.wedges.size();
+    if (elementID < pyrsBegin)
+      loadAsHex(asHex,in,in.tets[elementID]);
+    else if (elementID < wedgesBegin)
+      loadAsHex(asHex,in,in.pyrs[elementID-pyrsBegin]);
+    else if (elementID < hexesBegin)
+      loadAsHex(asHex,in,in.wedges[elementID-wedgesBegin]);
+    else
+      loadAsHex(asHex,in,in.hexes[elementID-hexesBegin]);
+  }
 
-    std::lock_guard<std::mutex> lock(mutex);
-    std::copy(localVertices.begin(),
-              localVertices.end(),
-              std::back_insert_iterator<std::vector<FatVertex>>(out));
+  /*! concatenates per-block output arrays (in block order), freeing
+      each block's array once it got copied */
+  std::vector<vec3f> concatBlocks(std::vector<std::vector<vec3f>> &blocks)
+  {
+    const size_t numBlocks = blocks.size();
+    std::vector<size_t> blockOffset(numBlocks);
+    for (size_t blockID=0;blockID<numBlocks;blockID++)
+      blockOffset[blockID] = blocks[blockID].size();
+    const size_t numVertices
+      = parallel_exclusive_scan(blockOffset.data(),blockOffset.data(),numBlocks);
+    std::vector<vec3f> result(numVertices);
+    parallel_for(numBlocks,[&](size_t blockID){
+        std::copy(blocks[blockID].begin(),blocks[blockID].end(),
+                  result.begin()+blockOffset[blockID]);
+        std::vector<vec3f>().swap(blocks[blockID]);
+      });
+    return result;
   }
-  
-  void doIsoSurfaceWedges(std::vector<FatVertex> &out,std::mutex &mutex,
-                          UMesh::SP in,
-                          size_t begin,
-                          size_t end,
-                          const float isoValue)
+
+  /*! turn a triangle soup (three vertices per triangle) into an
+      indexed triangle mesh, merging all vertices with bit-identical
+      positions. Sorts the vertices by position (parallel radix sort
+      over the 96-bit position), flags the first of each run of equal
+      positions, and uses a prefix sum over those flags to assign
+      unique vertex IDs - all steps run in parallel. */
+  UMesh::SP weldTriangleSoup(const std::vector<vec3f> &triVertices)
   {
-    std::vector<FatVertex> localVertices;
-    for (size_t i=begin;i<end;i++)
-      process(localVertices,in,in->wedges[i],isoValue);
+    const size_t numFatVertices = triVertices.size();
+    if (numFatVertices >= (size_t)std::numeric_limits<int>::max())
+      throw std::runtime_error("#umesh.iso: too many iso-surface vertices "
+                               "for 32-bit triangle indices");
+    UMesh::SP result = std::make_shared<UMesh>();
+    UMesh &out = *result;
+    std::vector<FatVertex> fatVertices(numFatVertices);
+    parallel_for_blocked(0,numFatVertices,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++)
+          fatVertices[i] = { triVertices[i], (uint32_t)i };
+      });
+    radixSort(fatVertices.data(),numFatVertices,96,
+              [](const FatVertex &v){
+                RadixKey key;
+                key.lo = uint64_t(radixKeyOf(v.pos.x))
+                  | (uint64_t(radixKeyOf(v.pos.y)) << 32);
+                key.hi = radixKeyOf(v.pos.z);
+                return key;
+              });
+
+    std::vector<int> uniqueVertexID(numFatVertices);
+    parallel_for_blocked(0,numFatVertices,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++)
+          uniqueVertexID[i]
+            = (i==0) || (fatVertices[i].pos != fatVertices[i-1].pos);
+      });
+    const int numUniqueVertices
+      = parallel_exclusive_scan(uniqueVertexID.data(),
+                                uniqueVertexID.data(),
+                                numFatVertices);
+    if (verbose)
+    std::cout << "#umesh.iso: found " << prettyNumber(numUniqueVertices) << " unique vertices ..." << std::endl;
 
-    std::lock_guard<std::mutex> lock(mutex);
-    std::copy(localVertices.begin(),
-              localVertices.end(),
-              std::back_insert_iterator<std::vector<FatVertex>>(out));
+    out.triangles.resize(numFatVertices/3);
+    out.vertices.resize(numUniqueVertices);
+    /* this assumes that every triangle is three ints - make sure
+       that's the case! */
+    static_assert(sizeof(out.triangles[0]) == 3*sizeof(int),
+                  "make sure nobody changed the fact that triangles "
+                  "are three ints, and nothing but");
+    int *triangleIndices = (int*)out.triangles.data();
+    parallel_for_blocked(0,numFatVertices,64*1024,[&](size_t begin, size_t end){
+        for (size_t i=begin;i<end;i++) {
+          const auto &vtx = fatVertices[i];
+          const bool isFirst = (i==0) || (vtx.pos != fatVertices[i-1].pos);
+          const int vertexID = uniqueVertexID[i] - (isFirst ? 0 : 1);
+          if (isFirst)
+            out.vertices[vertexID] = vtx.pos;
+          triangleIndices[vtx.idx] = vertexID;
+        }
+      });
+    return result;
   }
-  
-  void doIsoSurfaceHexes(std::vector<FatVertex> &out,std::mutex &mutex,
-                         UMesh::SP in,
-                         size_t begin,
-                         size_t end,
-                         const float isoValue)
+
+  /*! run MC for all given iso-values on all volumetric elements of
+      the input, in a single pass over the elements, and return one
+      (un-welded) triangle soup per iso-value, three vertices per
+      triangle */
+  std::vector<std::vector<vec3f>>
+  extractIsoSurfaceSoups(UMesh::SP in, const std::vector<float> &isoValues)
   {
-    std::vector<FatVertex> localVertices;
-    for (size_t i=begin;i<end;i++)
-      process(localVertices,in,in->hexes[i],isoValue);
+    if (!in) throw std::runtime_error("null input mesh");
+    if (!in->perVertex) throw std::runtime_error("input mesh w/o scalar field");
+    
+    const size_t numElements
+      = in->tets.size()+in->pyrs.size()+in->wedges.size()+in->hexes.size();
+    const size_t numIsoValues = isoValues.size();
+    if (verbose)
+      std::cout << "#umesh.iso: pushing " << prettyNumber(in->tets.size())
+                << " tets, " << prettyNumber(in->pyrs.size())
+                << " pyramids, " << prettyNumber(in->wedges.size())
+                << " wedges, and " << prettyNumber(in->hexes.size())
+                << " hexes, for " << numIsoValues << " iso-value(s)" << std::endl;
 
-    std::lock_guard<std::mutex> lock(mutex);
-    std::copy(localVertices.begin(),
-              localVertices.end(),
-              std::back_insert_iterator<std::vector<FatVertex>>(out));
+    /* sort the iso-values, so each element's [min,max) scalar range
+       maps to a contiguous range of iso-values it can cross - all
+       others get skipped without looking at the MC tables */
+    std::vector<std::pair<float,size_t>> sortedIsoValues(numIsoValues);
+    for (size_t i=0;i<numIsoValues;i++)
+      sortedIsoValues[i] = { isoValues[i], i };
+    std::sort(sortedIsoValues.begin(),sortedIsoValues.end());
+    std::vector<float> sortedValues(numIsoValues);
+    for (size_t i=0;i<numIsoValues;i++)
+      sortedValues[i] = sortedIsoValues[i].first;
+    
+    /* every block of elements writes into its own output arrays, so
+       there's no shared state (and no lock) while marching; the
+       per-block outputs then get concatenated in parallel, in block
+       order, so the result is deterministic */
+    const size_t blockSize = 16*1024;
+    const size_t numBlocks = (numElements+blockSize-1)/blockSize;
+    std::vector<std::vector<std::vector<vec3f>>> blockVertices
+      (numIsoValues,std::vector<std::vector<vec3f>>(numBlocks));
+    parallel_for(numBlocks,[&](size_t blockID){
+        const size_t begin = blockID*blockSize;
+        const size_t end   = std::min(begin+blockSize,numElements);
+        vec4f asHex[8];
+        for (size_t elementID=begin;elementID<end;elementID++) {
+          loadAsHex(asHex,*in,elementID);
+          float lo = asHex[0].w, hi = asHex[0].w;
+          for (int i=1;i<8;i++) {
+            lo = std::min(lo,asHex[i].w);
+            hi = std::max(hi,asHex[i].w);
+          }
+          // an element produces triangles iff lo <= iso < hi
+          const size_t first
+            = std::lower_bound(sortedValues.begin(),sortedValues.end(),lo)
+            - sortedValues.begin();
+          for (size_t i=first;i<numIsoValues && sortedValues[i] < hi;i++)
+            isoSurfaceHex(blockVertices[sortedIsoValues[i].second][blockID],
+                          asHex,sortedValues[i]);
+        }
+      });
+
+    std::vector<std::vector<vec3f>> result(numIsoValues);
+    for (size_t i=0;i<numIsoValues;i++)
+      result[i] = concatBlocks(blockVertices[i]);
+    return result;
   }
-  
-  void doIsoSurfaceTets(std::vector<FatVertex> &out,
-                        std::mutex &mutex,
-                        UMesh::SP in,
-                        size_t begin,
-                        size_t end,
-                        const float isoValue)
-  {
-    std::vector<FatVertex> localVertices;
-    for (size_t i=begin;i<end;i++)
-      process(localVertices,in,in->tets[i],isoValue);
 
-    std::lock_guard<std::mutex> lock(mutex);
-    std::copy(localVertices.begin(),
-              localVertices.end(),
-              std::back_insert_iterator<std::vector<FatVertex>>(out));
+  /*! run MC on all volumetric elements of the input, and return the
+      resulting (un-welded) triangle soup, three vertices per
+      triangle */
+  std::vector<vec3f> extractIsoSurfaceSoup(UMesh::SP in, float isoValue)
+  {
+    return std::move(extractIsoSurfaceSoups(in,{isoValue})[0]);
   }
   
   /*! given a umesh with volumetric elemnets (any sort), compute a new
@@ -507,87 +566,27 @@ namespace umesh {
     unchanged. */
   UMesh::SP extractIsoSurface(UMesh::SP in, float isoValue)
   {
-    if (!in) throw std::runtime_error("null input mesh");
-    if (!in->perVertex) throw std::runtime_error("input mesh w/o scalar field");
-    
-    UMesh::SP out = std::make_shared<UMesh>();
-    std::mutex mutex;
-
-    std::vector<FatVertex> fatVertices;
-    
-    if (verbose)
-      std::cout << "#umesh.iso: pushing " << prettyNumber(in->tets.size())
-              << " tets" << std::endl;
-    parallel_for_blocked
-      (0,in->tets.size(),1024,
-       [&](size_t begin, size_t end){
-        doIsoSurfaceTets(fatVertices,mutex,in,begin,end,isoValue);
-      });
-
-#if 0
-    if (verbose)
-    std::cout << "#umesh.iso: pushing " << prettyNumber(in->pyrs.size())
-              << " pyramids" << std::endl;
-    parallel_for_blocked
-      (0,in->pyrs.size(),1024,
-       [&](size_t begin, size_t end){
-        doIsoSurfacePyrs(fatVertices,mutex,in,begin,end,isoValue);
-      });
-
-    if (verbose)
-    std::cout << "#umesh.iso: pushing " << prettyNumber(in->wedges.size())
-              << " wedges" << std::endl;
-    parallel_for_blocked
-      (0,in->wedges.size(),1024,
-       [&](size_t begin, size_t end){
-        doIsoSurfaceWedges(fatVertices,mutex,in,begin,end,isoValue);
-      });
-
-    if (verbose)
-    std::cout << "#umesh.iso: pushing " << prettyNumber(in->hexes.size())
-              << " hexes" << std::endl;
-    parallel_for_blocked
-      (0,in->hexes.size(),1024,
-       [&](size_t begin, size_t end){
-        doIsoSurfaceHexes(fatVertices,mutex,in,begin,end,isoValue);
-      });
-#endif
-    const int numFatVertices = (int)fatVertices.size();
-    if (verbose)
-    std::cout << "#umesh.iso: found " << prettyNumber(numFatVertices/3) << " triangles ..." << std::endl;
-    if (verbose)
-    std::cout << "#umesh.iso: creating vertex/index arrays ..." << std::endl;
-    for (int i=0;i<numFatVertices;i++)
-      fatVertices[i].idx = i;
-#if UMESH_HAVE_TBB
-      tbb::parallel_sort(fatVertices.begin(),fatVertices.end(),FatVertexCompare());
-#else
-      std::sort(fatVertices.begin(),fatVertices.end(),FatVertexCompare());
-#endif
+    return extractIsoSurfaces(in,{isoValue})[0];
+  }
 
-    int numUniqueVertices = 0;
-    for (int i=0;i<numFatVertices;i++)
-      if ((i==0) || (fatVertices[i].pos != fatVertices[i-1].pos))
-        ++numUniqueVertices;
-    if (verbose)
-    std::cout << "#umesh.iso: found " << prettyNumber(numUniqueVertices) << " unique vertices ..." << std::endl;
-    out->triangles.resize(numFatVertices/3);
-    out->vertices.resize(numUniqueVertices);
-    int uniqueVertexID = -1;
-    for (int i=0;i<numFatVertices;i++) {
-      const auto &vtx = fatVertices[i];
-      if (i==0 || vtx.pos != fatVertices[i-1].pos) {
-        ++uniqueVertexID;
-        out->vertices[uniqueVertexID] = vtx.pos;
-      }
-      /* this line assumes that every triangle is three ints - make
-         sure that's the case! */
-      static_assert(sizeof(out->triangles[0]) == 3*sizeof(int),
-                    "make sure nobody changed the fact that triangles "
-                    "are three ints, and nothing but");
-      ((int*)out->triangles.data())[vtx.idx] = uniqueVertexID;
+  /*! same as extractIsoSurface, but for multiple iso-values at once:
+      the input mesh only gets traversed once, and every element only
+      gets marched for the iso-values within its scalar range */
+  std::vector<UMesh::SP> extractIsoSurfaces(UMesh::SP in,
+                                            const std::vector<float> &isoValues)
+  {
+    std::vector<std::vector<vec3f>> triVertices
+      = extractIsoSurfaceSoups(in,isoValues);
+    std::vector<UMesh::SP> result;
+    for (size_t i=0;i<isoValues.size();i++) {
+      if (verbose)
+      std::cout << "#umesh.iso: found " << prettyNumber(triVertices[i].size()/3)
+                << " triangles for iso-value " << isoValues[i]
+                << ", creating vertex/index arrays ..." << std::endl;
+      result.push_back(weldTriangleSoup(triVertices[i]));
+      std::vector<vec3f>().swap(triVertices[i]);
     }
-    return out;
+    return result;
   }
   
 } // ::umesh
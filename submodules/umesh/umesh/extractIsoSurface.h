@@ -27,6 +27,44 @@ namespace umesh {
       elemnets; tris and quads in the input get ignored; input remains
       unchanged. */
   UMesh::SP extractIsoSurface(UMesh::SP input, float isoValue);
+
+  /*! same as extractIsoSurface, but for a whole list of iso-values:
+      the input gets traversed only once, each element only gets
+      marched for those iso-values that lie within its scalar range,
+      and the result has one triangle mesh per iso-value, in the same
+      order as 'isoValues' */
+  std::vector<UMesh::SP> extractIsoSurfaces(UMesh::SP input,
+                                            const std::vector<float> &isoValues);
+
+  /*! same as extractIsoSurface, but returns the un-welded triangle
+      soup (three vertices per triangle), so it can be combined with
+      triangles from other sources before welding */
+  std::vector<vec3f> extractIsoSurfaceSoup(UMesh::SP input, float isoValue);
+
+  /*! un-welded counterpart to extractIsoSurfaces */
+  std::vector<std::vector<vec3f>>
+  extractIsoSurfaceSoups(UMesh::SP input, const std::vector<float> &isoValues);
+
+  /*! concatenates per-block triangle soups (in block order) into
+      one, freeing each block's soup once it got copied - for
+      marching blocks of cells in parallel, each into its own soup */
+  std::vector<vec3f> concatBlocks(std::vector<std::vector<vec3f>> &blocks);
+
+  /*! run marching cubes on a single hexahedron given in VTK vertex
+      order (w is the scalar value), appending three vertices per
+      generated triangle to 'triVertices'. Edge vertices always get
+      interpolated from the lexicographically smaller end, so any
+      two cells sharing an edge produce bit-identical vertices on
+      it. Degenerate hexes (tets, pyramids, wedges with replicated
+      vertices) are fine. */
+  void isoSurfaceHex(std::vector<vec3f> &triVertices,
+                     const vec4f vertex[8],
+                     const float isoValue);
+
+  /*! turn a triangle soup (three vertices per triangle) into an
+      indexed triangle mesh, merging vertices with bit-identical
+      positions */
+  UMesh::SP weldTriangleSoup(const std::vector<vec3f> &triVertices);
   
 } // ::umesh
 
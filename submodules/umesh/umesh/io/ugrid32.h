@@ -28,6 +28,13 @@ namespace umesh {
 
       static UMesh::SP load(const std::string &dataFileName,
                             const std::string &scalarFileName="");
+
+      /*! same as load(), but maps the file into memory and converts,
+          validates, and filters all arrays in parallel; prints one
+          summary line per element type rather than one warning per
+          degenerate element */
+      static UMesh::SP loadMapped(const std::string &dataFileName,
+                                  const std::string &scalarFileName="");
       
       UMesh::SP result; 
     };
@@ -0,0 +1,268 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+/* memory-mapped ugrid32/ugrid64 loading: all arrays get read straight
+   out of the mapped file, and converted, validated, and filtered in
+   parallel */
+
+#include "umesh/io/ugrid32.h"
+#include "umesh/io/ugrid64.h"
+#include "umesh/parallel_for.h"
+#include <atomic>
+#include <climits>
+#ifdef _WIN32
+# include <fstream>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace umesh {
+  namespace io {
+
+    /*! read-only view of an entire file; memory-mapped where
+        available, read into memory in one go otherwise */
+    struct MappedFile {
+      MappedFile(const std::string &fileName)
+        : fileName(fileName)
+      {
+#ifdef _WIN32
+        std::ifstream in(fileName,std::ios::binary|std::ios::ate);
+        if (!in.good())
+          throw std::runtime_error("could not open '"+fileName+"'");
+        buffer.resize(in.tellg());
+        in.seekg(0);
+        readArray(in,buffer.data(),buffer.size());
+        data = buffer.data();
+        size = buffer.size();
+#else
+        int fd = open(fileName.c_str(),O_RDONLY);
+        if (fd < 0)
+          throw std::runtime_error("could not open '"+fileName+"'");
+        struct stat st;
+        if (fstat(fd,&st) != 0) {
+          close(fd);
+          throw std::runtime_error("could not stat '"+fileName+"'");
+        }
+        size = st.st_size;
+        if (size > 0) {
+          void *mem = mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+          if (mem == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("could not mmap '"+fileName+"'");
+          }
+          madvise(mem,size,MADV_SEQUENTIAL);
+          data = (const char *)mem;
+        }
+        close(fd);
+#endif
+      }
+
+      ~MappedFile()
+      {
+#ifndef _WIN32
+        if (data) munmap((void*)data,size);
+#endif
+      }
+      MappedFile(const MappedFile &) = delete;
+      MappedFile &operator=(const MappedFile &) = delete;
+
+      /*! returns the next 'count' T's in the file, and advances the
+          read position past them */
+      template<typename T>
+      const T *next(size_t count, const char *what)
+      {
+        if (count > (size-offset)/sizeof(T))
+          throw std::runtime_error("ugrid file '"+fileName+"' ends before its "+what);
+        const T *result = (const T*)(data+offset);
+        offset += count*sizeof(T);
+        return result;
+      }
+
+      const std::string fileName;
+      const char *data   = nullptr;
+      size_t      size   = 0;
+      size_t      offset = 0;
+#ifdef _WIN32
+      std::vector<char> buffer;
+#endif
+    };
+
+    /*! same test as the (serial) ugrid loaders use: prims whose
+        bounding box is flat in any dimension are degenerate, and so
+        are 4-vertex prims with two vertices in the same spot */
+    template<int N>
+    inline bool isDegenerate(const std::vector<vec3f> &vertices,
+                             const int idx[N])
+    {
+      box3f bounds;
+      for (int i=0;i<N;i++)
+        bounds.extend(vertices[idx[i]]);
+      if ((bounds.lower.x==bounds.upper.x) ||
+          (bounds.lower.y==bounds.upper.y) ||
+          (bounds.lower.z==bounds.upper.z))
+        return true;
+      if (N == 4)
+        for (int i=0;i<N;i++)
+          for (int j=i+1;j<N;j++)
+            if (vertices[idx[i]] == vertices[idx[j]]) return true;
+      return false;
+    }
+
+    /*! converts 'count' prims of N 1-based indices each into 'prims':
+        a first parallel pass rebases and validates the indices and
+        flags degenerate prims, a prefix sum over per-block counts
+        gives each block's output position, and a second parallel
+        pass writes all non-degenerate prims, in input order. Vertex
+        k of each output prim is input vertex perm[k]. */
+    template<typename PrimT, typename IndexT>
+    void loadPrims(const char *what,
+                   const IndexT *in, size_t count,
+                   const std::vector<vec3f> &vertices,
+                   std::vector<PrimT> &prims,
+                   const int *perm = nullptr)
+    {
+      enum { N = PrimT::numVertices };
+      const size_t blockSize = 64*1024;
+      const size_t numBlocks = divRoundUp(count,blockSize);
+      std::vector<uint8_t>  isGood(count);
+      std::vector<uint64_t> blockBegin(numBlocks);
+      std::atomic<bool> badIndex(false);
+      parallel_for(numBlocks,[&](size_t blockID){
+          size_t numGood = 0;
+          const size_t end = std::min(count,(blockID+1)*blockSize);
+          for (size_t primID=blockID*blockSize;primID<end;primID++) {
+            int idx[N];
+            bool valid = true;
+            for (int i=0;i<N;i++) {
+              // 1-based; an index of 0 wraps around to 'too large'
+              const uint64_t vertexID = uint64_t(in[N*primID+i])-1;
+              valid &= (vertexID < vertices.size());
+              idx[i] = int(vertexID);
+            }
+            if (!valid) { badIndex = true; isGood[primID] = 0; continue; }
+            isGood[primID] = !isDegenerate<N>(vertices,idx);
+            numGood += isGood[primID];
+          }
+          blockBegin[blockID] = numGood;
+        });
+      if (badIndex)
+        throw std::runtime_error(std::string("ugrid file has ")+what
+                                 +" with out-of-range vertex indices");
+      const size_t numGood
+        = parallel_exclusive_scan(blockBegin.data(),blockBegin.data(),numBlocks);
+
+      const size_t numOld = prims.size();
+      prims.resize(numOld+numGood);
+      parallel_for(numBlocks,[&](size_t blockID){
+          size_t outID = numOld+blockBegin[blockID];
+          const size_t end = std::min(count,(blockID+1)*blockSize);
+          for (size_t primID=blockID*blockSize;primID<end;primID++) {
+            if (!isGood[primID]) continue;
+            PrimT &prim = prims[outID++];
+            for (int i=0;i<N;i++)
+              prim[i] = int(in[N*primID+(perm ? perm[i] : i)]-1);
+          }
+        });
+      std::cout << "#tetty.io: " << prettyNumber(numGood) << " " << what;
+      if (numGood != count)
+        std::cout << " (dropped " << prettyNumber(count-numGood) << " degenerate ones)";
+      std::cout << std::endl;
+    }
+
+    template<typename IndexT, typename CoordT>
+    UMesh::SP loadUGridMapped(const std::string &dataFileName,
+                              const std::string &scalarFileName)
+    {
+      MappedFile file(dataFileName);
+      struct {
+        IndexT n_verts, n_tris, n_quads, n_tets, n_pyrs, n_prisms, n_hexes;
+      } header = *file.next<decltype(header)>(1,"header");
+      if (uint64_t(header.n_verts) > uint64_t(INT_MAX))
+        throw std::runtime_error("ugrid file has too many vertices for 32-bit vertex indices");
+      std::cout << "#tetty.io: mapped ugrid file with "
+                << prettyNumber(header.n_verts) << " vertices" << std::endl;
+
+      UMesh::SP result = std::make_shared<UMesh>();
+      const size_t numVertices = header.n_verts;
+      const CoordT *coords = file.next<CoordT>(3*numVertices,"vertices");
+      result->vertices.resize(numVertices);
+      std::atomic<size_t> numFarVertices(0);
+      parallel_for_blocked(0,numVertices,64*1024,[&](size_t begin, size_t end){
+          size_t numFar = 0;
+          for (size_t i=begin;i<end;i++) {
+            const CoordT *pos = coords+3*i;
+            for (int d=0;d<3;d++)
+              if (pos[d] < -1e20f || pos[d] > +1e20f) { numFar++; break; }
+            result->vertices[i] = vec3f((float)pos[0],(float)pos[1],(float)pos[2]);
+          }
+          numFarVertices += numFar;
+        });
+      if (numFarVertices)
+        std::cout << "#tetty.io: warning: " << prettyNumber(numFarVertices)
+                  << " vertices with coordinates beyond +/-1e20" << std::endl;
+
+      if (scalarFileName != "") {
+        MappedFile scalarFile(scalarFileName);
+        const float *scalars = scalarFile.next<float>(numVertices,"scalars");
+        result->perVertex = std::make_shared<Attribute>();
+        result->perVertex->values.resize(numVertices);
+        parallel_for_blocked(0,numVertices,64*1024,[&](size_t begin, size_t end){
+            std::copy(scalars+begin,scalars+end,
+                      result->perVertex->values.data()+begin);
+          });
+        result->perVertex->finalize();
+      }
+
+      const IndexT *tris   = file.next<IndexT>(3*size_t(header.n_tris),"triangles");
+      const IndexT *quads  = file.next<IndexT>(4*size_t(header.n_quads),"quads");
+      file.next<IndexT>(size_t(header.n_tris)+size_t(header.n_quads),"surface IDs");
+      const IndexT *tets   = file.next<IndexT>(4*size_t(header.n_tets),"tets");
+      const IndexT *pyrs   = file.next<IndexT>(5*size_t(header.n_pyrs),"pyramids");
+      const IndexT *prisms = file.next<IndexT>(6*size_t(header.n_prisms),"prisms");
+      const IndexT *hexes  = file.next<IndexT>(8*size_t(header.n_hexes),"hexes");
+
+      loadPrims("triangles",tris,header.n_tris,result->vertices,result->triangles);
+      loadPrims("quads",quads,header.n_quads,result->vertices,result->quads);
+      loadPrims("tets",tets,header.n_tets,result->vertices,result->tets);
+      loadPrims("pyramids",pyrs,header.n_pyrs,result->vertices,result->pyrs);
+      /*! ugrid does NOT use the VTK ordering for wedges, but has front
+          and back side swapped out */
+      const int wedgePerm[6] = { 3,4,5,0,1,2 };
+      loadPrims("prisms",prisms,header.n_prisms,result->vertices,result->wedges,
+                wedgePerm);
+      loadPrims("hexes",hexes,header.n_hexes,result->vertices,result->hexes);
+
+      result->finalize();
+      return result;
+    }
+
+    UMesh::SP UGrid32Loader::loadMapped(const std::string &dataFileName,
+                                        const std::string &scalarFileName)
+    {
+      return loadUGridMapped<uint32_t,float>(dataFileName,scalarFileName);
+    }
+
+    UMesh::SP UGrid64Loader::loadMapped(const std::string &dataFileName,
+                                        const std::string &scalarFileName)
+    {
+      return loadUGridMapped<uint64_t,double>(dataFileName,scalarFileName);
+    }
+
+  } // ::umesh::io
+} // ::umesh
@@ -60,6 +60,7 @@
 #include <vector>
 #include <algorithm>
 #include <limits.h>
+#include <chrono>
 
 #if (!defined(__umesh_both__))
 # if defined(__CUDA_ARCH__)
@@ -437,6 +438,16 @@ namespace umesh {
     return result;
   }
 #undef osp_snprintf
+
+  /*! wall-clock seconds it takes to run 'lambda' */
+  template<typename Lambda>
+  inline double timeOf(const Lambda &lambda)
+  {
+    const auto begin = std::chrono::steady_clock::now();
+    lambda();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end-begin).count();
+  }
   
   inline vec3f::vec3f(const vec3i &v) : x{(float)v.x}, y{(float)v.y}, z{(float)v.z} { }
 
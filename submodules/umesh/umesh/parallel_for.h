@@ -18,6 +18,8 @@
 
 // std
 #include <mutex>
+#include <vector>
+#include <algorithm>
 
 #ifdef UMESH_DISABLE_TBB
 # undef UMESH_HAVE_TBB
@@ -87,5 +89,55 @@ namespace umesh {
                              taskFunction(block_begin,std::min(block_begin+blockSize,end));
                            });
   }
+
+  namespace detail {
+    template<bool INCLUSIVE, typename T>
+    T parallel_scan(const T *in, T *out, size_t N, size_t blockSize)
+    {
+      const size_t numBlocks = (N+blockSize-1)/blockSize;
+      std::vector<T> blockSum(numBlocks);
+      parallel_for(numBlocks,[&](size_t blockID){
+          const size_t begin = blockID*blockSize;
+          const size_t end   = std::min(begin+blockSize,N);
+          T sum = T(0);
+          for (size_t i=begin;i<end;i++) sum += in[i];
+          blockSum[blockID] = sum;
+        });
+      T total = T(0);
+      for (size_t blockID=0;blockID<numBlocks;blockID++) {
+        const T sum = blockSum[blockID];
+        blockSum[blockID] = total;
+        total += sum;
+      }
+      parallel_for(numBlocks,[&](size_t blockID){
+          const size_t begin = blockID*blockSize;
+          const size_t end   = std::min(begin+blockSize,N);
+          T sum = blockSum[blockID];
+          for (size_t i=begin;i<end;i++) {
+            const T value = in[i];
+            if (INCLUSIVE) sum += value;
+            out[i] = sum;
+            if (!INCLUSIVE) sum += value;
+          }
+        });
+      return total;
+    }
+  }
+
+  /*! exclusive prefix sum over 'in[0..N)', written to 'out' (which
+      may be the same array as 'in'); returns the total. Done in two
+      parallel passes over blocks of 'blockSize' elements, with a
+      (short) serial scan over the per-block sums in between */
+  template<typename T>
+  T parallel_exclusive_scan(const T *in, T *out, size_t N,
+                            size_t blockSize=64*1024)
+  { return detail::parallel_scan<false>(in,out,N,blockSize); }
+
+  /*! inclusive prefix sum over 'in[0..N)', written to 'out' (which
+      may be the same array as 'in'); returns the total */
+  template<typename T>
+  T parallel_inclusive_scan(const T *in, T *out, size_t N,
+                            size_t blockSize=64*1024)
+  { return detail::parallel_scan<true>(in,out,N,blockSize); }
   
 } // ::umesh
@@ -0,0 +1,378 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "umesh/partition.h"
+#include "umesh/parallel_for.h"
+#include <cmath>
+
+namespace umesh {
+
+  namespace {
+
+    enum { numBins = 128 };
+
+    inline float halfArea(const box3f &box)
+    {
+      if (box.empty()) return 0.f;
+      const vec3f d = box.size();
+      return d.x*d.y+d.y*d.z+d.z*d.x;
+    }
+
+    /*! blocks of prims that get binned (or reduced) by one task */
+    inline size_t blockSizeFor(size_t numPrims)
+    { return std::max(size_t(64*1024),(numPrims+63)/64); }
+
+    struct Stats {
+      void extend(const Stats &other)
+      {
+        bounds.extend(other.bounds);
+        centBounds.extend(other.centBounds);
+        cost += other.cost;
+      }
+
+      box3f  bounds;
+      box3f  centBounds;
+      double cost = 0.;
+    };
+
+    struct Bin {
+      void extend(const Bin &other)
+      {
+        bounds.extend(other.bounds);
+        cost  += other.cost;
+        count += other.count;
+      }
+
+      box3f  bounds;
+      double cost  = 0.;
+      size_t count = 0;
+    };
+
+    /*! per-axis bins. object-space binning puts each prim into the
+        'enter' bin of its centroid; spatial binning puts it into the
+        'enter' bin of its lower, and the 'exit' bin of its upper
+        coordinate */
+    struct Bins {
+      void extend(const Bins &other)
+      {
+        for (int d=0;d<3;d++)
+          for (int i=0;i<numBins;i++) {
+            enter[d][i].extend(other.enter[d][i]);
+            exit[d][i].extend(other.exit[d][i]);
+          }
+      }
+
+      Bin enter[3][numBins];
+      Bin exit[3][numBins];
+    };
+
+    /*! maps a coordinate to a bin, relative to range [lower,lower+extent) */
+    struct BinMapping {
+      BinMapping(const box3f &range)
+        : lower(range.lower)
+      {
+        const vec3f extent = range.size();
+        for (int d=0;d<3;d++) {
+          valid[d] = extent[d] > 0.f;
+          scale[d] = valid[d] ? numBins/extent[d] : 0.f;
+          width[d] = extent[d] / numBins;
+        }
+      }
+
+      inline int bin(const vec3f &p, int d) const
+      {
+        const int b = int((p[d]-lower[d])*scale[d]);
+        return std::max(0,std::min(int(numBins)-1,b));
+      }
+
+      inline float plane(int i, int d) const
+      { return lower[d] + i*width[d]; }
+
+      vec3f lower;
+      vec3f scale;
+      vec3f width;
+      bool  valid[3];
+    };
+
+    struct Split {
+      int    dim   = -1;
+      int    plane = -1;
+      double sah   = INFINITY;
+      /*! how far (in cost fraction) this split is off the target
+          ratio; only used for balanced splits */
+      double imbalance = INFINITY;
+    };
+
+    struct Partitioner {
+      Partitioner(UMesh::SP mesh, bool spatial, size_t leafThreshold)
+        : mesh(mesh), spatial(spatial), leafThreshold(leafThreshold)
+      {}
+
+      Stats computeStats(const std::vector<UMesh::PrimRef> &prims) const
+      {
+        const size_t blockSize = blockSizeFor(prims.size());
+        const size_t numBlocks = divRoundUp(prims.size(),blockSize);
+        std::vector<Stats> blockStats(numBlocks);
+        parallel_for(numBlocks,[&](size_t blockID){
+            Stats &stats = blockStats[blockID];
+            const size_t end = std::min(prims.size(),(blockID+1)*blockSize);
+            for (size_t i=blockID*blockSize;i<end;i++) {
+              const box3f pb = mesh->getBounds(prims[i]);
+              stats.bounds.extend(pb);
+              stats.centBounds.extend(pb.center());
+              stats.cost += primCost(prims[i]);
+            }
+          });
+        Stats stats;
+        for (auto &bs : blockStats) stats.extend(bs);
+        return stats;
+      }
+
+      void computeBins(const std::vector<UMesh::PrimRef> &prims,
+                       const BinMapping &mapping,
+                       Bins &bins) const
+      {
+        const size_t blockSize = blockSizeFor(prims.size());
+        const size_t numBlocks = divRoundUp(prims.size(),blockSize);
+        std::vector<Bins> blockBins(numBlocks);
+        parallel_for(numBlocks,[&](size_t blockID){
+            Bins &bb = blockBins[blockID];
+            const size_t end = std::min(prims.size(),(blockID+1)*blockSize);
+            for (size_t i=blockID*blockSize;i<end;i++) {
+              const box3f pb   = mesh->getBounds(prims[i]);
+              const float cost = primCost(prims[i]);
+              for (int d=0;d<3;d++) {
+                if (!mapping.valid[d]) continue;
+                Bin &enter
+                  = bb.enter[d][mapping.bin(spatial ? pb.lower : pb.center(),d)];
+                enter.bounds.extend(pb);
+                enter.cost += cost;
+                enter.count++;
+                if (spatial) {
+                  Bin &exit = bb.exit[d][mapping.bin(pb.upper,d)];
+                  exit.cost += cost;
+                  exit.count++;
+                }
+              }
+            }
+          });
+        for (auto &bb : blockBins) bins.extend(bb);
+      }
+
+      /*! find best split plane; if targetLeftFraction > 0 the split
+          is to be a balanced one, with about this fraction of the cost
+          on the left side */
+      Split findSplit(const std::vector<UMesh::PrimRef> &prims,
+                      const box3f &domain,
+                      const Stats &stats,
+                      double targetLeftFraction) const
+      {
+        const BinMapping mapping(spatial ? domain : stats.centBounds);
+        Bins bins;
+        computeBins(prims,mapping,bins);
+
+        Split best;
+        for (int d=0;d<3;d++) {
+          if (!mapping.valid[d]) continue;
+          // sweep from the right, for the right side of each plane
+          Bin right[numBins];
+          Bin sum;
+          for (int i=numBins-1;i>0;--i) {
+            sum.extend(spatial ? bins.exit[d][i] : bins.enter[d][i]);
+            right[i] = sum;
+          }
+          Split bestInDim;
+          Bin left;
+          for (int i=1;i<numBins;i++) {
+            left.extend(bins.enter[d][i-1]);
+            if (left.count == 0 || right[i].count == 0) continue;
+            if (left.count == prims.size() && right[i].count == prims.size())
+              // no progress - everything straddles this plane
+              continue;
+            float areaL, areaR;
+            if (spatial) {
+              box3f lDomain = domain, rDomain = domain;
+              lDomain.upper[d] = rDomain.lower[d] = mapping.plane(i,d);
+              areaL = halfArea(lDomain);
+              areaR = halfArea(rDomain);
+            } else {
+              areaL = halfArea(left.bounds);
+              areaR = halfArea(right[i].bounds);
+            }
+            Split split;
+            split.dim   = d;
+            split.plane = i;
+            split.sah   = areaL*left.cost + areaR*right[i].cost;
+            if (targetLeftFraction > 0.)
+              split.imbalance
+                = fabs(left.cost/(left.cost+right[i].cost)-targetLeftFraction);
+            if (split.imbalance < bestInDim.imbalance ||
+                (split.imbalance == bestInDim.imbalance && split.sah < bestInDim.sah))
+              bestInDim = split;
+          }
+          if (bestInDim.sah < best.sah)
+            best = bestInDim;
+        }
+        return best;
+      }
+
+      /*! returns, in the original order, all prims whose 'side'
+          flags have the given bit set; in parallel */
+      std::vector<UMesh::PrimRef> select(const std::vector<UMesh::PrimRef> &prims,
+                                         const std::vector<uint8_t> &sides,
+                                         uint8_t side) const
+      {
+        std::vector<uint64_t> outID(prims.size());
+        parallel_for_blocked(0,prims.size(),64*1024,[&](size_t begin, size_t end){
+            for (size_t i=begin;i<end;i++) outID[i] = (sides[i] & side) != 0;
+          });
+        const size_t numSelected
+          = parallel_exclusive_scan(outID.data(),outID.data(),prims.size());
+        std::vector<UMesh::PrimRef> selected(numSelected);
+        parallel_for_blocked(0,prims.size(),64*1024,[&](size_t begin, size_t end){
+            for (size_t i=begin;i<end;i++)
+              if (sides[i] & side) selected[outID[i]] = prims[i];
+          });
+        return selected;
+      }
+
+      /*! builds the subtree over the given prims (which get consumed
+          in the process) and their stats, and appends its bricks to
+          'bricks' */
+      void build(std::vector<UMesh::PrimRef> &prims,
+                 const Stats &stats,
+                 box3f domain,
+                 int maxBricks,
+                 std::vector<Brick> &bricks) const
+      {
+        domain = spatial ? intersection(domain,stats.bounds) : stats.bounds;
+
+        auto makeLeaf = [&]() {
+          Brick brick;
+          brick.prims  = std::move(prims);
+          brick.bounds = stats.bounds;
+          brick.domain = domain;
+          brick.cost   = stats.cost;
+          bricks.push_back(std::move(brick));
+        };
+        const bool balanced = maxBricks > 0;
+        if ((balanced && maxBricks < 2) || prims.size() < leafThreshold)
+          return makeLeaf();
+
+        const int leftBricks  = balanced ? maxBricks/2 : 0;
+        const int rightBricks = balanced ? maxBricks-leftBricks : 0;
+        const Split split
+          = findSplit(prims,domain,stats,
+                      balanced ? double(leftBricks)/maxBricks : 0.);
+        std::vector<UMesh::PrimRef> half[2];
+        Stats halfStats[2];
+        box3f halfDomain[2] = { domain, domain };
+        if (split.dim >= 0) {
+          const int dim = split.dim;
+          const BinMapping mapping(spatial ? domain : stats.centBounds);
+          const float pos = mapping.plane(split.plane,dim);
+          halfDomain[0].upper[dim] = halfDomain[1].lower[dim] = pos;
+          // bit 0: goes left, bit 1: goes right; also gathers the
+          // stats of both halves, for the next level
+          std::vector<uint8_t> sides(prims.size());
+          const size_t blockSize = blockSizeFor(prims.size());
+          const size_t numBlocks = divRoundUp(prims.size(),blockSize);
+          std::vector<Stats> blockStats(2*numBlocks);
+          parallel_for(numBlocks,[&](size_t blockID){
+              const size_t end = std::min(prims.size(),(blockID+1)*blockSize);
+              for (size_t i=blockID*blockSize;i<end;i++) {
+                const box3f pb = mesh->getBounds(prims[i]);
+                if (spatial)
+                  // same closed-interval test as box3f::overlaps()
+                  sides[i]
+                    = (pb.lower[dim] <= pos ? 1 : 0)
+                    | (pb.upper[dim] >= pos ? 2 : 0);
+                else
+                  sides[i] = mapping.bin(pb.center(),dim) < split.plane ? 1 : 2;
+                for (int side=0;side<2;side++) {
+                  if (!(sides[i] & (1<<side))) continue;
+                  Stats &bs = blockStats[2*blockID+side];
+                  bs.bounds.extend(pb);
+                  bs.centBounds.extend(pb.center());
+                  bs.cost += primCost(prims[i]);
+                }
+              }
+            });
+          for (size_t blockID=0;blockID<numBlocks;blockID++)
+            for (int side=0;side<2;side++)
+              halfStats[side].extend(blockStats[2*blockID+side]);
+          half[0] = select(prims,sides,1);
+          half[1] = select(prims,sides,2);
+        } else if (!spatial && prims.size() > 1) {
+          // all centroids in the same spot - split in list order
+          half[0].assign(prims.begin(),prims.begin()+prims.size()/2);
+          half[1].assign(prims.begin()+prims.size()/2,prims.end());
+          halfStats[0] = computeStats(half[0]);
+          halfStats[1] = computeStats(half[1]);
+        }
+        if (half[0].empty() || half[1].empty() ||
+            (half[0].size() == prims.size() && half[1].size() == prims.size()))
+          return makeLeaf();
+
+        prims.clear();
+        prims.shrink_to_fit();
+        std::vector<Brick> halfBricks[2];
+        parallel_for(2,[&](size_t side){
+            build(half[side],halfStats[side],halfDomain[side],
+                  side ? rightBricks : leftBricks,
+                  halfBricks[side]);
+          });
+        for (int side=0;side<2;side++)
+          for (auto &brick : halfBricks[side])
+            bricks.push_back(std::move(brick));
+      }
+
+      UMesh::SP    mesh;
+      const bool   spatial;
+      const size_t leafThreshold;
+    };
+
+    std::vector<Brick> partition(UMesh::SP mesh,
+                                 bool spatial,
+                                 int maxBricks,
+                                 size_t leafThreshold)
+    {
+      std::vector<UMesh::PrimRef> prims;
+      mesh->createVolumePrimRefs(prims);
+      std::vector<Brick> bricks;
+      if (prims.empty()) return bricks;
+      Partitioner partitioner(mesh,spatial,leafThreshold);
+      partitioner.build(prims,partitioner.computeStats(prims),
+                        mesh->getBounds(),maxBricks,bricks);
+      return bricks;
+    }
+  }
+
+  std::vector<Brick> partitionObjectSpace(UMesh::SP mesh,
+                                          int maxBricks,
+                                          size_t leafThreshold)
+  {
+    return partition(mesh,false,maxBricks,leafThreshold);
+  }
+
+  std::vector<Brick> partitionSpatially(UMesh::SP mesh,
+                                        int maxBricks,
+                                        size_t leafThreshold)
+  {
+    return partition(mesh,true,maxBricks,leafThreshold);
+  }
+
+} // ::umesh
@@ -0,0 +1,81 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "umesh/UMesh.h"
+
+namespace umesh {
+
+  /*! one brick (ie, leaf) of a partitioning of a mesh's volume
+      elements */
+  struct Brick {
+    /*! the prims in this brick, referring into the input mesh */
+    std::vector<UMesh::PrimRef> prims;
+    /*! bounds of all of this brick's prims */
+    box3f bounds;
+    /*! the region of space this brick is responsible for; for
+        spatial partitionings domains do not overlap (prims may
+        stick out of it, though); for object-space partitionings
+        this is the same as 'bounds' */
+    box3f domain;
+    /*! sum of primCost() over all prims */
+    double cost = 0.;
+  };
+
+  /*! relative cost of a prim, for load balancing; we use the number
+      of vertices, which is what both memory and sampling cost of an
+      element scale with */
+  inline float primCost(const UMesh::PrimRef &prim)
+  {
+    switch (prim.type) {
+    case UMesh::TET:   return 4.f;
+    case UMesh::PYR:   return 5.f;
+    case UMesh::WEDGE: return 6.f;
+    case UMesh::HEX:   return 8.f;
+    default:           return 1.f;
+    }
+  }
+
+  /*! partitions the volume elements of the given mesh into bricks,
+      such that every prim goes into exactly one brick (brick bounds
+      may overlap). Builds a tree top-down, with both halves of every
+      split getting built in parallel; splits use binned SAH over the
+      prim centroids.
+
+      If maxBricks > 0, every split divides its subtree's brick budget
+      in two halves, and picks - along the axis with the lowest SAH
+      cost - the bin plane that comes closest to dividing the
+      subtree's prim cost in the same ratio, so that all bricks end
+      up with about the same cost. Otherwise splits simply go to the
+      SAH-optimal plane. Either way, bricks with fewer than
+      leafThreshold prims do not get split any further.
+
+      Bricks are returned in tree order (ie, all of a subtree's
+      bricks are adjacent). */
+  std::vector<Brick> partitionObjectSpace(UMesh::SP mesh,
+                                          int maxBricks,
+                                          size_t leafThreshold);
+
+  /*! same as partitionObjectSpace(), but partitions *space*: each
+      split cuts its brick's domain in two, and prims overlapping
+      both halves go into both bricks. Bins count, for every plane,
+      the prims that start left of, and end right of, it. */
+  std::vector<Brick> partitionSpatially(UMesh::SP mesh,
+                                        int maxBricks,
+                                        size_t leafThreshold);
+
+} // ::umesh
@@ -0,0 +1,162 @@
+// ======================================================================== //
+// Copyright 2018-2021 Ingo Wald                                            //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "umesh/parallel_for.h"
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace umesh {
+
+  /*! a sort key of up to 128 bits; 'lo' holds the least significant
+      bits */
+  struct RadixKey {
+    /*! or's 'value' into the key, starting at bit 'shift' (which may
+        straddle the lo/hi boundary) */
+    inline void insert(uint64_t value, int shift)
+    {
+      if (shift >= 64) {
+        hi |= value << (shift-64);
+      } else {
+        lo |= value << shift;
+        if (shift > 0) hi |= value >> (64-shift);
+      }
+    }
+    
+    /*! extracts 'numBits' (at most 64) bits, starting at bit 'shift' */
+    inline uint64_t extract(int shift, int numBits) const
+    {
+      uint64_t value;
+      if (shift >= 64)
+        value = hi >> (shift-64);
+      else {
+        value = lo >> shift;
+        if (shift > 0) value |= hi << (64-shift);
+      }
+      return numBits >= 64 ? value : (value & ((1ull<<numBits)-1));
+    }
+    
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+  };
+
+  inline bool operator==(const RadixKey &a, const RadixKey &b)
+  { return a.lo == b.lo && a.hi == b.hi; }
+  inline bool operator!=(const RadixKey &a, const RadixKey &b)
+  { return !(a == b); }
+
+  /*! number of bits required to store any value in [0,count) */
+  inline int bitsRequiredFor(size_t count)
+  {
+    int numBits = 1;
+    while (numBits < 64 && (1ull<<numBits) < count) numBits++;
+    return numBits;
+  }
+
+  /*! maps a float to a uint32 whose unsigned ordering matches the
+      float's ordering (for non-NaN values); -0.f and +0.f map to the
+      same key */
+  inline uint32_t radixKeyOf(float f)
+  {
+    if (f == 0.f) return 0x80000000u;
+    uint32_t bits;
+    memcpy(&bits,&f,sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+  }
+
+  namespace radix_detail {
+    inline uint32_t digitOf(const RadixKey &key, int shift, uint32_t mask)
+    { return uint32_t(key.extract(shift,64)) & mask; }
+    inline uint32_t digitOf(uint64_t key, int shift, uint32_t mask)
+    { return shift >= 64 ? 0u : (uint32_t(key >> shift) & mask); }
+  }
+
+  /*! parallel, stable LSD radix sort of items[0..numItems), by the
+      lowest 'numKeyBits' (at most 128) bits of the key returned by
+      'keyOf(item)' - which can return any unsigned integer type, or a
+      RadixKey. Sorts up to 11 bits per pass (spreading the key bits
+      evenly over the minimum number of passes); each pass builds
+      per-block histograms in parallel, turns them into per-block
+      scatter offsets, then scatters in parallel, so all threads
+      write to disjoint ranges. Passes whose digit is the same for all items
+      get skipped, so keys with unused high bits do not cost extra
+      passes. Requires one temporary copy of the input array. */
+  template<typename T, typename KeyFct>
+  void radixSort(T *items, size_t numItems, int numKeyBits, const KeyFct &keyOf)
+  {
+    if (numItems < 2 || numKeyBits <= 0) return;
+    const int      numPasses     = (numKeyBits+10)/11;
+    const int      bitsPerDigit  = (numKeyBits+numPasses-1)/numPasses;
+    const int      numDigits     = 1<<bitsPerDigit;
+    const uint32_t digitMask     = numDigits-1;
+    const size_t blockSize = std::max(size_t(64*1024),(numItems+1023)/1024);
+    const size_t numBlocks = (numItems+blockSize-1)/blockSize;
+
+    std::vector<T>      temp(numItems);
+    std::vector<size_t> offsets(numBlocks*numDigits);
+    T *src = items;
+    T *dst = temp.data();
+    for (int shift=0;shift<numKeyBits;shift+=bitsPerDigit) {
+      parallel_for(numBlocks,[&](size_t blockID){
+          size_t *hist = offsets.data()+blockID*numDigits;
+          std::fill(hist,hist+numDigits,size_t(0));
+          const size_t end = std::min(numItems,(blockID+1)*blockSize);
+          for (size_t i=blockID*blockSize;i<end;i++)
+            hist[radix_detail::digitOf(keyOf(src[i]),shift,digitMask)]++;
+        });
+
+      // turn the histograms into scatter offsets, digit-major: all
+      // of digit 0 (in block order), then all of digit 1, ...
+      bool allSameDigit = false;
+      size_t sum = 0;
+      for (int digit=0;digit<numDigits;digit++) {
+        const size_t digitBegin = sum;
+        for (size_t blockID=0;blockID<numBlocks;blockID++) {
+          size_t &count = offsets[blockID*numDigits+digit];
+          const size_t c = count;
+          count = sum;
+          sum += c;
+        }
+        if (sum-digitBegin == numItems) allSameDigit = true;
+      }
+      if (allSameDigit) continue;
+
+      parallel_for(numBlocks,[&](size_t blockID){
+          size_t *offset = offsets.data()+blockID*numDigits;
+          const size_t end = std::min(numItems,(blockID+1)*blockSize);
+          for (size_t i=blockID*blockSize;i<end;i++)
+            dst[offset[radix_detail::digitOf(keyOf(src[i]),shift,digitMask)]++]
+              = src[i];
+        });
+      std::swap(src,dst);
+    }
+    if (src != items)
+      parallel_for_blocked(0,numItems,64*1024,[&](size_t begin, size_t end){
+          std::copy(src+begin,src+end,items+begin);
+        });
+  }
+
+  /*! radix-sort an array of plain unsigned integer keys */
+  template<typename T>
+  void radixSort(T *keys, size_t numKeys)
+  {
+    radixSort(keys,numKeys,int(8*sizeof(T)),[](const T &key){ return key; });
+  }
+
+} // ::umesh
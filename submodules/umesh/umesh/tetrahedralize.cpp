@@ -15,7 +15,11 @@
 // ======================================================================== //
 
 #include "umesh/tetrahedralize.h"
+# ifdef UMESH_HAVE_TBB
+#  include "tbb/parallel_sort.h"
+# endif
 #include <algorithm>
+#include <atomic>
 #include <set>
 
 #ifndef PRINT
@@ -320,6 +324,390 @@ namespace umesh {
 
 
 
+  // ##################################################################
+  // parallel tetrahedralization
+  // ##################################################################
+
+  /*! the input vertices a newly created center vertex gets averaged
+      from, in sorted order (possibly with duplicates, just like the
+      std::vector<int> in MergedMesh::getCenter()); unused entries
+      are -1. Two elements asking for the center of the same vertices
+      thus produce the same key, no matter in which order they list
+      them */
+  struct CenterKey {
+    enum { maxVertices = 8 };
+    int idx[maxVertices];
+  };
+  
+  inline bool operator<(const CenterKey &a, const CenterKey &b)
+  {
+    for (int i=0;i<CenterKey::maxVertices;i++)
+      if (a.idx[i] != b.idx[i]) return a.idx[i] < b.idx[i];
+    return false;
+  }
+  
+  inline bool operator==(const CenterKey &a, const CenterKey &b)
+  {
+    for (int i=0;i<CenterKey::maxVertices;i++)
+      if (a.idx[i] != b.idx[i]) return false;
+    return true;
+  }
+
+  /*! splits elements into tets the exact same way MergedMesh does
+      (same centers requested, in the same order, and the same tets
+      emitted in the same order), but hands both center requests and
+      tets to a 'Sink', so the same code can run in each of the
+      count/prefix-sum/write passes of the parallel
+      tetrahedralization. Sink::center(idx,N) returns the vertex ID
+      to use for that center, Sink::tet() gets every tet, including
+      degenerate ones */
+  template<typename Sink>
+  struct Tessellator {
+    Tessellator(const UMesh &in, Sink &sink) : in(in), sink(sink) {}
+
+    inline void add(const UMesh::Tet &tet) { sink.tet(tet); }
+    
+    inline void add(const UMesh::Pyr &pyr)
+    {
+      int base = center({pyr[0],pyr[1],pyr[2],pyr[3]});
+      add(UMesh::Tet(pyr[0],pyr[1],base,pyr[4]));
+      add(UMesh::Tet(pyr[1],pyr[2],base,pyr[4]));
+      add(UMesh::Tet(pyr[2],pyr[3],base,pyr[4]));
+      add(UMesh::Tet(pyr[3],pyr[0],base,pyr[4]));
+    }
+
+    inline void add(const UMesh::Wedge &wedge)
+    {
+      const vec3f v0 = in.vertices[wedge[0]];
+      const vec3f v1 = in.vertices[wedge[1]];
+      const vec3f v2 = in.vertices[wedge[2]];
+      const vec3f v3 = in.vertices[wedge[3]];
+      const vec3f v4 = in.vertices[wedge[4]];
+      const vec3f v5 = in.vertices[wedge[5]];
+      if (v2 == v5)
+        throw std::runtime_error("wedge that should be a pyramid!?");
+
+      const vec3f base[4] = { v0,v1,v3,v4 };
+      int numUniqueBaseVertices = 0;
+      for (int i=0;i<4;i++) {
+        bool unique = true;
+        for (int j=0;j<i;j++)
+          if (base[j] == base[i]) unique = false;
+        numUniqueBaseVertices += unique;
+      }
+      if (numUniqueBaseVertices == 4) {
+        int c = center({wedge[0],wedge[1],wedge[2],
+                        wedge[3],wedge[4],wedge[5]});
+        add(UMesh::Pyr(wedge[0],wedge[1],wedge[4],wedge[3],c));
+        add(UMesh::Pyr(wedge[0],wedge[3],wedge[5],wedge[2],c));
+        add(UMesh::Pyr(wedge[1],wedge[2],wedge[5],wedge[4],c));
+        add(UMesh::Tet(wedge[0],wedge[2],wedge[1],c));
+        add(UMesh::Tet(wedge[3],wedge[4],wedge[5],c));
+      } else if (numUniqueBaseVertices == 3) {
+        if (v0 == v1) {
+          int c = center({wedge[0],wedge[2],
+                          wedge[3],wedge[4],wedge[5]});
+          add(UMesh::Tet(wedge[0],wedge[4],wedge[3],c));
+          add(UMesh::Pyr(wedge[0],wedge[3],wedge[5],wedge[2],c));
+          add(UMesh::Pyr(wedge[1],wedge[2],wedge[5],wedge[4],c));
+          add(UMesh::Tet(wedge[3],wedge[4],wedge[5],c));
+        } else if (v3 == v4) {
+          int c = center({wedge[0],wedge[1],wedge[2],
+                          wedge[3],wedge[5]});
+          add(UMesh::Tet(wedge[0],wedge[1],wedge[3],c));
+          add(UMesh::Pyr(wedge[0],wedge[3],wedge[5],wedge[2],c));
+          add(UMesh::Pyr(wedge[1],wedge[2],wedge[5],wedge[4],c));
+          add(UMesh::Tet(wedge[0],wedge[2],wedge[1],c));
+        } else
+          throw std::runtime_error("oy-wey.... what _is_ that shape!?");
+      } else
+        throw std::runtime_error("wedge that should be a tet!?");
+    }
+
+    inline void add(const UMesh::Hex &hex)
+    {
+      int c = center({hex[0],hex[1],hex[2],hex[3],
+                      hex[4],hex[5],hex[6],hex[7]});
+      add(UMesh::Pyr(hex[0],hex[1],hex[2],hex[3],c));
+      add(UMesh::Pyr(hex[4],hex[7],hex[6],hex[5],c));
+      add(UMesh::Pyr(hex[0],hex[4],hex[5],hex[1],c));
+      add(UMesh::Pyr(hex[2],hex[6],hex[7],hex[3],c));
+      add(UMesh::Pyr(hex[0],hex[3],hex[7],hex[4],c));
+      add(UMesh::Pyr(hex[1],hex[5],hex[6],hex[2],c));
+    }
+
+    /*! adds the element with given ID in the tets-pyrs-wedges-hexes
+        numbering over all of the input's elements */
+    inline void addElement(size_t elementID)
+    {
+      if (elementID < in.tets.size())
+        return add(in.tets[elementID]);
+      elementID -= in.tets.size();
+      if (elementID < in.pyrs.size())
+        return add(in.pyrs[elementID]);
+      elementID -= in.pyrs.size();
+      if (elementID < in.wedges.size())
+        return add(in.wedges[elementID]);
+      elementID -= in.wedges.size();
+      add(in.hexes[elementID]);
+    }
+
+    inline int center(std::initializer_list<int> idx)
+    {
+      CenterKey key;
+      int N = 0;
+      for (auto i : idx) key.idx[N++] = i;
+      std::sort(key.idx,key.idx+N);
+      for (int i=N;i<CenterKey::maxVertices;i++) key.idx[i] = -1;
+      return sink.center(key,N);
+    }
+
+    const UMesh &in;
+    Sink &sink;
+  };
+
+  /*! applies MergedMesh::add(Tet)'s tests to a tet whose vertices
+      are already in 'vertices': returns false for degenerate or flat
+      tets, and flips negatively oriented ones */
+  inline bool orientTet(UMesh::Tet &tet,
+                        const std::vector<vec3f> &vertices,
+                        std::atomic<bool> &hadWrongOrientation)
+  {
+    if (tet.x == tet.y ||
+        tet.x == tet.z ||
+        tet.x == tet.w ||
+        tet.y == tet.z ||
+        tet.y == tet.w ||
+        tet.z == tet.w)
+      return false;
+    vec3f a = vertices[tet.x];
+    vec3f b = vertices[tet.y];
+    vec3f c = vertices[tet.z];
+    vec3f d = vertices[tet.w];
+    float volume = dot(d-a,cross(b-a,c-a));
+    if (volume == 0.f)
+      return false;
+    if (volume < 0.f) {
+      hadWrongOrientation = true;
+      tet = UMesh::Tet(tet.x,tet.y,tet.w,tet.z);
+    }
+    return true;
+  }
+  
+  /*! tetrahedralizes all elements in parallel, with the same result
+      as running them all through MergedMesh (bit for bit, and in the
+      same order), in four passes over the elements:
+
+      1) count the center vertices each element creates, and
+      prefix-sum those counts;
+
+      2) write each element's center keys; then sort those keys
+      (remembering where each came from), number the unique ones in
+      order of first use - which is the order MergedMesh would have
+      created them in - and compute their positions and values;
+
+      3) count each element's (non-degenerate) tets, and prefix-sum
+      those counts;
+
+      4) write each element's tets into the preallocated output.
+
+      Steps 3 and 4 only run over the 'owned' elements (all by
+      default), while the vertex array always covers all of them */
+  struct ParallelTetrahedralizer {
+    ParallelTetrahedralizer(UMesh::SP in) : in(in) {}
+
+    struct CountCenters {
+      inline int  center(const CenterKey &, int) { count++; return -1; }
+      inline void tet(const UMesh::Tet &) {}
+      size_t count = 0;
+    };
+    struct WriteCenters {
+      inline int  center(const CenterKey &key, int) { *out++ = key; return -1; }
+      inline void tet(const UMesh::Tet &) {}
+      CenterKey *out;
+    };
+    struct CountTets {
+      inline int  center(const CenterKey &, int) { return *centerID++; }
+      inline void tet(UMesh::Tet tet)
+      { count += orientTet(tet,*vertices,*hadWrongOrientation); }
+      const int *centerID;
+      const std::vector<vec3f> *vertices;
+      std::atomic<bool> *hadWrongOrientation;
+      size_t count = 0;
+    };
+    struct WriteTets {
+      inline int  center(const CenterKey &, int) { return *centerID++; }
+      inline void tet(UMesh::Tet tet)
+      { if (orientTet(tet,*vertices,*hadWrongOrientation)) *out++ = tet; }
+      const int *centerID;
+      const std::vector<vec3f> *vertices;
+      std::atomic<bool> *hadWrongOrientation;
+      UMesh::Tet *out;
+    };
+
+    size_t numElements() const
+    { return in->tets.size()+in->pyrs.size()+in->wedges.size()+in->hexes.size(); }
+
+    /*! runs steps 1 and 2 over all elements */
+    void computeCenters()
+    {
+      const size_t numElements = this->numElements();
+      std::vector<size_t> &firstCenter = this->firstCenter;
+      firstCenter.resize(numElements);
+      parallel_for_blocked
+        (0,numElements,16*1024,
+         [&](size_t begin, size_t end){
+           for (size_t elementID=begin;elementID<end;elementID++) {
+             CountCenters sink;
+             Tessellator<CountCenters>(*in,sink).addElement(elementID);
+             firstCenter[elementID] = sink.count;
+           }
+         });
+      const size_t numCenters
+        = parallel_exclusive_scan(firstCenter.data(),firstCenter.data(),numElements);
+
+      std::vector<CenterKey> keys(numCenters);
+      parallel_for_blocked
+        (0,numElements,16*1024,
+         [&](size_t begin, size_t end){
+           for (size_t elementID=begin;elementID<end;elementID++) {
+             WriteCenters sink;
+             sink.out = keys.data()+firstCenter[elementID];
+             Tessellator<WriteCenters>(*in,sink).addElement(elementID);
+           }
+         });
+
+      // sort center requests by key, and - for the same key - by
+      // request order, so the first one of every group is the one
+      // that would have created that vertex
+      std::vector<uint64_t> order(numCenters);
+      parallel_for_blocked
+        (0,numCenters,64*1024,
+         [&](size_t begin, size_t end){
+           for (size_t i=begin;i<end;i++) order[i] = i;
+         });
+      auto byKey = [&](uint64_t a, uint64_t b)
+      { return (keys[a] < keys[b]) || (keys[a] == keys[b] && a < b); };
+# ifdef UMESH_HAVE_TBB
+      tbb::parallel_sort(order.begin(),order.end(),byKey);
+# else
+      std::sort(order.begin(),order.end(),byKey);
+# endif
+
+      auto isFirstOfGroup = [&](size_t i)
+      { return i == 0 || !(keys[order[i]] == keys[order[i-1]]); };
+      
+      // flag each first request, by request order, and prefix-sum
+      // those flags to number the new vertices in order of first use
+      std::vector<uint64_t> newVertexID(numCenters,0);
+      parallel_for_blocked
+        (0,numCenters,64*1024,
+         [&](size_t begin, size_t end){
+           for (size_t i=begin;i<end;i++)
+             if (isFirstOfGroup(i)) newVertexID[order[i]] = 1;
+         });
+      const size_t numNewVertices
+        = parallel_exclusive_scan(newVertexID.data(),newVertexID.data(),numCenters);
+      
+      const size_t numInputVertices = in->vertices.size();
+      if (numInputVertices+numNewVertices >= size_t(1ull<<31))
+        throw std::runtime_error("tetrahedralize: vertex index overflow");
+      out = std::make_shared<UMesh>();
+      out->vertices.resize(numInputVertices+numNewVertices);
+      std::copy(in->vertices.begin(),in->vertices.end(),out->vertices.begin());
+      if (in->perVertex) {
+        out->perVertex = std::make_shared<Attribute>();
+        out->perVertex->name = in->perVertex->name;
+        out->perVertex->values.resize(out->vertices.size());
+        std::copy(in->perVertex->values.begin(),in->perVertex->values.end(),
+                  out->perVertex->values.begin());
+      }
+
+      // every group's first request creates the vertex, and hands its
+      // ID to all others in the group
+      centerID.resize(numCenters);
+      parallel_for_blocked
+        (0,numCenters,64*1024,
+         [&](size_t begin, size_t end){
+           for (size_t i=begin;i<end;i++) {
+             if (!isFirstOfGroup(i)) continue;
+             const CenterKey &key = keys[order[i]];
+             const int ID = int(numInputVertices+newVertexID[order[i]]);
+
+             vec3f centerPos = vec3f(0.f);
+             float centerVal = 0.f;
+             int N = 0;
+             for (;N<CenterKey::maxVertices && key.idx[N] >= 0;N++) {
+               if (in->perVertex)
+                 centerVal += in->perVertex->values[key.idx[N]];
+               centerPos = centerPos + in->vertices[key.idx[N]];
+             }
+             centerVal *= (1.f/N);
+             centerPos = centerPos * (1.f/N);
+             out->vertices[ID] = centerPos;
+             if (out->perVertex)
+               out->perVertex->values[ID] = centerVal;
+             
+             for (size_t j=i;j<numCenters && (j==i || !isFirstOfGroup(j));j++)
+               centerID[order[j]] = ID;
+           }
+         });
+    }
+
+    /*! runs steps 3 and 4 over all elements whose ID (in
+        tets-pyrs-wedges-hexes numbering) is flagged in 'owned' */
+    template<typename IsOwned>
+    void computeTets(const IsOwned &isOwned)
+    {
+      const size_t numElements = this->numElements();
+      std::atomic<bool> hadWrongOrientation(false);
+      std::vector<size_t> firstTet(numElements);
+      parallel_for_blocked
+        (0,numElements,16*1024,
+         [&](size_t begin, size_t end){
+           for (size_t elementID=begin;elementID<end;elementID++) {
+             CountTets sink;
+             sink.centerID = centerID.data()+firstCenter[elementID];
+             sink.vertices = &out->vertices;
+             sink.hadWrongOrientation = &hadWrongOrientation;
+             if (isOwned(elementID))
+               Tessellator<CountTets>(*in,sink).addElement(elementID);
+             firstTet[elementID] = sink.count;
+           }
+         });
+      const size_t numTets
+        = parallel_exclusive_scan(firstTet.data(),firstTet.data(),numElements);
+      
+      out->tets.resize(numTets);
+      parallel_for_blocked
+        (0,numElements,16*1024,
+         [&](size_t begin, size_t end){
+           for (size_t elementID=begin;elementID<end;elementID++) {
+             if (!isOwned(elementID)) continue;
+             WriteTets sink;
+             sink.centerID = centerID.data()+firstCenter[elementID];
+             sink.vertices = &out->vertices;
+             sink.hadWrongOrientation = &hadWrongOrientation;
+             sink.out = out->tets.data()+firstTet[elementID];
+             Tessellator<WriteTets>(*in,sink).addElement(elementID);
+           }
+         });
+      
+      if (hadWrongOrientation)
+        std::cout
+          << UMESH_TERMINAL_RED
+          <<"WARNING: at least one tet (or other element that generated a tet)\n was wrongly oriented!!! (I'll swap those tets, but that's still fishy...)"
+          << UMESH_TERMINAL_DEFAULT
+          << std::endl;
+    }
+    
+    UMesh::SP in, out;
+    /*! per element, where its center requests start */
+    std::vector<size_t> firstCenter;
+    /*! per center request, the vertex it resolved to */
+    std::vector<int>    centerID;
+  };
+
 #if 0
   // only use for debugging, to force priting of prims that contain certain vertices or faces
 
@@ -406,19 +794,13 @@ namespace umesh {
       }
 #endif    
 
-    MergedMesh merged(in);
-    for (auto tet : in->tets)
-      merged.add(tet);
-    for (auto pyr : in->pyrs)
-      merged.add(pyr);
-    for (auto wedge : in->wedges) 
-      merged.add(wedge);
-    for (auto hex : in->hexes) 
-      merged.add(hex);
+    ParallelTetrahedralizer tetrahedralizer(in);
+    tetrahedralizer.computeCenters();
+    tetrahedralizer.computeTets([](size_t){ return true; });
     std::cout << "done tetrahedralizing, got "
-              << sizeString(merged.out)
+              << sizeString(tetrahedralizer.out)
               << " from " << sizeString(in) << std::endl;
-    return merged.out;
+    return tetrahedralizer.out;
   }
 
 
@@ -433,40 +815,32 @@ namespace umesh {
                            int ownedHexes)
   {
     // ------------------------------------------------------------------
-    // first stage: push _all_ elements, to ensure we get same vertex
-    // array as 'non-owned' version
-    // ------------------------------------------------------------------
-    MergedMesh merged(in);
-    for (auto tet : in->tets)
-      merged.add(tet);
-    for (auto pyr : in->pyrs)
-      merged.add(pyr);
-    for (auto wedge : in->wedges) 
-      merged.add(wedge);
-    for (auto hex : in->hexes) 
-      merged.add(hex);
-    // ------------------------------------------------------------------
-    // now, kll all so-far generated tets in the output mesh, but keep
-    // the vertex array...
-    // ------------------------------------------------------------------
-    merged.out->tets.clear();
-    // ------------------------------------------------------------------
-    // and re-push (only) the owned ones
+    // create the center vertices of _all_ elements, to ensure we get
+    // same vertex array as 'non-owned' version, but only the tets of
+    // the owned ones
     // ------------------------------------------------------------------
-    for (size_t i=0;i<std::min((int)in->tets.size(),ownedTets);i++)
-      merged.add(in->tets[i]);
-    for (size_t i=0;i<std::min((int)in->pyrs.size(),ownedPyrs);i++)
-      merged.add(in->pyrs[i]);
-    for (size_t i=0;i<std::min((int)in->wedges.size(),ownedWedges);i++)
-      merged.add(in->wedges[i]);
-    for (size_t i=0;i<std::min((int)in->hexes.size(),ownedHexes);i++)
-      merged.add(in->hexes[i]);
+    ParallelTetrahedralizer tetrahedralizer(in);
+    tetrahedralizer.computeCenters();
+    const size_t endTets   = std::min(in->tets.size(),size_t(std::max(ownedTets,0)));
+    const size_t endPyrs   = std::min(in->pyrs.size(),size_t(std::max(ownedPyrs,0)));
+    const size_t endWedges = std::min(in->wedges.size(),size_t(std::max(ownedWedges,0)));
+    const size_t endHexes  = std::min(in->hexes.size(),size_t(std::max(ownedHexes,0)));
+    tetrahedralizer.computeTets([&](size_t elementID){
+        if (elementID < in->tets.size()) return elementID < endTets;
+        elementID -= in->tets.size();
+        if (elementID < in->pyrs.size()) return elementID < endPyrs;
+        elementID -= in->pyrs.size();
+        if (elementID < in->wedges.size()) return elementID < endWedges;
+        elementID -= in->wedges.size();
+        return elementID < endHexes;
+      });
+    UMesh::SP result = tetrahedralizer.out;
     std::cout << "finalizing..." << std::endl;
-    merged.out->finalize();
+    result->finalize();
     std::cout << "done tetrahedralizing (second stage), got "
-              << sizeString(merged.out)
+              << sizeString(result)
               << " from " << sizeString(in) << std::endl;
-    return merged.out;
+    return result;
   }
 
   /*! same as tetrahedralize(), but chop up ONLY elements with curved
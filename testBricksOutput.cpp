@@ -1,4 +1,4 @@
-#include "submodules/umesh/umesh/math.h"
+#include "grids.h"
 #include <cstring>
 #include <set>
 #include <map>
@@ -8,6 +8,7 @@
 #include <vector>
 
 using namespace umesh;
+using gridlets::morton_encode3D;
 
 struct Brick {
     vec3i lower;
@@ -16,24 +17,6 @@ struct Brick {
     std::vector<int> scalarIDs;
 };
 
-//Morton codes
-inline unsigned long long morton_encode3D(unsigned long long x, unsigned long long y, unsigned long long z)
-{                                                                                            
-    auto separate_bits = [](unsigned long long n)                                            
-    {                                                                                        
-        n &= 0b1111111111111111111111ull;                                                    
-        n = (n ^ (n << 32)) & 0b1111111111111111000000000000000000000000000000001111111111111111ull;
-        n = (n ^ (n << 16)) & 0b0000000011111111000000000000000011111111000000000000000011111111ull;
-        n = (n ^ (n <<  8)) & 0b1111000000001111000000001111000000001111000000001111000000001111ull;
-        n = (n ^ (n <<  4)) & 0b0011000011000011000011000011000011000011000011000011000011000011ull;
-        n = (n ^ (n <<  2)) & 0b1001001001001001001001001001001001001001001001001001001001001001ull;
-        return n;                                                                            
-    };                                                                                       
-                                                                                             
-    return separate_bits(x) | (separate_bits(y) << 1) | (separate_bits(z) << 2);             
-} 
-
-
 struct is_smaller{
     bool operator()(const Brick &a, const Brick &b) const{
         return morton_encode3D(a.lower.x, a.lower.y, a.lower.z) < morton_encode3D(b.lower.x, b.lower.y, b.lower.z);
@@ -55,7 +38,7 @@ void compareBricks(std::vector<Brick> &origBricks, std::vector<Brick> &compBrick
         return;
     }
 
-    for(int i = 0; i< origBricks.size(); i++){
+    for(size_t i = 0; i< origBricks.size(); i++){
         if(origBricks[i].lower != compBricks[i].lower){
             std::cout << "Bricks.lower mismatch for brick number "<< i << "!" << std::endl;
             std::cout << "original bricks.lower: " << origBricks[i].lower  << ", comp. bricks.lower: " << compBricks[i].lower << std::endl;
@@ -90,6 +73,11 @@ int main(int ac, char **av){
     std::vector <Brick> origBricks;
     std::vector <Brick> compBricks;
 
+    if (ac != 3) {
+        std::cout << "usage: " << av[0] << " original.grids compared.grids" << std::endl;
+        return 1;
+    }
+
     std::cout << "first file - original, second file - to be compaired" << std::endl;
 
     //read first file